@@ -194,6 +194,38 @@ namespace pycohal
     }
   };
 
+  /// Queues a python list of batch operations as a single batch, so that the whole list crosses the python-to-C boundary in one call
+  uhal::BatchResult batch ( uhal::ClientInterface& aClient, const boost::python::list& aOperations )
+  {
+    const boost::python::ssize_t lSize ( boost::python::len ( aOperations ) );
+    std::vector< uhal::BatchOperation > lOperations;
+    lOperations.reserve ( lSize );
+
+    for ( boost::python::ssize_t i = 0; i != lSize; ++i )
+    {
+      lOperations.push_back ( boost::python::extract< const uhal::BatchOperation& > ( aOperations[i] ) );
+    }
+
+    return aClient.batch ( lOperations );
+  }
+
+  /// Wrapper function for list-like indexing of BatchResult in python
+  uint32_t get_batch_result_item ( const uhal::BatchResult& aResult, int i )
+  {
+    if ( i<0 )
+    {
+      i += aResult.size();
+    }
+
+    if ( i<0 || i>=int ( aResult.size() ) )
+    {
+      PyErr_SetString ( PyExc_IndexError, "Index out of range" );
+      boost::python::throw_error_already_set();
+    }
+
+    return aResult.at ( i );
+  }
+
   std::string convert_to_string( const uhal::ValWord<uint32_t>& valWord )
   {
     return boost::lexical_cast<std::string>(valWord.value());
@@ -294,6 +326,73 @@ BOOST_PYTHON_MODULE ( _core )
   .def ( "__getitem__", &pycohal::ValVectorIndexingSuite<uint32_t>::getSlice )
   .def ( "__iter__", boost::python::range ( &uhal::ValVector<uint32_t>::begin , &uhal::ValVector<uint32_t>::end ) )
   ;
+  // Wrap uhal::BatchOperation
+  class_< uhal::BatchOperation > ( "BatchOperation", no_init )
+  .def ( "read", static_cast< uhal::BatchOperation (*) ( const uint32_t& ) > ( &uhal::BatchOperation::read ) )
+  .def ( "read", static_cast< uhal::BatchOperation (*) ( const uint32_t&, const uint32_t& ) > ( &uhal::BatchOperation::read ) )
+  .def ( "read", static_cast< uhal::BatchOperation (*) ( const uhal::Node& ) > ( &uhal::BatchOperation::read ) )
+  .staticmethod ( "read" )
+  .def ( "write", static_cast< uhal::BatchOperation (*) ( const uint32_t&, const uint32_t& ) > ( &uhal::BatchOperation::write ) )
+  .def ( "write", static_cast< uhal::BatchOperation (*) ( const uint32_t&, const uint32_t&, const uint32_t& ) > ( &uhal::BatchOperation::write ) )
+  .def ( "write", static_cast< uhal::BatchOperation (*) ( const uhal::Node&, const uint32_t& ) > ( &uhal::BatchOperation::write ) )
+  .staticmethod ( "write" )
+  .def ( "rmw_bits", static_cast< uhal::BatchOperation (*) ( const uint32_t&, const uint32_t&, const uint32_t& ) > ( &uhal::BatchOperation::rmw_bits ) )
+  .def ( "rmw_bits", static_cast< uhal::BatchOperation (*) ( const uhal::Node&, const uint32_t&, const uint32_t& ) > ( &uhal::BatchOperation::rmw_bits ) )
+  .staticmethod ( "rmw_bits" )
+  .def ( "rmw_sum", static_cast< uhal::BatchOperation (*) ( const uint32_t&, const int32_t& ) > ( &uhal::BatchOperation::rmw_sum ) )
+  .def ( "rmw_sum", static_cast< uhal::BatchOperation (*) ( const uhal::Node&, const int32_t& ) > ( &uhal::BatchOperation::rmw_sum ) )
+  .staticmethod ( "rmw_sum" )
+  ;
+  // Wrap uhal::BatchResult
+  class_< uhal::BatchResult > ( "BatchResult", init< const uhal::BatchResult& >() )
+  .def ( init<>() )
+  .def ( "valid", &uhal::BatchResult::valid )
+  .def ( "value", &uhal::BatchResult::value )
+  .def ( "size",  &uhal::BatchResult::size )
+  .def ( "at", &uhal::BatchResult::at )
+  .def ( "__len__", &uhal::BatchResult::size )
+  .def ( "__getitem__", &pycohal::get_batch_result_item )
+  ;
+  // Wrap uhal::LatencyHistogram
+  class_< uhal::LatencyHistogram > ( "LatencyHistogram", init< const uhal::LatencyHistogram& >() )
+  .def_readonly ( "entries", &uhal::LatencyHistogram::entries )
+  .def_readonly ( "total", &uhal::LatencyHistogram::total )
+  .def_readonly ( "max", &uhal::LatencyHistogram::max )
+  .add_property ( "buckets", make_getter ( &uhal::LatencyHistogram::buckets, return_value_policy<return_by_value>() ) )
+  .def ( "mean", &uhal::LatencyHistogram::mean )
+  .def ( "upperEdge", &uhal::LatencyHistogram::upperEdge )
+  .staticmethod ( "upperEdge" )
+  ;
+  // Wrap uhal::TransactionMetrics
+  class_< uhal::TransactionMetrics > ( "TransactionMetrics", init< const uhal::TransactionMetrics& >() )
+  .def_readonly ( "transactions", &uhal::TransactionMetrics::transactions )
+  .def_readonly ( "words", &uhal::TransactionMetrics::words )
+  .def_readonly ( "latency", &uhal::TransactionMetrics::latency )
+  ;
+  // Wrap uhal::ClientMetrics, with its TransactionType enum in its scope
+  {
+    scope lClientMetricsScope = class_< uhal::ClientMetrics > ( "ClientMetrics", init< const uhal::ClientMetrics& >() )
+    .def ( "transaction", &uhal::ClientMetrics::transaction, pycohal::const_ref_return_policy() )
+    .def_readonly ( "packets", &uhal::ClientMetrics::packets )
+    .def_readonly ( "sentBytes", &uhal::ClientMetrics::sentBytes )
+    .def_readonly ( "receivedBytes", &uhal::ClientMetrics::receivedBytes )
+    .def_readonly ( "dispatches", &uhal::ClientMetrics::dispatches )
+    .def_readonly ( "failedDispatches", &uhal::ClientMetrics::failedDispatches )
+    .def_readonly ( "packetLatency", &uhal::ClientMetrics::packetLatency )
+    .def_readonly ( "dispatchLatency", &uhal::ClientMetrics::dispatchLatency )
+    ;
+
+    enum_< uhal::ClientMetrics::TransactionType > ( "TransactionType" )
+    .value ( "READ", uhal::ClientMetrics::READ )
+    .value ( "WRITE", uhal::ClientMetrics::WRITE )
+    .value ( "NON_INCREMENTAL_READ", uhal::ClientMetrics::NON_INCREMENTAL_READ )
+    .value ( "NON_INCREMENTAL_WRITE", uhal::ClientMetrics::NON_INCREMENTAL_WRITE )
+    .value ( "RMW_BITS", uhal::ClientMetrics::RMW_BITS )
+    .value ( "RMW_SUM", uhal::ClientMetrics::RMW_SUM )
+    .value ( "CONFIG_SPACE_READ", uhal::ClientMetrics::CONFIG_SPACE_READ )
+    .export_values()
+    ;
+  }
   // Wrap uhal::Node
   class_<uhal::Node, boost::noncopyable /*since no copy CTOR*/ > ( "Node", no_init )
   .def ( "getNode",         static_cast< const uhal::Node& ( uhal::Node::* ) ( const std::string& ) const > ( &uhal::Node::getNode ), pycohal::norm_ref_return_policy() )
@@ -333,19 +432,28 @@ BOOST_PYTHON_MODULE ( _core )
          .def ( "uri",    &uhal::ClientInterface::uri )
          .def ( "write", ( uhal::ValHeader ( uhal::ClientInterface::* ) ( const uint32_t&, const uint32_t&, const uint32_t& ) ) 0, uhal_ClientInterface_write_overloads() )
          .def ( "read", ( uhal::ValWord<uint32_t> ( uhal::ClientInterface::* ) ( const uint32_t&, const uint32_t& ) ) 0,                  uhal_ClientInterface_read_overloads() )
-         .def ( "writeBlock", &uhal::ClientInterface::writeBlock, uhal_ClientInterface_writeBlock_overloads() )
-         .def ( "readBlock",  &uhal::ClientInterface::readBlock,  uhal_ClientInterface_readBlock_overloads() )
+         .def ( "writeBlock", ( uhal::ValHeader ( uhal::ClientInterface::* ) ( const uint32_t&, const std::vector<uint32_t>&, const uhal::defs::BlockReadWriteMode& ) ) 0, uhal_ClientInterface_writeBlock_overloads() )
+         .def ( "readBlock",  ( uhal::ValVector<uint32_t> ( uhal::ClientInterface::* ) ( const uint32_t&, const uint32_t&, const uhal::defs::BlockReadWriteMode& ) ) 0, uhal_ClientInterface_readBlock_overloads() )
          .def ( "rmw_bits", &uhal::ClientInterface::rmw_bits )
          .def ( "rmw_sum", &uhal::ClientInterface::rmw_sum )
+         .def ( "batch", &pycohal::batch )
          .def ( "dispatch", &uhal::ClientInterface::dispatch )
          .def ( "setTimeoutPeriod", &uhal::ClientInterface::setTimeoutPeriod )
          .def ( "getTimeoutPeriod", &uhal::ClientInterface::getTimeoutPeriod )
+         .def ( "setMetricsEnabled", &uhal::ClientInterface::setMetricsEnabled )
+         .def ( "getMetricsEnabled", &uhal::ClientInterface::getMetricsEnabled )
+         .def ( "getMetrics", &uhal::ClientInterface::getMetrics )
+         .def ( "resetMetrics", &uhal::ClientInterface::resetMetrics )
          .def ( "__str__", &uhal::ClientInterface::id, pycohal::const_ref_return_policy() )
          ;
 
   class_<uhal::IPbusCore, bases<uhal::ClientInterface>, boost::noncopyable /* no to-python converter (would require a copy CTOR) */,
          boost::shared_ptr<uhal::IPbusCore> /* all instances are held within boost::shared_ptr */ >("IPbusCore", no_init /* no CTORs */)
          .def ( "readConfigurationSpace", ( uhal::ValWord<uint32_t> ( uhal::IPbusCore::* ) ( const uint32_t&, const uint32_t& ) ) 0, uhal_IPbusCore_readConfigurationSpace_overloads() )
+         .def ( "snapshotConfigurationSpace", &uhal::IPbusCore::snapshotConfigurationSpace )
+         .def ( "setConfigurationSpaceCaching", &uhal::IPbusCore::setConfigurationSpaceCaching )
+         .def ( "getConfigurationSpaceCaching", &uhal::IPbusCore::getConfigurationSpaceCaching )
+         .def ( "clearConfigurationSpaceCache", &uhal::IPbusCore::clearConfigurationSpaceCache )
          ;
 
   class_<uhal::UDP<uhal::IPbus<1, 3> >, bases<uhal::IPbusCore>,
@@ -380,6 +488,10 @@ BOOST_PYTHON_MODULE ( _core )
 
   def ( "buildClient", pycohal::buildClient );
 
+  // Size of the thread pool of the transport reactor shared by all UDP and TCP clients
+  def ( "setTransportThreads", &uhal::TransportReactor::setDefaultNumberOfThreads );
+  def ( "getTransportThreads", &uhal::TransportReactor::getDefaultNumberOfThreads );
+
   // Wrap uhal::HwInterface
   class_<uhal::HwInterface> ( "HwInterface", init<const uhal::HwInterface&>() )
   .def ( "getClient", &uhal::HwInterface::getClient, pycohal::norm_ref_return_policy() )
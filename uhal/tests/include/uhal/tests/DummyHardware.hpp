@@ -66,7 +66,11 @@ namespace uhal
     class DummyHardwareInterface {
     public:
       DummyHardwareInterface(const boost::chrono::microseconds& aReplyDelay) :
-        mReplyDelay(aReplyDelay)
+        mReplyDelay(aReplyDelay),
+        mDroppedRequests(0),
+        mDroppedReplies(0),
+        mFailedReplies(0),
+        mOvertakenReplies(0)
       {
       }
 
@@ -84,9 +88,41 @@ namespace uhal
           mReplyDelay = aDelay;
         }
 
+        //! Silently drops the next aCount control packets received, as if they were lost on the way to the hardware
+        void dropRequests(const uint32_t& aCount)
+        {
+          mDroppedRequests = aCount;
+        }
+
+        //! Silently drops the replies to the next aCount control packets, as if they were lost on the way back; the replies are still kept in the IPbus 2.0 reply history
+        void dropReplies(const uint32_t& aCount)
+        {
+          mDroppedReplies = aCount;
+        }
+
+        //! Holds back the replies to the next aCount control packets, each until the reply to the following control packet has been sent, as if it had been overtaken on the way back; only UDP dummy hardware sends the held-back reply
+        void overtakeReplies(const uint32_t& aCount)
+        {
+          mOvertakenReplies = aCount;
+        }
+
+        //! Sets an error InfoCode in the first transaction header of the replies to the next aCount control packets, as if the transaction had failed in the hardware
+        void failReplies(const uint32_t& aCount)
+        {
+          mFailedReplies = aCount;
+        }
+
       protected:
         //! The delay in seconds between the request and reply of the first transaction
         boost::chrono::microseconds mReplyDelay;
+        //! The number of control packets still to be dropped on receipt
+        uint32_t mDroppedRequests;
+        //! The number of replies to control packets still to be dropped
+        uint32_t mDroppedReplies;
+        //! The number of replies to control packets still to be marked as failed
+        uint32_t mFailedReplies;
+        //! The number of replies to control packets still to be held back until the following reply has been sent
+        uint32_t mOvertakenReplies;
     };
 
 
@@ -199,6 +235,8 @@ namespace uhal
         std::vector< uint32_t > mReceive;
         //! The buffer for the outgoing IPbus packet
         std::vector< uint32_t > mReply;
+        //! A reply which is being held back until the following reply has been sent; empty if there is none
+        std::vector< uint32_t > mOvertakenReply;
   
         //! The history of the replies for the retry mechanism (IPbus 2.0 and above only)
         std::deque< std::pair< uint32_t , std::vector< uint32_t > > > mReplyHistory;
@@ -165,6 +165,7 @@ namespace uhal
 
         void bandwidthRxTest();  ///< Read bandwidth test
         void bandwidthTxTest();  ///< Write bandwidth test
+        void singleReadRateTest(); ///< Single-word read rate test
         void validationTest();   ///< Historic basic firmware/software validation test
 
     public:
@@ -63,6 +63,14 @@ public:
 
   void setReplyDelay (const boost::chrono::microseconds& aDelay);
 
+  void dropRequests (const uint32_t& aCount);
+
+  void dropReplies (const uint32_t& aCount);
+
+  void overtakeReplies (const uint32_t& aCount);
+
+  void failReplies (const uint32_t& aCount);
+
 private:
   boost::scoped_ptr<DummyHardwareInterface> mHw;
   boost::thread mHwThread;
@@ -99,6 +107,8 @@ double measureReadLatency(ClientInterface& aClient, uint32_t aBaseAddr, uint32_t
 
 double measureReadLatency(const std::vector<ClientInterface*>& aClients, uint32_t aBaseAddr, uint32_t aDepth, size_t aNrIterations, bool aDispatchEachIteration, bool aVerbose);
 
+double measureSingleReadLatency(const std::vector<ClientInterface*>& aClients, uint32_t aBaseAddr, uint32_t aNrReadsPerDispatch, size_t aNrIterations, bool aVerbose);
+
 double measureWriteLatency(ClientInterface& aClient, uint32_t aBaseAddr, uint32_t aDepth, size_t aNrIterations, bool aDispatchEachIteration, bool aVerbose);
 
 double measureWriteLatency(const std::vector<ClientInterface*>& aClients, uint32_t aBaseAddr, uint32_t aDepth, size_t aNrIterations, bool aDispatchEachIteration, bool aVerbose);
@@ -45,6 +45,7 @@
 #include "uhal/log/log_inserters.integer.hpp"
 #include "uhal/log/log.hpp"
 #include "uhal/ProtocolIPbus.hpp"
+#include "uhal/utilities/bits.hpp"
 
 
 namespace uhal
@@ -60,6 +61,7 @@ namespace uhal
       mConfigurationSpace(),
       mReceive ( BUFFER_SIZE , 0x00000000 ),
       mReply ( BUFFER_SIZE , 0x00000000 ),
+      mOvertakenReply(),
       mReplyHistory ( REPLY_HISTORY_DEPTH , std::make_pair ( 0 , mReply ) ),
       mLastPacketHeader ( 0x200000f0 ),
       mTrafficHistory ( 16, 0x00 ),
@@ -86,15 +88,20 @@ namespace uhal
         bool is_status_request = ( *mReceive.begin() == 0xF1000020 );
         bool is_resend_request = ( ( *mReceive.begin() & 0xFF0000FF ) == 0xF2000020 );
 
-        if ( mBigEndianHack || is_status_request || is_resend_request )
+        // Network byte order differs from host order on little-endian hosts
+        if ( ( mBigEndianHack || is_status_request || is_resend_request ) && ( htonl ( 1 ) != 1 ) )
         {
-          for ( std::vector<uint32_t>::iterator lIt ( mReceive.begin() ) ; lIt != mReceive.begin() + ( aByteCount>>2 ) ; ++lIt )
-          {
-            *lIt = ntohl ( *lIt );
-          }
+          utilities::SwapByteOrder ( & mReceive.front() , & mReceive.front() + ( aByteCount>>2 ) );
         }
       }
 
+      // Status and re-send requests (packet types 1 and 2) are never dropped
+      if ( mDroppedRequests && ( IPbus_major == 1 || ( *mReceive.begin() & 0xF000000F ) == 0x20000000 ) )
+      {
+        log ( Notice() , "Dropping received control packet (" , Integer ( --mDroppedRequests ) , " more to drop)" );
+        return;
+      }
+
       std::vector<uint32_t>::const_iterator lBegin, lEnd;
 
       //
@@ -119,12 +126,27 @@ namespace uhal
         mReply.push_back ( IPbus< IPbus_major , IPbus_minor >::ExpectedHeader ( base_type::mType , base_type::mWordCounter , base_type::mTransactionId , ( IPbus_major==1 ? 2 : 1 ) ) );
       }
 
+      // The first transaction header follows the packet header in IPbus 2.0; for IPbus 1.3 it is the reply to the byte-order transaction
+      if ( mFailedReplies && ( base_type::mPacketType == 0 ) && ( mReply.size() > ( IPbus_major == 2 ? 1 : 0 ) ) )
+      {
+        log ( Notice() , "Setting error InfoCode in reply to control packet (" , Integer ( --mFailedReplies ) , " more to fail)" );
+        uint32_t& lHeader ( mReply.at ( IPbus_major == 2 ? 1 : 0 ) );
+        lHeader = ( IPbus_major == 2 ? ( ( lHeader & ~0xF ) | 0x1 ) : ( ( lHeader & ~0x3 ) | 0x2 ) );
+      }
+
       if ( ( base_type::mPacketType == 0 ) && ( mReply.size() != 0 ) )
       {
         mReplyHistory.push_back ( std::make_pair ( base_type::mPacketCounter , mReply ) );
         mReplyHistory.pop_front();
       }
 
+      if ( mDroppedReplies && ( base_type::mPacketType == 0 ) && ( mReply.size() != 0 ) )
+      {
+        log ( Notice() , "Dropping reply to control packet (" , Integer ( --mDroppedReplies ) , " more to drop)" );
+        mReply.clear();
+        return;
+      }
+
       if ( mReplyDelay > boost::chrono::microseconds(0) )
       {
         log ( Info() , "Sleeping for " , mReplyDelay );
@@ -149,14 +171,17 @@ namespace uhal
 
       if ( IPbus_major == 2 )
       {
-        if ( mBigEndianHack || base_type::mPacketType == 1 )
+        if ( ( mBigEndianHack || base_type::mPacketType == 1 ) && ( htonl ( 1 ) != 1 ) && mReply.size() )
         {
-          for ( std::vector<uint32_t>::iterator lIt ( mReply.begin() ) ; lIt != mReply.end() ; ++lIt )
-          {
-            *lIt = htonl ( *lIt );
-          }
+          utilities::SwapByteOrder ( & mReply.front() , & mReply.front() + mReply.size() );
         }
       }
+
+      if ( mOvertakenReplies && ( base_type::mPacketType == 0 ) && ( mReply.size() != 0 ) && mOvertakenReply.empty() )
+      {
+        log ( Notice() , "Holding back reply to control packet until the next reply has been sent (" , Integer ( --mOvertakenReplies ) , " more to hold back)" );
+        mOvertakenReply.swap ( mReply );
+      }
     }
 
 
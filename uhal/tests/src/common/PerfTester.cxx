@@ -79,6 +79,9 @@ uhal::tests::PerfTester::PerfTester() :
   // Transmit bandwidth test
   m_testFuncMap["BandwidthTx"] = &PerfTester::bandwidthTxTest;
   m_testDescMap["BandwidthTx"] = "Block write test (default depth = 340) to find the transmit bandwidth.";
+  // Single-word read rate test
+  m_testFuncMap["SingleReadRate"] = &PerfTester::singleReadRateTest;
+  m_testDescMap["SingleReadRate"] = "Many single-word reads (default number = 340) per dispatch, to find the per-transaction overhead.";
   // Validation test
   m_testFuncMap["Validation"] = &PerfTester::validationTest;
   m_testDescMap["Validation"] = "For validating downstream subsystems, such as the Control Hub or the IPbus firmware.";
@@ -105,7 +108,7 @@ int uhal::tests::PerfTester::run ( int argc, char* argv[] )
     ( "iterations,i", po::value<uint64_t> ( &m_iterations )->default_value ( 1000 ), "Number of test iterations to run." )
     ( "devices,d", po::value<StringVec> ( &m_deviceURIs )->multitoken(), "List of device connection URIs, e.g. chtcp-1.3://..., etc" )
     ( "baseAddr,b", po::value<string> ( &m_baseAddrStr )->default_value ( "0x0" ), "Base address (in hex) of the test location on the target device(s)." )
-    ( "bandwidthTestDepth,w", po::value<boost::uint32_t> ( &m_bandwidthTestDepth )->default_value ( 340 ), "Depth of read/write used in bandwidth tests." )
+    ( "bandwidthTestDepth,w", po::value<boost::uint32_t> ( &m_bandwidthTestDepth )->default_value ( 340 ), "Depth of read/write used in bandwidth tests, or number of reads per dispatch in the single read rate test." )
     ( "perIterationDispatch,p", "Force a network dispatch every test iteration instead of the default single dispatch call at the end." )
     ( "includeConnect,c", "Include connect time in reported bandwidths and latencies" );
     po::variables_map argMap;
@@ -347,6 +350,32 @@ void uhal::tests::PerfTester::bandwidthTxTest()
 }
 
 
+void uhal::tests::PerfTester::singleReadRateTest()
+{
+  if ( ! m_includeConnect )
+  {
+    BOOST_FOREACH ( ClientPtr& iClient, m_clients )
+    {
+      iClient->read ( m_baseAddr );
+      iClient->dispatch();
+    }
+  }
+
+  std::vector<ClientInterface*> lClients;
+  BOOST_FOREACH ( ClientPtr& iClient, m_clients )
+  {
+    lClients.push_back( &*iClient );
+  }
+
+  double totalSeconds = measureSingleReadLatency(lClients, m_baseAddr, m_bandwidthTestDepth, m_iterations, m_verbose);
+  double totalReads = double ( m_deviceURIs.size() ) * m_iterations * m_bandwidthTestDepth;
+  outputStandardResults ( totalSeconds );
+  cout << "Reads queued per dispatch       = " << m_bandwidthTestDepth << "\n"
+       << "Total single-word reads         = " << totalReads << "\n"
+       << "Average read rate               = " << totalReads/totalSeconds << " Hz" << endl;
+}
+
+
 void uhal::tests::PerfTester::validationTest()
 {
   std::vector<ClientInterface*> lClients;
@@ -34,6 +34,12 @@ void uhal::tests::UDPDummyHardware<IPbus_major,IPbus_minor>::handle_receive(cons
   if ( base_type::mReply.size() )
   {
     mSocket.send_to ( boost::asio::buffer ( & ( base_type::mReply[0] ) , base_type::mReply.size() <<2 ) , mSenderEndpoint );
+
+    if ( base_type::mOvertakenReply.size() )
+    {
+      mSocket.send_to ( boost::asio::buffer ( & ( base_type::mOvertakenReply[0] ) , base_type::mOvertakenReply.size() <<2 ) , mSenderEndpoint );
+      base_type::mOvertakenReply.clear();
+    }
   }
 
   mSocket.async_receive_from(boost::asio::buffer ( & ( base_type::mReceive[0] ), base_type::mReceive.size() <<2 ),
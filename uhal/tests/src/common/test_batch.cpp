@@ -0,0 +1,170 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Tom Williams, Rutherford Appleton Laboratory, Oxfordshire
+      email: tom.williams <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+#include "uhal/uhal.hpp"
+
+#include "uhal/tests/definitions.hpp"
+#include "uhal/tests/fixtures.hpp"
+#include "uhal/tests/tools.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <vector>
+
+
+// Long enough that the batch is split over several packets
+#define N_OPERATIONS size_t(5000)
+
+
+namespace uhal {
+namespace tests {
+
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(BatchTestSuite, batch_write_read, DummyHardwareFixture,
+{
+  HwInterface hw = getHwInterface();
+  ClientInterface& c = hw.getClient();
+  const Node& upper = hw.getNode ( "REG_UPPER_MASK" );
+  const Node& lower = hw.getNode ( "REG_LOWER_MASK" );
+  const uint32_t mem_addr = hw.getNode ( "MEM" ).getAddress();
+  const uint32_t x = static_cast<uint32_t> ( rand() ) & 0xFFFF;
+  const uint32_t y = static_cast<uint32_t> ( rand() ) & 0xFFFF;
+
+  std::vector<uint32_t> xx;
+  std::vector<BatchOperation> operations;
+  operations.push_back ( BatchOperation::write ( upper , x ) );
+  operations.push_back ( BatchOperation::write ( lower.getAddress() , y , lower.getMask() ) );
+
+  for ( size_t i = 0; i != N_OPERATIONS; ++i )
+  {
+    xx.push_back ( static_cast<uint32_t> ( rand() ) );
+    operations.push_back ( BatchOperation::write ( mem_addr + i , xx.back() ) );
+  }
+
+  operations.push_back ( BatchOperation::read ( upper ) );
+  operations.push_back ( BatchOperation::read ( lower ) );
+  operations.push_back ( BatchOperation::read ( upper.getAddress() ) );
+
+  for ( size_t i = 0; i != N_OPERATIONS; ++i )
+  {
+    operations.push_back ( BatchOperation::read ( mem_addr + i ) );
+  }
+
+  BatchResult result = c.batch ( operations );
+  BOOST_CHECK_EQUAL ( result.size() , operations.size() );
+  BOOST_CHECK ( !result.valid() );
+  BOOST_CHECK_THROW ( result.at ( 0 ) , uhal::exception::NonValidatedMemory );
+  c.dispatch();
+
+  BOOST_REQUIRE ( result.valid() );
+  const size_t first_read = N_OPERATIONS + 2;
+  BOOST_CHECK_EQUAL ( result.at ( first_read ) , x );
+  BOOST_CHECK_EQUAL ( result.at ( first_read + 1 ) , y );
+  BOOST_CHECK_EQUAL ( result.at ( first_read + 2 ) , ( x << 16 ) | y );
+
+  std::vector<uint32_t> values = result.value();
+  BOOST_CHECK_EQUAL ( values.size() , operations.size() );
+  BOOST_CHECK_EQUAL ( values.at ( first_read ) , x );
+  BOOST_CHECK ( std::equal ( xx.begin() , xx.end() , values.begin() + first_read + 3 ) );
+
+  for ( size_t i = 0; i != N_OPERATIONS; ++i )
+  {
+    BOOST_CHECK_EQUAL ( result.at ( 2 + i ) , uint32_t ( 0 ) );
+  }
+}
+)
+
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(BatchTestSuite, batch_rmw, DummyHardwareFixture,
+{
+  HwInterface hw = getHwInterface();
+  ClientInterface& c = hw.getClient();
+  const Node& reg = hw.getNode ( "REG" );
+  const uint32_t x = static_cast<uint32_t> ( rand() );
+  const uint32_t and_term = static_cast<uint32_t> ( rand() );
+  const uint32_t or_term = static_cast<uint32_t> ( rand() );
+  const int32_t addend = static_cast<int32_t> ( rand() );
+
+  std::vector<BatchOperation> operations;
+  operations.push_back ( BatchOperation::write ( reg , x ) );
+  operations.push_back ( BatchOperation::rmw_bits ( reg , and_term , or_term ) );
+  operations.push_back ( BatchOperation::rmw_sum ( reg.getAddress() , addend ) );
+  operations.push_back ( BatchOperation::read ( reg ) );
+
+  BatchResult result = c.batch ( operations );
+  c.dispatch();
+  BOOST_REQUIRE ( result.valid() );
+
+  const uint32_t bits = ( x & and_term ) | or_term;
+  const uint32_t sum = bits + static_cast<uint32_t> ( addend );
+  BOOST_CHECK_EQUAL ( result[3] , sum );
+
+  // IPbus 1.3 returns the modified value, IPbus 2.0 the original value
+  if ( hw.uri().find ( "-1.3://" ) != std::string::npos )
+  {
+    BOOST_CHECK_EQUAL ( result[1] , bits );
+    BOOST_CHECK_EQUAL ( result[2] , sum );
+  }
+  else
+  {
+    BOOST_CHECK_EQUAL ( result[1] , x );
+    BOOST_CHECK_EQUAL ( result[2] , bits );
+  }
+}
+)
+
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(BatchTestSuite, batch_access_violations, DummyHardwareFixture,
+{
+  HwInterface hw = getHwInterface();
+  ClientInterface& c = hw.getClient();
+
+  BOOST_CHECK_THROW ( BatchOperation::read ( hw.getNode ( "REG_WRITE_ONLY" ) ) , uhal::exception::ReadAccessDenied );
+  BOOST_CHECK_THROW ( BatchOperation::write ( hw.getNode ( "REG_READ_ONLY" ) , 1 ) , uhal::exception::WriteAccessDenied );
+  BOOST_CHECK_THROW ( BatchOperation::write ( hw.getNode ( "REG_MASKED_WRITE_ONLY" ) , 1 ) , uhal::exception::WriteAccessDenied );
+  BOOST_CHECK_THROW ( BatchOperation::rmw_sum ( hw.getNode ( "REG_READ_ONLY" ) , 1 ) , uhal::exception::WriteAccessDenied );
+  BOOST_CHECK_THROW ( BatchOperation::write ( hw.getNode ( "REG_UPPER_MASK" ) , 0x10000 ) , uhal::exception::BitsSetWhichAreForbiddenByBitMask );
+
+  // An empty batch is valid immediately
+  BatchResult result = c.batch ( std::vector<BatchOperation>() );
+  BOOST_CHECK ( result.valid() );
+  BOOST_CHECK_EQUAL ( result.size() , size_t ( 0 ) );
+  BOOST_CHECK_NO_THROW ( c.dispatch() );
+}
+)
+
+
+} // end ns tests
+} // end ns uhal
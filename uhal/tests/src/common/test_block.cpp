@@ -38,8 +38,10 @@
 #include "uhal/tests/fixtures.hpp"
 #include "uhal/tests/tools.hpp"
 
+#include <boost/filesystem.hpp>
 #include <boost/test/unit_test.hpp>
 
+#include <algorithm>
 #include <vector>
 #include <iostream>
 #include <cstdlib>
@@ -128,6 +130,86 @@ UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(BlockReadWriteTestSuite, block_write_read, D
 )
 
 
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(BlockReadWriteTestSuite, block_write_read_into, DummyHardwareFixture,
+{
+  std::vector<size_t> lDepths = getBlockUnitTestDepths(N_1MB);
+
+  for(size_t i=0; i<lDepths.size(); i++) {
+    const size_t N = lDepths.at(i);
+    BOOST_TEST_MESSAGE("  N = " << N);
+
+    HwInterface hw = getHwInterface();
+
+    std::vector<uint32_t> xx;
+    xx.reserve ( N );
+    for ( size_t i=0; i!= N; ++i )
+    {
+      xx.push_back ( static_cast<uint32_t> ( rand() ) );
+    }
+
+    // One extra word, to check that nothing is written beyond the requested size
+    std::vector<uint32_t> lDestination ( N + 1 , 0xDEADBEEF );
+
+    hw.getNode ( "LARGE_MEM" ).writeBlock ( xx );
+    ValHeader mem = hw.getNode ( "LARGE_MEM" ).readBlockInto ( N , & lDestination.at ( 0 ) );
+    BOOST_CHECK ( !mem.valid() );
+    BOOST_CHECK_NO_THROW ( hw.dispatch() );
+    BOOST_CHECK ( mem.valid() );
+
+    bool correct_block_write_read = true;
+    for ( size_t j=0; j!=N; ++j )
+    {
+      correct_block_write_read = correct_block_write_read && ( lDestination.at ( j ) == xx.at ( j ) );
+    }
+
+    BOOST_CHECK ( correct_block_write_read );
+    BOOST_CHECK_EQUAL ( lDestination.at ( N ) , uint32_t ( 0xDEADBEEF ) );
+  }
+}
+)
+
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(BlockReadWriteTestSuite, block_write_read_packet_size, DummyHardwareFixture,
+{
+  // The packet size and number of packets in flight can only be set through the URI for direct UDP clients
+  if ( ( deviceType == IPBUS_1_3_UDP ) || ( deviceType == IPBUS_2_0_UDP ) )
+  {
+    std::string address_file;
+    {
+      boost::filesystem::path conn_fn ( connectionFileURI );
+      boost::filesystem::path fn ( "dummy_address.xml" );
+      address_file = ( conn_fn.parent_path() /fn ).string();
+    }
+    // Small packets (many transactions split across packets), and jumbo packets (many transactions packed into one packet)
+    std::vector<std::string> lAttributes;
+    lAttributes.push_back ( deviceType == IPBUS_2_0_UDP ? "?max_packet_size=128&max_in_flight=2" : "?max_packet_size=128" );
+    lAttributes.push_back ( deviceType == IPBUS_2_0_UDP ? "?jumbo=1" : "?max_packet_size=8972" );
+
+    for ( std::vector<std::string>::const_iterator lIt = lAttributes.begin(); lIt != lAttributes.end(); ++lIt )
+    {
+      BOOST_TEST_MESSAGE ( "  URI attributes = " << *lIt );
+      HwInterface hw = ConnectionManager::getDevice ( "test_device_id", getHwInterface().uri() + *lIt, address_file );
+      hw.setTimeoutPeriod(timeout);
+
+      const size_t N = 10 * N_1kB;
+      std::vector<uint32_t> xx;
+      xx.reserve ( N );
+      for ( size_t i=0; i!= N; ++i )
+      {
+        xx.push_back ( static_cast<uint32_t> ( rand() ) );
+      }
+
+      hw.getNode ( "LARGE_MEM" ).writeBlock ( xx );
+      ValVector< uint32_t > mem = hw.getNode ( "LARGE_MEM" ).readBlock ( N );
+      BOOST_CHECK_NO_THROW ( hw.dispatch() );
+      BOOST_CHECK ( mem.valid() );
+      BOOST_CHECK ( std::equal ( mem.begin() , mem.end() , xx.begin() ) );
+    }
+  }
+}
+)
+
+
 UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(BlockReadWriteTestSuite, fifo_write_read, DummyHardwareFixture,
 {
   std::vector<size_t> lDepths = getBlockUnitTestDepths(quickTest ? N_1MB : N_200MB);
@@ -101,6 +101,79 @@ UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(ConfigSpaceTestSuite, read_masked, DummyHard
 }
 )
 
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(ConfigSpaceTestSuite, snapshot, DummyHardwareFixture,
+{
+  HwInterface hw = getHwInterface();
+
+  IPbusCore& client = dynamic_cast<IPbusCore&>(hw.getClient());
+
+  switch (deviceType) {
+    case IPBUS_1_3_UDP :
+    case IPBUS_1_3_TCP :
+    case IPBUS_1_3_CONTROLHUB :
+      BOOST_CHECK_THROW(client.snapshotConfigurationSpace(0, 10), exception::ValidationError);
+      break;
+    default:
+      ValVector<uint32_t> x = client.snapshotConfigurationSpace(0, 10);
+      ValVector<uint32_t> y = client.snapshotConfigurationSpace(3, 4);
+
+      client.dispatch();
+      BOOST_REQUIRE(x.valid());
+      BOOST_REQUIRE_EQUAL(x.size(), size_t(10));
+      BOOST_REQUIRE_EQUAL(y.size(), size_t(4));
+      for (size_t i = 0; i < x.size(); i++)
+        BOOST_CHECK_EQUAL(x.at(i), uint32_t(uint16_t(getpid()) << 16 | i));
+      for (size_t i = 0; i < y.size(); i++)
+        BOOST_CHECK_EQUAL(y.at(i), x.at(i + 3));
+  }
+}
+)
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(ConfigSpaceTestSuite, cached_snapshot, DummyHardwareFixture,
+{
+  HwInterface hw = getHwInterface();
+
+  IPbusCore& client = dynamic_cast<IPbusCore&>(hw.getClient());
+
+  switch (deviceType) {
+    case IPBUS_1_3_UDP :
+    case IPBUS_1_3_TCP :
+    case IPBUS_1_3_CONTROLHUB :
+      break;
+    default:
+      BOOST_CHECK(!client.getConfigurationSpaceCaching());
+      client.setConfigurationSpaceCaching(true);
+      BOOST_CHECK(client.getConfigurationSpaceCaching());
+      client.resetMetrics();
+      client.setMetricsEnabled(true);
+
+      ValVector<uint32_t> x = client.snapshotConfigurationSpace(0, 10);
+      client.dispatch();
+      BOOST_REQUIRE(x.valid());
+      BOOST_CHECK_EQUAL(client.getMetrics().transaction(ClientMetrics::CONFIG_SPACE_READ).transactions, uint64_t(1));
+
+      // Reads covered by the snapshot are valid immediately, and are not sent to the target
+      ValVector<uint32_t> y = client.snapshotConfigurationSpace(2, 5);
+      ValWord<uint32_t> z = client.readConfigurationSpace(7, 0xFF00);
+      BOOST_CHECK(y.valid());
+      BOOST_CHECK(z.valid());
+      for (size_t i = 0; i < y.size(); i++)
+        BOOST_CHECK_EQUAL(y.at(i), x.at(i + 2));
+      BOOST_CHECK_EQUAL(z.value(), uint32_t((x.at(7) & 0xFF00) >> 8));
+      BOOST_CHECK_EQUAL(client.getMetrics().transaction(ClientMetrics::CONFIG_SPACE_READ).transactions, uint64_t(1));
+
+      // After clearing the cache, the target is read again
+      client.clearConfigurationSpaceCache();
+      ValWord<uint32_t> w = client.readConfigurationSpace(7);
+      BOOST_CHECK(!w.valid());
+      client.dispatch();
+      BOOST_CHECK_EQUAL(w.value(), x.at(7));
+      BOOST_CHECK_EQUAL(client.getMetrics().transaction(ClientMetrics::CONFIG_SPACE_READ).transactions, uint64_t(2));
+      client.setConfigurationSpaceCaching(false);
+  }
+}
+)
+
 } // end ns tests
 } // end ns uhal
 
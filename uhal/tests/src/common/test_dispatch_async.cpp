@@ -0,0 +1,152 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Tom Williams, Rutherford Appleton Laboratory, Oxfordshire
+      email: tom.williams <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+#include "uhal/uhal.hpp"
+#include "uhal/tests/definitions.hpp"
+#include "uhal/tests/fixtures.hpp"
+#include "uhal/tests/tools.hpp"
+
+#include <boost/bind/bind.hpp>
+#include <boost/chrono/chrono_io.hpp>
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <iostream>
+#include <vector>
+
+
+#define N_BATCHES 20
+#define N_WORDS   uint32_t(100)
+
+
+namespace uhal {
+namespace tests {
+
+
+void set_dispatch_result ( boost::promise< bool >& aPromise , exception::exception* aException )
+{
+  aPromise.set_value ( aException == NULL );
+}
+
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(AsyncDispatchTestSuite, double_buffered_write_read, DummyHardwareFixture,
+{
+  HwInterface hw = getHwInterface();
+  const Node& lNode ( hw.getNode ( "LARGE_MEM" ) );
+
+  std::vector< std::vector<uint32_t> > lWritten;
+  std::vector< ValVector<uint32_t> > lRead;
+  boost::shared_future< void > lPrevious;
+
+  for ( size_t i = 0; i != N_BATCHES; ++i )
+  {
+    std::vector<uint32_t> lValues;
+    for ( size_t j = 0; j != N_WORDS; ++j )
+    {
+      lValues.push_back ( static_cast<uint32_t> ( rand() ) );
+    }
+
+    lNode.writeBlockOffset ( lValues , i * N_WORDS );
+    lRead.push_back ( lNode.readBlockOffset ( N_WORDS , i * N_WORDS ) );
+    lWritten.push_back ( lValues );
+
+    // Dispatch this batch, then wait for the previous one whilst this one is in flight
+    boost::shared_future< void > lCurrent = hw.dispatchAsync();
+
+    if ( i != 0 )
+    {
+      BOOST_CHECK_NO_THROW ( lPrevious.get() );
+      BOOST_CHECK ( lRead.at ( i-1 ).valid() );
+    }
+
+    lPrevious = lCurrent;
+  }
+
+  BOOST_CHECK_NO_THROW ( lPrevious.get() );
+
+  for ( size_t i = 0; i != N_BATCHES; ++i )
+  {
+    BOOST_REQUIRE ( lRead.at ( i ).valid() );
+    BOOST_CHECK ( lRead.at ( i ).value() == lWritten.at ( i ) );
+  }
+}
+)
+
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(AsyncDispatchTestSuite, callback_write_read, DummyHardwareFixture,
+{
+  HwInterface hw = getHwInterface();
+  const uint32_t x = static_cast<uint32_t> ( rand() );
+
+  hw.getNode ( "REG" ).write ( x );
+  ValWord< uint32_t > lReg = hw.getNode ( "REG" ).read();
+
+  boost::promise< bool > lResult;
+  boost::shared_future< bool > lFuture ( lResult.get_future() );
+  hw.dispatchAsync ( boost::bind ( &set_dispatch_result , boost::ref ( lResult ) , boost::placeholders::_1 ) );
+
+  BOOST_CHECK ( lFuture.get() );
+  BOOST_REQUIRE ( lReg.valid() );
+  BOOST_CHECK_EQUAL ( lReg.value() , x );
+}
+)
+
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(AsyncDispatchTestSuite, timeout_through_future, DummyHardwareFixture,
+{
+  hwRunner.setReplyDelay( boost::chrono::milliseconds(timeout) + boost::chrono::seconds(1) );
+  HwInterface hw = getHwInterface();
+
+  // The timeout of the first packet should be delivered through the future, rather than on the next call
+  hw.getNode ( "REG" ).read();
+  boost::shared_future< void > lFuture = hw.dispatchAsync();
+  BOOST_CHECK_THROW ( lFuture.get() , uhal::exception::ClientTimeout );
+
+  const boost::chrono::milliseconds sleepDuration = boost::chrono::milliseconds(timeout) + boost::chrono::seconds(1);
+  BOOST_TEST_MESSAGE("Sleeping for " << sleepDuration << " seconds to allow DummyHardware to clear itself");
+  boost::this_thread::sleep_for(sleepDuration);
+
+  const uint32_t x = static_cast<uint32_t> ( rand() );
+  hw.getNode ( "REG" ).write ( x );
+  ValWord< uint32_t > lReg = hw.getNode ( "REG" ).read();
+  lFuture = hw.dispatchAsync();
+  BOOST_CHECK_NO_THROW ( lFuture.get() );
+  BOOST_REQUIRE ( lReg.valid() );
+  BOOST_CHECK_EQUAL ( lReg.value() , x );
+}
+)
+
+
+} // end ns tests
+} // end ns uhal
@@ -0,0 +1,166 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Tom Williams, Rutherford Appleton Laboratory, Oxfordshire
+      email: tom.williams <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+#include "uhal/uhal.hpp"
+
+#include "uhal/tests/definitions.hpp"
+#include "uhal/tests/fixtures.hpp"
+#include "uhal/tests/tools.hpp"
+
+#include <boost/ref.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <stdexcept>
+#include <vector>
+
+
+// Long enough that many chunks are read, each split over several packets
+#define N_WORDS uint64_t(100000)
+#define CHUNK_SIZE uint32_t(3000)
+
+
+namespace uhal {
+namespace tests {
+
+
+//! Receives the chunks delivered by a FIFO readout, checking that every word has the value written to the dummy hardware's FIFO
+struct ChunkCollector
+{
+  ChunkCollector ( const uint32_t& aExpected ) :
+    expected ( aExpected ),
+    words ( 0 ),
+    chunks ( 0 ),
+    largestChunk ( 0 ),
+    allExpected ( true )
+  {
+  }
+
+  void operator() ( const uint32_t* aWords , const uint32_t& aWordCount )
+  {
+    for ( uint32_t i = 0 ; i != aWordCount ; ++i )
+    {
+      allExpected = allExpected && ( aWords[i] == expected );
+    }
+
+    words += aWordCount;
+    chunks++;
+    largestChunk = std::max ( largestChunk , aWordCount );
+  }
+
+  uint32_t expected;
+  uint64_t words;
+  uint32_t chunks;
+  uint32_t largestChunk;
+  bool allExpected;
+};
+
+
+//! Throws on the second chunk delivered
+struct FailingConsumer
+{
+  FailingConsumer() : chunks ( 0 ) {}
+
+  void operator() ( const uint32_t* , const uint32_t& )
+  {
+    if ( ++chunks == 2 )
+    {
+      throw std::runtime_error ( "Consumer is full" );
+    }
+  }
+
+  uint32_t chunks;
+};
+
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(FifoReaderTestSuite, stream_fifo, DummyHardwareFixture,
+{
+  HwInterface hw = getHwInterface();
+  // The FIFO implementation on the dummy HW is a single memory location, so every word read has the last value written
+  const uint32_t x = static_cast<uint32_t> ( rand() );
+  hw.getNode ( "FIFO" ).write ( x );
+  hw.dispatch();
+
+  FifoReader reader ( hw.getNode ( "FIFO" ) , CHUNK_SIZE , 3 );
+  BOOST_CHECK_EQUAL ( reader.getChunkSize() , CHUNK_SIZE );
+  BOOST_CHECK_EQUAL ( reader.getMaxChunksInFlight() , 3u );
+
+  ChunkCollector collector ( x );
+  BOOST_CHECK_EQUAL ( reader.read ( N_WORDS , boost::ref ( collector ) ) , N_WORDS );
+  BOOST_CHECK_EQUAL ( collector.words , N_WORDS );
+  BOOST_CHECK_EQUAL ( collector.chunks , ( N_WORDS + CHUNK_SIZE - 1 ) / CHUNK_SIZE );
+  BOOST_CHECK_EQUAL ( collector.largestChunk , CHUNK_SIZE );
+  BOOST_CHECK ( collector.allExpected );
+
+  // The number of words to read can be taken from an occupancy register
+  hw.getNode ( "REG" ).write ( 12345 );
+  hw.dispatch();
+  ChunkCollector available ( x );
+  BOOST_CHECK_EQUAL ( reader.readAvailable ( hw.getNode ( "REG" ) , boost::ref ( available ) ) , 12345u );
+  BOOST_CHECK_EQUAL ( available.words , 12345u );
+  BOOST_CHECK ( available.allExpected );
+
+  ChunkCollector capped ( x );
+  BOOST_CHECK_EQUAL ( reader.readAvailable ( hw.getNode ( "REG" ) , boost::ref ( capped ) , 100 ) , 100u );
+  BOOST_CHECK_EQUAL ( capped.words , 100u );
+
+  // The client can still be used directly between readouts
+  ValWord< uint32_t > y = hw.getNode ( "REG" ).read();
+  hw.dispatch();
+  BOOST_CHECK_EQUAL ( y.value() , 12345u );
+}
+)
+
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(FifoReaderTestSuite, stream_fifo_errors, DummyHardwareFixture,
+{
+  HwInterface hw = getHwInterface();
+
+  BOOST_CHECK_THROW ( FifoReader ( hw.getNode ( "MEM" ) ) , uhal::exception::FifoReadoutRequiresPort );
+
+  // An exception thrown by the consumer ends the readout, and is reported once all chunks in flight have come back
+  FifoReader reader ( hw.getNode ( "FIFO" ) , CHUNK_SIZE , 3 );
+  FailingConsumer consumer;
+  BOOST_CHECK_THROW ( reader.read ( N_WORDS , boost::ref ( consumer ) ) , uhal::exception::FifoReadoutCallbackFailed );
+  BOOST_CHECK_EQUAL ( consumer.chunks , 2u );
+
+  // ... after which the reader can be used again
+  ChunkCollector collector ( 0 );
+  BOOST_CHECK_EQUAL ( reader.read ( N_WORDS , boost::ref ( collector ) ) , N_WORDS );
+  BOOST_CHECK_EQUAL ( collector.words , N_WORDS );
+}
+)
+
+
+} // end ns tests
+} // end ns uhal
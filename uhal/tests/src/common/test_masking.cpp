@@ -76,5 +76,75 @@ UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(MaskedNodeTestSuite, write_read_masked, Dumm
 )
 
 
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(MaskedNodeTestSuite, shadow_cache, DummyHardwareFixture,
+{
+  HwInterface hw = getHwInterface();
+  ClientInterface& client = hw.getClient();
+  const Node& lLower = hw.getNode ( "REG_LOWER_MASK" );
+  const Node& lUpper = hw.getNode ( "REG_UPPER_MASK" );
+  const uint32_t lAddr = lLower.getAddress();
+
+  BOOST_CHECK ( hw.getNode ( "REG" ).hasTag ( "test" ) );
+  BOOST_CHECK ( ! hw.getNode ( "REG" ).hasTag ( "tes" ) );
+  BOOST_CHECK ( ! hw.getNode ( "REG" ).hasTag ( "cacheable" ) );
+  BOOST_CHECK ( ! client.isCacheable ( lAddr ) );
+  client.setCacheable ( lAddr );
+  BOOST_CHECK ( client.isCacheable ( lAddr ) );
+  const ClientInterface::ShadowCacheStatistics lStart = client.getShadowCacheStatistics();
+
+  // Value unknown: the masked write is a read-modify-write, and the first read goes to the target and fills the cache
+  uint32_t x = static_cast<uint32_t> ( rand() );
+  lLower.write ( x & 0xFFFF );
+  lUpper.write ( x >> 16 );
+  ValWord<uint32_t> lMiss = client.read ( lAddr );
+  BOOST_CHECK ( ! lMiss.valid() );
+  hw.dispatch();
+  BOOST_CHECK_EQUAL ( lMiss.value(), x );
+  BOOST_CHECK_EQUAL ( client.getShadowCacheStatistics().misses, lStart.misses + 1 );
+
+  // Value known: reads are answered locally, and consecutive masked writes become a single plain write
+  ValWord<uint32_t> lHit = lUpper.read();
+  BOOST_CHECK ( lHit.valid() );
+  BOOST_CHECK_EQUAL ( lHit.value(), x >> 16 );
+
+  uint32_t y = static_cast<uint32_t> ( rand() );
+  ValHeader lFirst = lLower.write ( y & 0xFFFF );
+  ValHeader lSecond = lUpper.write ( y >> 16 );
+  ValWord<uint32_t> lLocal = client.read ( lAddr );
+  BOOST_CHECK ( lLocal.valid() );
+  BOOST_CHECK_EQUAL ( lLocal.value(), y );
+  hw.dispatch();
+  BOOST_CHECK ( lFirst.valid() && lSecond.valid() );
+  ClientInterface::ShadowCacheStatistics lStats = client.getShadowCacheStatistics();
+  BOOST_CHECK_EQUAL ( lStats.hits, lStart.hits + 2 );
+  BOOST_CHECK_EQUAL ( lStats.convertedWrites, lStart.convertedWrites + 1 );
+  BOOST_CHECK_EQUAL ( lStats.mergedWrites, lStart.mergedWrites + 1 );
+
+  // The target holds the merged value
+  client.setCacheable ( lAddr , false );
+  ValWord<uint32_t> lTarget = client.read ( lAddr );
+  BOOST_CHECK ( ! lTarget.valid() );
+  hw.dispatch();
+  BOOST_CHECK_EQUAL ( lTarget.value(), y );
+
+  // Block writes and explicit invalidation make the next read go to the target
+  client.setCacheable ( lAddr );
+  client.write ( lAddr , x );
+  BOOST_CHECK ( client.read ( lAddr ).valid() );
+  client.writeBlock ( lAddr , std::vector<uint32_t> ( 1 , y ) );
+  ValWord<uint32_t> lAfterBlock = client.read ( lAddr );
+  BOOST_CHECK ( ! lAfterBlock.valid() );
+  hw.dispatch();
+  BOOST_CHECK_EQUAL ( lAfterBlock.value(), y );
+  BOOST_CHECK ( client.read ( lAddr ).valid() );
+  client.invalidateShadowCache();
+  ValWord<uint32_t> lAfterInvalidate = client.read ( lAddr );
+  BOOST_CHECK ( ! lAfterInvalidate.valid() );
+  hw.dispatch();
+  BOOST_CHECK_EQUAL ( lAfterInvalidate.value(), y );
+}
+)
+
+
 } // end ns tests
 } // end ns uhal
@@ -0,0 +1,167 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Tom Williams, Rutherford Appleton Laboratory, Oxfordshire
+      email: tom.williams <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+#include "uhal/uhal.hpp"
+
+#include "uhal/tests/definitions.hpp"
+#include "uhal/tests/fixtures.hpp"
+#include "uhal/tests/tools.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <numeric>
+#include <vector>
+
+
+// Long enough that the block transfers are split over several packets
+#define N_WORDS size_t(20000)
+
+
+namespace uhal {
+namespace tests {
+
+
+uint64_t sum_of_buckets ( const LatencyHistogram& aHistogram )
+{
+  return std::accumulate ( aHistogram.buckets.begin() , aHistogram.buckets.end() , uint64_t ( 0 ) );
+}
+
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(MetricsTestSuite, count_transactions, DummyHardwareFixture,
+{
+  HwInterface hw = getHwInterface();
+  ClientInterface& c = hw.getClient();
+  const uint32_t reg_addr = hw.getNode ( "REG" ).getAddress();
+  const uint32_t mem_addr = hw.getNode ( "MEM" ).getAddress();
+  const uint32_t fifo_addr = hw.getNode ( "FIFO" ).getAddress();
+
+  // Nothing is recorded while metrics are disabled
+  BOOST_CHECK ( ! c.getMetricsEnabled() );
+  c.write ( reg_addr , 0 );
+  c.dispatch();
+  BOOST_CHECK_EQUAL ( c.getMetrics().transaction ( ClientMetrics::WRITE ).transactions , uint64_t ( 0 ) );
+  BOOST_CHECK_EQUAL ( c.getMetrics().packets , uint64_t ( 0 ) );
+  BOOST_CHECK_EQUAL ( c.getMetrics().dispatches , uint64_t ( 0 ) );
+
+  c.setMetricsEnabled ( true );
+  BOOST_CHECK ( c.getMetricsEnabled() );
+  c.write ( reg_addr , static_cast<uint32_t> ( rand() ) );
+  ValWord<uint32_t> reg = c.read ( reg_addr );
+  c.writeBlock ( mem_addr , std::vector<uint32_t> ( N_WORDS , 0xDEADBEEF ) );
+  ValVector<uint32_t> mem = c.readBlock ( mem_addr , N_WORDS );
+  c.readBlock ( fifo_addr , 10 , defs::NON_INCREMENTAL );
+  c.rmw_bits ( reg_addr , 0xFFFF0000 , 0x1 );
+  c.rmw_sum ( reg_addr , 1 );
+  c.dispatch();
+  BOOST_REQUIRE ( reg.valid() && mem.valid() );
+
+  const ClientMetrics metrics = c.getMetrics();
+  BOOST_CHECK_EQUAL ( metrics.transaction ( ClientMetrics::WRITE ).transactions , uint64_t ( 2 ) );
+  BOOST_CHECK_EQUAL ( metrics.transaction ( ClientMetrics::WRITE ).words , uint64_t ( N_WORDS + 1 ) );
+  BOOST_CHECK_EQUAL ( metrics.transaction ( ClientMetrics::READ ).transactions , uint64_t ( 2 ) );
+  BOOST_CHECK_EQUAL ( metrics.transaction ( ClientMetrics::READ ).words , uint64_t ( N_WORDS + 1 ) );
+  BOOST_CHECK_EQUAL ( metrics.transaction ( ClientMetrics::NON_INCREMENTAL_READ ).transactions , uint64_t ( 1 ) );
+  BOOST_CHECK_EQUAL ( metrics.transaction ( ClientMetrics::NON_INCREMENTAL_READ ).words , uint64_t ( 10 ) );
+  BOOST_CHECK_EQUAL ( metrics.transaction ( ClientMetrics::NON_INCREMENTAL_WRITE ).transactions , uint64_t ( 0 ) );
+  BOOST_CHECK_EQUAL ( metrics.transaction ( ClientMetrics::RMW_BITS ).transactions , uint64_t ( 1 ) );
+  BOOST_CHECK_EQUAL ( metrics.transaction ( ClientMetrics::RMW_SUM ).transactions , uint64_t ( 1 ) );
+
+  // Each transaction is attributed to exactly one packet, whose latency is then recorded against it
+  for ( uint32_t i = 0; i != ClientMetrics::NUMBER_OF_TRANSACTION_TYPES; ++i )
+  {
+    const TransactionMetrics& type = metrics.transactions.at ( i );
+    BOOST_CHECK_EQUAL ( type.latency.entries , type.transactions );
+    BOOST_CHECK_EQUAL ( sum_of_buckets ( type.latency ) , type.transactions );
+  }
+
+  // The block transfers do not fit in one packet
+  BOOST_CHECK ( metrics.packets > 1 );
+  BOOST_CHECK ( metrics.sentBytes > N_WORDS * 4 );
+  BOOST_CHECK ( metrics.receivedBytes > N_WORDS * 4 );
+  BOOST_CHECK_EQUAL ( metrics.packetLatency.entries , metrics.packets );
+  BOOST_CHECK_EQUAL ( sum_of_buckets ( metrics.packetLatency ) , metrics.packets );
+  BOOST_CHECK ( metrics.packetLatency.max <= metrics.packetLatency.total );
+
+  BOOST_CHECK_EQUAL ( metrics.dispatches , uint64_t ( 1 ) );
+  BOOST_CHECK_EQUAL ( metrics.failedDispatches , uint64_t ( 0 ) );
+  BOOST_CHECK_EQUAL ( metrics.dispatchLatency.entries , uint64_t ( 1 ) );
+  BOOST_CHECK_EQUAL ( metrics.dispatchLatency.mean() , double ( metrics.dispatchLatency.total ) );
+
+  c.resetMetrics();
+  const ClientMetrics reset_metrics = c.getMetrics();
+  BOOST_CHECK_EQUAL ( reset_metrics.transaction ( ClientMetrics::READ ).transactions , uint64_t ( 0 ) );
+  BOOST_CHECK_EQUAL ( reset_metrics.transaction ( ClientMetrics::READ ).latency.entries , uint64_t ( 0 ) );
+  BOOST_CHECK_EQUAL ( reset_metrics.packets , uint64_t ( 0 ) );
+  BOOST_CHECK_EQUAL ( reset_metrics.dispatchLatency.entries , uint64_t ( 0 ) );
+  BOOST_CHECK_EQUAL ( reset_metrics.dispatchLatency.mean() , 0.0 );
+  c.setMetricsEnabled ( false );
+}
+)
+
+
+BOOST_AUTO_TEST_SUITE(LatencyHistogramTestSuite)
+
+BOOST_AUTO_TEST_CASE(bucket_edges)
+{
+  BOOST_CHECK_EQUAL ( LatencyHistogram::upperEdge ( 0 ) , uint64_t ( 1 ) );
+  BOOST_CHECK_EQUAL ( LatencyHistogram::upperEdge ( 10 ) , uint64_t ( 1024 ) );
+
+  AtomicLatencyHistogram histogram;
+  histogram.add ( 0 );
+  histogram.add ( 1 );
+  histogram.add ( 1023 , 2 );
+  histogram.add ( 1024 );
+  histogram.add ( uint64_t ( 1 ) << 40 );
+
+  LatencyHistogram snapshot;
+  histogram.get ( snapshot );
+  BOOST_CHECK_EQUAL ( snapshot.entries , uint64_t ( 6 ) );
+  BOOST_CHECK_EQUAL ( snapshot.max , uint64_t ( 1 ) << 40 );
+  BOOST_CHECK_EQUAL ( snapshot.buckets.at ( 0 ) , uint64_t ( 1 ) );
+  BOOST_CHECK_EQUAL ( snapshot.buckets.at ( 1 ) , uint64_t ( 1 ) );
+  BOOST_CHECK_EQUAL ( snapshot.buckets.at ( 10 ) , uint64_t ( 2 ) );
+  BOOST_CHECK_EQUAL ( snapshot.buckets.at ( 11 ) , uint64_t ( 1 ) );
+  BOOST_CHECK_EQUAL ( snapshot.buckets.at ( LatencyHistogram::NUMBER_OF_BUCKETS - 1 ) , uint64_t ( 1 ) );
+
+  histogram.reset();
+  histogram.get ( snapshot );
+  BOOST_CHECK_EQUAL ( snapshot.entries , uint64_t ( 0 ) );
+  BOOST_CHECK_EQUAL ( sum_of_buckets ( snapshot ) , uint64_t ( 0 ) );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+} // end ns tests
+} // end ns uhal
@@ -33,6 +33,8 @@
 */
 
 #include "uhal/uhal.hpp"
+#include "uhal/ProtocolIPbus.hpp"
+#include "uhal/ProtocolUDP.hpp"
 #include "uhal/tests/definitions.hpp"
 #include "uhal/tests/fixtures.hpp"
 #include "uhal/tests/tools.hpp"
@@ -40,6 +42,7 @@
 
 #include <boost/thread.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/test/unit_test.hpp>
@@ -150,6 +153,132 @@ void job_single ( HwInterface& hw )
 }
 
 
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(MultithreadedTestSuite, shared_reactor, DummyHardwareFixture,
+{
+  if (deviceType != IPBUS_2_0_PCIE)
+  {
+    TransportReactor::setDefaultNumberOfThreads ( 2 );
+    boost::weak_ptr< TransportReactor > lWeakReactor;
+
+    {
+      ConnectionManager manager ( connectionFileURI );
+      std::vector<HwInterface> hws;
+
+      for ( size_t i=0; i!=N_THREADS; ++i )
+      {
+        hws.push_back ( manager.getDevice ( deviceId ) );
+        hws.back().setTimeoutPeriod ( TIMEOUT_MULTIPLIER * timeout );
+      }
+
+      // All clients run on the one reactor, with the number of threads set above
+      boost::shared_ptr< TransportReactor > lReactor ( TransportReactor::getInstance() );
+      lWeakReactor = lReactor;
+      BOOST_CHECK_EQUAL ( lReactor->getNumberOfThreads() , uint32_t ( 2 ) );
+      BOOST_CHECK ( lReactor.use_count() > long ( N_THREADS ) );
+      lReactor.reset();
+
+      std::vector<boost::thread*> jobs;
+
+      for ( size_t i=0; i!=N_THREADS; ++i )
+      {
+        jobs.push_back ( new boost::thread ( job_single, boost::ref ( hws.at ( i ) ) ) );
+      }
+
+      for ( size_t i=0; i!=N_THREADS; ++i )
+      {
+        jobs[i]->join();
+        delete jobs[i];
+      }
+    }
+
+    // The reactor's threads are stopped once the last client using it has been destroyed
+    BOOST_CHECK ( lWeakReactor.expired() );
+    TransportReactor::setDefaultNumberOfThreads ( 0 );
+  }
+  else
+    std::cout << "  **  Skipping shared reactor test for PCIe  **" << std::endl;
+}
+)
+
+
+bool uses_shared_socket ( ClientInterface& aClient )
+{
+  if ( UDP< IPbus< 1 , 3 > >* lClient = dynamic_cast< UDP< IPbus< 1 , 3 > >* > ( &aClient ) )
+    return lClient->usesSharedSocket();
+
+  if ( UDP< IPbus< 2 , 0 > >* lClient = dynamic_cast< UDP< IPbus< 2 , 0 > >* > ( &aClient ) )
+    return lClient->usesSharedSocket();
+
+  return false;
+}
+
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(MultithreadedTestSuite, shared_socket, DummyHardwareFixture,
+{
+  if ( ( deviceType == IPBUS_1_3_UDP ) || ( deviceType == IPBUS_2_0_UDP ) )
+  {
+    std::string address_file;
+    {
+      boost::filesystem::path conn_fn ( connectionFileURI );
+      boost::filesystem::path fn ( "dummy_address.xml" );
+      address_file = ( conn_fn.parent_path() /fn ).string();
+    }
+
+    const std::string lUri ( getHwInterface().uri() + "?shared_socket=1" );
+    TransportReactor::setDefaultNumberOfThreads ( 2 );
+
+    {
+      std::vector<HwInterface> hws;
+
+      for ( size_t i=0; i!=N_THREADS; ++i )
+      {
+        hws.push_back ( ConnectionManager::getDevice ( "test_device_id", lUri, address_file ) );
+        hws.back().setTimeoutPeriod ( TIMEOUT_MULTIPLIER * timeout );
+      }
+
+      // There is one shared socket per reactor thread, each serving the target once; the remaining clients of the target fall back to sockets of their own
+      size_t lShared ( 0 );
+
+      for ( size_t i=0; i!=N_THREADS; ++i )
+      {
+        lShared += uses_shared_socket ( hws.at ( i ).getClient() ) ? 1 : 0;
+      }
+
+      BOOST_CHECK_EQUAL ( lShared , size_t ( 2 ) );
+
+      std::vector<boost::thread*> jobs;
+
+      for ( size_t i=0; i!=N_THREADS; ++i )
+      {
+        jobs.push_back ( new boost::thread ( job_single, boost::ref ( hws.at ( i ) ) ) );
+      }
+
+      for ( size_t i=0; i!=N_THREADS; ++i )
+      {
+        jobs[i]->join();
+        delete jobs[i];
+      }
+
+      // Each client only sees the replies to its own packets
+      for ( size_t i=0; i!=N_THREADS; ++i )
+      {
+        uint32_t x = static_cast<uint32_t> ( rand() );
+        hws.at ( i ).getNode ( "REG" ).write ( x );
+        ValWord< uint32_t > reg = hws.at ( i ).getNode ( "REG" ).read();
+        BOOST_CHECK_NO_THROW ( hws.at ( i ).dispatch() );
+        BOOST_CHECK ( reg.valid() );
+        BOOST_CHECK_EQUAL ( reg.value() , x );
+      }
+    }
+
+    TransportReactor::setDefaultNumberOfThreads ( 0 );
+  }
+  else
+    std::cout << "  **  Skipping shared socket test for non-UDP clients  **" << std::endl;
+}
+)
+
+
 UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(MultithreadedTestSuite, single_hwinterface, DummyHardwareFixture,
 {
   for ( size_t iter=0; iter!= N_ITERATIONS ; ++iter )
@@ -0,0 +1,161 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Tom Williams, Rutherford Appleton Laboratory, Oxfordshire
+      email: tom.williams <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+#include "uhal/uhal.hpp"
+#include "uhal/tests/definitions.hpp"
+#include "uhal/tests/fixtures.hpp"
+#include "uhal/tests/tools.hpp"
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <iostream>
+#include <vector>
+
+
+#define N_MAX_THREADS 8
+#define N_ITERATIONS  5
+#define N_WORDS       uint32_t(1000)
+
+
+namespace uhal {
+namespace tests {
+
+
+void job_thread_local_queuing ( ClientInterface& aClient, const uint32_t aBaseAddr, size_t& aNrErrors )
+{
+  try
+  {
+    for ( size_t iter=0; iter!= N_ITERATIONS ; ++iter )
+    {
+      std::vector< ValHeader > lWrites;
+      std::vector< ValWord< uint32_t > > lReads;
+
+      for ( uint32_t i=0; i!= N_WORDS; ++i )
+      {
+        lWrites.push_back ( aClient.write ( aBaseAddr + i , aBaseAddr + i + iter ) );
+      }
+
+      for ( uint32_t i=0; i!= N_WORDS; ++i )
+      {
+        lReads.push_back ( aClient.read ( aBaseAddr + i ) );
+      }
+
+      aClient.dispatch();
+
+      for ( uint32_t i=0; i!= N_WORDS; ++i )
+      {
+        if ( ( ! lWrites.at ( i ).valid() ) || ( ! lReads.at ( i ).valid() ) || ( lReads.at ( i ).value() != aBaseAddr + i + iter ) )
+        {
+          ++aNrErrors;
+        }
+      }
+    }
+  }
+  catch ( const std::exception& aExc )
+  {
+    log ( Error() , "Exception thrown in thread-local queuing job: " , aExc.what() );
+    ++aNrErrors;
+  }
+}
+
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(MultithreadedQueuingTestSuite, thread_local_queuing_scaling, DummyHardwareFixture,
+{
+  HwInterface hw = getHwInterface();
+  hw.getClient().setThreadLocalQueuing ( true );
+  BOOST_CHECK ( hw.getClient().getThreadLocalQueuing() );
+  const uint32_t lBaseAddr ( hw.getNode ( "MEM" ).getAddress() );
+
+  for ( size_t lNrThreads=1; lNrThreads <= N_MAX_THREADS; lNrThreads *= 2 )
+  {
+    std::vector< boost::thread* > lJobs;
+    std::vector< size_t > lNrErrors ( lNrThreads , 0 );
+    Timer lTimer;
+
+    // Each thread accesses its own region of the memory, so that its values can be checked
+    for ( size_t i=0; i!=lNrThreads; ++i )
+    {
+      lJobs.push_back ( new boost::thread ( boost::bind ( job_thread_local_queuing , boost::ref ( hw.getClient() ) , lBaseAddr + i * N_WORDS , boost::ref ( lNrErrors.at ( i ) ) ) ) );
+    }
+
+    for ( size_t i=0; i!=lNrThreads; ++i )
+    {
+      lJobs.at ( i )->join();
+      delete lJobs.at ( i );
+      BOOST_CHECK_EQUAL ( lNrErrors.at ( i ) , size_t ( 0 ) );
+    }
+
+    const double lSeconds ( lTimer.elapsedSeconds() );
+    const double lNrTransactions ( 2. * lNrThreads * N_ITERATIONS * N_WORDS );
+    std::cout << " --> " << lNrThreads << " thread(s) sharing one client queued and dispatched " << lNrTransactions << " single-word transactions in " << lSeconds << " seconds ("
+              << lNrTransactions / lSeconds << " transactions/s)" << std::endl;
+  }
+
+  hw.getClient().setThreadLocalQueuing ( false );
+}
+)
+
+
+void job_dispatch ( ClientInterface& aClient )
+{
+  aClient.dispatch();
+}
+
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(MultithreadedQueuingTestSuite, thread_local_dispatch, DummyHardwareFixture,
+{
+  HwInterface hw = getHwInterface();
+  hw.getClient().setThreadLocalQueuing ( true );
+
+  ValHeader lWrite = hw.getNode ( "REG" ).write ( 0xC0FFEE );
+  ValWord< uint32_t > lRead = hw.getNode ( "REG" ).read();
+
+  // A dispatch from another thread must leave the transactions queued by this thread untouched
+  boost::thread lThread ( boost::bind ( job_dispatch , boost::ref ( hw.getClient() ) ) );
+  lThread.join();
+  BOOST_CHECK ( ! lWrite.valid() );
+  BOOST_CHECK ( ! lRead.valid() );
+
+  BOOST_CHECK_NO_THROW ( hw.dispatch() );
+  BOOST_CHECK ( lWrite.valid() );
+  BOOST_CHECK ( lRead.valid() );
+  BOOST_CHECK_EQUAL ( lRead.value() , uint32_t ( 0xC0FFEE ) );
+}
+)
+
+
+} // end ns tests
+} // end ns uhal
@@ -33,6 +33,7 @@
 */
 
 #include "uhal/uhal.hpp"
+#include "uhal/ProtocolIPbusCore.hpp"
 
 #include "uhal/tests/definitions.hpp"
 #include "uhal/tests/fixtures.hpp"
@@ -121,6 +122,166 @@ UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(RawClientTestSuite, mem_write_read, DummyHar
 )
 
 
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(RawClientTestSuite, mem_coalesced_write_read, DummyHardwareFixture,
+{
+  // Long enough that the merged transactions exceed the maximum word count of an IPbus 1.3 transaction
+  const uint32_t N = 600;
+  HwInterface hw = getHwInterface();
+  IPbusCore& c = dynamic_cast<IPbusCore&> ( hw.getClient() );
+  c.setTransactionCoalescing ( true );
+  BOOST_CHECK ( c.getTransactionCoalescing() );
+
+  const uint32_t addr = hw.getNode ( "MEM" ).getAddress();
+  const uint32_t reg_addr = hw.getNode ( "REG" ).getAddress();
+  const uint32_t reg_x = static_cast<uint32_t> ( rand() );
+  std::vector<uint32_t> xx;
+
+  for ( size_t i=0; i!= N; ++i )
+  {
+    xx.push_back ( static_cast<uint32_t> ( rand() ) );
+    c.write ( addr+i , xx.back() );
+
+    // Break the run part way through with an access to an unrelated address
+    if ( i == N/2 )
+    {
+      c.write ( reg_addr , reg_x );
+    }
+  }
+
+  std::vector< ValWord<uint32_t> > words;
+  ValWord<uint32_t> reg;
+
+  for ( size_t i=0; i!= N; ++i )
+  {
+    words.push_back ( c.read ( addr+i , ( i%2 ) ? defs::NOMASK : 0xFFFF00 ) );
+
+    if ( i == N/2 )
+    {
+      reg = c.read ( reg_addr );
+    }
+  }
+
+  ValVector<uint32_t> mem = c.readBlock ( addr , N );
+  c.dispatch();
+
+  BOOST_REQUIRE ( mem.valid() );
+  BOOST_CHECK ( std::equal ( mem.begin() , mem.end() , xx.begin() ) );
+  BOOST_REQUIRE ( reg.valid() );
+  BOOST_CHECK_EQUAL ( reg.value() , reg_x );
+
+  bool correct_coalesced_read = true;
+
+  for ( size_t i=0; i!= N; ++i )
+  {
+    correct_coalesced_read = correct_coalesced_read && words.at ( i ).valid();
+    correct_coalesced_read = correct_coalesced_read && ( words.at ( i ).value() == ( ( i%2 ) ? xx.at ( i ) : ( ( xx.at ( i ) >> 8 ) & 0xFFFF ) ) );
+  }
+
+  BOOST_CHECK ( correct_coalesced_read );
+}
+)
+
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(RawClientTestSuite, error_reply, DummyHardwareFixture,
+{
+  HwInterface hw = getHwInterface();
+  ClientInterface* c = &hw.getClient();
+  uint32_t x = static_cast<uint32_t> ( rand() );
+  uint32_t addr = hw.getNode ( "REG" ).getAddress();
+  c->write ( addr , x );
+  BOOST_CHECK_NO_THROW ( c->dispatch() );
+
+  // An error InfoCode in a reply is found by the detailed validation, after the fast check of the reply headers fails
+  hwRunner.failReplies ( 1 );
+  c->read ( addr );
+  BOOST_CHECK_THROW ( c->dispatch() , uhal::exception::IPbusCoreResponseCodeSet );
+
+  ValWord< uint32_t > y = c->read ( addr );
+  BOOST_CHECK_NO_THROW ( c->dispatch() );
+  BOOST_CHECK ( y.valid() );
+  BOOST_CHECK_EQUAL ( y.value() , x );
+}
+)
+
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(RawClientTestSuite, buffer_pool, DummyHardwareFixture,
+{
+  // Long enough to fill many buffers
+  const uint32_t N = 1024 * 1024;
+  HwInterface hw = getHwInterface();
+  ClientInterface* c = &hw.getClient();
+  uint32_t addr = hw.getNode ( "LARGE_MEM" ).getAddress();
+
+  c->setBufferPoolPreallocation ( 3 );
+  BOOST_CHECK_EQUAL ( c->getBufferPoolPreallocation() , uint32_t ( 3 ) );
+  BOOST_CHECK ( c->getBufferPoolStatistics().size >= 3 );
+
+  c->setBufferPoolHighWaterMark ( 2 );
+  BOOST_CHECK_EQUAL ( c->getBufferPoolHighWaterMark() , uint32_t ( 2 ) );
+  c->resetBufferPoolStatistics();
+
+  std::vector<uint32_t> xx ( N );
+  for ( size_t i=0; i!= N; ++i )
+  {
+    xx[i] = static_cast<uint32_t> ( rand() );
+  }
+
+  c->writeBlock ( addr, xx );
+  ValVector< uint32_t > mem = c->readBlock ( addr, N );
+  c->dispatch();
+  BOOST_CHECK ( mem.valid() );
+  BOOST_CHECK ( std::equal ( mem.begin() , mem.end() , xx.begin() ) );
+
+  ClientInterface::BufferPoolStatistics stats = c->getBufferPoolStatistics();
+  BOOST_CHECK ( stats.hits + stats.misses > 2 );
+  BOOST_CHECK ( stats.trimmed > 0 );
+  BOOST_CHECK ( stats.size <= 2 );
+  BOOST_CHECK ( stats.peakInUse >= 1 );
+  BOOST_CHECK_EQUAL ( stats.inUse , uint32_t ( 0 ) );
+
+  // With no explicit high-water mark, the pool retains as many buffers as were in use at the same time
+  c->setBufferPoolHighWaterMark ( 0 );
+  BOOST_CHECK_EQUAL ( c->getBufferPoolHighWaterMark() , std::max ( uint32_t ( 3 ) , stats.peakInUse ) );
+}
+)
+
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(RawClientTestSuite, mem_write_by_reference_read, DummyHardwareFixture,
+{
+  const uint32_t N =1024*1024/4;
+  HwInterface hw = getHwInterface();
+  ClientInterface* c = &hw.getClient();
+  std::vector<uint32_t> xx;
+  boost::shared_ptr< std::vector<uint32_t> > yy ( new std::vector<uint32_t>() );
+
+  for ( size_t i=0; i!= N; ++i )
+  {
+    xx.push_back ( static_cast<uint32_t> ( rand() ) );
+    yy->push_back ( static_cast<uint32_t> ( rand() ) );
+  }
+
+  const std::vector<uint32_t> yyCopy ( *yy );
+  uint32_t addr = hw.getNode ( "LARGE_MEM" ).getAddress();
+  ValHeader xxHeader = c->writeBlock ( addr, & ( xx.at ( 0 ) ), N );
+  ValHeader yyHeader = c->writeBlock ( addr + N, boost::shared_ptr< const std::vector<uint32_t> > ( yy ) );
+  // The client must keep the shared buffer alive until it has been sent
+  yy.reset();
+  ValVector< uint32_t > mem = c->readBlock ( addr, 2 * N );
+  BOOST_CHECK ( !xxHeader.valid() );
+  BOOST_CHECK ( !yyHeader.valid() );
+  c->dispatch();
+  BOOST_CHECK ( xxHeader.valid() );
+  BOOST_CHECK ( yyHeader.valid() );
+  BOOST_CHECK ( mem.valid() );
+  BOOST_CHECK_EQUAL ( mem.size(), 2 * N );
+  BOOST_CHECK ( std::equal ( xx.begin(), xx.end(), mem.begin() ) );
+  BOOST_CHECK ( std::equal ( yyCopy.begin(), yyCopy.end(), mem.begin() + N ) );
+
+  BOOST_CHECK_THROW ( c->writeBlock ( addr, boost::shared_ptr< const std::vector<uint32_t> >() ), uhal::exception::NullBufferException );
+}
+)
+
+
 UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(RawClientTestSuite, mem_rmw_bits, DummyHardwareFixture,
 {
   HwInterface hw = getHwInterface();
@@ -33,6 +33,8 @@
 */
 
 #include "uhal/uhal.hpp"
+#include "uhal/ProtocolIPbus.hpp"
+#include "uhal/ProtocolUDP.hpp"
 
 #include "uhal/tests/definitions.hpp"
 #include "uhal/tests/fixtures.hpp"
@@ -102,6 +104,44 @@ UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(SingleReadWriteTestSuite, on_the_fly_connect
 )
 
 
+typedef UDP< IPbus< 2 , 0 > > IPbus2UdpClient;
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(SingleReadWriteTestSuite, busy_poll_write_read, DummyHardwareFixture,
+{
+  // Only the UDP and TCP clients run on the transport reactor
+  if ( deviceType != IPBUS_2_0_PCIE )
+  {
+    std::string address_file;
+    {
+      boost::filesystem::path conn_fn ( connectionFileURI );
+      boost::filesystem::path fn ( "dummy_address.xml" );
+      address_file = ( conn_fn.parent_path() /fn ).string();
+    }
+    std::string uri = getHwInterface().uri();
+    uri += ( uri.find ( '?' ) == std::string::npos ? "?" : "&" );
+    HwInterface hw=ConnectionManager::getDevice ( "test_device_id", uri + "busy_poll=1000", address_file );
+    hw.setTimeoutPeriod(timeout);
+
+    if ( deviceType == IPBUS_2_0_UDP )
+    {
+      BOOST_CHECK_EQUAL ( dynamic_cast< IPbus2UdpClient& > ( hw.getClient() ).getBusyPollBudget() , 1000u );
+    }
+
+    // Each dispatch is completed by this thread busy-polling the reactor, or by the reactor's own threads once the spin budget runs out
+    for ( size_t i = 0 ; i != 100 ; ++i )
+    {
+      uint32_t x = static_cast<uint32_t> ( rand() );
+      hw.getNode ( "REG" ).write ( x );
+      ValWord< uint32_t > mem = hw.getNode ( "REG" ).read();
+      BOOST_CHECK_NO_THROW ( hw.dispatch() );
+      BOOST_REQUIRE ( mem.valid() );
+      BOOST_CHECK_EQUAL ( mem.value(), x );
+    }
+  }
+}
+)
+
+
 UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(SingleReadWriteTestSuite, search_device_id, MinimalFixture,
 {
   ConnectionManager manager (connectionFileURI);
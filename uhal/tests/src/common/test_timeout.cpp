@@ -44,8 +44,10 @@
 #include "uhal/tests/tools.hpp"
 
 #include <boost/chrono/chrono_io.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/test/unit_test.hpp>
 
+#include <algorithm>
 #include <iostream>
 #include <cstdlib>
 #include <typeinfo>
@@ -79,5 +81,226 @@ UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(TimeoutTestSuite, check_timeout, DummyHardwa
 )
 
 
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(TimeoutTestSuite, buffer_pool_survives_timeout, DummyHardwareFixture,
+{
+  hwRunner.setReplyDelay( boost::chrono::milliseconds(timeout) + boost::chrono::seconds(1) );
+  HwInterface hw = getHwInterface();
+  ClientInterface& c = hw.getClient();
+  c.setBufferPoolPreallocation ( 4 );
+  const uint64_t allocated = c.getBufferPoolStatistics().allocated;
+
+  BOOST_CHECK_THROW ( { hw.getNode ( "REG" ).read();  hw.dispatch(); } , uhal::exception::ClientTimeout );
+
+  const boost::chrono::milliseconds sleepDuration = boost::chrono::milliseconds(timeout) + boost::chrono::seconds(1);
+  BOOST_TEST_MESSAGE("Sleeping for " << sleepDuration << " seconds to allow DummyHardware to clear itself");
+  boost::this_thread::sleep_for(sleepDuration);
+
+  // The buffers in flight at the time of the timeout are returned to the pool, so recovery needs no new allocations
+  ClientInterface::BufferPoolStatistics stats = c.getBufferPoolStatistics();
+  BOOST_CHECK_EQUAL ( stats.inUse , uint32_t ( 0 ) );
+  BOOST_CHECK ( stats.size >= 1 );
+
+  hw.getNode ( "REG" ).write ( 42 );
+  BOOST_CHECK_EQUAL ( c.getBufferPoolStatistics().hits , stats.hits + 1 );
+  BOOST_CHECK_EQUAL ( c.getBufferPoolStatistics().allocated , allocated );
+}
+)
+
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(TimeoutTestSuite, recover_from_lost_packets, DummyHardwareFixture,
+{
+  // The status/resend recovery mechanism is only implemented by the direct IPbus 2.0 UDP client
+  if ( deviceType == IPBUS_2_0_UDP )
+  {
+    std::string address_file;
+    {
+      boost::filesystem::path conn_fn ( connectionFileURI );
+      boost::filesystem::path fn ( "dummy_address.xml" );
+      address_file = ( conn_fn.parent_path() /fn ).string();
+    }
+    HwInterface hw = ConnectionManager::getDevice ( "test_device_id", getHwInterface().uri() + "?max_retries=3", address_file );
+    hw.setTimeoutPeriod(timeout);
+
+    uint32_t x = static_cast<uint32_t> ( rand() );
+    hw.getNode ( "REG" ).write ( x );
+    BOOST_CHECK_NO_THROW ( hw.dispatch() );
+
+    // Lost request: the packet is sent again
+    hwRunner.dropRequests ( 1 );
+    ValWord<uint32_t> y = hw.getNode ( "REG" ).read();
+    BOOST_CHECK_NO_THROW ( hw.dispatch() );
+    BOOST_CHECK ( y.valid() );
+    BOOST_CHECK_EQUAL ( y.value() , x );
+
+    // Lost reply: the target is asked to re-send it, rather than executing the write a second time
+    hwRunner.dropReplies ( 1 );
+    ValWord<uint32_t> z = hw.getNode ( "REG" ).read();
+    hw.getNode ( "REG" ).write ( x + 1 );
+    ValWord<uint32_t> w = hw.getNode ( "REG" ).read();
+    BOOST_CHECK_NO_THROW ( hw.dispatch() );
+    BOOST_CHECK ( z.valid() && w.valid() );
+    BOOST_CHECK_EQUAL ( z.value() , x );
+    BOOST_CHECK_EQUAL ( w.value() , x + 1 );
+
+    // Late reply: the reply arrives after the status request was sent, and the status reply is discarded at the next dispatch
+    hwRunner.setReplyDelay( boost::chrono::milliseconds(timeout) + boost::chrono::milliseconds(timeout / 2) );
+    ValWord<uint32_t> v = hw.getNode ( "REG" ).read();
+    BOOST_CHECK_NO_THROW ( hw.dispatch() );
+    BOOST_CHECK_EQUAL ( v.value() , x + 1 );
+    v = hw.getNode ( "REG" ).read();
+    BOOST_CHECK_NO_THROW ( hw.dispatch() );
+    BOOST_CHECK_EQUAL ( v.value() , x + 1 );
+
+    // Too many lost packets: the dispatch fails with a timeout, and the client can be used again afterwards
+    hwRunner.dropRequests ( 4 );
+    hw.getNode ( "REG" ).read();
+    BOOST_CHECK_THROW ( hw.dispatch() , uhal::exception::UdpTimeout );
+    v = hw.getNode ( "REG" ).read();
+    BOOST_CHECK_NO_THROW ( hw.dispatch() );
+    BOOST_CHECK_EQUAL ( v.value() , x + 1 );
+  }
+}
+)
+
+
+typedef UDP< IPbus< 2 , 0 > > IPbus2UdpClient;
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(TimeoutTestSuite, adaptive_window, DummyHardwareFixture,
+{
+  // Only the IPbus 2.0 UDP client keeps several packets in flight directly
+  if ( deviceType == IPBUS_2_0_UDP )
+  {
+    std::string address_file;
+    {
+      boost::filesystem::path conn_fn ( connectionFileURI );
+      boost::filesystem::path fn ( "dummy_address.xml" );
+      address_file = ( conn_fn.parent_path() /fn ).string();
+    }
+    HwInterface hw = ConnectionManager::getDevice ( "test_device_id", getHwInterface().uri() + "?max_retries=3", address_file );
+    hw.setTimeoutPeriod(timeout);
+    IPbus2UdpClient& c = dynamic_cast< IPbus2UdpClient& > ( hw.getClient() );
+
+    const size_t N = 10 * 1024 / 4;
+    std::vector<uint32_t> xx ( N , 0xdeadbeef );
+    hw.getNode ( "LARGE_MEM" ).writeBlock ( xx );
+    BOOST_CHECK_NO_THROW ( hw.dispatch() );
+
+    // Without packet loss, the window stays at the number of buffers in the target
+    IPbus2UdpClient::CongestionStatistics stats = c.getCongestionStatistics();
+    BOOST_CHECK ( stats.windowLimit > 2 );
+    BOOST_CHECK_EQUAL ( stats.window , stats.windowLimit );
+    BOOST_CHECK_EQUAL ( stats.windowDecreases , 0u );
+    BOOST_CHECK ( stats.roundTripTimeSamples > 0 );
+    BOOST_CHECK ( stats.smoothedRoundTripTime > 0 );
+
+    // A timeout halves the window
+    hwRunner.dropReplies ( 1 );
+    hw.getNode ( "REG" ).read();
+    BOOST_CHECK_NO_THROW ( hw.dispatch() );
+    stats = c.getCongestionStatistics();
+    BOOST_CHECK_EQUAL ( stats.windowDecreases , 1u );
+    BOOST_CHECK_EQUAL ( stats.window , std::max ( stats.windowLimit / 2 , 1u ) );
+
+    // ... and it then grows back by about one packet per window of replies
+    for ( size_t i = 0 ; ( i != 10 ) && ( stats.window != stats.windowLimit ) ; ++i )
+    {
+      ValVector< uint32_t > mem = hw.getNode ( "LARGE_MEM" ).readBlock ( N );
+      BOOST_CHECK_NO_THROW ( hw.dispatch() );
+      BOOST_CHECK ( std::equal ( mem.begin() , mem.end() , xx.begin() ) );
+      stats = c.getCongestionStatistics();
+    }
+    BOOST_CHECK_EQUAL ( stats.window , stats.windowLimit );
+  }
+}
+)
+
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(TimeoutTestSuite, reordered_replies, DummyHardwareFixture,
+{
+  // Only the IPbus 2.0 UDP client numbers its packets, and so can match replies which arrive out of order
+  if ( deviceType == IPBUS_2_0_UDP )
+  {
+    std::string address_file;
+    {
+      boost::filesystem::path conn_fn ( connectionFileURI );
+      boost::filesystem::path fn ( "dummy_address.xml" );
+      address_file = ( conn_fn.parent_path() /fn ).string();
+    }
+
+    // Packets are matched by the ID of their first transaction, or by their packet ID when recovery is enabled
+    std::vector<std::string> suffixes ( 1 , "" );
+    suffixes.push_back ( "?max_retries=3" );
+
+    for ( size_t i = 0 ; i != suffixes.size() ; ++i )
+    {
+      HwInterface hw = ConnectionManager::getDevice ( "test_device_id", getHwInterface().uri() + suffixes[i], address_file );
+      hw.setTimeoutPeriod(timeout);
+      IPbus2UdpClient& c = dynamic_cast< IPbus2UdpClient& > ( hw.getClient() );
+
+      const size_t N = 10 * 1024 / 4;
+      std::vector<uint32_t> xx;
+      for ( size_t j = 0 ; j != N ; ++j )
+        xx.push_back ( static_cast<uint32_t> ( rand() ) );
+      hw.getNode ( "LARGE_MEM" ).writeBlock ( xx );
+      BOOST_CHECK_NO_THROW ( hw.dispatch() );
+
+      // Each held-back reply arrives after the reply to the following packet; both are accepted, without any timeout
+      hwRunner.overtakeReplies ( 3 );
+      ValVector< uint32_t > mem = hw.getNode ( "LARGE_MEM" ).readBlock ( N );
+      BOOST_CHECK_NO_THROW ( hw.dispatch() );
+      BOOST_REQUIRE ( mem.valid() );
+      BOOST_CHECK ( std::equal ( mem.begin() , mem.end() , xx.begin() ) );
+
+      IPbus2UdpClient::CongestionStatistics stats = c.getCongestionStatistics();
+      BOOST_CHECK_EQUAL ( stats.reorderedReplies , 3u );
+      BOOST_CHECK_EQUAL ( stats.windowDecreases , 0u );
+    }
+  }
+}
+)
+
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(TimeoutTestSuite, batched_datagrams, DummyHardwareFixture,
+{
+  // Only the IPbus 2.0 UDP client keeps enough packets in flight for them to be sent, and their replies received, several at a time
+  if ( deviceType == IPBUS_2_0_UDP )
+  {
+    std::string address_file;
+    {
+      boost::filesystem::path conn_fn ( connectionFileURI );
+      boost::filesystem::path fn ( "dummy_address.xml" );
+      address_file = ( conn_fn.parent_path() /fn ).string();
+    }
+
+    // Small packets, so that each block transfer is split over many packets
+    HwInterface hw = ConnectionManager::getDevice ( "test_device_id", getHwInterface().uri() + "?max_packet_size=64&max_retries=3", address_file );
+    hw.setTimeoutPeriod(timeout);
+    IPbus2UdpClient& c = dynamic_cast< IPbus2UdpClient& > ( hw.getClient() );
+
+    const size_t N = 10 * 1024 / 4;
+    std::vector<uint32_t> xx;
+    for ( size_t i = 0 ; i != N ; ++i )
+      xx.push_back ( static_cast<uint32_t> ( rand() ) );
+
+    for ( size_t i = 0 ; i != 10 ; ++i )
+    {
+      hw.getNode ( "LARGE_MEM" ).writeBlock ( xx );
+      ValVector< uint32_t > mem = hw.getNode ( "LARGE_MEM" ).readBlock ( N );
+      BOOST_CHECK_NO_THROW ( hw.dispatch() );
+      BOOST_REQUIRE ( mem.valid() );
+      BOOST_CHECK ( std::equal ( mem.begin() , mem.end() , xx.begin() ) );
+    }
+
+    // Batching must not disturb the matching of replies to their packets
+    IPbus2UdpClient::CongestionStatistics stats = c.getCongestionStatistics();
+    BOOST_CHECK_EQUAL ( stats.windowDecreases , 0u );
+#ifdef __linux__
+    BOOST_CHECK ( ( stats.batchedPackets + stats.batchedReplies ) > 0 );
+#endif
+  }
+}
+)
+
+
 } // end ns tests
 } // end ns uhal
@@ -0,0 +1,165 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Tom Williams, Rutherford Appleton Laboratory, Oxfordshire
+      email: tom.williams <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+#include "uhal/uhal.hpp"
+
+#include "uhal/tests/definitions.hpp"
+#include "uhal/tests/fixtures.hpp"
+#include "uhal/tests/tools.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <vector>
+
+
+// Long enough that the program is split over several packets
+#define N_WORDS uint32_t(20000)
+#define N_REPLAYS 5
+
+
+namespace uhal {
+namespace tests {
+
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(TransactionProgramTestSuite, replay_write_read, DummyHardwareFixture,
+{
+  HwInterface hw = getHwInterface();
+  ClientInterface& c = hw.getClient();
+  const uint32_t reg_addr = hw.getNode ( "REG" ).getAddress();
+  const uint32_t mem_addr = hw.getNode ( "LARGE_MEM" ).getAddress();
+
+  TransactionProgram program;
+  const uint32_t reg_write = program.write ( reg_addr , 0 );
+  const uint32_t field_write = program.write ( reg_addr , 0 , 0xFF00 );
+  const uint32_t mem_write = program.writeBlock ( mem_addr , std::vector<uint32_t> ( N_WORDS , 0 ) );
+  const uint32_t reg_read = program.read ( reg_addr );
+  const uint32_t field_read = program.read ( reg_addr , 0xFF00 );
+  const uint32_t mem_read = program.readBlock ( mem_addr , N_WORDS );
+
+  BOOST_CHECK_EQUAL ( program.writeSlots() , N_WORDS + 2 );
+  BOOST_CHECK_EQUAL ( program.resultSlots() , N_WORDS + 2 );
+  BOOST_CHECK ( !program.valid() );
+  BOOST_CHECK_THROW ( program.value ( reg_read ) , uhal::exception::NonValidatedMemory );
+
+  for ( size_t i = 0; i != N_REPLAYS; ++i )
+  {
+    const uint32_t x = static_cast<uint32_t> ( rand() ) & 0xFFFF00FF;
+    const uint32_t y = static_cast<uint32_t> ( rand() ) & 0xFF;
+    std::vector<uint32_t> xx;
+
+    program.setWriteValue ( reg_write , x );
+    program.setWriteValue ( field_write , y );
+
+    for ( size_t j = 0; j != N_WORDS; ++j )
+    {
+      xx.push_back ( static_cast<uint32_t> ( rand() ) );
+      program.setWriteValue ( mem_write + j , xx.back() );
+    }
+
+    ValHeader reply = c.replay ( program );
+    BOOST_CHECK ( !reply.valid() );
+    c.dispatch();
+
+    BOOST_REQUIRE ( reply.valid() );
+    BOOST_REQUIRE ( program.valid() );
+    BOOST_CHECK_EQUAL ( program.value ( reg_read ) , x | ( y << 8 ) );
+    BOOST_CHECK_EQUAL ( program.value ( field_read ) , y );
+    BOOST_CHECK ( std::equal ( xx.begin() , xx.end() , program.values().begin() + mem_read ) );
+  }
+}
+)
+
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(TransactionProgramTestSuite, replay_rmw, DummyHardwareFixture,
+{
+  HwInterface hw = getHwInterface();
+  ClientInterface& c = hw.getClient();
+  const uint32_t addr = hw.getNode ( "REG" ).getAddress();
+  const uint32_t x = static_cast<uint32_t> ( rand() );
+
+  c.write ( addr , x );
+  c.dispatch();
+
+  TransactionProgram program;
+  const uint32_t sum = program.rmw_sum ( addr , 1 );
+  // A read-modify-write which leaves the register unchanged, so returns the same value for all protocol versions
+  const uint32_t bits = program.rmw_bits ( addr , 0xFFFFFFFF , 0x0 );
+  const uint32_t reg = program.read ( addr );
+
+  // IPbus 1.3 returns the modified value, IPbus 2.0 the original value
+  const bool ipbus1_3 = ( hw.uri().find ( "-1.3://" ) != std::string::npos );
+  uint32_t expected = x;
+
+  for ( size_t i = 0; i != N_REPLAYS; ++i )
+  {
+    c.replay ( program );
+    // Transactions queued after a replay are unaffected by it
+    ValWord<uint32_t> reg2 = c.read ( addr );
+    c.dispatch();
+
+    BOOST_CHECK_EQUAL ( program.value ( sum ) , ipbus1_3 ? expected + 1 : expected );
+    ++expected;
+    BOOST_CHECK_EQUAL ( program.value ( bits ) , expected );
+    BOOST_CHECK_EQUAL ( program.value ( reg ) , expected );
+    BOOST_CHECK_EQUAL ( reg2.value() , expected );
+  }
+}
+)
+
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(TransactionProgramTestSuite, slot_access_violations, DummyHardwareFixture,
+{
+  HwInterface hw = getHwInterface();
+  const uint32_t addr = hw.getNode ( "REG" ).getAddress();
+
+  TransactionProgram program;
+  const uint32_t field_write = program.write ( addr , 0x1 , 0xF0 );
+  program.read ( addr );
+
+  BOOST_CHECK_THROW ( program.write ( addr , 0x10 , 0xF0 ) , uhal::exception::BitsSetWhichAreForbiddenByBitMask );
+  BOOST_CHECK_THROW ( program.setWriteValue ( field_write , 0x10 ) , uhal::exception::BitsSetWhichAreForbiddenByBitMask );
+  BOOST_CHECK_EQUAL ( program.getWriteValue ( field_write ) , uint32_t ( 0x1 ) );
+  BOOST_CHECK_THROW ( program.setWriteValue ( 1 , 0x1 ) , uhal::exception::TransactionProgramSlotOutOfRange );
+
+  hw.getClient().replay ( program );
+  hw.dispatch();
+  BOOST_CHECK_EQUAL ( program.value ( 0 ) & 0xF0 , uint32_t ( 0x10 ) );
+  BOOST_CHECK_THROW ( program.value ( 1 ) , uhal::exception::TransactionProgramSlotOutOfRange );
+}
+)
+
+
+} // end ns tests
+} // end ns uhal
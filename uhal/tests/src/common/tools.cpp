@@ -59,6 +59,26 @@ void DummyHardwareRunner::setReplyDelay(const boost::chrono::microseconds& aDela
   mHw->setReplyDelay(aDelay);
 }
 
+void DummyHardwareRunner::dropRequests(const uint32_t& aCount)
+{
+  mHw->dropRequests(aCount);
+}
+
+void DummyHardwareRunner::dropReplies(const uint32_t& aCount)
+{
+  mHw->dropReplies(aCount);
+}
+
+void DummyHardwareRunner::overtakeReplies(const uint32_t& aCount)
+{
+  mHw->overtakeReplies(aCount);
+}
+
+void DummyHardwareRunner::failReplies(const uint32_t& aCount)
+{
+  mHw->failReplies(aCount);
+}
+
 
 double measureReadLatency(ClientInterface& aClient, uint32_t aBaseAddr, uint32_t aDepth, size_t aNrIterations, bool aDispatchEachIteration, bool aVerbose)
 {
@@ -104,6 +124,36 @@ double measureReadLatency(const std::vector<ClientInterface*>& aClients, uint32_
 }
 
 
+double measureSingleReadLatency(const std::vector<ClientInterface*>& aClients, uint32_t aBaseAddr, uint32_t aNrReadsPerDispatch, size_t aNrIterations, bool aVerbose)
+{
+  typedef std::vector<ClientInterface*>::const_iterator ClientIterator_t;
+  Timer myTimer;
+
+  for ( unsigned i = 0; i < aNrIterations ; ++i )
+  {
+    if ( aVerbose )
+    {
+      std::cout << "Iteration " << i << std::endl;
+    }
+
+    for (ClientIterator_t lIt = aClients.begin(); lIt != aClients.end(); lIt++)
+    {
+      for ( uint32_t j = 0; j < aNrReadsPerDispatch ; ++j )
+      {
+        (*lIt)->read ( aBaseAddr );
+      }
+    }
+
+    for (ClientIterator_t lIt = aClients.begin(); lIt != aClients.end(); lIt++)
+    {
+      (*lIt)->dispatch();
+    }
+  }
+
+  return myTimer.elapsedSeconds();
+}
+
+
 double measureWriteLatency(ClientInterface& aClient, uint32_t aBaseAddr, uint32_t aDepth, size_t aNrIterations, bool aDispatchEachIteration, bool aVerbose)
 {
   return measureWriteLatency(std::vector<ClientInterface*>(1, &aClient), aBaseAddr, aDepth, aNrIterations, aDispatchEachIteration, aVerbose);
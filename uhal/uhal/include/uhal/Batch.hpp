@@ -0,0 +1,253 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+
+
+/**
+	@file
+*/
+
+#ifndef _uhal_Batch_hpp_
+#define _uhal_Batch_hpp_
+
+
+#include <stdint.h>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include "uhal/definitions.hpp"
+#include "uhal/ValMem.hpp"
+
+
+namespace uhal
+{
+  class ClientInterface;
+  class IPbusCore;
+  class Node;
+
+
+  /**
+    A descriptor of a single register access within a batch.
+    Descriptors are created through the static factory functions, which check node permissions and write masks up front, so that a batch is either queued in full or not at all.
+  */
+  class BatchOperation
+  {
+      friend class ClientInterface;
+      friend class IPbusCore;
+
+    public:
+      /**
+        Describe a read of a single, unmasked word
+        @param aAddr the address of the register to read
+        @return the operation descriptor
+      */
+      static BatchOperation read ( const uint32_t& aAddr );
+
+      /**
+        Describe a read of a single, masked word
+        @param aAddr the address of the register to read
+        @param aMask the mask to apply to the value after reading
+        @return the operation descriptor
+      */
+      static BatchOperation read ( const uint32_t& aAddr , const uint32_t& aMask );
+
+      /**
+        Describe a read of the register, or sub-field of a register, associated with a node
+        @param aNode the node to read
+        @return the operation descriptor
+      */
+      static BatchOperation read ( const Node& aNode );
+
+      /**
+        Describe a write of a single, unmasked word
+        @param aAddr the address of the register to write
+        @param aValue the value to write to the register
+        @return the operation descriptor
+      */
+      static BatchOperation write ( const uint32_t& aAddr , const uint32_t& aValue );
+
+      /**
+        Describe a write of a single, masked word; as with ClientInterface::write, this is performed as a read-modify-write
+        @param aAddr the address of the register to write
+        @param aValue the value to write to the register
+        @param aMask the mask to apply to the value
+        @return the operation descriptor
+      */
+      static BatchOperation write ( const uint32_t& aAddr , const uint32_t& aValue , const uint32_t& aMask );
+
+      /**
+        Describe a write to the register, or sub-field of a register, associated with a node
+        @param aNode the node to write
+        @param aValue the value to write
+        @return the operation descriptor
+      */
+      static BatchOperation write ( const Node& aNode , const uint32_t& aValue );
+
+      /**
+        Describe a read-modify-write of the bits of a register
+        @param aAddr the address of the register to read, modify, write
+        @param aANDterm the AND-term to apply to existing value in the target register
+        @param aORterm the OR-term to apply to existing value in the target register
+        @return the operation descriptor
+      */
+      static BatchOperation rmw_bits ( const uint32_t& aAddr , const uint32_t& aANDterm , const uint32_t& aORterm );
+
+      /**
+        Describe a read-modify-write of the bits of the register associated with a node
+        @param aNode the node to read, modify, write
+        @param aANDterm the AND-term to apply to existing value in the target register
+        @param aORterm the OR-term to apply to existing value in the target register
+        @return the operation descriptor
+      */
+      static BatchOperation rmw_bits ( const Node& aNode , const uint32_t& aANDterm , const uint32_t& aORterm );
+
+      /**
+        Describe a read-modify-write sum on a register
+        @param aAddr the address of the register to read, modify, write
+        @param aAddend the addend to add to the existing value in the target register
+        @return the operation descriptor
+      */
+      static BatchOperation rmw_sum ( const uint32_t& aAddr , const int32_t& aAddend );
+
+      /**
+        Describe a read-modify-write sum on the register associated with a node
+        @param aNode the node to read, modify, write
+        @param aAddend the addend to add to the existing value in the target register
+        @return the operation descriptor
+      */
+      static BatchOperation rmw_sum ( const Node& aNode , const int32_t& aAddend );
+
+    private:
+      //! The types of transaction which an operation is queued as
+      enum OperationType
+      {
+        READ,
+        WRITE,
+        RMW_BITS,
+        RMW_SUM
+      };
+
+      /**
+        Constructor
+        @param aType the type of transaction
+        @param aAddr the address of the register
+        @param aTerm1 the value to write, the AND-term or the addend
+        @param aTerm2 the OR-term
+        @param aMask the mask to apply to the returned value
+      */
+      BatchOperation ( const OperationType& aType , const uint32_t& aAddr , const uint32_t& aTerm1 , const uint32_t& aTerm2 , const uint32_t& aMask );
+
+      //! The type of transaction
+      OperationType mType;
+      //! The address of the register
+      uint32_t mAddr;
+      //! The value to write, the AND-term or the addend
+      uint32_t mTerm1;
+      //! The OR-term
+      uint32_t mTerm2;
+      //! The mask to apply to the returned value
+      uint32_t mMask;
+  };
+
+
+  /**
+    The results of a batch, holding one word per operation in a single contiguous block.
+    For reads, the entry is the value read with the mask of the operation applied; for read-modify-writes (including masked writes), it is the value returned by the transaction; for unmasked writes, it is zero.
+    Copies share the same underlying memory.
+  */
+  class BatchResult
+  {
+      friend class ClientInterface;
+
+    public:
+      //! Default constructor, giving an empty, invalid result
+      BatchResult();
+
+      /**
+        Return whether the replies to every operation in the batch have been received and validated
+        @return whether the results are valid
+      */
+      bool valid();
+
+      /**
+        Return the number of operations in the batch
+        @return the number of operations in the batch
+      */
+      std::size_t size() const;
+
+      /**
+        If the results have been validated, return the result of an operation without bounds-checking
+        @param aIndex the index of the operation in the batch
+        @return the result of the operation
+      */
+      uint32_t operator[] ( std::size_t aIndex ) const;
+
+      /**
+        If the results have been validated, return the result of an operation
+        @param aIndex the index of the operation in the batch
+        @return the result of the operation
+      */
+      uint32_t at ( std::size_t aIndex ) const;
+
+      /**
+        If the results have been validated, return a copy of the results of all operations
+        @return the results of all operations in the batch
+      */
+      std::vector< uint32_t > value() const;
+
+    private:
+      /**
+        Constructor
+        @param aValues the validated memory into which the unmasked replies are written
+        @param aMasks the mask of each operation, or NULL if no operation is masked
+      */
+      BatchResult ( const ValVector< uint32_t >& aValues , const boost::shared_ptr< const std::vector< uint32_t > >& aMasks );
+
+      /**
+        Apply the mask of an operation to its unmasked reply
+        @param aIndex the index of the operation in the batch
+        @param aValue the unmasked reply
+        @return the masked result
+      */
+      uint32_t applyMask ( std::size_t aIndex , const uint32_t& aValue ) const;
+
+      //! The unmasked replies, one per operation
+      ValVector< uint32_t > mValues;
+      //! The mask of each operation; NULL if no operation in the batch is masked
+      boost::shared_ptr< const std::vector< uint32_t > > mMasks;
+  };
+
+}
+
+
+#endif
@@ -40,11 +40,14 @@
 #define _uhal_Buffers_hpp_
 
 
-#include <deque>
 #include <stdint.h>         // for uint32_t, uint8_t
 #include <utility>          // for pair
 #include <vector>           // for vector
 
+#include <boost/chrono/system_clocks.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "uhal/ClientMetrics.hpp"
 #include "uhal/ValMem.hpp"
 
 
@@ -59,9 +62,10 @@ namespace uhal
       /**
       	Constructor
       	@param aMaxSendSize The size of the buffer (in bytes) in the target device for receiving IPbus data packets from uhal.
-      	@warning Used to set internal buffer size, not for checking
+      	@param aMaxReplySize The size of the buffer (in bytes) in the target device for sending IPbus reply packets to uhal.
+      	@warning Used to set internal buffer sizes, not for checking
       */
-      Buffers ( const uint32_t& aMaxSendSize = 65536 );
+      Buffers ( const uint32_t& aMaxSendSize = 65536 , const uint32_t& aMaxReplySize = 65536 );
 
       //! Destructor
       virtual ~Buffers();
@@ -78,6 +82,12 @@ namespace uhal
       */
       const uint32_t& replyCounter();
 
+      /**
+        Get the size of the send buffer, i.e. the maximum send size with which these buffers were constructed
+        @return the size of the send buffer in bytes
+      */
+      uint32_t sendCapacity() const;
+
       /**
       	Helper function to copy an object to the send buffer
       	@param aPtr a pointer to an object to be copied
@@ -102,6 +112,14 @@ namespace uhal
       */
       uint8_t* send ( const uint8_t* aPtr , const uint32_t& aSize );
 
+      /**
+        Helper function to add a block of memory to the outgoing packet without copying it to the send buffer; the corresponding bytes of the send buffer are reserved but left unwritten
+        @param aPtr a pointer to the start of the memory to be sent
+        @param aSize the number of bytes to be sent
+        @warning The memory must remain valid until the packet has been transmitted
+      */
+      void sendByReference ( const uint8_t* aPtr , const uint32_t& aSize );
+
       /**
       	Helper function to add a destination object to the reply queue
       	@param aPtr a pointer to some persistent object which can be written to when the transaction is performed
@@ -141,17 +159,89 @@ namespace uhal
       */
       void add ( const ValVector< uint32_t >& aValMem );
 
+      /**
+        Helper function to associate a block of memory with this buffer so that it is guaranteed to exist until the packet has been transmitted
+        @param aMemory a shared pointer to the memory, typically that passed to sendByReference
+      */
+      void add ( const boost::shared_ptr< const void >& aMemory );
+
       /**
       	Get a pointer to the start of the send buffer
       	@return a pointer to the start of the send buffer
       */
       uint8_t* getSendBuffer();
 
+      /**
+        Get the list of memory blocks which make up the outgoing packet, i.e. the contents of the send buffer interleaved with any memory sent by reference
+        @param aSegments a vector to which the (pointer, size) pairs of the memory blocks are appended
+      */
+      void getSendSegments ( std::vector< std::pair< const uint8_t* , size_t > >& aSegments );
+
       /**
       	Get a reference to the reply queue
       	@return a reference to the reply queue
       */
-      std::deque< std::pair< uint8_t* , uint32_t > >& getReplyBuffer();
+      std::vector< std::pair< uint8_t* , uint32_t > >& getReplyBuffer();
+
+      /**
+        Get a pointer to the start of the reply queue
+        @return a pointer to the first entry in the reply queue
+      */
+      std::pair< uint8_t* , uint32_t >* getReplyBufferBegin();
+
+      /**
+        Get a pointer to the end of the reply queue
+        @return a pointer to one past the last entry in the reply queue
+      */
+      std::pair< uint8_t* , uint32_t >* getReplyBufferEnd();
+
+      /**
+        Record that the transaction most recently queued may be extended by a later access, provided that nothing else is queued into this buffer in the meantime
+        @param aHeader a pointer to the header of the transaction in the send buffer
+        @param aNextAddress the address at which an access must start in order to extend the transaction
+      */
+      void setExtendableTransaction ( uint8_t* aHeader , const uint32_t& aNextAddress );
+
+      /**
+        Get the transaction which can be extended by an access to the given address
+        @param aAddress the address at which the access starts
+        @return a pointer to the header of the transaction in the send buffer, or NULL if the transaction most recently queued cannot be extended by an access to this address
+      */
+      uint32_t* getExtendableTransaction ( const uint32_t& aAddress );
+
+      /**
+        Record that the last word in the send buffer is the value of a single-word write to the given address, which may be overwritten in place provided that nothing else is queued into this buffer in the meantime
+        @param aAddress the address of the register being written
+      */
+      void setPatchableWord ( const uint32_t& aAddress );
+
+      /**
+        Get the value of the single-word write to the given address, if it is the transaction most recently queued
+        @param aAddress the address of the register being written
+        @return a pointer to the value in the send buffer, or NULL if the transaction most recently queued is not a write to this address
+      */
+      uint32_t* getPatchableWord ( const uint32_t& aAddress );
+
+      /**
+        Record that a transaction of a given type was queued into this buffer, so that the round-trip latency of the packet can be attributed to it
+        @param aType the type of transaction
+      */
+      void countTransaction ( const ClientMetrics::TransactionType& aType );
+
+      /**
+        Get the number of transactions of each type queued into this buffer
+        @return a pointer to the counts, indexed by ClientMetrics::TransactionType
+      */
+      const uint32_t* getTransactionCounts() const;
+
+      //! Record the time at which the packet is passed to the transport layer
+      void setDispatchTime();
+
+      /**
+        Get the time at which the packet was passed to the transport layer
+        @return the time at which the packet was passed to the transport layer, or the epoch of the steady clock if it was not recorded
+      */
+      const boost::chrono::steady_clock::time_point& getDispatchTime() const;
 
       //! Helper function to mark all validated memories associated with this buffer as valid
       void validate ();
@@ -167,15 +257,56 @@ namespace uhal
 
       //! The start location of the memory buffer
       std::vector<uint8_t> mSendBuffer;
-      //! The queue of reply destinations
-      std::deque< std::pair< uint8_t* , uint32_t > > mReplyBuffer;
-
-      //! Deque holding validated memories so that they are guaranteed to exist when the transaction is performed
-      std::deque< ValHeader > mValHeaders;
-      //! Deque holding validated memories so that they are guaranteed to exist when the transaction is performed
-      std::deque< ValWord< uint32_t > > mUnsignedValWords;
-      //! Deque holding validated memories so that they are guaranteed to exist when the transaction is performed
-      std::deque< ValVector< uint32_t > > mUnsignedValVectors;
+      //! A block of memory which is sent by reference, and the offset in the send buffer at which it belongs
+      struct SendReference
+      {
+        //! The offset in the send buffer at which the memory belongs
+        uint32_t mOffset;
+        //! A pointer to the start of the memory
+        const uint8_t* mPtr;
+        //! The number of bytes to be sent
+        uint32_t mSize;
+      };
+
+      //! The blocks of memory which are sent by reference, in order of increasing offset
+      std::vector< SendReference > mSendReferences;
+
+      //! Whether the transaction most recently queued may be extended
+      bool mExtendable;
+      //! The offset in the send buffer of the header of the transaction which may be extended
+      uint32_t mExtendableHeaderOffset;
+      //! The address at which an access must start in order to extend the transaction
+      uint32_t mExtendableNextAddress;
+      //! The number of bytes in the send buffer when the transaction was recorded, used to check that nothing has been queued since
+      uint32_t mExtendableSendCounter;
+      //! The number of reply destinations when the transaction was recorded, used to check that nothing has been queued since
+      std::size_t mExtendableReplyCount;
+
+      //! Whether the last word in the send buffer is the value of a write which may be overwritten in place
+      bool mPatchable;
+      //! The address of the register whose value may be overwritten in place
+      uint32_t mPatchableAddress;
+      //! The number of bytes in the send buffer when the write was recorded, used to check that nothing has been queued since
+      uint32_t mPatchableSendCounter;
+      //! The number of reply destinations when the write was recorded, used to check that nothing has been queued since
+      std::size_t mPatchableReplyCount;
+
+      //! The number of transactions of each type queued into this buffer, while metrics are enabled
+      uint32_t mTransactionCounts[ ClientMetrics::NUMBER_OF_TRANSACTION_TYPES ];
+      //! The time at which the packet was passed to the transport layer, while metrics are enabled
+      boost::chrono::steady_clock::time_point mDispatchTime;
+
+      //! The queue of reply destinations; its capacity is reserved up front from the maximum reply size, and is retained when the buffer is cleared, so that it never reallocates
+      std::vector< std::pair< uint8_t* , uint32_t > > mReplyBuffer;
+
+      //! Vector holding validated memories so that they are guaranteed to exist when the transaction is performed
+      std::vector< ValHeader > mValHeaders;
+      //! Vector holding validated memories so that they are guaranteed to exist when the transaction is performed
+      std::vector< ValWord< uint32_t > > mUnsignedValWords;
+      //! Vector holding validated memories so that they are guaranteed to exist when the transaction is performed
+      std::vector< ValVector< uint32_t > > mUnsignedValVectors;
+      //! Vector holding memory sent by reference so that it is guaranteed to exist when the transaction is performed
+      std::vector< boost::shared_ptr< const void > > mSendReferenceOwners;
   };
 
 }
@@ -47,12 +47,22 @@
 #include <utility>
 #include <vector>
 
+#include <boost/atomic.hpp>
+#include <boost/chrono/system_clocks.hpp>
 #include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/future.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/unordered_map.hpp>
 
 #include "uhal/grammars/URI.hpp"
 #include "uhal/log/exception.hpp"
+#include "uhal/Batch.hpp"
+#include "uhal/ClientMetrics.hpp"
 #include "uhal/definitions.hpp"
 #include "uhal/ValMem.hpp"
 
@@ -62,12 +72,16 @@ namespace uhal
   // Forward declaration
   class Buffers;
   class IPbusCore;
+  class TransactionProgram;
 
   namespace exception
   {
     //! Exception class to handle the case where pinging of a client failed.
     UHAL_DEFINE_EXCEPTION_CLASS ( PingFailed , "Exception class to handle the case where pinging of a client failed." )
 
+    //! Exception class to handle the case where the transactions of an asynchronous dispatch were lost, or an unexpected error occurred whilst waiting for their replies.
+    UHAL_DEFINE_EXCEPTION_CLASS ( AsynchronousDispatchFailure , "Exception class to handle the case where the transactions of an asynchronous dispatch were lost, or an unexpected error occurred whilst waiting for their replies." )
+
     //! Exception class to handle the case where a masked write was attempted with a data source which has non-zero bits outside the bit-mask's bounds.
     UHAL_DEFINE_EXCEPTION_CLASS ( BitsSetWhichAreForbiddenByBitMask , "Exception class to handle the case where a masked write was attempted with a data source which has non-zero bits outside the bit-mask's bounds." )
 
@@ -139,6 +153,21 @@ namespace uhal
       //! Method to dispatch all queued transactions, and wait until all corresponding responses have been received
       void dispatch ();
 
+      //! Function called when an asynchronous dispatch completes; its argument is NULL if the dispatch succeeded, and otherwise points to the exception describing the failure, which is only valid for the duration of the call
+      typedef boost::function< void ( exception::exception* ) > DispatchCallback;
+
+      /**
+        Method to dispatch all queued transactions without waiting for the corresponding responses, so that the next batch of transactions can be queued whilst this one is in flight
+        @return a future which becomes ready once all corresponding responses have been received and validated, and which holds the exception if the dispatch failed
+      */
+      boost::shared_future< void > dispatchAsync ();
+
+      /**
+        Method to dispatch all queued transactions without waiting for the corresponding responses, so that the next batch of transactions can be queued whilst this one is in flight
+        @param aCallback function called once all corresponding responses have been received and validated, or the dispatch has failed; for UDP and TCP clients it is called from the client's completion thread, and must not wait on later dispatches from the same client
+      */
+      void dispatchAsync ( const DispatchCallback& aCallback );
+
       /**
       	A method to modify the timeout period for any pending or future transactions
         @warning Protected by user mutex, so only for use from user side (not from client code)
@@ -153,6 +182,77 @@ namespace uhal
       */
       uint64_t getTimeoutPeriod();
 
+      /**
+        Select whether each calling thread queues its transactions into its own buffers, so that several threads sharing this client do not serialise on the user mutex while queuing.
+        In this mode, dispatch only sends the transactions queued by the calling thread.
+        @warning Must only be changed while no transactions are queued
+        @param aThreadLocalQueuing whether transactions should be queued into per-thread buffers
+      */
+      void setThreadLocalQueuing ( const bool& aThreadLocalQueuing );
+
+      /**
+        Return whether each calling thread queues its transactions into its own buffers
+        @return whether each calling thread queues its transactions into its own buffers
+      */
+      bool getThreadLocalQueuing() const;
+
+      //! Statistics on the use of the pool of buffers into which transactions are queued
+      struct BufferPoolStatistics
+      {
+        //! Constructor, zeroing all counters
+        BufferPoolStatistics();
+
+        //! Number of times a buffer was taken from the pool without allocating
+        uint64_t hits;
+        //! Number of times the pool was empty when a buffer was needed, so that new buffers were allocated
+        uint64_t misses;
+        //! Number of buffers allocated
+        uint64_t allocated;
+        //! Number of buffers freed, rather than returned to the pool, since the pool was at its high-water mark
+        uint64_t trimmed;
+        //! Number of buffers currently idle in the pool
+        uint32_t size;
+        //! Largest number of buffers idle in the pool at the same time
+        uint32_t peakSize;
+        //! Number of buffers currently taken from the pool, i.e. being filled or waiting for replies
+        uint32_t inUse;
+        //! Largest number of buffers taken from the pool at the same time
+        uint32_t peakInUse;
+      };
+
+      /**
+        Set the number of buffers allocated each time the pool runs dry, and allocate that many buffers up front if the pool holds fewer
+        @param aCount the number of buffers to allocate at a time (at least one is always allocated)
+      */
+      void setBufferPoolPreallocation ( const uint32_t& aCount );
+
+      /**
+        Return the number of buffers allocated each time the pool runs dry
+        @return the number of buffers allocated each time the pool runs dry
+      */
+      uint32_t getBufferPoolPreallocation();
+
+      /**
+        Set the largest number of idle buffers which the pool retains; buffers returned beyond this are freed.
+        @param aCount the high-water mark, or zero to track the largest number of buffers in use at the same time since the statistics were last reset (but no fewer than the pre-allocation count)
+      */
+      void setBufferPoolHighWaterMark ( const uint32_t& aCount );
+
+      /**
+        Return the largest number of idle buffers which the pool retains
+        @return the high-water mark currently in effect
+      */
+      uint32_t getBufferPoolHighWaterMark();
+
+      /**
+        Return the statistics on the use of the buffer pool
+        @return the statistics on the use of the buffer pool
+      */
+      BufferPoolStatistics getBufferPoolStatistics();
+
+      //! Reset the counters and peaks of the buffer pool statistics to the current state of the pool
+      void resetBufferPoolStatistics();
+
     protected:
       /**
       	A method to retrieve the timeout period currently being used
@@ -186,6 +286,24 @@ namespace uhal
       */
       ValHeader writeBlock ( const uint32_t& aAddr, const std::vector< uint32_t >& aValues, const defs::BlockReadWriteMode& aMode=defs::INCREMENTAL );
 
+      /**
+      	Write a block of data from caller-owned memory to a block of registers or a block-write port, without copying the data into the send buffer
+      	@param aAddr the address of the register to write
+      	@param aValues a pointer to the first of the values to write to the registers or a block-write port
+      	@param aSize the number of values to write
+      	@param aMode whether we are writing to a block of registers (INCREMENTAL) or a block-write port (NON_INCREMENTAL)
+      	@warning The memory must remain valid and unmodified until the returned ValHeader is valid, or until the dispatch has thrown
+      */
+      ValHeader writeBlock ( const uint32_t& aAddr, const uint32_t* aValues, const uint32_t& aSize, const defs::BlockReadWriteMode& aMode=defs::INCREMENTAL );
+
+      /**
+      	Write a block of data from a shared buffer to a block of registers or a block-write port, without copying the data into the send buffer
+      	@param aAddr the address of the register to write
+      	@param aValues the values to write to the registers or a block-write port; the client keeps a reference to them until they have been transmitted
+      	@param aMode whether we are writing to a block of registers (INCREMENTAL) or a block-write port (NON_INCREMENTAL)
+      */
+      ValHeader writeBlock ( const uint32_t& aAddr, const boost::shared_ptr< const std::vector< uint32_t > >& aValues, const defs::BlockReadWriteMode& aMode=defs::INCREMENTAL );
+
       /**
       	Read a single, unmasked, unsigned word
       	@param aAddr the address of the register to read
@@ -210,6 +328,17 @@ namespace uhal
       */
       ValVector< uint32_t > readBlock ( const uint32_t& aAddr, const uint32_t& aSize, const defs::BlockReadWriteMode& aMode=defs::INCREMENTAL );
 
+      /**
+      	Read a block of unsigned data from a block of registers or a block-read port directly into caller-owned memory
+      	@param aAddr the lowest address in the block of registers or the address of the block-read port
+      	@param aSize the number of words to read
+      	@param aDestination a pointer to the memory, of at least aSize words, into which the reply data is to be written
+      	@param aMode whether we are reading from a block of registers (INCREMENTAL) or a block-read port (NON_INCREMENTAL)
+      	@return a Validated Header which becomes valid once the data has been written to the destination memory
+      	@warning The memory must remain valid until the returned ValHeader is valid, or until the dispatch has thrown
+      */
+      ValHeader readBlock ( const uint32_t& aAddr, const uint32_t& aSize, uint32_t* aDestination, const defs::BlockReadWriteMode& aMode=defs::INCREMENTAL );
+
       /**
       	Read the value of a register, apply the AND-term, apply the OR-term, set the register to this new value and return a copy of the original value to the user
       	@param aAddr the address of the register to read, modify, write
@@ -227,6 +356,90 @@ namespace uhal
       */
       ValWord< uint32_t > rmw_sum ( const uint32_t& aAddr , const int32_t& aAddend );
 
+      /**
+        Queue the transactions of a transaction program, encoding them into packets for this client first if it has not already been done
+        @param aProgram the program to be replayed
+        @return a Validated Header which becomes valid once the replies have been written to the result slots of the program
+        @warning The program must not be modified or replayed again until the returned ValHeader is valid, or until the dispatch has thrown
+      */
+      ValHeader replay ( TransactionProgram& aProgram );
+
+      /**
+        Queue a batch of single-word register accesses under a single acquisition of the client's lock, with the replies written into one contiguous block of memory
+        @param aOperations the operations to be queued, in order
+        @return the results of the operations, which become valid once all of the replies have been received
+      */
+      BatchResult batch ( const std::vector< BatchOperation >& aOperations );
+
+      /**
+        Select whether the register at a given address is cacheable, i.e. that its value only changes through this client, so that the last value read from or written to it can be kept in the client's shadow cache.
+        Reads of a cacheable register whose value is known are then answered without a transaction, and masked writes to it become plain writes of the merged value; consecutive masked writes are merged into one write while the first is still the last transaction in the filling buffer.
+        Registers whose node carries the "cacheable" tag in the address table are made cacheable when the HwInterface is created.
+        @param aAddr the address of the register
+        @param aCacheable whether the register is cacheable
+      */
+      void setCacheable ( const uint32_t& aAddr , const bool& aCacheable = true );
+
+      /**
+        Return whether the register at a given address is cacheable
+        @param aAddr the address of the register
+        @return whether the register is cacheable
+      */
+      bool isCacheable ( const uint32_t& aAddr );
+
+      //! Forget the values of all registers in the shadow cache (e.g. after the target has been reset behind the client's back), which remain cacheable; this does not depend on the number of registers
+      void invalidateShadowCache ();
+
+      /**
+        Forget the value of a single register in the shadow cache, which remains cacheable
+        @param aAddr the address of the register
+      */
+      void invalidateShadowCache ( const uint32_t& aAddr );
+
+      //! Statistics on the use of the shadow cache
+      struct ShadowCacheStatistics
+      {
+        //! Constructor, zeroing all counters
+        ShadowCacheStatistics();
+
+        //! Number of reads of cacheable registers answered from the shadow cache
+        uint64_t hits;
+        //! Number of reads of cacheable registers which were sent to the target, since their value was not known
+        uint64_t misses;
+        //! Number of masked writes sent as plain writes of the merged value, rather than as read-modify-writes
+        uint64_t convertedWrites;
+        //! Number of masked writes merged into the write queued just before them
+        uint64_t mergedWrites;
+      };
+
+      /**
+        Return the statistics on the use of the shadow cache
+        @return the statistics on the use of the shadow cache
+      */
+      ShadowCacheStatistics getShadowCacheStatistics();
+
+      /**
+        Select whether the client records transaction-level metrics: the number of transactions and words of each type, the number of packets and bytes, and histograms of the latency of packets and dispatches.
+        The counters are updated without locking, and the clock is read once per packet and once per dispatch.
+        @param aEnabled whether metrics are recorded
+      */
+      void setMetricsEnabled ( const bool& aEnabled );
+
+      /**
+        Return whether the client records transaction-level metrics
+        @return whether the client records transaction-level metrics
+      */
+      bool getMetricsEnabled() const;
+
+      /**
+        Return a snapshot of the transaction-level metrics
+        @return a snapshot of the transaction-level metrics
+      */
+      ClientMetrics getMetrics() const;
+
+      //! Zero the transaction-level metrics
+      void resetMetrics();
+
     protected:
       /**
         Pure virtual function which actually performs the dispatch operation
@@ -237,6 +450,16 @@ namespace uhal
       //! Virtual function to dispatch all buffers and block until all replies are received
       virtual void Flush( );
 
+      /**
+        Return whether Flush may be called from the client's completion thread whilst other threads queue and dispatch transactions, i.e. whether the transport layer does its I/O in its own thread
+        If not, asynchronous dispatches are completed before dispatchAsync returns
+        @return whether Flush may be called from the completion thread
+      */
+      virtual bool supportsAsynchronousFlush();
+
+      //! Wait for all pending asynchronous dispatches to complete and stop the completion thread; must be called by the destructor of any class which supports asynchronous flushes, since the completion thread calls its Flush method
+      void stopCompletionThread();
+
 
       //! Send a byte order transaction
       virtual ValHeader implementBOT( ) = 0;
@@ -256,6 +479,16 @@ namespace uhal
       */
       virtual ValHeader implementWriteBlock ( const uint32_t& aAddr, const std::vector< uint32_t >& aValues, const defs::BlockReadWriteMode& aMode=defs::INCREMENTAL ) = 0;
 
+      /**
+      Write a block of data from caller-owned memory to a block of registers or a block-write port, passing the memory to the transport layer by reference
+      @param aAddr the address of the register to write
+      @param aValues a pointer to the first of the values to write to the registers or a block-write port
+      @param aSize the number of values to write
+      @param aMode whether we are writing to a block of registers (INCREMENTAL) or a block-write port (NON_INCREMENTAL)
+      @param aOwner an optional shared pointer to the memory, which is kept alive by each buffer referencing it
+      */
+      virtual ValHeader implementWriteBlock ( const uint32_t& aAddr, const uint32_t* aValues, const uint32_t& aSize, const defs::BlockReadWriteMode& aMode, const boost::shared_ptr< const void >& aOwner ) = 0;
+
       /**
       Read a single, masked, unsigned word
       @param aAddr the address of the register to read
@@ -273,6 +506,16 @@ namespace uhal
       */
       virtual ValVector< uint32_t > implementReadBlock ( const uint32_t& aAddr, const uint32_t& aSize, const defs::BlockReadWriteMode& aMode=defs::INCREMENTAL ) = 0;
 
+      /**
+      Read a block of unsigned data from a block of registers or a block-read port directly into caller-owned memory
+      @param aAddr the lowest address in the block of registers or the address of the block-read port
+      @param aSize the number of words to read
+      @param aDestination a pointer to the memory into which the reply data is to be written
+      @param aMode whether we are reading from a block of registers (INCREMENTAL) or a block-read port (NON_INCREMENTAL)
+      @return a Validated Header which becomes valid once the data has been written to the destination memory
+      */
+      virtual ValHeader implementReadBlock ( const uint32_t& aAddr, const uint32_t& aSize, uint32_t* aDestination, const defs::BlockReadWriteMode& aMode ) = 0;
+
 
       /**
       Read the value of a register, apply the AND-term, apply the OR-term, set the register to this new value and return a copy of the new value to the user
@@ -291,12 +534,28 @@ namespace uhal
       */
       virtual ValWord< uint32_t > implementRMWsum ( const uint32_t& aAddr , const int32_t& aAddend ) = 0;
 
+      /**
+      Encode the transactions recorded in a transaction program into packets which fit the buffers of this client
+      @param aProgram the program to be encoded
+      */
+      virtual void implementEncode ( TransactionProgram& aProgram ) = 0;
+
+      /**
+      Queue a batch of single-word register accesses
+      @param aOperations the operations to be queued, in order
+      @return a Validated Memory holding one unmasked reply word per operation
+      */
+      virtual ValVector< uint32_t > implementBatch ( const std::vector< BatchOperation >& aOperations ) = 0;
+
       //! Add a preamble to an IPbus buffer
       virtual void preamble ( boost::shared_ptr< Buffers > aBuffers );
 
       //! Return the size of the preamble
       virtual uint32_t getPreambleSize();
 
+      //! Return the size of the reply to the preamble
+      virtual uint32_t getPreambleReplySize();
+
       /**
       	Finalize the buffer before it is transmitted
         @param aBuffers the buffer to finalize before dispatch
@@ -337,18 +596,25 @@ namespace uhal
       	Function which the dispatch calls when the reply is received to check that the headers are as expected
       	@param aSendBufferStart a pointer to the start of the first word of IPbus data which was sent (i.e. with no preamble)
       	@param aSendBufferEnd a pointer to the end of the last word of IPbus data which was sent
-      	@param aReplyStartIt an iterator to the start of the list of memory locations in to which the reply was written
-      	@param aReplyEndIt an iterator to the end (one past last valid entry) of the list of memory locations in to which the reply was written
+      	@param aReplyStartIt a pointer to the start of the array of memory locations in to which the reply was written
+      	@param aReplyEndIt a pointer to the end (one past last valid entry) of the array of memory locations in to which the reply was written
       	@return whether the returned IPbus packet is valid
       */
       virtual  exception::exception* validate ( uint8_t* aSendBufferStart ,
           uint8_t* aSendBufferEnd ,
-          std::deque< std::pair< uint8_t* , uint32_t > >::iterator aReplyStartIt ,
-          std::deque< std::pair< uint8_t* , uint32_t > >::iterator aReplyEndIt ) = 0;
+          std::pair< uint8_t* , uint32_t >* aReplyStartIt ,
+          std::pair< uint8_t* , uint32_t >* aReplyEndIt ) = 0;
 
       //! Function which is called when an exception is thrown
       virtual void dispatchExceptionHandler();
 
+      /**
+        Record that a transaction was queued, if metrics are enabled, attributing it to the currently filling buffer
+        @param aType the type of transaction
+        @param aWords the number of words read or written by the transaction
+      */
+      void countTransaction ( const ClientMetrics::TransactionType& aType , const uint32_t& aWords );
+
       /**
         Function to return a buffer to the buffer pool
         @param aBuffers a shared-pointer to a buffer to be returned to the buffer pool
@@ -370,14 +636,151 @@ namespace uhal
       */
       void returnBufferToPool ( std::deque< std::vector< boost::shared_ptr< Buffers > > >& aBuffers );
 
+      //! Scoped lock on the user mutex, which is not taken when each thread queues its transactions into its own buffers
+      class UserSideLock
+      {
+        public:
+          /**
+            Constructor
+            @param aClient the client whose user mutex is to be locked
+          */
+          UserSideLock ( ClientInterface& aClient );
+
+          //! Destructor, which releases the user mutex if it was taken
+          ~UserSideLock();
+
+        private:
+          UserSideLock ( const UserSideLock& );
+          UserSideLock& operator= ( const UserSideLock& );
+
+          //! The user mutex, or NULL if it was not taken
+          boost::mutex* mMutex;
+      };
+
     private:
       /**
         If the current buffer is null, allocate a buffer from the buffer pool for it
-        If the buffer pool is empty, create 10 new buffers
+        If the buffer pool is empty, create the pre-allocation count of new buffers
       */
       void updateCurrentBuffers();
+
+      //! Free the buffer pool and drop any buffers being filled
       void deleteBuffers();
 
+      //! Return any buffers being filled to the pool, discarding their transactions, and mark buffers being filled by other threads as stale
+      void discardQueuedBuffers();
+
+      /**
+        Allocate new buffers into the pool until it holds at least a given number
+        @param aCount the number of idle buffers which the pool should hold
+        @warning mBufferMutex must be held
+      */
+      void fillBufferPool ( const uint32_t& aCount );
+
+      /**
+        Return a buffer to the pool, or free it if the pool is at its high-water mark
+        @param aBuffers a shared-pointer to the buffer, which is reset
+        @warning mBufferMutex must be held
+      */
+      void releaseToBufferPool ( boost::shared_ptr< Buffers >& aBuffers );
+
+      /**
+        Return the high-water mark currently in effect
+        @return the high-water mark currently in effect
+        @warning mBufferMutex must be held
+      */
+      uint32_t bufferPoolHighWaterMark() const;
+
+      /**
+        Return the buffer which is currently being filled, i.e. the shared buffer or, if thread-local queuing is enabled, that of the calling thread
+        @return a reference to the shared-pointer to the currently filling buffer
+      */
+      boost::shared_ptr< Buffers >& getCurrentBuffers();
+
+      /**
+        Finalize the currently filling buffer, pass it to the transport layer and release it
+        @warning The user mutex must be held, so that buffers are passed to the transport layer one at a time
+      */
+      void dispatchCurrentBuffers();
+
+      /**
+        Record that a buffer is being passed to the transport layer, if metrics are enabled
+        @param aBuffers the buffer being passed to the transport layer
+      */
+      void countPacket ( Buffers& aBuffers );
+
+      /**
+        Record that a dispatch has completed, if metrics are enabled
+        @param aSucceeded whether the dispatch succeeded
+        @param aStart the time at which the dispatch was called
+      */
+      void countDispatch ( const bool& aSucceeded , const boost::chrono::steady_clock::time_point& aStart );
+
+      //! Release the currently filling buffer, as if it were full, either by dispatching it or, if pre-emptive dispatch is disabled, by queuing it for the next dispatch
+      void releaseCurrentBuffers();
+
+      /**
+        Return a buffer with at least the requested amount of free space, releasing the currently filling buffer if it does not have enough
+        @param aSendSize the amount of data to be sent, which must fit in an empty buffer
+        @param aReplySize the amount of data expected in the reply, which must fit in an empty buffer
+        @return the currently filling buffer
+      */
+      boost::shared_ptr< Buffers > reserveBufferSpace ( const uint32_t& aSendSize , const uint32_t& aReplySize );
+
+      //! Body of the completion thread, which waits for the replies to each asynchronous dispatch in turn and then calls its callback
+      void runCompletionThread();
+
+      /**
+        Fulfil the promise returned by dispatchAsync
+        @param aPromise the promise to be fulfilled
+        @param aException the exception which caused the dispatch to fail, or NULL if it succeeded
+      */
+      static void setDispatchPromise ( const boost::shared_ptr< boost::promise< void > >& aPromise , exception::exception* aException );
+
+      //! The state of a cacheable register in the shadow cache
+      struct ShadowRegister
+      {
+        ShadowRegister();
+
+        //! The value of mShadowCacheGeneration when the value was last updated; the value is unknown if it differs
+        uint32_t mGeneration;
+        //! Whether mValue holds the value of the register
+        bool mKnown;
+        //! The value of the register
+        uint32_t mValue;
+        //! Whether the value of the register will be known once mPendingRead is valid
+        bool mPending;
+        //! A read of the register whose reply has not been checked yet
+        ValWord< uint32_t > mPendingRead;
+        //! The reply to the last write queued through the cache, which is returned for any masked write merged into it
+        ValHeader mLastWrite;
+      };
+
+      /**
+        Look up the value of a register in the shadow cache
+        @param aRegister the cache entry of the register
+        @param aValue returns the value of the register, if known
+        @return whether the value of the register is known
+        @warning mShadowCacheMutex must be held
+      */
+      bool getShadowValue ( ShadowRegister& aRegister , uint32_t& aValue );
+
+      /**
+        Record a write to a register in the shadow cache, if it is cacheable, and mark the value as patchable in the filling buffer
+        @param aAddr the address of the register
+        @param aValue the value written
+        @param aReply the reply to the write
+      */
+      void updateShadowRegister ( const uint32_t& aAddr , const uint32_t& aValue , const ValHeader& aReply );
+
+      /**
+        Forget the values of the cacheable registers in a range of addresses
+        @param aAddr the first address written
+        @param aSize the number of words written
+        @param aMode whether a block of registers (INCREMENTAL) or a single port (NON_INCREMENTAL) was written
+      */
+      void invalidateShadowRange ( const uint32_t& aAddr , const uint32_t& aSize , const defs::BlockReadWriteMode& aMode );
+
 
     private:
       //! A MutEx lock used to make sure the access functions are thread safe
@@ -389,6 +792,15 @@ namespace uhal
       //! A memory pool of buffers which will be dispatched
       std::deque < boost::shared_ptr< Buffers > > mBuffers;
 
+      //! The number of buffers allocated each time the pool runs dry. Must lock mBufferMutex when accessing this.
+      uint32_t mBufferPoolPreallocation;
+
+      //! The largest number of idle buffers retained by the pool, or zero to follow the peak number in use. Must lock mBufferMutex when accessing this.
+      uint32_t mBufferPoolHighWaterMark;
+
+      //! Statistics on the use of the buffer pool. Must lock mBufferMutex when accessing this.
+      BufferPoolStatistics mBufferPoolStatistics;
+
 #ifdef NO_PREEMPTIVE_DISPATCH
       //! A deque to store buffers pending dispatch for the case where pre-emptive dispatch is disabled
       std::deque < boost::shared_ptr< Buffers > > mNoPreemptiveDispatchBuffers;
@@ -397,6 +809,73 @@ namespace uhal
       //! A pointer to a buffer-wrapper object
       boost::shared_ptr< Buffers > mCurrentBuffers;
 
+      //! The buffer being filled by a given thread when thread-local queuing is enabled
+      struct ThreadLocalBuffers
+      {
+        ThreadLocalBuffers();
+
+        //! The buffer currently being filled by this thread
+        boost::shared_ptr< Buffers > mBuffers;
+        //! The value of mBufferGeneration when the buffer was taken from the pool
+        uint32_t mGeneration;
+      };
+
+      //! The buffer being filled by each thread when thread-local queuing is enabled
+      boost::thread_specific_ptr< ThreadLocalBuffers > mThreadLocalBuffers;
+
+      //! Whether each calling thread queues its transactions into its own buffers
+      bool mThreadLocalQueuing;
+
+      //! Counter incremented each time the queued buffers are discarded, used to discard per-thread buffers filled before a dispatch error. Must lock mBufferMutex when accessing this.
+      uint32_t mBufferGeneration;
+
+      //! The cacheable registers, indexed by address. Must lock mShadowCacheMutex when accessing this.
+      boost::unordered_map< uint32_t , ShadowRegister > mShadowCache;
+
+      //! Counter incremented to invalidate every entry of the shadow cache at once. Must lock mShadowCacheMutex when accessing this.
+      uint32_t mShadowCacheGeneration;
+
+      //! Statistics on the use of the shadow cache. Must lock mShadowCacheMutex when accessing this.
+      ShadowCacheStatistics mShadowCacheStatistics;
+
+      //! Whether any register has ever been made cacheable, so that the accesses of clients without cacheable registers skip the cache altogether
+      bool mShadowCacheInUse;
+
+      //! A MutEx lock protecting the shadow cache, which is never held while queuing transactions
+      boost::mutex mShadowCacheMutex;
+
+      //! Whether transaction-level metrics are recorded
+      boost::atomic< bool > mMetricsEnabled;
+
+      //! The counters behind the transaction-level metrics
+      ClientMetricsCounters mMetrics;
+
+      //! An asynchronous dispatch whose replies have not yet been waited for
+      struct PendingDispatch
+      {
+        //! The function to be called once the dispatch completes
+        DispatchCallback mCallback;
+        //! The value of mBufferGeneration when the dispatch was made, used to detect that its buffers were discarded by a later dispatch error
+        uint32_t mGeneration;
+        //! The time at which the dispatch was called
+        boost::chrono::steady_clock::time_point mStart;
+      };
+
+      //! The asynchronous dispatches whose replies have not yet been waited for, in the order they were made. Must lock mCompletionMutex when accessing this.
+      std::deque< PendingDispatch > mPendingDispatches;
+
+      //! A MutEx lock protecting the pending asynchronous dispatches and the completion thread
+      boost::mutex mCompletionMutex;
+
+      //! Conditional variable used to wake the completion thread
+      boost::condition_variable mCompletionConditionalVariable;
+
+      //! Whether the completion thread has been asked to stop once the pending dispatches have completed. Must lock mCompletionMutex when accessing this.
+      bool mCompletionThreadStopping;
+
+      //! The thread which waits for the replies to asynchronous dispatches, started by the first asynchronous dispatch
+      boost::thread mCompletionThread;
+
       //! the identifier of the target for this client
       std::string mId;
 
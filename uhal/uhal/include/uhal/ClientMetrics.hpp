@@ -0,0 +1,251 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+
+
+/**
+	@file
+*/
+
+#ifndef _uhal_ClientMetrics_hpp_
+#define _uhal_ClientMetrics_hpp_
+
+
+#include <stdint.h>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+
+
+namespace uhal
+{
+
+  //! A snapshot of a histogram of latencies, whose fixed buckets have upper edges doubling from one microsecond upwards
+  struct LatencyHistogram
+  {
+    //! The number of buckets; the last bucket also counts every latency beyond its upper edge
+    static const uint32_t NUMBER_OF_BUCKETS = 24;
+
+    //! Constructor, zeroing all counters
+    LatencyHistogram();
+
+    /**
+      Return the upper edge of a bucket; the bucket counts the latencies below this edge, and at or above the upper edge of the previous bucket
+      @param aBucket the index of the bucket
+      @return the upper edge of the bucket in microseconds
+    */
+    static uint64_t upperEdge ( const uint32_t& aBucket );
+
+    /**
+      Return the mean of the latencies recorded
+      @return the mean latency in microseconds, or zero if no latency was recorded
+    */
+    double mean() const;
+
+    //! Number of latencies recorded
+    uint64_t entries;
+    //! Sum of the latencies recorded, in microseconds
+    uint64_t total;
+    //! Largest latency recorded, in microseconds
+    uint64_t max;
+    //! Number of latencies recorded in each bucket
+    std::vector< uint64_t > buckets;
+  };
+
+
+  //! A snapshot of the metrics of one type of transaction
+  struct TransactionMetrics
+  {
+    //! Constructor, zeroing all counters
+    TransactionMetrics();
+
+    //! Number of transactions queued
+    uint64_t transactions;
+    //! Number of words read or written by these transactions
+    uint64_t words;
+    //! Round-trip latency of the packets which carried these transactions, recorded once per transaction
+    LatencyHistogram latency;
+  };
+
+
+  //! A snapshot of the transaction-level metrics of a client
+  struct ClientMetrics
+  {
+    //! The types of transaction which are counted; masked writes are counted as the transactions which they are sent as
+    enum TransactionType
+    {
+      READ,
+      WRITE,
+      NON_INCREMENTAL_READ,
+      NON_INCREMENTAL_WRITE,
+      RMW_BITS,
+      RMW_SUM,
+      CONFIG_SPACE_READ,
+      NUMBER_OF_TRANSACTION_TYPES
+    };
+
+    //! Constructor, zeroing all counters
+    ClientMetrics();
+
+    /**
+      Return the metrics of one type of transaction
+      @param aType the type of transaction
+      @return the metrics of this type of transaction
+    */
+    const TransactionMetrics& transaction ( const TransactionType& aType ) const;
+
+    //! The metrics of each type of transaction, indexed by TransactionType
+    std::vector< TransactionMetrics > transactions;
+    //! Number of packets passed to the transport layer
+    uint64_t packets;
+    //! Number of bytes of IPbus data sent, including the packet headers
+    uint64_t sentBytes;
+    //! Number of bytes of IPbus data received in valid replies, including the packet headers
+    uint64_t receivedBytes;
+    //! Number of dispatches which completed successfully
+    uint64_t dispatches;
+    //! Number of dispatches which threw, or whose callback was passed an exception
+    uint64_t failedDispatches;
+    //! Latency from a packet being passed to the transport layer until its reply has been validated
+    LatencyHistogram packetLatency;
+    //! Latency from a dispatch being called until all of its replies have been validated
+    LatencyHistogram dispatchLatency;
+  };
+
+
+  //! A latency histogram whose counters may be updated concurrently by several threads without locking
+  class AtomicLatencyHistogram : private boost::noncopyable
+  {
+    public:
+      //! Constructor, zeroing all counters
+      AtomicLatencyHistogram();
+
+      /**
+        Record a latency
+        @param aLatency the latency in microseconds
+        @param aWeight the number of times that the latency is recorded
+      */
+      void add ( const uint64_t& aLatency , const uint64_t& aWeight = 1 );
+
+      /**
+        Copy the counters into a snapshot
+        @param aSnapshot the snapshot to be filled
+      */
+      void get ( LatencyHistogram& aSnapshot ) const;
+
+      //! Zero all counters
+      void reset();
+
+    private:
+      //! Number of latencies recorded
+      boost::atomic< uint64_t > mEntries;
+      //! Sum of the latencies recorded, in microseconds
+      boost::atomic< uint64_t > mTotal;
+      //! Largest latency recorded, in microseconds
+      boost::atomic< uint64_t > mMax;
+      //! Number of latencies recorded in each bucket
+      boost::atomic< uint64_t > mBuckets[ LatencyHistogram::NUMBER_OF_BUCKETS ];
+  };
+
+
+  //! The counters behind ClientMetrics, which are updated without locking by the threads queuing transactions and by the transport layer
+  class ClientMetricsCounters : private boost::noncopyable
+  {
+    public:
+      //! Constructor, zeroing all counters
+      ClientMetricsCounters();
+
+      /**
+        Record that a transaction was queued
+        @param aType the type of transaction
+        @param aWords the number of words read or written by the transaction
+      */
+      void countTransaction ( const ClientMetrics::TransactionType& aType , const uint32_t& aWords );
+
+      /**
+        Record that a packet was passed to the transport layer
+        @param aBytes the number of bytes of IPbus data sent
+      */
+      void countPacket ( const uint32_t& aBytes );
+
+      /**
+        Record that the reply to a packet was validated
+        @param aBytes the number of bytes of IPbus data received
+        @param aLatency the time since the packet was passed to the transport layer, in microseconds
+        @param aTransactionCounts the number of transactions of each type which the packet carried
+      */
+      void countReply ( const uint32_t& aBytes , const uint64_t& aLatency , const uint32_t* aTransactionCounts );
+
+      /**
+        Record that a dispatch completed
+        @param aSucceeded whether the dispatch succeeded
+        @param aLatency the time since the dispatch was called, in microseconds
+      */
+      void countDispatch ( const bool& aSucceeded , const uint64_t& aLatency );
+
+      /**
+        Copy the counters into a snapshot
+        @param aSnapshot the snapshot to be filled
+      */
+      void get ( ClientMetrics& aSnapshot ) const;
+
+      //! Zero all counters
+      void reset();
+
+    private:
+      //! Number of transactions queued, per type
+      boost::atomic< uint64_t > mTransactions[ ClientMetrics::NUMBER_OF_TRANSACTION_TYPES ];
+      //! Number of words read or written, per type of transaction
+      boost::atomic< uint64_t > mWords[ ClientMetrics::NUMBER_OF_TRANSACTION_TYPES ];
+      //! Round-trip latency of the packets, per type of transaction
+      AtomicLatencyHistogram mTransactionLatency[ ClientMetrics::NUMBER_OF_TRANSACTION_TYPES ];
+      //! Number of packets passed to the transport layer
+      boost::atomic< uint64_t > mPackets;
+      //! Number of bytes of IPbus data sent
+      boost::atomic< uint64_t > mSentBytes;
+      //! Number of bytes of IPbus data received
+      boost::atomic< uint64_t > mReceivedBytes;
+      //! Number of dispatches which completed successfully
+      boost::atomic< uint64_t > mDispatches;
+      //! Number of dispatches which failed
+      boost::atomic< uint64_t > mFailedDispatches;
+      //! Round-trip latency of the packets
+      AtomicLatencyHistogram mPacketLatency;
+      //! Latency of the dispatches
+      AtomicLatencyHistogram mDispatchLatency;
+  };
+
+}
+
+
+#endif
@@ -0,0 +1,161 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+
+/**
+	@file
+*/
+
+#ifndef _uhal_FifoReader_hpp_
+#define _uhal_FifoReader_hpp_
+
+
+#include <deque>
+#include <limits>
+#include <stdint.h>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "uhal/log/exception.hpp"
+
+
+namespace uhal
+{
+  class Node;
+
+  namespace exception
+  {
+    //! Exception class to handle the case where a FIFO readout was requested from a node which is not a non-incrementing, readable port.
+    UHAL_DEFINE_EXCEPTION_CLASS ( FifoReadoutRequiresPort , "Exception class to handle the case where a FIFO readout was requested from a node which is not a non-incrementing, readable port." )
+    //! Exception class to handle the case where the function to which a FIFO readout delivers its data threw an exception.
+    UHAL_DEFINE_EXCEPTION_CLASS ( FifoReadoutCallbackFailed , "Exception class to handle the case where the function to which a FIFO readout delivers its data threw an exception." )
+  }
+
+
+  /**
+    A streaming readout of a non-incrementing port, such as a FIFO.
+    The words are read in chunks, each of which is queued as non-incrementing reads into memory owned by the reader and dispatched asynchronously, so that several chunks are in flight at once; each chunk is delivered, in order, as soon as its replies have been validated, and its memory is then reused, so the memory used does not depend on the number of words read.
+  */
+  class FifoReader : private boost::noncopyable
+  {
+    public:
+      /**
+        Function to which each chunk of words is delivered, in the order in which they were read; for UDP and TCP clients it is called from the client's completion thread, and must not queue or dispatch transactions through the same client
+        The first argument points to the words read, which are only valid for the duration of the call, and the second argument is the number of words
+      */
+      typedef boost::function< void ( const uint32_t* , const uint32_t& ) > ChunkCallback;
+
+      /**
+        Constructor
+        @param aPort the non-incrementing port to be read
+        @param aChunkSize the number of words in each chunk, which is limited to the size of the port
+        @param aMaxChunksInFlight the number of chunks which may be waiting for their replies at the same time
+      */
+      FifoReader ( const Node& aPort , const uint32_t& aChunkSize = 4096 , const uint32_t& aMaxChunksInFlight = 4 );
+
+      //! Destructor
+      virtual ~FifoReader();
+
+      /**
+        Read a number of words from the port, delivering them chunk by chunk; returns once every chunk has been delivered, or the readout has failed
+        @param aWordCount the number of words to read
+        @param aCallback the function to which each chunk of words is delivered
+        @return the number of words delivered
+      */
+      uint64_t read ( const uint64_t& aWordCount , const ChunkCallback& aCallback );
+
+      /**
+        Read the number of words currently held by the FIFO from its occupancy register, and then read that many words from the port, delivering them chunk by chunk
+        @param aOccupancy the register holding the number of words which may be read from the port
+        @param aCallback the function to which each chunk of words is delivered
+        @param aMaxWordCount the largest number of words to read, whatever the occupancy
+        @return the number of words delivered
+      */
+      uint64_t readAvailable ( const Node& aOccupancy , const ChunkCallback& aCallback , const uint64_t& aMaxWordCount = std::numeric_limits< uint64_t >::max() );
+
+      /**
+        Return the number of words in each chunk
+        @return the number of words in each chunk
+      */
+      uint32_t getChunkSize() const;
+
+      /**
+        Return the number of chunks which may be waiting for their replies at the same time
+        @return the number of chunks which may be waiting for their replies at the same time
+      */
+      uint32_t getMaxChunksInFlight() const;
+
+    private:
+      /**
+        Function called when the dispatch of a chunk completes, which delivers the chunk and makes its memory available for the next one
+        @param aChunk the index of the chunk's memory
+        @param aWordCount the number of words in the chunk
+        @param aException NULL if the dispatch succeeded, and otherwise the exception describing the failure
+      */
+      void chunkDone ( const std::size_t& aChunk , const uint32_t& aWordCount , exception::exception* aException );
+
+      //! The port being read
+      const Node& mPort;
+
+      //! The number of words in each chunk
+      uint32_t mChunkSize;
+
+      //! The memory into which each chunk is read
+      std::vector< std::vector< uint32_t > > mChunks;
+
+      //! The indices of the chunks which are not waiting for replies
+      std::deque< std::size_t > mFreeChunks;
+
+      //! The function to which the chunks of the current readout are delivered
+      ChunkCallback mCallback;
+
+      //! Mutex protecting the free chunks, the exception and the count of delivered words
+      boost::mutex mMutex;
+
+      //! Conditional variable on which the reading thread waits for chunks to be delivered
+      boost::condition_variable mConditionalVariable;
+
+      //! The first exception raised during the current readout, after which no more chunks are delivered
+      exception::exception* mException;
+
+      //! The number of words delivered in the current readout
+      uint64_t mWordsDelivered;
+  };
+
+}
+
+
+#endif
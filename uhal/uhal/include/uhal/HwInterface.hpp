@@ -100,6 +100,18 @@ namespace uhal
       //! Make the IPbus client issue a dispatch
       void dispatch ();
 
+      /**
+        Make the IPbus client issue a dispatch without waiting for the replies
+        @return a future which becomes ready once all replies have been received and validated, and which holds the exception if the dispatch failed
+      */
+      boost::shared_future< void > dispatchAsync ();
+
+      /**
+        Make the IPbus client issue a dispatch without waiting for the replies
+        @param aCallback function called once all replies have been received and validated, or the dispatch has failed
+      */
+      void dispatchAsync ( const ClientInterface::DispatchCallback& aCallback );
+
       /**
       	A method to modify the timeout period for any pending or future transactions
       	@param aTimeoutPeriod the desired timeout period in milliseconds
@@ -153,7 +165,7 @@ namespace uhal
 
     private:
       /**
-      	A function which sets the HwInterface pointer in the Node to point to this HwInterface
+      	A function which sets the HwInterface pointer in the Node to point to this HwInterface, and makes the registers of nodes tagged "cacheable" cacheable in the client
       	@param aNode a Node that is to be claimed
       */
       void claimNode ( Node& aNode );
@@ -234,6 +234,13 @@ namespace uhal
       */
       const std::string& getTags() const;
 
+      /**
+        Return whether the tags string contains a given tag, the tags being separated by commas, semicolons or whitespace
+        @param aTag the tag to look for
+        @return whether the tags string contains the tag
+      */
+      bool hasTag ( const std::string& aTag ) const;
+
       /**
       	Return the optional description string which the user can specify for the current node
       	@return the optional description string which the user can specify for the current node
@@ -308,6 +315,15 @@ namespace uhal
       */
       ValVector< uint32_t > readBlockOffset ( const uint32_t& aSize , const uint32_t& aOffset ) const;
 
+      /**
+        Read a block of unsigned data from a block of registers or a block-read port directly into caller-owned memory
+        @param aSize the number of words to read
+        @param aDestination a pointer to the memory, of at least aSize words, into which the reply data is to be written
+        @return a Validated Header which becomes valid once the data has been written to the destination memory
+        @warning The memory must remain valid until the returned ValHeader is valid, or until the dispatch has thrown
+      */
+      ValHeader readBlockInto ( const uint32_t& aSize , uint32_t* aDestination ) const;
+
       /**
       	Get the underlying IPbus client
       	@return the IPbus client that will be used to issue a dispatch
@@ -45,6 +45,7 @@
 
 #include <iomanip>
 #include <iostream>
+#include <list>
 #include <string>
 
 
@@ -110,6 +111,12 @@ namespace uhal
       */
       virtual uint32_t getPreambleSize();
 
+      /**
+        Get the size of the reply to the preamble added by this protocol layer
+        @return the size of the reply to the preamble added by this protocol layer
+      */
+      virtual uint32_t getPreambleReplySize();
+
       /**
       	Finalize an IPbus buffer before it is transmitted
         @param aBuffers a buffer on which to do the predispatch operation
@@ -120,14 +127,14 @@ namespace uhal
       	Function which the dispatch calls when the reply is received to check that the headers are as expected
       	@param aSendBufferStart a pointer to the start of the first word of IPbus data which was sent (i.e. with no preamble)
       	@param aSendBufferEnd a pointer to the end of the last word of IPbus data which was sent
-      	@param aReplyStartIt an iterator to the start of the list of memory locations in to which the reply was written
-      	@param aReplyEndIt an iterator to the end (one past last valid entry) of the list of memory locations in to which the reply was written
+      	@param aReplyStartIt a pointer to the start of the array of memory locations in to which the reply was written
+      	@param aReplyEndIt a pointer to the end (one past last valid entry) of the array of memory locations in to which the reply was written
       	@return whether the returned IPbus packet is valid
       */
       virtual  exception::exception* validate ( uint8_t* aSendBufferStart ,
           uint8_t* aSendBufferEnd ,
-          std::deque< std::pair< uint8_t* , uint32_t > >::iterator aReplyStartIt ,
-          std::deque< std::pair< uint8_t* , uint32_t > >::iterator aReplyEndIt );
+          std::pair< uint8_t* , uint32_t >* aReplyStartIt ,
+          std::pair< uint8_t* , uint32_t >* aReplyEndIt );
 
       /**
         Returns the maximum number of buffers that should be in-flight from the uHAL client at any given time. 
@@ -166,8 +173,14 @@ namespace uhal
         uint16_t mReplyErrorCode;
       };
 
-      //! A queue of preample structs making the memory used by the preambles persistent during the dispatch. Must lock mPreamblesMutex when accessing this deque.
-      std::deque< tpreamble > mPreambles;
+      /**
+        Remove the preamble struct into which a given reply was written
+        @param aReplyChunkByteCounter the location of the first word of the ControlHub reply preamble
+      */
+      void removePreamble ( const uint8_t* aReplyChunkByteCounter );
+
+      //! A list of preample structs making the memory used by the preambles persistent during the dispatch. Buffers filled by different threads may be dispatched in a different order to that in which their preambles were created, so entries are matched by address rather than position. Must lock mPreamblesMutex when accessing this list.
+      std::list< tpreamble > mPreambles;
       //! Mutex to be used when accessing mPreambles
       boost::mutex mPreamblesMutex;
 
@@ -42,6 +42,7 @@
 
 #include <deque>
 #include <iosfwd>
+#include <list>
 #include <stdint.h>
 #include <string>
 #include <utility>
@@ -92,6 +93,9 @@ namespace uhal
       //! Return the size of the preamble
       virtual uint32_t getPreambleSize();
 
+      //! Return the size of the reply to the preamble
+      virtual uint32_t getPreambleReplySize();
+
       //! Finalize the buffer before it is transmitted
       virtual void predispatch ( boost::shared_ptr< Buffers > aBuffers );
 
@@ -157,6 +161,18 @@ namespace uhal
         return 0;
       }
 
+      //! Returns the mask of the header fields which are compared between each request and its reply: protocol version, transaction ID, type, direction and InfoCode
+      uint32_t replyHeaderCheckMask() const
+      {
+        return 0xFFFE00FF;
+      }
+
+      //! Returns the masked XOR of a request header and the header of its successful reply: only the direction bit differs
+      uint32_t replyHeaderCheckValue() const
+      {
+        return 0x4;
+      }
+
       //! Returns the maximum value of the word count in the transaction header, for each IPbus version
       uint32_t getMaxTransactionWordCount() const
       {
@@ -208,6 +224,9 @@ namespace uhal
       //! Return the size of the preamble
       virtual uint32_t getPreambleSize();
 
+      //! Return the size of the reply to the preamble
+      virtual uint32_t getPreambleReplySize();
+
       //! Finalize the buffer before it is transmitted
       virtual void predispatch ( boost::shared_ptr< Buffers > aBuffers );
 
@@ -250,14 +269,14 @@ namespace uhal
       	Function which the transport protocol calls when the IPbus reply is received to check that the headers are as expected
       	@param aSendBufferStart a pointer to the start of the first word of IPbus data which was sent (i.e. with no preamble)
       	@param aSendBufferEnd a pointer to the end of the last word of IPbus data which was sent
-      	@param aReplyStartIt an iterator to the start of the list of memory locations in to which the reply was written
-      	@param aReplyEndIt an iterator to the end (one past last valid entry) of the list of memory locations in to which the reply was written
+      	@param aReplyStartIt a pointer to the start of the array of memory locations in to which the reply was written
+      	@param aReplyEndIt a pointer to the end (one past last valid entry) of the array of memory locations in to which the reply was written
       	@return whether the returned IPbus packet is valid
       */
       virtual  exception::exception* validate ( uint8_t* aSendBufferStart ,
           uint8_t* aSendBufferEnd ,
-          std::deque< std::pair< uint8_t* , uint32_t > >::iterator aReplyStartIt ,
-          std::deque< std::pair< uint8_t* , uint32_t > >::iterator aReplyEndIt );
+          std::pair< uint8_t* , uint32_t >* aReplyStartIt ,
+          std::pair< uint8_t* , uint32_t >* aReplyEndIt );
 
       /**
         Abstract interface of function to calculate the IPbus header for a particular protocol version
@@ -286,6 +305,18 @@ namespace uhal
         return 0xF;
       }
 
+      //! Returns the mask of the header fields which are compared between each request and its reply: protocol version, transaction ID, type and InfoCode
+      uint32_t replyHeaderCheckMask() const
+      {
+        return 0xFFFF00FF;
+      }
+
+      //! Returns the masked XOR of a request header and the header of its successful reply: only the InfoCode differs, from request (0xF) to success (0)
+      uint32_t replyHeaderCheckValue() const
+      {
+        return 0xF;
+      }
+
       //! Returns the maximum value of the word count in the transaction header, for each IPbus version
       uint32_t getMaxTransactionWordCount() const
       {
@@ -308,7 +339,8 @@ namespace uhal
       uint16_t mPacketCounter;
 
       boost::mutex mReceivePacketMutex;
-      std::deque< uint32_t > mReceivePacketHeader;
+      //! The locations into which returned packet headers are written, matched by address since buffers filled by different threads may be dispatched out of order
+      std::list< uint32_t > mReceivePacketHeader;
   };
 
 
@@ -42,12 +42,14 @@
 
 #include <deque>
 #include <iosfwd>
+#include <map>
 #include <stdint.h>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include "uhal/ClientInterface.hpp"
 #include "uhal/definitions.hpp"
@@ -138,6 +140,41 @@ namespace uhal
       */
       ValWord< uint32_t > readConfigurationSpace ( const uint32_t& aAddr, const uint32_t& aMask );
 
+      /**
+        Read a contiguous range of the configuration address space, using as few multi-word transactions as the buffers allow; if configuration space caching is enabled, a range already read by an earlier snapshot is returned without any transaction being sent
+        @param aAddr the lowest address in the range to read
+        @param aSize the number of words to read
+        @return a Validated Memory which wraps the location to which the reply data is to be written
+      */
+      ValVector< uint32_t > snapshotConfigurationSpace ( const uint32_t& aAddr, const uint32_t& aSize );
+
+      /**
+        Select whether the results of configuration space snapshots are kept, so that later snapshots and single-word reads of the same addresses are answered without communicating with the target
+        @param aCaching whether configuration space snapshots should be cached
+      */
+      void setConfigurationSpaceCaching ( const bool& aCaching );
+
+      /**
+        Return whether the results of configuration space snapshots are cached
+        @return whether configuration space snapshots are cached
+      */
+      bool getConfigurationSpaceCaching() const;
+
+      //! Discard all cached configuration space snapshots, so that the next read of each address is sent to the target
+      void clearConfigurationSpaceCache();
+
+      /**
+        Select whether single-word reads, or single-word writes, to consecutive addresses are merged into one incrementing block transaction as they are queued, in order to reduce the number of transaction headers sent and received
+        @param aCoalescing whether adjacent single-word accesses should be merged
+      */
+      void setTransactionCoalescing ( const bool& aCoalescing );
+
+      /**
+        Return whether single-word reads, or single-word writes, to consecutive addresses are merged into one incrementing block transaction
+        @return whether adjacent single-word accesses are merged
+      */
+      bool getTransactionCoalescing() const;
+
     protected:
 
       //! Send a byte order transaction
@@ -158,6 +195,16 @@ namespace uhal
       */
       virtual ValHeader implementWriteBlock ( const uint32_t& aAddr, const std::vector< uint32_t >& aValues, const defs::BlockReadWriteMode& aMode=defs::INCREMENTAL );
 
+      /**
+        Write a block of data from caller-owned memory to a block of registers or a block-write port, passing the memory to the transport layer by reference
+        @param aAddr the address of the register to write
+        @param aValues a pointer to the first of the values to write to the registers or a block-write port
+        @param aSize the number of values to write
+        @param aMode whether we are writing to a block of registers (INCREMENTAL) or a block-write port (NON_INCREMENTAL)
+        @param aOwner an optional shared pointer to the memory, which is kept alive by each buffer referencing it
+      */
+      virtual ValHeader implementWriteBlock ( const uint32_t& aAddr, const uint32_t* aValues, const uint32_t& aSize, const defs::BlockReadWriteMode& aMode, const boost::shared_ptr< const void >& aOwner );
+
       /**
         Read a single, masked, unsigned word
         @param aAddr the address of the register to read
@@ -175,6 +222,16 @@ namespace uhal
       */
       virtual ValVector< uint32_t > implementReadBlock ( const uint32_t& aAddr, const uint32_t& aSize, const defs::BlockReadWriteMode& aMode=defs::INCREMENTAL );
 
+      /**
+        Read a block of unsigned data from a block of registers or a block-read port directly into caller-owned memory
+        @param aAddr the lowest address in the block of registers or the address of the block-read port
+        @param aSize the number of words to read
+        @param aDestination a pointer to the memory into which the reply data is to be written
+        @param aMode whether we are reading from a block of registers (INCREMENTAL) or a block-read port (NON_INCREMENTAL)
+        @return a Validated Header which becomes valid once the data has been written to the destination memory
+      */
+      virtual ValHeader implementReadBlock ( const uint32_t& aAddr, const uint32_t& aSize, uint32_t* aDestination, const defs::BlockReadWriteMode& aMode );
+
       /**
         Read a single, masked, unsigned word from the configuration address space
         @param aAddr the address of the register to read
@@ -183,6 +240,14 @@ namespace uhal
       */
       virtual ValWord< uint32_t > implementReadConfigurationSpace ( const uint32_t& aAddr, const uint32_t& aMask = defs::NOMASK );
 
+      /**
+        Read a block of unsigned data from the configuration address space
+        @param aAddr the lowest address in the range to read
+        @param aSize the number of words to read
+        @return a Validated Memory which wraps the location to which the reply data is to be written
+      */
+      virtual ValVector< uint32_t > implementSnapshotConfigurationSpace ( const uint32_t& aAddr, const uint32_t& aSize );
+
       /**
         Read the value of a register, apply the AND-term, apply the OR-term, set the register to this new value and return a copy of the new value to the user
         @param aAddr the address of the register to read, modify, write
@@ -200,20 +265,33 @@ namespace uhal
       */
       virtual ValWord< uint32_t > implementRMWsum ( const uint32_t& aAddr , const int32_t& aAddend );
 
+      /**
+        Encode the transactions recorded in a transaction program into packets which fit the buffers of this client
+        @param aProgram the program to be encoded
+      */
+      virtual void implementEncode ( TransactionProgram& aProgram );
+
+      /**
+        Queue a batch of single-word register accesses
+        @param aOperations the operations to be queued, in order
+        @return a Validated Memory holding one unmasked reply word per operation
+      */
+      virtual ValVector< uint32_t > implementBatch ( const std::vector< BatchOperation >& aOperations );
+
 
     protected:
       /**
       	Function which the transport protocol calls when the IPbus reply is received to check that the headers are as expected
       	@param aSendBufferStart a pointer to the start of the first word of IPbus data which was sent (i.e. with no preamble)
       	@param aSendBufferEnd a pointer to the end of the last word of IPbus data which was sent
-      	@param aReplyStartIt an iterator to the start of the list of memory locations in to which the reply was written
-      	@param aReplyEndIt an iterator to the end (one past last valid entry) of the list of memory locations in to which the reply was written
+      	@param aReplyStartIt a pointer to the start of the array of memory locations in to which the reply was written
+      	@param aReplyEndIt a pointer to the end (one past last valid entry) of the array of memory locations in to which the reply was written
       	@return whether the returned IPbus packet is valid
       */
       virtual  exception::exception* validate ( uint8_t* aSendBufferStart ,
           uint8_t* aSendBufferEnd ,
-          std::deque< std::pair< uint8_t* , uint32_t > >::iterator aReplyStartIt ,
-          std::deque< std::pair< uint8_t* , uint32_t > >::iterator aReplyEndIt );
+          std::pair< uint8_t* , uint32_t >* aReplyStartIt ,
+          std::pair< uint8_t* , uint32_t >* aReplyEndIt );
 
       /**
         Abstract interface of function to calculate the IPbus header for a particular protocol version
@@ -239,6 +317,12 @@ namespace uhal
       //! Returns the InfoCode for request transactions in this IPbus version.
       virtual uint8_t requestTransactionInfoCode() const = 0;
 
+      //! Returns the mask of the header fields (protocol version, transaction ID, type and InfoCode) which are compared between each request and its reply during validation, in this IPbus version.
+      virtual uint32_t replyHeaderCheckMask() const = 0;
+
+      //! Returns the value of the masked bits of a request header XORed with the header of a successful reply, in this IPbus version.
+      virtual uint32_t replyHeaderCheckValue() const = 0;
+
       //! Returns the maximum value of the word count in the transaction header, for each IPbus version
       virtual uint32_t getMaxTransactionWordCount() const = 0;
 
@@ -249,8 +333,130 @@ namespace uhal
 
       virtual boost::function<void (std::ostream&, const uint8_t&)> getInfoCodeTranslator() = 0;
 
+      /**
+        Check the reply headers for the common case that every transaction succeeded, comparing each against its request header with a single mask, without decoding the reply headers
+        @param aSendBufferStart a pointer to the start of the first word of IPbus data which was sent (i.e. with no preamble)
+        @param aSendBufferEnd a pointer to the end of the last word of IPbus data which was sent
+        @param aReplyStartIt a pointer to the start of the array of memory locations in to which the reply was written
+        @param aReplyEndIt a pointer to the end (one past last valid entry) of the array of memory locations in to which the reply was written
+        @return whether every reply header is as expected; if not, the headers must be checked in detail to describe what went wrong
+      */
+      bool validateReplyHeaders ( const uint8_t* aSendBufferStart ,
+          const uint8_t* aSendBufferEnd ,
+          const std::pair< uint8_t* , uint32_t >* aReplyStartIt ,
+          const std::pair< uint8_t* , uint32_t >* aReplyEndIt );
+
+      /**
+        Queue a write of a single, unmasked word, extending the previous transaction if coalescing is enabled
+        @param aAddr the address of the register to write
+        @param aSource the value to write to the register
+        @param aReply the validated memory helper struct into which the returned IPbus header is to be written
+        @return the buffer into which the write was queued, in which the validated memory must be stored
+      */
+      boost::shared_ptr< Buffers > queueWrite ( const uint32_t& aAddr, const uint32_t& aSource, _ValHeader_& aReply );
+
+      /**
+        Queue a read of a single word, extending the previous transaction if coalescing is enabled
+        @param aAddr the address of the register to read
+        @param aDestination the memory into which the reply data is to be written
+        @param aReply the validated memory helper struct into which the returned IPbus header is to be written
+        @return the buffer into which the read was queued, in which the validated memory must be stored
+      */
+      boost::shared_ptr< Buffers > queueRead ( const uint32_t& aAddr, uint32_t& aDestination, _ValHeader_& aReply );
+
+      /**
+        Queue a read-modify-write of the bits of a register
+        @param aAddr the address of the register to read, modify, write
+        @param aANDterm the AND-term to apply to existing value in the target register
+        @param aORterm the OR-term to apply to existing value in the target register
+        @param aDestination the memory into which the reply data is to be written
+        @param aReply the validated memory helper struct into which the returned IPbus header is to be written
+        @return the buffer into which the transaction was queued, in which the validated memory must be stored
+      */
+      boost::shared_ptr< Buffers > queueRMWbits ( const uint32_t& aAddr , const uint32_t& aANDterm , const uint32_t& aORterm , uint32_t& aDestination, _ValHeader_& aReply );
+
+      /**
+        Queue a read-modify-write sum on a register
+        @param aAddr the address of the register to read, modify, write
+        @param aAddend the addend to add to the existing value in the target register
+        @param aDestination the memory into which the reply data is to be written
+        @param aReply the validated memory helper struct into which the returned IPbus header is to be written
+        @return the buffer into which the transaction was queued, in which the validated memory must be stored
+      */
+      boost::shared_ptr< Buffers > queueRMWsum ( const uint32_t& aAddr , const int32_t& aAddend , uint32_t& aDestination, _ValHeader_& aReply );
+
+      /**
+        Split a block write into transactions that fit the available buffer space, and queue them
+        @param aAddr the address of the register to write
+        @param aSource a pointer to the first byte of the values to write
+        @param aPayloadByteCount the number of bytes to write
+        @param aMode whether we are writing to a block of registers (INCREMENTAL) or a block-write port (NON_INCREMENTAL)
+        @param aByReference whether the payload is passed to the transport layer by reference rather than copied to the send buffer
+        @param aOwner an optional shared pointer to the payload memory, which is kept alive by each buffer referencing it
+        @return a Validated Header which will contain the returned IPbus headers
+      */
+      ValHeader queueWriteBlock ( const uint32_t& aAddr, const uint8_t* aSource, const uint32_t& aPayloadByteCount, const defs::BlockReadWriteMode& aMode, const bool& aByReference, const boost::shared_ptr< const void >& aOwner );
+
+      /**
+        Split a block read into transactions that fit the available buffer space, and queue them
+        @param aAddr the lowest address in the block of registers or the address of the block-read port
+        @param aDestination a pointer to the first byte of the memory into which the reply data is to be written
+        @param aPayloadByteCount the number of bytes to read
+        @param aType the type of the read transactions; READ or CONFIG_SPACE_READ for a block of registers, or NI_READ for a block-read port
+        @param aReply the validated memory helper struct into which the returned IPbus headers are to be written
+        @return the buffer holding the last chunk of the read, in which the validated memory must be stored
+      */
+      boost::shared_ptr< Buffers > queueReadBlock ( const uint32_t& aAddr, uint8_t* aDestination, const uint32_t& aPayloadByteCount, const eIPbusTransactionType& aType, _ValHeader_& aReply );
+
+      /**
+        Return the packet of a transaction program into which the next transaction is to be encoded, starting a new packet if the last one does not have the requested space
+        @param aProgram the program being encoded
+        @param aSendSize the amount of data that the transaction wishes to send
+        @param aReplySize the amount of data that the transaction expects to receive
+        @param aAvailableSendSize return the amount of space available in the packet for outgoing data
+        @param aAvailableReplySize return the amount of space available in the packet for incoming data
+        @return the index of the packet
+      */
+      uint32_t programPacket ( TransactionProgram& aProgram , const uint32_t& aSendSize , const uint32_t& aReplySize , uint32_t& aAvailableSendSize , uint32_t& aAvailableReplySize );
+
+      /**
+        Extend the transaction most recently queued into a buffer by one word, if it is an incrementing transaction of the given type which ends immediately before the given address
+        @param aBuffers the buffer into which the access is being queued
+        @param aType the type of the access; either READ or WRITE
+        @param aAddr the address of the access
+        @return a pointer to the header of the extended transaction, or NULL if the access must be queued as a new transaction
+      */
+      uint8_t* extendTransaction ( Buffers& aBuffers , const eIPbusTransactionType& aType , const uint32_t& aAddr );
+
+      /**
+        Find a cached configuration space snapshot which has been validated and covers the given range
+        @param aAddr the lowest address in the range
+        @param aSize the number of words in the range
+        @param aOffset return the offset of the lowest address of the range within the snapshot
+        @return a pointer to the snapshot, or NULL if no cached snapshot covers the range
+      */
+      ValVector< uint32_t >* findConfigurationSpaceSnapshot ( const uint32_t& aAddr, const uint32_t& aSize, uint32_t& aOffset );
+
+      /**
+        Return the transaction ID for the next transaction and increment the transaction counter
+        @return the transaction ID for the next transaction
+      */
+      uint32_t nextTransactionId();
+
       //! The transaction counter which will be incremented in the sent IPbus headers
       uint32_t mTransactionCounter;
+
+      //! Mutex protecting the transaction counter when several threads queue transactions concurrently
+      boost::mutex mTransactionCounterMutex;
+
+      //! Whether single-word accesses to consecutive addresses are merged into one transaction
+      bool mTransactionCoalescing;
+
+      //! Whether the results of configuration space snapshots are cached
+      bool mConfigurationSpaceCaching;
+
+      //! The cached configuration space snapshots, indexed by their lowest address; only accessed while the user-side lock is held
+      std::map< uint32_t , ValVector< uint32_t > > mConfigurationSpaceCache;
   };
 
 
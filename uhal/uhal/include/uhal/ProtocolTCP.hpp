@@ -47,7 +47,9 @@
 #include <vector>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/atomic.hpp>
 #include <boost/asio/io_service.hpp>
+#include <boost/asio/strand.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/deadline_timer.hpp>
 #include <boost/chrono/system_clocks.hpp>
@@ -56,6 +58,7 @@
 #include <boost/thread/condition_variable.hpp>
 
 #include "uhal/ClientInterface.hpp"
+#include "uhal/TransportReactor.hpp"
 #include "uhal/log/exception.hpp"
 #include "uhal/utilities/TimeIntervalStats.hpp"
 
@@ -111,6 +114,18 @@ namespace uhal
       //! Destructor
       virtual ~TCP();
 
+      /**
+        Set the spin budget of the low-latency completion mode, in which the thread waiting for a dispatch to complete busy-polls the transport reactor itself, before falling back to sleeping until a thread of the reactor wakes it
+        @param aMicroseconds how long to busy-poll for, in microseconds; zero (the default) disables busy-polling
+      */
+      void setBusyPollBudget ( const uint32_t& aMicroseconds );
+
+      /**
+        Return the spin budget of the low-latency completion mode
+        @return how long to busy-poll for, in microseconds; zero if busy-polling is disabled
+      */
+      uint32_t getBusyPollBudget() const;
+
     private:
       /**
       	Send the IPbus buffer to the target, read back the response and call the packing-protocol's validate function
@@ -122,6 +137,12 @@ namespace uhal
       //! Concrete implementation of the synchronization function to block until all buffers have been sent, all replies received and all data validated
       virtual void Flush( );
 
+      /**
+        Replies are received and validated by the transport layer's own thread, so Flush may be called from the completion thread
+        @return true
+      */
+      virtual bool supportsAsynchronousFlush();
+
       //! Function which tidies up this protocol layer in the event of an exception
       virtual void dispatchExceptionHandler();
 
@@ -180,12 +201,27 @@ namespace uhal
       //! Function to block a thread pending a BOOST conditional-variable and its associated regular variable
       void WaitOnConditionalVariable();
 
+      /**
+        Return the value of the variable associated with the conditional variable, for use whilst busy-polling
+        @return whether all packets have been sent and all replies have been received
+      */
+      bool isFlushDone();
+
 
     private:
       typedef boost::chrono::steady_clock SteadyClock_t;
 
-      //! The boost::asio::io_service used to create the connections
-      boost::asio::io_service mIOservice;
+      //! The process-wide reactor whose io_service drives the socket and the deadline timer
+      boost::shared_ptr< TransportReactor > mReactor;
+
+      //! The strand through which all completion handlers of this client run, so that they never run concurrently
+      boost::asio::io_service::strand mStrand;
+
+      //! The lifetime token held by every outstanding completion handler of this client, so that the destructor can wait for them
+      boost::shared_ptr< void > mHandlerToken;
+
+      //! Whether the client is being destroyed, so that the deadline timer must not be put back to sleep
+      bool mClosing;
 
       //! A shared pointer to a boost::asio tcp socket through which the operation will be performed
       boost::asio::ip::tcp::socket mSocket;
@@ -196,12 +232,6 @@ namespace uhal
       //! The mechanism for providing the time-out
       boost::asio::deadline_timer mDeadlineTimer;
 
-      /// Needed when multi-threading to stop the boost::asio::io_service thinking it has nothing to do and so close the socket
-      boost::asio::io_service::work mIOserviceWork;
-
-      //! The Worker thread in Multi-threaded mode
-      boost::thread mDispatchThread;
-
       //! A MutEx lock used to make sure the access functions are thread safe
       boost::mutex mTransportLayerMutex;
 
@@ -264,6 +294,10 @@ namespace uhal
       TimeIntervalStats mLSTStats;
       TimeIntervalStats mInterSendTimeStats;
       TimeIntervalStats mInterRecvTimeStats;
+
+      //! The spin budget of the low-latency completion mode (in microseconds), which may be set by the "busy_poll" URI attribute; zero disables busy-polling
+      boost::atomic< uint32_t > mBusyPollBudget;
+
   };
 
 }
@@ -42,20 +42,26 @@
 
 #include <deque>
 #include <iostream>
+#include <set>
 #include <stdint.h>
 #include <string>
 #include <vector>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/atomic.hpp>
 #include <boost/asio/io_service.hpp>
+#include <boost/asio/strand.hpp>
 #include <boost/asio/ip/udp.hpp>
 #include <boost/asio/deadline_timer.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 #include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition_variable.hpp>
 
 #include "uhal/ClientInterface.hpp"
+#include "uhal/TransportReactor.hpp"
+#include "uhal/UDPMultiplexer.hpp"
 #include "uhal/log/exception.hpp"
 
 
@@ -111,6 +117,56 @@ namespace uhal
       //! Destructor
       virtual ~UDP();
 
+      //! Statistics on the adaptive window which limits the number of packets in flight, and on the round-trip time from which it is paced
+      struct CongestionStatistics
+      {
+        //! Constructor, zeroing all fields
+        CongestionStatistics();
+
+        //! The number of packets currently allowed in flight
+        uint32_t window;
+        //! The upper bound on the window, i.e. the number of buffers negotiated with the target or set by the "max_in_flight" URI attribute
+        uint32_t windowLimit;
+        //! Number of times the window was halved following a timeout
+        uint64_t windowDecreases;
+        //! The smoothed round-trip time (in microseconds); zero until a reply has been timed
+        uint64_t smoothedRoundTripTime;
+        //! The smoothed mean deviation of the round-trip time (in microseconds)
+        uint64_t roundTripTimeVariation;
+        //! Number of replies whose round-trip time has been measured; replies to packets sent before a timeout are not timed
+        uint64_t roundTripTimeSamples;
+        //! Number of replies which arrived before the reply to an older packet, and were matched to their packet by its ID (IPbus 2.0 only)
+        uint64_t reorderedReplies;
+        //! Number of packets sent several at a time by a single system call (Linux only)
+        uint64_t batchedPackets;
+        //! Number of replies received several at a time by a single system call (Linux only)
+        uint64_t batchedReplies;
+      };
+
+      /**
+        Return the statistics on the adaptive window and round-trip time
+        @return the statistics on the adaptive window and round-trip time
+      */
+      CongestionStatistics getCongestionStatistics();
+
+      /**
+        Set the spin budget of the low-latency completion mode, in which the thread waiting for a dispatch to complete busy-polls the transport reactor itself, before falling back to sleeping until a thread of the reactor wakes it
+        @param aMicroseconds how long to busy-poll for, in microseconds; zero (the default) disables busy-polling
+      */
+      void setBusyPollBudget ( const uint32_t& aMicroseconds );
+
+      /**
+        Return the spin budget of the low-latency completion mode
+        @return how long to busy-poll for, in microseconds; zero if busy-polling is disabled
+      */
+      uint32_t getBusyPollBudget() const;
+
+      /**
+        Return whether the client shares a socket with the clients of other targets, as requested by the "shared_socket" URI attribute
+        @return whether the client sends and receives through the UDP multiplexer
+      */
+      bool usesSharedSocket() const;
+
     private:
       /**
       	Send the IPbus buffer to the target, read back the response and call the packing-protocol's validate function
@@ -122,9 +178,27 @@ namespace uhal
       //! Concrete implementation of the synchronization function to block until all buffers have been sent, all replies received and all data validated
       virtual void Flush( );
 
+      /**
+        Replies are received and validated by the transport layer's own thread, so Flush may be called from the completion thread
+        @return true
+      */
+      virtual bool supportsAsynchronousFlush();
+
       //! Function which tidies up this protocol layer in the event of an exception
       virtual void dispatchExceptionHandler();
 
+      /**
+        Return the maximum number of packets in flight, as negotiated with the target or set by the "max_in_flight" URI attribute
+        @return the maximum number of packets in flight
+      */
+      uint32_t getMaxNumberOfBuffers();
+
+      /**
+        Return the number of packets currently allowed in flight, which adapts between one and getMaxNumberOfBuffers
+        @return the number of packets currently allowed in flight
+      */
+      uint32_t getWindowSize();
+
       /**
         Return the maximum size to be sent based on the buffer size in the target
         @return the maximum size to be sent
@@ -140,6 +214,29 @@ namespace uhal
       //! Set up the UDP socket
       void connect();
 
+      /**
+        Return whether the socket, or the client's channel on the shared socket, is open
+        @return whether the socket is open
+      */
+      bool isSocketOpen();
+
+      //! Close the socket, or the client's channel on the shared socket, cancelling any outstanding receive
+      void closeSocket();
+
+      /**
+        Send a datagram to the target through the socket, or the client's channel on the shared socket
+        @param aBuffers the segments of the datagram
+        @param aErrorCode return the error with which the send failed, if any
+      */
+      template < typename ConstBufferSequence >
+      void sendTo ( const ConstBufferSequence& aBuffers , boost::system::error_code& aErrorCode );
+
+      /**
+        Return the native handle of the socket, or of the shared socket
+        @return the native handle of the socket
+      */
+      boost::asio::ip::udp::socket::native_handle_type nativeHandle();
+
       /**
         Initialize performing the next UDP write operation
         In multi-threaded mode, this runs the ASIO async send and exits
@@ -147,6 +244,13 @@ namespace uhal
       */
       void write ( );
 
+      /**
+        Send the packet about to be written together with the queued packets which fit in the window, with a single system call (Linux only)
+        Packets which the kernel does not accept are left to be sent one at a time, with the packet IDs they were given
+        @return whether every packet of the batch was sent
+      */
+      bool sendBatch();
+
       /**
         Callback function which is called upon completion of the ASIO async send
         This, then, makes a call to read to read back the reply to what has just been sent
@@ -161,6 +265,12 @@ namespace uhal
       */
       void read ( );
 
+      /**
+        Drain the replies already waiting on the socket with a single system call, without blocking (Linux only)
+        @return whether at least one reply was received
+      */
+      bool receiveBatch();
+
       /**
         Callback function which is called upon completion of the ASIO async receive
         This, then, checks the queue to see if there are more packets to be sent and if so, calls write
@@ -168,9 +278,40 @@ namespace uhal
       */
       void read_callback ( const boost::system::error_code& aErrorCode , std::size_t aBytesTransferred );
 
+      /**
+        Work out whether a reply which was scattered straight into the reply destinations of a packet is the complete reply to the oldest packet in flight; if not, the reply is gathered into the reply memory, so that it can be handled as if it had been staged there
+        @param aBytesTransferred the size of the reply
+        @return whether the reply is already in place, and only needs validating
+      */
+      bool takeScatteredReply ( const std::size_t& aBytesTransferred );
+
+      /**
+        Account for the arrival of the reply to a packet in flight: free its place in the window, time its round trip and grow the window
+        @param aIndex the position of the packet amongst the packets awaiting a reply, oldest first
+        @param aReceiveTime the time at which the reply arrived
+      */
+      void replyReceived ( const std::size_t& aIndex , const boost::posix_time::ptime& aReceiveTime );
+
+      /**
+        Find the packet in flight to which the reply in the reply memory belongs, by comparing the packet header and the ID of the first transaction with those sent; packets whose replies have already arrived are skipped
+        @param aBytesTransferred the size of the reply
+        @param aIndex return the position of the packet amongst the packets awaiting a reply, oldest first
+        @return the packet to which the reply belongs, or an empty pointer if there is none
+      */
+      boost::shared_ptr< Buffers > matchReply ( const std::size_t& aBytesTransferred , std::size_t& aIndex );
+
       //! Function called by the ASIO deadline timer
       void CheckDeadline();
 
+      //! Send an IPbus 2.0 status request to the target, and rearm the deadline timer for its reply
+      void sendStatusRequest();
+
+      /**
+        Handle an IPbus 2.0 status reply: either learn the ID of the next control packet expected by the target, or work out whether a request or a reply was lost following a timeout, and resend the request packets or request that the replies are resent
+        @param aBytesTransferred the size of the status reply
+      */
+      void handleStatusReply ( std::size_t aBytesTransferred );
+
       /**
         Function to set the value of a variable associated with a BOOST conditional-variable and then notify that conditional variable
         @param aValue a value to which to update the variable associated with a BOOST conditional-variable
@@ -180,9 +321,24 @@ namespace uhal
       //! Function to block a thread pending a BOOST conditional-variable and its associated regular variable
       void WaitOnConditionalVariable();
 
+      /**
+        Return the value of the variable associated with the conditional variable, for use whilst busy-polling
+        @return whether all packets have been sent and all replies have been received
+      */
+      bool isFlushDone();
+
     private:
-      //! The boost::asio::io_service used to create the connections
-      boost::asio::io_service mIOservice;
+      //! The process-wide reactor whose io_service drives the socket and the deadline timer
+      boost::shared_ptr< TransportReactor > mReactor;
+
+      //! The strand through which all completion handlers of this client run, so that they never run concurrently
+      boost::asio::io_service::strand mStrand;
+
+      //! The lifetime token held by every outstanding completion handler of this client, so that the destructor can wait for them
+      boost::shared_ptr< void > mHandlerToken;
+
+      //! Whether the client is being destroyed, so that the deadline timer must not be put back to sleep
+      bool mClosing;
 
       //! A shared pointer to a boost::asio udp socket through which the operation will be performed
       boost::asio::ip::udp::socket mSocket;
@@ -190,21 +346,21 @@ namespace uhal
       //! A shared pointer to a boost::asio udp endpoint - used in the ASIO send and receive functions (UDP has no concept of a connection)
       boost::asio::ip::udp::endpoint mEndpoint;
 
+      //! The client's channel on a socket shared with the clients of other targets, in place of mSocket, if the "shared_socket" URI attribute was given
+      boost::shared_ptr< UDPMultiplexer::Channel > mChannel;
+
       //! The mechanism for providing the time-out
       boost::asio::deadline_timer mDeadlineTimer;
 
       /**
-        A block of memory into which we write replies, before copying them to their final destination
-        @note This should not be necessary and was, for a while, removed, with the buffer sequence created, instead, pointing to the final destinations
-        @note Tom Williams, however believes that there is a problem with scatter-gather operations of size>64 with the UDP and so has reverted it -- see https://svnweb.cern.ch/trac/cactus/ticket/259#comment:17
+        A block of memory into which replies are staged, before copying them to their final destination, when they cannot be received straight into it
+        @note Replies are scattered straight into the reply destinations of the packet expected, with the reply memory taking any excess bytes; the reply is gathered back into the reply memory if it turns out to be short, malformed or the reply to another packet
+        @note Replies split over more than 64 segments are always staged, since ASIO silently ignores the segments of a buffer sequence beyond the 64th -- see https://svnweb.cern.ch/trac/cactus/ticket/259#comment:17
       */
       std::vector<uint8_t> mReplyMemory;
 
-      //! Needed when multi-threading to stop the boost::asio::io_service thinking it has nothing to do and so close the socket
-      boost::asio::io_service::work mIOserviceWork;
-
-      //! The Worker thread in Multi-threaded mode
-      boost::thread mDispatchThread;
+      //! The packet into whose reply destinations the reply being received is scattered, or an empty pointer if the reply is staged in the reply memory
+      boost::shared_ptr< Buffers > mScatteredReply;
 
       //! A MutEx lock used to make sure the access functions are thread safe
       boost::mutex mTransportLayerMutex;
@@ -217,6 +373,9 @@ namespace uhal
       //! Counter of how many writes have been sent, for which no reply has yet been received
       uint32_t mPacketsInFlight;
 
+      //! The packets in the reply queue whose replies overtook the reply to an older packet, and have already been copied to their destinations; they are validated once all older packets have been
+      std::set< Buffers* > mEarlyReplies;
+
       //! A mutex for use by the conditional variable
       boost::mutex mConditionalVariableMutex;
       //! A conditional variable for blocking the main thread until the variable with which it is associated is set correctly
@@ -235,6 +394,78 @@ namespace uhal
       */
       uhal::exception::exception* mAsynchronousException;
 
+      //! The maximum number of status/resend attempts made to recover from each timeout (IPbus 2.0 only); zero disables recovery, so that a timeout ends the dispatch
+      uint32_t mMaxRecoveryAttempts;
+
+      //! The number of recovery attempts made since the last valid reply was received
+      uint32_t mRecoveryAttempts;
+
+      //! The ID to be given to the next control packet when recovery is enabled; zero whilst the target's status is unknown
+      uint16_t mNextPacketId;
+
+      //! Whether a status request has been sent to find out the target's limits and next expected ID, and the dispatch is held back until it is answered
+      bool mStatusPending;
+
+      //! The IPbus 2.0 status request packet, in network byte-order
+      std::vector< uint32_t > mStatusRequest;
+
+      //! The maximum size of the send and reply packets (in bytes)
+      uint32_t mMaxPacketSize;
+
+      //! Whether the maximum packet size was set by the "max_packet_size" URI attribute, rather than negotiated with the target
+      bool mFixedPacketSize;
+
+      //! The maximum number of packets in flight; zero to use the inner protocol's limit
+      uint32_t mMaxNumberOfBuffers;
+
+      //! Whether the maximum number of packets in flight was set by the "max_in_flight" URI attribute, rather than negotiated with the target
+      bool mFixedNumberOfBuffers;
+
+      //! Whether the "jumbo" URI attribute allows the packet size negotiated with the target to exceed a standard Ethernet frame
+      bool mJumboFrames;
+
+      //! The adaptive limit on the number of packets in flight, which grows by one packet per window of replies and is halved on each timeout; zero until the first timeout, meaning no limit below getMaxNumberOfBuffers
+      double mCongestionWindow;
+
+      //! Number of times the window has been halved
+      uint64_t mWindowDecreases;
+
+      //! The times at which the packets in flight were sent, oldest first; not-a-date-time for packets which must not be timed since they were sent before a timeout
+      std::deque< boost::posix_time::ptime > mSendTimes;
+
+      //! The smoothed round-trip time (in microseconds)
+      double mSmoothedRoundTripTime;
+
+      //! The smoothed mean deviation of the round-trip time (in microseconds)
+      double mRoundTripTimeVariation;
+
+      //! Number of round-trip time measurements made
+      uint64_t mRoundTripTimeSamples;
+
+      //! Number of replies which overtook the reply to an older packet
+      uint64_t mReorderedReplies;
+
+      //! Memory into which batches of replies are drained from the socket; each reply is swapped into the reply memory in turn
+      std::vector< std::vector< uint8_t > > mReceiveBatch;
+
+      //! The sizes of the replies of the current batch
+      std::vector< std::size_t > mReceiveBatchSizes;
+
+      //! The packets into whose reply destinations the replies of the current batch were scattered; empty pointers for replies staged in their batch memory
+      std::vector< boost::shared_ptr< Buffers > > mReceiveBatchTargets;
+
+      //! The position in the current batch of the next reply to be handled
+      std::size_t mReceiveBatchIndex;
+
+      //! Number of packets sent by system calls which sent more than one packet
+      uint64_t mBatchedPackets;
+
+      //! Number of replies received by system calls which received more than one reply
+      uint64_t mBatchedReplies;
+
+      //! The spin budget of the low-latency completion mode (in microseconds), which may be set by the "busy_poll" URI attribute; zero disables busy-polling
+      boost::atomic< uint32_t > mBusyPollBudget;
+
   };
 
 
@@ -0,0 +1,296 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+
+/**
+	@file
+*/
+
+#ifndef _uhal_TransactionProgram_hpp_
+#define _uhal_TransactionProgram_hpp_
+
+
+#include <deque>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "uhal/definitions.hpp"
+#include "uhal/log/exception.hpp"
+#include "uhal/ValMem.hpp"
+
+
+namespace uhal
+{
+  class ClientInterface;
+  class IPbusCore;
+
+  namespace exception
+  {
+    //! Exception class to handle the case where a write slot or result slot was requested which does not exist in a transaction program.
+    UHAL_DEFINE_EXCEPTION_CLASS ( TransactionProgramSlotOutOfRange , "Exception class to handle the case where a write slot or result slot was requested which does not exist in a transaction program." )
+  }
+
+
+  /**
+    A sequence of transactions which is recorded once and then replayed through a client many times.
+    The transactions are encoded into packets by the client on the first replay; subsequent replays copy the encoded packets into the send buffers, with only the write payloads patched, and the replies are written into result slots owned by the program.
+    @warning The program must remain valid, and must not be modified, until the replies to its most recent replay have been received, or until the dispatch has thrown
+  */
+  class TransactionProgram : private boost::noncopyable
+  {
+      friend class ClientInterface;
+      friend class IPbusCore;
+
+    public:
+      //! Constructor
+      TransactionProgram();
+
+      //! Destructor
+      virtual ~TransactionProgram();
+
+      /**
+        Record a write of a single, unmasked word to a register
+        @param aAddr the address of the register to write
+        @param aValue the value to write to the register
+        @return the index of the write slot holding the value
+      */
+      uint32_t write ( const uint32_t& aAddr, const uint32_t& aValue );
+
+      /**
+        Record a write of a single, masked word to a register
+        @param aAddr the address of the register to write
+        @param aValue the value to write to the register
+        @param aMask the mask to apply to the value
+        @return the index of the write slot holding the value
+      */
+      uint32_t write ( const uint32_t& aAddr, const uint32_t& aValue, const uint32_t& aMask );
+
+      /**
+        Record a write of a block of data to a block of registers or a block-write port
+        @param aAddr the address of the register to write
+        @param aValues the values to write to the registers or a block-write port
+        @param aMode whether we are writing to a block of registers (INCREMENTAL) or a block-write port (NON_INCREMENTAL)
+        @return the index of the write slot holding the first value; the others follow it
+      */
+      uint32_t writeBlock ( const uint32_t& aAddr, const std::vector< uint32_t >& aValues, const defs::BlockReadWriteMode& aMode=defs::INCREMENTAL );
+
+      /**
+        Record a read of a single, masked, unsigned word
+        @param aAddr the address of the register to read
+        @param aMask the mask to apply to the value after reading
+        @return the index of the result slot into which the value is read
+      */
+      uint32_t read ( const uint32_t& aAddr, const uint32_t& aMask = defs::NOMASK );
+
+      /**
+        Record a read of a block of unsigned data from a block of registers or a block-read port
+        @param aAddr the lowest address in the block of registers or the address of the block-read port
+        @param aSize the number of words to read
+        @param aMode whether we are reading from a block of registers (INCREMENTAL) or a block-read port (NON_INCREMENTAL)
+        @return the index of the result slot into which the first word is read; the others follow it
+      */
+      uint32_t readBlock ( const uint32_t& aAddr, const uint32_t& aSize, const defs::BlockReadWriteMode& aMode=defs::INCREMENTAL );
+
+      /**
+        Record a read-modify-write of the bits of a register
+        @param aAddr the address of the register to read, modify, write
+        @param aANDterm the AND-term to apply to existing value in the target register
+        @param aORterm the OR-term to apply to existing value in the target register
+        @return the index of the result slot into which the value returned by the transaction is read
+      */
+      uint32_t rmw_bits ( const uint32_t& aAddr , const uint32_t& aANDterm , const uint32_t& aORterm );
+
+      /**
+        Record a read-modify-write sum on a register
+        @param aAddr the address of the register to read, modify, write
+        @param aAddend the addend to add to the existing value in the target register
+        @return the index of the result slot into which the value returned by the transaction is read
+      */
+      uint32_t rmw_sum ( const uint32_t& aAddr , const int32_t& aAddend );
+
+      /**
+        Change the value written by a write slot in subsequent replays
+        @param aSlot the index of the write slot
+        @param aValue the value to write
+        @warning Must not be called whilst a replay of this program is waiting to be dispatched
+      */
+      void setWriteValue ( const uint32_t& aSlot , const uint32_t& aValue );
+
+      /**
+        Return the value written by a write slot
+        @param aSlot the index of the write slot
+        @return the value written by the write slot
+      */
+      const uint32_t& getWriteValue ( const uint32_t& aSlot ) const;
+
+      /**
+        Return the number of write slots in the program
+        @return the number of write slots in the program
+      */
+      std::size_t writeSlots() const;
+
+      /**
+        Return the number of result slots in the program
+        @return the number of result slots in the program
+      */
+      std::size_t resultSlots() const;
+
+      /**
+        Return whether the results of the most recent replay have been received and validated
+        @return whether the results of the most recent replay are valid
+      */
+      bool valid() const;
+
+      /**
+        Return the value held in a result slot, with the mask of the corresponding read applied
+        @param aSlot the index of the result slot
+        @return the masked value held in the result slot
+      */
+      uint32_t value ( const uint32_t& aSlot ) const;
+
+      /**
+        Return the unmasked values held in all result slots
+        @return the unmasked values held in the result slots
+      */
+      const std::vector< uint32_t >& values() const;
+
+    private:
+      //! The types of operation which can be recorded
+      enum OperationType
+      {
+        WRITE,
+        MASKED_WRITE,
+        WRITE_BLOCK,
+        READ,
+        READ_BLOCK,
+        RMW_BITS,
+        RMW_SUM
+      };
+
+      //! A recorded operation
+      struct Operation
+      {
+        //! The type of the operation
+        OperationType mType;
+        //! The address which the operation accesses
+        uint32_t mAddr;
+        //! The number of words written or read
+        uint32_t mSize;
+        //! Whether a block operation accesses a block of registers or a port
+        defs::BlockReadWriteMode mMode;
+        //! The first write slot (for writes) or result slot (for reads and read-modify-writes) of the operation
+        uint32_t mSlot;
+        //! The AND-term or the addend of a read-modify-write
+        uint32_t mTerm1;
+        //! The OR-term of a read-modify-write
+        uint32_t mTerm2;
+      };
+
+      //! The encoded form of one packet of the program
+      struct Packet
+      {
+        //! Constructor
+        Packet();
+
+        /**
+          Append a word to the encoded transactions
+          @param aWord the word to be appended
+        */
+        void send ( const uint32_t& aWord );
+
+        /**
+          Append a destination to the reply
+          @param aPtr a pointer to the memory into which the reply is to be written
+          @param aSize the number of bytes which can be safely written
+        */
+        void receive ( uint8_t* aPtr , const uint32_t& aSize );
+
+        //! The encoded transactions, excluding the preamble added by the client
+        std::vector< uint8_t > mSend;
+        //! The destinations of the reply, in the result slots and headers of the program
+        std::vector< std::pair< uint8_t* , uint32_t > > mReplies;
+        //! The number of bytes expected in the reply, excluding the preamble
+        uint32_t mReplyByteCount;
+      };
+
+      /**
+        Record an operation, discarding any encoding of the program
+        @param aType the type of the operation
+        @param aAddr the address which the operation accesses
+        @param aSize the number of words written or read
+        @param aMode whether a block operation accesses a block of registers or a port
+        @param aSlot the first slot of the operation
+        @param aTerm1 the AND-term or the addend of a read-modify-write
+        @param aTerm2 the OR-term of a read-modify-write
+      */
+      void record ( const OperationType& aType , const uint32_t& aAddr , const uint32_t& aSize , const defs::BlockReadWriteMode& aMode , const uint32_t& aSlot , const uint32_t& aTerm1 = 0 , const uint32_t& aTerm2 = 0 );
+
+      /**
+        Calculate the word which encodes the value of a write slot
+        @param aSlot the index of the write slot
+        @return the word which is sent
+      */
+      uint32_t encodeWriteValue ( const uint32_t& aSlot ) const;
+
+      //! Discard the encoding of the program, so that it is re-encoded on the next replay
+      void clearEncoding();
+
+      //! The recorded operations
+      std::vector< Operation > mOperations;
+      //! The values of the write slots
+      std::vector< uint32_t > mWriteValues;
+      //! The masks of the write slots
+      std::vector< uint32_t > mWriteMasks;
+      //! The result slots
+      std::vector< uint32_t > mResults;
+      //! The masks of the result slots
+      std::vector< uint32_t > mResultMasks;
+
+      //! The client for which the program is encoded, or NULL if it has not been encoded
+      const ClientInterface* mEncodedFor;
+      //! The encoded packets
+      std::vector< Packet > mPackets;
+      //! The location of the encoded word of each write slot, as the index of the packet and the byte offset in it
+      std::vector< std::pair< uint32_t , uint32_t > > mWriteLocations;
+      //! The destinations of the reply headers, and of the replies of masked writes, which are not kept; a deque so that the destinations are not moved as it grows
+      std::deque< uint32_t > mScratch;
+
+      //! The validated memory of the most recent replay (mutable since querying its validity is a non-const operation)
+      mutable ValHeader mReply;
+  };
+
+}
+
+#endif
@@ -0,0 +1,221 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+
+
+
+/**
+	@file
+*/
+
+#ifndef _uhal_TransportReactor_hpp_
+#define _uhal_TransportReactor_hpp_
+
+
+#include <stdint.h>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+
+namespace uhal
+{
+
+  /**
+    A completion handler which holds a reference to the lifetime token of the client which started the operation, so that the client can wait for all of its outstanding handlers to have run before it is destroyed
+  */
+  template < typename Handler >
+  class TrackedHandler
+  {
+    public:
+      /**
+        Constructor
+        @param aHandler the completion handler to wrap
+        @param aToken the lifetime token of the client which started the operation
+      */
+      TrackedHandler ( const Handler& aHandler , const boost::shared_ptr< void >& aToken ) :
+        mHandler ( aHandler ),
+        mToken ( aToken )
+      {
+      }
+
+      //! Invoke the wrapped handler without arguments
+      void operator() ()
+      {
+        mHandler();
+      }
+
+      //! Invoke the wrapped handler with one argument (e.g. the error code of a timer wait)
+      template < typename Arg1 >
+      void operator() ( const Arg1& aArg1 )
+      {
+        mHandler ( aArg1 );
+      }
+
+      //! Invoke the wrapped handler with two arguments (e.g. the error code and byte count of a socket operation)
+      template < typename Arg1 , typename Arg2 >
+      void operator() ( const Arg1& aArg1 , const Arg2& aArg2 )
+      {
+        mHandler ( aArg1 , aArg2 );
+      }
+
+    private:
+      //! The wrapped completion handler
+      Handler mHandler;
+      //! The lifetime token of the client which started the operation
+      boost::shared_ptr< void > mToken;
+  };
+
+
+  /**
+    A process-wide pool of threads running a single boost::asio::io_service, which drives the asynchronous operations of all UDP and TCP clients
+    Rather than each client owning an io_service and a dispatch thread, the clients share one reactor, and each client runs its completion handlers through its own strand, so that the handlers of any one client never run concurrently
+    The reactor is created when the first client needs it, and its threads are stopped when the last client using it is destroyed
+  */
+  class TransportReactor : private boost::noncopyable
+  {
+    public:
+      //! Destructor, stopping and joining the threads of the pool
+      ~TransportReactor();
+
+      /**
+        Return the reactor shared by all clients, creating it if no client currently holds it
+        @return a shared pointer to the reactor, which the client should hold for as long as it has sockets or timers on the reactor's io_service
+      */
+      static boost::shared_ptr< TransportReactor > getInstance();
+
+      /**
+        Set the number of threads in the pool of the next reactor created; the reactor currently in use, if any, is not affected
+        @param aNumberOfThreads the number of threads; zero selects the number of hardware threads of the machine
+      */
+      static void setDefaultNumberOfThreads ( const uint32_t& aNumberOfThreads );
+
+      /**
+        Return the number of threads in the pool of the next reactor created
+        @return the number of threads; zero denotes the number of hardware threads of the machine
+      */
+      static uint32_t getDefaultNumberOfThreads();
+
+      /**
+        Return the number of threads in the pool of this reactor
+        @return the number of threads running the io_service
+      */
+      uint32_t getNumberOfThreads() const;
+
+      /**
+        Return the io_service run by the pool, on which clients create their sockets, timers and strands
+        @return the io_service run by the pool
+      */
+      boost::asio::io_service& getIOservice();
+
+      /**
+        Busy-poll the io_service from the calling thread, running any handlers which are ready, until a condition holds or a spin budget is exhausted
+        The calling thread thereby completes the operations it is waiting for itself, rather than sleeping until a thread of the pool wakes it
+        @param aDone the condition awaited, called without arguments
+        @param aBudget how long to spin for
+        @return whether the condition holds
+      */
+      template < typename Predicate >
+      bool busyPoll ( const Predicate& aDone , const boost::posix_time::time_duration& aBudget )
+      {
+        const boost::posix_time::ptime lDeadline ( boost::posix_time::microsec_clock::universal_time() + aBudget );
+
+        while ( ! aDone() )
+        {
+          mIOservice.poll_one();
+
+          if ( boost::posix_time::microsec_clock::universal_time() >= lDeadline )
+          {
+            return aDone();
+          }
+        }
+
+        return true;
+      }
+
+      /**
+        Wrap a completion handler so that it holds a reference to a client's lifetime token
+        @param aHandler the completion handler to wrap
+        @param aToken the lifetime token of the client
+        @return the wrapped completion handler
+      */
+      template < typename Handler >
+      static TrackedHandler< Handler > track ( const Handler& aHandler , const boost::shared_ptr< void >& aToken )
+      {
+        return TrackedHandler< Handler > ( aHandler , aToken );
+      }
+
+      /**
+        Release a client's lifetime token, and block until every completion handler which holds a reference to it has run and been destroyed; the client's sockets must have been closed and its timers cancelled beforehand
+        @param aToken the lifetime token of the client, which is reset
+      */
+      static void waitForHandlers ( boost::shared_ptr< void >& aToken );
+
+    private:
+      /**
+        Constructor, starting the threads of the pool
+        This is private since only a single instance is to be created at a time, using the getInstance method
+        @param aNumberOfThreads the number of threads in the pool
+      */
+      TransportReactor ( const uint32_t& aNumberOfThreads );
+
+      //! The io_service run by the pool
+      boost::asio::io_service mIOservice;
+
+      //! Stops the io_service thinking it has nothing to do, whilst no client has an operation outstanding
+      boost::scoped_ptr< boost::asio::io_service::work > mIOserviceWork;
+
+      //! The threads running the io_service
+      boost::thread_group mThreads;
+
+      //! The number of threads in the pool
+      uint32_t mNumberOfThreads;
+
+      //! A mutex guarding the shared instance and the default number of threads
+      static boost::mutex mInstanceMutex;
+
+      //! The reactor currently in use, if any
+      static boost::weak_ptr< TransportReactor > mInstance;
+
+      //! The number of threads in the pool of the next reactor created
+      static uint32_t mDefaultNumberOfThreads;
+  };
+
+}
+
+#endif
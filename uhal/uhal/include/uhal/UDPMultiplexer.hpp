@@ -0,0 +1,264 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+
+
+
+/**
+	@file
+*/
+
+#ifndef _uhal_UDPMultiplexer_hpp_
+#define _uhal_UDPMultiplexer_hpp_
+
+
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <vector>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "uhal/TransportReactor.hpp"
+
+
+namespace uhal
+{
+
+  /**
+    A pool of UDP sockets, one per thread of the transport reactor, each of which is shared by many UDP clients talking to different targets
+    Each socket keeps a receive outstanding, and hands each datagram to the channel registered for the datagram's source endpoint; the client owning the channel then matches the datagram to its packets by their IPbus packet and transaction IDs, as it would on a socket of its own
+    Since a target cannot tell apart two clients sending from the same socket, each socket has at most one channel per target endpoint
+  */
+  class UDPMultiplexer : private boost::noncopyable
+  {
+    public:
+      //! The completion handler of a send or receive on a channel
+      typedef boost::function< void ( const boost::system::error_code& , std::size_t ) > Handler;
+
+      /**
+        The part of a shared socket which belongs to one client, offering the subset of the operations of a UDP socket which the client uses
+        Datagrams which arrive while no receive is outstanding are queued, as they would be in the buffer of a socket of the client's own, until the channel is closed
+      */
+      class Channel : private boost::noncopyable
+      {
+        public:
+          /**
+            Constructor
+            @param aMultiplexer the multiplexer owning the socket
+            @param aSocket the index of the socket within the pool
+            @param aEndpoint the endpoint of the target
+          */
+          Channel ( const boost::shared_ptr< UDPMultiplexer >& aMultiplexer , const std::size_t& aSocket , const boost::asio::ip::udp::endpoint& aEndpoint );
+
+          //! Destructor, deregistering the channel from its socket
+          ~Channel();
+
+          //! Open the channel, so that datagrams from the target are delivered to it
+          void open();
+
+          //! Close the channel, dropping any queued datagrams and completing an outstanding receive with boost::asio::error::operation_aborted
+          void close();
+
+          /**
+            Return whether the channel is open
+            @return whether the channel is open
+          */
+          bool is_open();
+
+          /**
+            Send a datagram to the target
+            @param aBuffers the segments of the datagram
+            @param aErrorCode return the error with which the send failed, if any
+            @return the number of bytes sent
+          */
+          template < typename ConstBufferSequence >
+          std::size_t send ( const ConstBufferSequence& aBuffers , boost::system::error_code& aErrorCode )
+          {
+            return socket().send_to ( aBuffers , mEndpoint , 0 , aErrorCode );
+          }
+
+          /**
+            Send a datagram to the target, and post the completion handler to the reactor
+            Datagram sends do not wait for the target, so the send itself is made synchronously; this also keeps the clients sharing the socket from having operations of their own outstanding on it
+            @param aBuffers the segments of the datagram
+            @param aHandler the completion handler
+          */
+          template < typename ConstBufferSequence >
+          void async_send ( const ConstBufferSequence& aBuffers , const Handler& aHandler )
+          {
+            boost::system::error_code lErrorCode;
+            const std::size_t lBytesTransferred ( send ( aBuffers , lErrorCode ) );
+            post ( aHandler , lErrorCode , lBytesTransferred );
+          }
+
+          /**
+            Receive the next datagram from the target, into the given buffers; the completion handler is posted to the reactor once the datagram arrives
+            @param aBuffers the segments into which to scatter the datagram; they must stay valid until the handler has run, or the channel has been closed
+            @param aHandler the completion handler
+          */
+          void async_receive ( const std::vector< boost::asio::mutable_buffer >& aBuffers , const Handler& aHandler );
+
+          /**
+            Return the native handle of the shared socket, for sending several datagrams with a single system call
+            @return the native handle of the shared socket
+          */
+          boost::asio::ip::udp::socket::native_handle_type native_handle();
+
+        private:
+          friend class UDPMultiplexer;
+
+          /**
+            Return the shared socket
+            @return the shared socket
+          */
+          boost::asio::ip::udp::socket& socket();
+
+          /**
+            Post a completion handler to the reactor
+            @param aHandler the completion handler
+            @param aErrorCode the error code with which the operation completed
+            @param aBytesTransferred the number of bytes transferred
+          */
+          void post ( const Handler& aHandler , const boost::system::error_code& aErrorCode , const std::size_t& aBytesTransferred );
+
+          /**
+            Hand a datagram received by the shared socket to the channel
+            @param aData the start of the datagram
+            @param aSize the size of the datagram
+          */
+          void deliver ( const uint8_t* aData , const std::size_t& aSize );
+
+          //! The multiplexer owning the socket
+          boost::shared_ptr< UDPMultiplexer > mMultiplexer;
+          //! The index of the socket within the pool
+          std::size_t mSocket;
+          //! The endpoint of the target
+          boost::asio::ip::udp::endpoint mEndpoint;
+
+          //! A mutex guarding the state of the channel
+          boost::mutex mMutex;
+          //! Whether the channel is open
+          bool mOpen;
+          //! The datagrams which arrived while no receive was outstanding
+          std::deque< std::vector< uint8_t > > mQueue;
+          //! The buffers of the outstanding receive
+          std::vector< boost::asio::mutable_buffer > mReceiveBuffers;
+          //! The completion handler of the outstanding receive, if any
+          Handler mReceiveHandler;
+      };
+
+      //! Destructor, closing the sockets and waiting for their outstanding receives to complete
+      ~UDPMultiplexer();
+
+      /**
+        Open a channel to a target on one of the shared sockets, creating the pool of sockets if no client currently holds it
+        @param aEndpoint the endpoint of the target
+        @return the channel, or an empty pointer if every socket of the pool already has a channel to the target
+      */
+      static boost::shared_ptr< Channel > openChannel ( const boost::asio::ip::udp::endpoint& aEndpoint );
+
+      /**
+        Return the number of sockets in the pool
+        @return the number of sockets in the pool
+      */
+      std::size_t getNumberOfSockets() const;
+
+    private:
+      /**
+        Constructor, opening one socket per thread of the reactor and starting their receives
+        This is private since only a single instance is to be created at a time, using the openChannel method
+        @param aReactor the transport reactor
+      */
+      UDPMultiplexer ( const boost::shared_ptr< TransportReactor >& aReactor );
+
+      /**
+        Start a receive on a shared socket
+        @param aSocket the index of the socket within the pool
+      */
+      void receive ( const std::size_t& aSocket );
+
+      /**
+        Callback function which is called upon completion of a receive on a shared socket; it hands the datagram to the channel registered for its source endpoint, and starts the next receive
+        @param aSocket the index of the socket within the pool
+        @param aErrorCode the error code with which the ASIO operation completed
+        @param aBytesTransferred the size of the datagram
+      */
+      void receive_callback ( const std::size_t& aSocket , const boost::system::error_code& aErrorCode , std::size_t aBytesTransferred );
+
+      //! The state of one of the shared sockets
+      struct SharedSocket
+      {
+        /**
+          Constructor, opening the socket
+          @param aIOservice the io_service on which to create the socket
+        */
+        SharedSocket ( boost::asio::io_service& aIOservice );
+
+        //! The socket
+        boost::asio::ip::udp::socket socket;
+        //! The memory into which datagrams are received
+        std::vector< uint8_t > memory;
+        //! The source endpoint of the last datagram received
+        boost::asio::ip::udp::endpoint sender;
+        //! The channels of the socket, by the endpoint of their target
+        std::map< boost::asio::ip::udp::endpoint , Channel* > channels;
+      };
+
+      //! The transport reactor whose io_service drives the sockets
+      boost::shared_ptr< TransportReactor > mReactor;
+
+      //! The lifetime token held by every outstanding receive of the sockets, so that the destructor can wait for them
+      boost::shared_ptr< void > mHandlerToken;
+
+      //! The shared sockets
+      std::vector< boost::shared_ptr< SharedSocket > > mSockets;
+
+      //! A mutex guarding the channels of the sockets
+      boost::mutex mMutex;
+
+      //! A mutex guarding the shared instance
+      static boost::mutex mInstanceMutex;
+
+      //! The multiplexer currently in use, if any
+      static boost::weak_ptr< UDPMultiplexer > mInstance;
+  };
+
+}
+
+#endif
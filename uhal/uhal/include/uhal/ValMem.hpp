@@ -46,7 +46,9 @@
 #include <stdint.h>                // for uint32_t, uint8_t
 #include <vector>
 
-#include <boost/shared_ptr.hpp>
+#include <boost/intrusive_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/smart_ptr/intrusive_ref_counter.hpp>
 
 #include "uhal/log/exception.hpp"
 #include "uhal/definitions.hpp"
@@ -75,14 +77,81 @@ namespace uhal
   template< typename T > class ValVector;
 
 
-  //! A helper struct wrapping an IPbus header and a valid flag
-  struct _ValHeader_
+  //! A list of the IPbus headers returned for a validated memory, which stores the first header inline (since most validated memories are filled by a single transaction) and only allocates a deque for any further headers; the address of each header is stable
+  class IPbusHeaderList
+  {
+    public:
+      //! Default constructor
+      IPbusHeaderList();
+
+      //! Destructor
+      ~IPbusHeaderList();
+
+      /**
+        Add a header to the end of the list
+        @param aHeader the value of the new header
+      */
+      void push_back ( const uint32_t& aHeader );
+
+      /**
+        Return the last header in the list
+        @return a reference to the last header in the list
+      */
+      uint32_t& back();
+
+      /**
+        Return a header in the list
+        @param aIndex the index of the header to be retrieved
+        @return a reference to the header at the specified index
+      */
+      uint32_t& operator[] ( std::size_t aIndex );
+
+      /**
+        Return the number of headers in the list
+        @return the number of headers in the list
+      */
+      std::size_t size() const;
+
+    private:
+      //! Disable copy construction, since the addresses of the headers are given to the Buffers
+      IPbusHeaderList ( const IPbusHeaderList& );
+      //! Disable assignment, since the addresses of the headers are given to the Buffers
+      IPbusHeaderList& operator= ( const IPbusHeaderList& );
+
+      //! The first header
+      uint32_t mFirst;
+      //! The number of headers in the list
+      std::size_t mSize;
+      //! Any headers after the first, only allocated when required
+      boost::scoped_ptr< std::deque<uint32_t> > mOthers;
+  };
+
+
+  //! A helper struct wrapping an IPbus header and a valid flag; instances are reference-counted intrusively and allocated from a pool
+  struct _ValHeader_ : public boost::intrusive_ref_counter< _ValHeader_ >
   {
     public:
       //! A flag for marking whether the data is actually valid
       bool valid;
       //! The IPbus header associated with the transaction that returned this data
-      std::deque<uint32_t> IPbusHeaders;
+      IPbusHeaderList IPbusHeaders;
+
+      //! Destructor, virtual so that the derived helper structs are correctly destroyed when the last reference to them is released
+      virtual ~_ValHeader_();
+
+      /**
+        Allocate memory for a helper struct from the pool of the appropriate size
+        @param aSize the number of bytes to be allocated
+        @return a pointer to the allocated memory
+      */
+      static void* operator new ( std::size_t aSize );
+
+      /**
+        Return the memory of a helper struct to the pool of the appropriate size
+        @param aPtr a pointer to the memory to be released
+        @param aSize the number of bytes which were allocated
+      */
+      static void operator delete ( void* aPtr , std::size_t aSize );
 
     protected:
       //! Make ValHeader a friend since it is the only class that should be able to create an instance this struct
@@ -139,6 +208,14 @@ namespace uhal
         @param aValid an initial validity
       */
       _ValVector_ ( const std::vector<T>& aValue , const bool& aValid );
+
+      /**
+        Constructor
+        Private, since this struct should only be used by the ValVector
+        @param aSize the initial size of the block of memory, whose entries are value-initialized
+        @param aValid an initial validity
+      */
+      _ValVector_ ( const uint32_t& aSize , const bool& aValid );
   };
 
 
@@ -179,8 +256,8 @@ namespace uhal
       void valid ( bool aValid );
 
     protected:
-      //! A shared pointer to a _ValWord_ struct, so that every copy of this ValWord points to the same underlying memory
-      boost::shared_ptr< _ValHeader_ > mMembers;
+      //! An intrusive pointer to a _ValHeader_ struct, so that every copy of this ValHeader points to the same underlying memory
+      boost::intrusive_ptr< _ValHeader_ > mMembers;
   };
 
 
@@ -262,8 +339,8 @@ namespace uhal
       void mask ( const uint32_t& aMask );
 
     private:
-      //! A shared pointer to a _ValWord_ struct, so that every copy of this ValWord points to the same underlying memory
-      boost::shared_ptr< _ValWord_<T> > mMembers;
+      //! An intrusive pointer to a _ValWord_ struct, so that every copy of this ValWord points to the same underlying memory
+      boost::intrusive_ptr< _ValWord_<T> > mMembers;
 
   };
 
@@ -395,8 +472,8 @@ namespace uhal
       void value ( const std::vector<T>& aValue );
 
     private:
-      //! A shared pointer to a _ValVector_ struct, so that every copy of this ValVector points to the same underlying memory
-      boost::shared_ptr< _ValVector_<T> > mMembers;
+      //! An intrusive pointer to a _ValVector_ struct, so that every copy of this ValVector points to the same underlying memory
+      boost::intrusive_ptr< _ValVector_<T> > mMembers;
 
   };
 
@@ -38,6 +38,12 @@
 
 #include "uhal/definitions.hpp"
 #include "uhal/ValMem.hpp"
+#include "uhal/Batch.hpp"
+#include "uhal/ClientMetrics.hpp"
 #include "uhal/ConnectionManager.hpp"
+#include "uhal/FifoReader.hpp"
 #include "uhal/HwInterface.hpp"
 #include "uhal/Node.hpp"
+#include "uhal/TransactionProgram.hpp"
+#include "uhal/TransportReactor.hpp"
+#include "uhal/UDPMultiplexer.hpp"
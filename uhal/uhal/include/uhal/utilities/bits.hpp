@@ -51,6 +51,13 @@ namespace uhal
       @return the number of trailing zero-bits
     */
     unsigned int TrailingRightBits ( uint32_t aValue );
+
+    /**
+      Helper function to reverse the byte order of each of a range of 32-bit words in place, e.g. to convert a packet between host and network byte order
+      @param aBegin a pointer to the first word to be converted
+      @param aEnd a pointer to one past the last word to be converted
+    */
+    void SwapByteOrder ( uint32_t* aBegin , uint32_t* aEnd );
   }
 }
 
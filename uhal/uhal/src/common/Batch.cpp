@@ -0,0 +1,229 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+
+#include "uhal/Batch.hpp"
+
+
+#include "uhal/ClientInterface.hpp"                            // for BitsSetWhichAreForbiddenByBitMask
+#include "uhal/log/LogLevels.hpp"
+#include "uhal/log/log_inserters.integer.hpp"                  // for Integer
+#include "uhal/log/log_inserters.quote.hpp"                    // for Quote
+#include "uhal/log/log.hpp"
+#include "uhal/Node.hpp"
+#include "uhal/utilities/bits.hpp"
+
+
+namespace uhal
+{
+
+  BatchOperation::BatchOperation ( const OperationType& aType , const uint32_t& aAddr , const uint32_t& aTerm1 , const uint32_t& aTerm2 , const uint32_t& aMask ) :
+    mType ( aType ),
+    mAddr ( aAddr ),
+    mTerm1 ( aTerm1 ),
+    mTerm2 ( aTerm2 ),
+    mMask ( aMask )
+  {
+  }
+
+
+  BatchOperation BatchOperation::read ( const uint32_t& aAddr )
+  {
+    return BatchOperation ( READ , aAddr , 0 , 0 , defs::NOMASK );
+  }
+
+
+  BatchOperation BatchOperation::read ( const uint32_t& aAddr , const uint32_t& aMask )
+  {
+    return BatchOperation ( READ , aAddr , 0 , 0 , aMask );
+  }
+
+
+  BatchOperation BatchOperation::read ( const Node& aNode )
+  {
+    if ( aNode.getPermission() & defs::READ )
+    {
+      return read ( aNode.getAddress() , aNode.getMask() );
+    }
+
+    exception::ReadAccessDenied lExc;
+    log ( lExc , "Node " , Quote ( aNode.getPath() ) , ": permissions denied read access" );
+    throw lExc;
+  }
+
+
+  BatchOperation BatchOperation::write ( const uint32_t& aAddr , const uint32_t& aValue )
+  {
+    return BatchOperation ( WRITE , aAddr , aValue , 0 , defs::NOMASK );
+  }
+
+
+  BatchOperation BatchOperation::write ( const uint32_t& aAddr , const uint32_t& aValue , const uint32_t& aMask )
+  {
+    uint32_t lShiftSize ( utilities::TrailingRightBits ( aMask ) );
+    uint32_t lBitShiftedSource ( aValue << lShiftSize );
+
+    if ( ( ( lBitShiftedSource >> lShiftSize ) != aValue ) || ( lBitShiftedSource & ~aMask ) )
+    {
+      exception::BitsSetWhichAreForbiddenByBitMask lExc;
+      log ( lExc , "Source data (" , Integer ( aValue , IntFmt<hex,fixed>() ) , ") has bits set outside the bounds allowed by the bit-mask (" ,
+            Integer ( aMask , IntFmt<hex,fixed>() ) , ")" );
+      throw lExc;
+    }
+
+    return rmw_bits ( aAddr , ~aMask , lBitShiftedSource );
+  }
+
+
+  BatchOperation BatchOperation::write ( const Node& aNode , const uint32_t& aValue )
+  {
+    if ( aNode.getPermission() & defs::WRITE )
+    {
+      if ( aNode.getMask() == defs::NOMASK )
+      {
+        return write ( aNode.getAddress() , aValue );
+      }
+      else if ( aNode.getPermission() & defs::READ )
+      {
+        return write ( aNode.getAddress() , aValue , aNode.getMask() );
+      }
+    }
+
+    exception::WriteAccessDenied lExc;
+    log ( lExc , "Node " , Quote ( aNode.getPath() ) , ": permissions denied write access" );
+    throw lExc;
+  }
+
+
+  BatchOperation BatchOperation::rmw_bits ( const uint32_t& aAddr , const uint32_t& aANDterm , const uint32_t& aORterm )
+  {
+    return BatchOperation ( RMW_BITS , aAddr , aANDterm , aORterm , defs::NOMASK );
+  }
+
+
+  BatchOperation BatchOperation::rmw_bits ( const Node& aNode , const uint32_t& aANDterm , const uint32_t& aORterm )
+  {
+    if ( aNode.getPermission() == defs::READWRITE )
+    {
+      return rmw_bits ( aNode.getAddress() , aANDterm , aORterm );
+    }
+
+    exception::WriteAccessDenied lExc;
+    log ( lExc , "Node " , Quote ( aNode.getPath() ) , ": permissions denied read-modify-write access" );
+    throw lExc;
+  }
+
+
+  BatchOperation BatchOperation::rmw_sum ( const uint32_t& aAddr , const int32_t& aAddend )
+  {
+    return BatchOperation ( RMW_SUM , aAddr , static_cast< uint32_t > ( aAddend ) , 0 , defs::NOMASK );
+  }
+
+
+  BatchOperation BatchOperation::rmw_sum ( const Node& aNode , const int32_t& aAddend )
+  {
+    if ( aNode.getPermission() == defs::READWRITE )
+    {
+      return rmw_sum ( aNode.getAddress() , aAddend );
+    }
+
+    exception::WriteAccessDenied lExc;
+    log ( lExc , "Node " , Quote ( aNode.getPath() ) , ": permissions denied read-modify-write access" );
+    throw lExc;
+  }
+
+
+
+  BatchResult::BatchResult()
+  {
+  }
+
+
+  BatchResult::BatchResult ( const ValVector< uint32_t >& aValues , const boost::shared_ptr< const std::vector< uint32_t > >& aMasks ) :
+    mValues ( aValues ),
+    mMasks ( aMasks )
+  {
+  }
+
+
+  bool BatchResult::valid()
+  {
+    return mValues.valid();
+  }
+
+
+  std::size_t BatchResult::size() const
+  {
+    return mValues.size();
+  }
+
+
+  uint32_t BatchResult::operator[] ( std::size_t aIndex ) const
+  {
+    return applyMask ( aIndex , mValues[aIndex] );
+  }
+
+
+  uint32_t BatchResult::at ( std::size_t aIndex ) const
+  {
+    return applyMask ( aIndex , mValues.at ( aIndex ) );
+  }
+
+
+  std::vector< uint32_t > BatchResult::value() const
+  {
+    std::vector< uint32_t > lValues ( mValues.value() );
+
+    if ( mMasks )
+    {
+      for ( std::size_t i = 0 ; i != lValues.size() ; ++i )
+      {
+        lValues[i] = applyMask ( i , lValues[i] );
+      }
+    }
+
+    return lValues;
+  }
+
+
+  uint32_t BatchResult::applyMask ( std::size_t aIndex , const uint32_t& aValue ) const
+  {
+    if ( ! mMasks )
+    {
+      return aValue;
+    }
+
+    const uint32_t& lMask ( ( *mMasks ) [aIndex] );
+    return ( aValue & lMask ) >> utilities::TrailingRightBits ( lMask );
+  }
+
+}
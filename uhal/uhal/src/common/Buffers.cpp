@@ -33,17 +33,34 @@
 #include "uhal/Buffers.hpp"
 
 
+#include <algorithm>
 #include <string.h>
 
 
 namespace uhal
 {
 
-  Buffers::Buffers ( const uint32_t& aMaxSendSize ) :
+  Buffers::Buffers ( const uint32_t& aMaxSendSize , const uint32_t& aMaxReplySize ) :
     mSendCounter ( 0 ),
     mReplyCounter ( 0 ),
-    mSendBuffer ( aMaxSendSize , 0x00 )
+    mSendBuffer ( aMaxSendSize , 0x00 ),
+    mExtendable ( false ),
+    mExtendableHeaderOffset ( 0 ),
+    mExtendableNextAddress ( 0 ),
+    mExtendableSendCounter ( 0 ),
+    mExtendableReplyCount ( 0 ),
+    mPatchable ( false ),
+    mPatchableAddress ( 0 ),
+    mPatchableSendCounter ( 0 ),
+    mPatchableReplyCount ( 0 ),
+    mDispatchTime()
   {
+    std::fill ( mTransactionCounts , mTransactionCounts + ClientMetrics::NUMBER_OF_TRANSACTION_TYPES , 0 );
+    // Every reply destination is at least two bytes long (the shortest being the ControlHub port and error code fields), except for zero-length block reads, each of which follows a four-byte IPbus header
+    mReplyBuffer.reserve ( ( aMaxReplySize >> 1 ) + ( aMaxReplySize >> 2 ) + 1 );
+    // The validated memories are at least one IPbus header (four bytes) apart
+    mValHeaders.reserve ( ( aMaxReplySize >> 2 ) + 1 );
+    mUnsignedValWords.reserve ( ( aMaxReplySize >> 2 ) + 1 );
   }
 
 
@@ -62,6 +79,11 @@ namespace uhal
     return mReplyCounter;
   }
 
+  uint32_t Buffers::sendCapacity() const
+  {
+    return mSendBuffer.size();
+  }
+
 
   uint8_t* Buffers::send ( const uint8_t* aPtr , const uint32_t& aSize )
   {
@@ -72,6 +94,17 @@ namespace uhal
   }
 
 
+  void Buffers::sendByReference ( const uint8_t* aPtr , const uint32_t& aSize )
+  {
+    SendReference lReference;
+    lReference.mOffset = mSendCounter;
+    lReference.mPtr = aPtr;
+    lReference.mSize = aSize;
+    mSendReferences.push_back ( lReference );
+    mSendCounter += aSize;
+  }
+
+
   void Buffers::receive ( uint8_t* aPtr , const uint32_t& aSize )
   {
     mReplyBuffer.push_back ( std::make_pair ( aPtr , aSize ) );
@@ -93,30 +126,127 @@ namespace uhal
     mUnsignedValVectors.push_back ( aValMem );
   }
 
+  void Buffers::add ( const boost::shared_ptr< const void >& aMemory )
+  {
+    mSendReferenceOwners.push_back ( aMemory );
+  }
+
   uint8_t* Buffers::getSendBuffer()
   {
     return &mSendBuffer[0];
   }
 
-  std::deque< std::pair< uint8_t* , uint32_t > >& Buffers::getReplyBuffer()
+  void Buffers::getSendSegments ( std::vector< std::pair< const uint8_t* , size_t > >& aSegments )
+  {
+    uint32_t lOffset ( 0 );
+
+    for ( std::vector< SendReference >::const_iterator lIt = mSendReferences.begin() ; lIt != mSendReferences.end() ; ++lIt )
+    {
+      if ( lIt->mOffset != lOffset )
+      {
+        aSegments.push_back ( std::make_pair ( &mSendBuffer[0] + lOffset , lIt->mOffset - lOffset ) );
+      }
+
+      aSegments.push_back ( std::make_pair ( lIt->mPtr , lIt->mSize ) );
+      lOffset = lIt->mOffset + lIt->mSize;
+    }
+
+    if ( lOffset != mSendCounter )
+    {
+      aSegments.push_back ( std::make_pair ( &mSendBuffer[0] + lOffset , mSendCounter - lOffset ) );
+    }
+  }
+
+  std::vector< std::pair< uint8_t* , uint32_t > >& Buffers::getReplyBuffer()
   {
     return mReplyBuffer;
   }
 
+  std::pair< uint8_t* , uint32_t >* Buffers::getReplyBufferBegin()
+  {
+    return mReplyBuffer.empty() ? NULL : &mReplyBuffer[0];
+  }
+
+  std::pair< uint8_t* , uint32_t >* Buffers::getReplyBufferEnd()
+  {
+    return mReplyBuffer.empty() ? NULL : &mReplyBuffer[0] + mReplyBuffer.size();
+  }
+
+
+  void Buffers::setExtendableTransaction ( uint8_t* aHeader , const uint32_t& aNextAddress )
+  {
+    mExtendable = true;
+    mExtendableHeaderOffset = aHeader - &mSendBuffer[0];
+    mExtendableNextAddress = aNextAddress;
+    mExtendableSendCounter = mSendCounter;
+    mExtendableReplyCount = mReplyBuffer.size();
+  }
+
+  uint32_t* Buffers::getExtendableTransaction ( const uint32_t& aAddress )
+  {
+    if ( mExtendable && ( aAddress == mExtendableNextAddress ) && ( mSendCounter == mExtendableSendCounter ) && ( mReplyBuffer.size() == mExtendableReplyCount ) )
+    {
+      return ( uint32_t* ) ( &mSendBuffer[0] + mExtendableHeaderOffset );
+    }
+
+    return NULL;
+  }
+
+
+  void Buffers::setPatchableWord ( const uint32_t& aAddress )
+  {
+    mPatchable = true;
+    mPatchableAddress = aAddress;
+    mPatchableSendCounter = mSendCounter;
+    mPatchableReplyCount = mReplyBuffer.size();
+  }
+
+  uint32_t* Buffers::getPatchableWord ( const uint32_t& aAddress )
+  {
+    if ( mPatchable && ( aAddress == mPatchableAddress ) && ( mSendCounter == mPatchableSendCounter ) && ( mReplyBuffer.size() == mPatchableReplyCount ) )
+    {
+      return ( uint32_t* ) ( &mSendBuffer[0] + mSendCounter - 4 );
+    }
+
+    return NULL;
+  }
+
+
+  void Buffers::countTransaction ( const ClientMetrics::TransactionType& aType )
+  {
+    ++mTransactionCounts[ aType ];
+  }
+
+  const uint32_t* Buffers::getTransactionCounts() const
+  {
+    return mTransactionCounts;
+  }
+
+
+  void Buffers::setDispatchTime()
+  {
+    mDispatchTime = boost::chrono::steady_clock::now();
+  }
+
+  const boost::chrono::steady_clock::time_point& Buffers::getDispatchTime() const
+  {
+    return mDispatchTime;
+  }
+
 
   void Buffers::validate ( )
   {
-    for ( std::deque< ValHeader >::iterator lIt = mValHeaders.begin() ; lIt != mValHeaders.end() ; ++lIt )
+    for ( std::vector< ValHeader >::iterator lIt = mValHeaders.begin() ; lIt != mValHeaders.end() ; ++lIt )
     {
       lIt->valid ( true );
     }
 
-    for ( std::deque< ValWord< uint32_t > >::iterator lIt = mUnsignedValWords.begin() ; lIt != mUnsignedValWords.end() ; ++lIt )
+    for ( std::vector< ValWord< uint32_t > >::iterator lIt = mUnsignedValWords.begin() ; lIt != mUnsignedValWords.end() ; ++lIt )
     {
       lIt->valid ( true );
     }
 
-    for ( std::deque< ValVector< uint32_t > >::iterator lIt = mUnsignedValVectors.begin() ; lIt != mUnsignedValVectors.end() ; ++lIt )
+    for ( std::vector< ValVector< uint32_t > >::iterator lIt = mUnsignedValVectors.begin() ; lIt != mUnsignedValVectors.end() ; ++lIt )
     {
       lIt->valid ( true );
     }
@@ -127,10 +257,16 @@ namespace uhal
   {
     mSendCounter = 0 ;
     mReplyCounter = 0 ;
+    mSendReferences.clear();
+    mExtendable = false;
+    mPatchable = false;
+    std::fill ( mTransactionCounts , mTransactionCounts + ClientMetrics::NUMBER_OF_TRANSACTION_TYPES , 0 );
+    mDispatchTime = boost::chrono::steady_clock::time_point();
     mReplyBuffer.clear();
     mValHeaders.clear();
     mUnsignedValWords.clear();
     mUnsignedValVectors.clear();
+    mSendReferenceOwners.clear();
   }
 
 }
@@ -33,14 +33,19 @@
 #include "uhal/ClientInterface.hpp"
 
 
+#include <algorithm>                                            // for max
 #include <sstream>
 
+#include <boost/bind/bind.hpp>
+#include <boost/chrono/duration.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread/lock_guard.hpp>
 
 #include "uhal/Buffers.hpp"
+#include "uhal/TransactionProgram.hpp"
 #include "uhal/log/LogLevels.hpp"                              // for BaseLo...
 #include "uhal/log/log_inserters.integer.hpp"                  // for Integer
+#include "uhal/log/log_inserters.quote.hpp"                    // for Quote
 #include "uhal/log/log.hpp"
 #include "uhal/utilities/bits.hpp"
 
@@ -50,9 +55,19 @@ namespace uhal
 
   ClientInterface::ClientInterface ( const std::string& aId, const URI& aUri,  const boost::posix_time::time_duration& aTimeoutPeriod ) :
     mBuffers(),
+    mBufferPoolPreallocation ( 10 ),
+    mBufferPoolHighWaterMark ( 0 ),
+    mBufferPoolStatistics(),
 #ifdef NO_PREEMPTIVE_DISPATCH
     mNoPreemptiveDispatchBuffers(),
 #endif
+    mThreadLocalQueuing ( false ),
+    mBufferGeneration ( 0 ),
+    mShadowCacheGeneration ( 0 ),
+    mShadowCacheInUse ( false ),
+    mMetricsEnabled ( false ),
+    mMetrics(),
+    mCompletionThreadStopping ( false ),
     mId ( aId ),
     mTimeoutPeriod ( aTimeoutPeriod ),
     mUri ( aUri )
@@ -62,9 +77,19 @@ namespace uhal
 
   ClientInterface::ClientInterface ( ) :
     mBuffers(),
+    mBufferPoolPreallocation ( 10 ),
+    mBufferPoolHighWaterMark ( 0 ),
+    mBufferPoolStatistics(),
 #ifdef NO_PREEMPTIVE_DISPATCH
     mNoPreemptiveDispatchBuffers(),
 #endif
+    mThreadLocalQueuing ( false ),
+    mBufferGeneration ( 0 ),
+    mShadowCacheGeneration ( 0 ),
+    mShadowCacheInUse ( false ),
+    mMetricsEnabled ( false ),
+    mMetrics(),
+    mCompletionThreadStopping ( false ),
     mId ( ),
     mTimeoutPeriod ( boost::posix_time::pos_infin ),
     mUri ( )
@@ -74,9 +99,19 @@ namespace uhal
 
   ClientInterface::ClientInterface ( const ClientInterface& aClientInterface ) :
     mBuffers(),
+    mBufferPoolPreallocation ( 10 ),
+    mBufferPoolHighWaterMark ( 0 ),
+    mBufferPoolStatistics(),
 #ifdef NO_PREEMPTIVE_DISPATCH
     mNoPreemptiveDispatchBuffers(),
 #endif
+    mThreadLocalQueuing ( false ),
+    mBufferGeneration ( 0 ),
+    mShadowCacheGeneration ( 0 ),
+    mShadowCacheInUse ( false ),
+    mMetricsEnabled ( false ),
+    mMetrics(),
+    mCompletionThreadStopping ( false ),
     mId ( aClientInterface.mId ),
     mTimeoutPeriod ( aClientInterface.mTimeoutPeriod ),
     mUri ( aClientInterface.mUri )
@@ -174,8 +209,74 @@ namespace uhal
   }
 
 
+  ClientInterface::BufferPoolStatistics::BufferPoolStatistics() :
+    hits ( 0 ),
+    misses ( 0 ),
+    allocated ( 0 ),
+    trimmed ( 0 ),
+    size ( 0 ),
+    peakSize ( 0 ),
+    inUse ( 0 ),
+    peakInUse ( 0 )
+  {
+  }
+
+
+  ClientInterface::ThreadLocalBuffers::ThreadLocalBuffers() :
+    mBuffers(),
+    mGeneration ( 0 )
+  {
+  }
+
+
+  ClientInterface::ShadowCacheStatistics::ShadowCacheStatistics() :
+    hits ( 0 ),
+    misses ( 0 ),
+    convertedWrites ( 0 ),
+    mergedWrites ( 0 )
+  {
+  }
+
+
+  ClientInterface::ShadowRegister::ShadowRegister() :
+    mGeneration ( 0 ),
+    mKnown ( false ),
+    mValue ( 0 ),
+    mPending ( false ),
+    mPendingRead(),
+    mLastWrite()
+  {
+  }
+
+
+  ClientInterface::UserSideLock::UserSideLock ( ClientInterface& aClient ) :
+    mMutex ( aClient.mThreadLocalQueuing ? NULL : &aClient.mUserSideMutex )
+  {
+    if ( mMutex )
+    {
+      mMutex->lock();
+    }
+  }
+
+
+  ClientInterface::UserSideLock::~UserSideLock()
+  {
+    if ( mMutex )
+    {
+      mMutex->unlock();
+    }
+  }
+
+
   void ClientInterface::dispatch ()
   {
+    boost::chrono::steady_clock::time_point lStart;
+
+    if ( mMetricsEnabled.load ( boost::memory_order_relaxed ) )
+    {
+      lStart = boost::chrono::steady_clock::now();
+    }
+
     boost::lock_guard<boost::mutex> lLock ( mUserSideMutex );
 
     try
@@ -186,6 +287,7 @@ namespace uhal
       for ( std::deque < boost::shared_ptr< Buffers > >::iterator lIt = mNoPreemptiveDispatchBuffers.begin(); lIt != mNoPreemptiveDispatchBuffers.end(); ++lIt )
       {
         this->predispatch ( *lIt );
+        countPacket ( **lIt );
         this->implementDispatch ( *lIt ); //responsibility for *lIt passed to the implementDispatch function
         lIt->reset();
       }
@@ -198,19 +300,300 @@ namespace uhal
       this->Flush();
 #endif
 
-      if ( mCurrentBuffers )
+      if ( getCurrentBuffers() )
       {
-        this->predispatch ( mCurrentBuffers );
-        this->implementDispatch ( mCurrentBuffers ); //responsibility for mCurrentBuffers passed to the implementDispatch function
-        mCurrentBuffers.reset();
+        dispatchCurrentBuffers();
         this->Flush();
       }
     }
     catch ( ... )
     {
       this->dispatchExceptionHandler();
+      countDispatch ( false , lStart );
       throw;
     }
+
+    countDispatch ( true , lStart );
+  }
+
+
+  boost::shared_future< void > ClientInterface::dispatchAsync ()
+  {
+    boost::shared_ptr< boost::promise< void > > lPromise ( new boost::promise< void >() );
+    boost::shared_future< void > lFuture ( lPromise->get_future() );
+    dispatchAsync ( boost::bind ( &ClientInterface::setDispatchPromise , lPromise , boost::placeholders::_1 ) );
+    return lFuture;
+  }
+
+
+  void ClientInterface::dispatchAsync ( const DispatchCallback& aCallback )
+  {
+    exception::exception* lExc ( NULL );
+    boost::chrono::steady_clock::time_point lStart;
+
+    if ( mMetricsEnabled.load ( boost::memory_order_relaxed ) )
+    {
+      lStart = boost::chrono::steady_clock::now();
+    }
+
+    {
+      boost::lock_guard<boost::mutex> lLock ( mUserSideMutex );
+
+      try
+      {
+#ifdef NO_PREEMPTIVE_DISPATCH
+
+        for ( std::deque < boost::shared_ptr< Buffers > >::iterator lIt = mNoPreemptiveDispatchBuffers.begin(); lIt != mNoPreemptiveDispatchBuffers.end(); ++lIt )
+        {
+          this->predispatch ( *lIt );
+          countPacket ( **lIt );
+          this->implementDispatch ( *lIt ); //responsibility for *lIt passed to the implementDispatch function
+          lIt->reset();
+        }
+
+        {
+          boost::lock_guard<boost::mutex> lLock ( mBufferMutex );
+          mNoPreemptiveDispatchBuffers.clear();
+        }
+#endif
+
+        if ( getCurrentBuffers() )
+        {
+          dispatchCurrentBuffers();
+        }
+
+        if ( this->supportsAsynchronousFlush() )
+        {
+          PendingDispatch lPending;
+          lPending.mCallback = aCallback;
+          lPending.mStart = lStart;
+          {
+            boost::lock_guard<boost::mutex> lBufferLock ( mBufferMutex );
+            lPending.mGeneration = mBufferGeneration;
+          }
+
+          {
+            boost::lock_guard<boost::mutex> lCompletionLock ( mCompletionMutex );
+
+            if ( ! mCompletionThread.joinable() )
+            {
+              mCompletionThread = boost::thread ( boost::bind ( &ClientInterface::runCompletionThread , this ) );
+            }
+
+            mPendingDispatches.push_back ( lPending );
+          }
+          mCompletionConditionalVariable.notify_one();
+          return;
+        }
+
+        this->Flush();
+      }
+      catch ( exception::exception& aExc )
+      {
+        this->dispatchExceptionHandler();
+        lExc = aExc.clone();
+      }
+      catch ( ... )
+      {
+        this->dispatchExceptionHandler();
+        countDispatch ( false , lStart );
+        throw;
+      }
+    }
+
+    countDispatch ( ! lExc , lStart );
+
+    // The callback is called without holding the user mutex, so that it may queue and dispatch further transactions
+    aCallback ( lExc );
+    delete lExc;
+  }
+
+
+  void ClientInterface::runCompletionThread ()
+  {
+    while ( true )
+    {
+      PendingDispatch lPending;
+      {
+        boost::unique_lock<boost::mutex> lLock ( mCompletionMutex );
+
+        while ( mPendingDispatches.empty() && ! mCompletionThreadStopping )
+        {
+          mCompletionConditionalVariable.wait ( lLock );
+        }
+
+        if ( mPendingDispatches.empty() )
+        {
+          return;
+        }
+
+        lPending = mPendingDispatches.front();
+        mPendingDispatches.pop_front();
+      }
+
+      exception::exception* lExc ( NULL );
+
+      try
+      {
+        this->Flush();
+      }
+      catch ( exception::exception& aExc )
+      {
+        lExc = aExc.clone();
+        boost::lock_guard<boost::mutex> lLock ( mUserSideMutex );
+        this->dispatchExceptionHandler();
+      }
+      catch ( const std::exception& aExc )
+      {
+        lExc = new exception::AsynchronousDispatchFailure();
+        log ( *lExc , "Exception " , Quote ( aExc.what() ) , " caught whilst waiting for the replies to an asynchronous dispatch from client " , Quote ( mId ) );
+        boost::lock_guard<boost::mutex> lLock ( mUserSideMutex );
+        this->dispatchExceptionHandler();
+      }
+
+      if ( ! lExc )
+      {
+        boost::lock_guard<boost::mutex> lLock ( mBufferMutex );
+
+        if ( lPending.mGeneration != mBufferGeneration )
+        {
+          lExc = new exception::AsynchronousDispatchFailure();
+          log ( *lExc , "Transactions of asynchronous dispatch from client " , Quote ( mId ) , " were discarded due to an error in an earlier dispatch" );
+        }
+      }
+
+      countDispatch ( ! lExc , lPending.mStart );
+
+      try
+      {
+        lPending.mCallback ( lExc );
+      }
+      catch ( const std::exception& aExc )
+      {
+        log ( Error() , "Exception " , Quote ( aExc.what() ) , " thrown by asynchronous dispatch callback of client " , Quote ( mId ) );
+      }
+
+      delete lExc;
+    }
+  }
+
+
+  void ClientInterface::setDispatchPromise ( const boost::shared_ptr< boost::promise< void > >& aPromise , exception::exception* aException )
+  {
+    if ( ! aException )
+    {
+      aPromise->set_value();
+      return;
+    }
+
+    try
+    {
+      aException->ThrowAsDerivedType();
+    }
+    catch ( ... )
+    {
+      aPromise->set_exception ( boost::current_exception() );
+    }
+  }
+
+
+  bool ClientInterface::supportsAsynchronousFlush()
+  {
+    return false;
+  }
+
+
+  void ClientInterface::stopCompletionThread()
+  {
+    {
+      boost::lock_guard<boost::mutex> lLock ( mCompletionMutex );
+      mCompletionThreadStopping = true;
+    }
+    mCompletionConditionalVariable.notify_one();
+
+    if ( mCompletionThread.joinable() )
+    {
+      mCompletionThread.join();
+    }
+  }
+
+
+  void ClientInterface::dispatchCurrentBuffers ()
+  {
+    boost::shared_ptr< Buffers >& lCurrentBuffers ( getCurrentBuffers() );
+
+    if ( mThreadLocalQueuing )
+    {
+      // A dispatch error since this thread took its buffer from the pool has cleared the protocol state which the buffer's preamble refers to, so drop the buffer, as deleteBuffers does for the shared buffer
+      boost::lock_guard<boost::mutex> lLock ( mBufferMutex );
+
+      if ( mThreadLocalBuffers->mGeneration != mBufferGeneration )
+      {
+        log ( Warning() , "Discarding transactions queued by this thread before an earlier dispatch error on client " , Quote ( mId ) );
+        releaseToBufferPool ( lCurrentBuffers );
+        return;
+      }
+    }
+
+    this->predispatch ( lCurrentBuffers );
+    countPacket ( *lCurrentBuffers );
+    this->implementDispatch ( lCurrentBuffers ); //responsibility for the current buffer passed to the implementDispatch function
+    lCurrentBuffers.reset();
+  }
+
+
+  void ClientInterface::countPacket ( Buffers& aBuffers )
+  {
+    if ( mMetricsEnabled.load ( boost::memory_order_relaxed ) )
+    {
+      aBuffers.setDispatchTime();
+      mMetrics.countPacket ( aBuffers.sendCounter() );
+    }
+  }
+
+
+  void ClientInterface::countDispatch ( const bool& aSucceeded , const boost::chrono::steady_clock::time_point& aStart )
+  {
+    // Dispatches called before metrics were enabled have no start time
+    if ( mMetricsEnabled.load ( boost::memory_order_relaxed ) && ( aStart != boost::chrono::steady_clock::time_point() ) )
+    {
+      boost::chrono::microseconds lLatency ( boost::chrono::duration_cast< boost::chrono::microseconds > ( boost::chrono::steady_clock::now() - aStart ) );
+      mMetrics.countDispatch ( aSucceeded , lLatency.count() );
+    }
+  }
+
+
+  void ClientInterface::countTransaction ( const ClientMetrics::TransactionType& aType , const uint32_t& aWords )
+  {
+    if ( ! mMetricsEnabled.load ( boost::memory_order_relaxed ) )
+    {
+      return;
+    }
+
+    mMetrics.countTransaction ( aType , aWords );
+    // The transaction (or, if it was split, its last part) is in the currently filling buffer, whose round-trip latency is then recorded against it
+    boost::shared_ptr< Buffers >& lBuffers ( getCurrentBuffers() );
+
+    if ( lBuffers )
+    {
+      lBuffers->countTransaction ( aType );
+    }
+  }
+
+
+  boost::shared_ptr< Buffers >& ClientInterface::getCurrentBuffers ()
+  {
+    if ( ! mThreadLocalQueuing )
+    {
+      return mCurrentBuffers;
+    }
+
+    if ( ! mThreadLocalBuffers.get() )
+    {
+      mThreadLocalBuffers.reset ( new ThreadLocalBuffers() );
+    }
+
+    return mThreadLocalBuffers->mBuffers;
   }
 
 
@@ -222,12 +605,18 @@ namespace uhal
   {
     exception::exception* lRet = this->validate ( aBuffers->getSendBuffer() ,
                                  aBuffers->getSendBuffer() + aBuffers->sendCounter() ,
-                                 aBuffers->getReplyBuffer().begin() ,
-                                 aBuffers->getReplyBuffer().end() );
+                                 aBuffers->getReplyBufferBegin() ,
+                                 aBuffers->getReplyBufferEnd() );
 
     //results are valid, so mark returned data as valid
     if ( !lRet )
     {
+      if ( mMetricsEnabled.load ( boost::memory_order_relaxed ) && ( aBuffers->getDispatchTime() != boost::chrono::steady_clock::time_point() ) )
+      {
+        boost::chrono::microseconds lLatency ( boost::chrono::duration_cast< boost::chrono::microseconds > ( boost::chrono::steady_clock::now() - aBuffers->getDispatchTime() ) );
+        mMetrics.countReply ( aBuffers->replyCounter() , lLatency.count() , aBuffers->getTransactionCounts() );
+      }
+
       aBuffers->validate ();
     }
 
@@ -242,6 +631,12 @@ namespace uhal
   }
 
 
+  uint32_t ClientInterface::getPreambleReplySize()
+  {
+    return 0;
+  }
+
+
   void ClientInterface::preamble ( boost::shared_ptr< Buffers > aBuffers )
   {}
 
@@ -257,8 +652,7 @@ namespace uhal
 
     if ( aBuffers )
     {
-      mBuffers.push_back ( aBuffers );
-      aBuffers.reset();
+      releaseToBufferPool ( aBuffers );
     }
   }
 
@@ -271,7 +665,7 @@ namespace uhal
     {
       if ( *lIt )
       {
-        mBuffers.push_back ( *lIt );
+        releaseToBufferPool ( *lIt );
       }
     }
 
@@ -287,7 +681,7 @@ namespace uhal
     {
       if ( *lIt )
       {
-        mBuffers.push_back ( *lIt );
+        releaseToBufferPool ( *lIt );
       }
     }
 
@@ -305,7 +699,7 @@ namespace uhal
       {
         if ( *lIt2 )
         {
-          mBuffers.push_back ( *lIt2 );
+          releaseToBufferPool ( *lIt2 );
         }
       }
     }
@@ -320,108 +714,254 @@ namespace uhal
     log ( Debug() , "Checking buffer space" );
     //if there are no existing buffers in the pool, create them
     updateCurrentBuffers();
-    uint32_t lSendBufferFreeSpace ( this->getMaxSendSize() - mCurrentBuffers->sendCounter() );
-    uint32_t lReplyBufferFreeSpace ( this->getMaxReplySize() - mCurrentBuffers->replyCounter() );
+    boost::shared_ptr< Buffers >& lCurrentBuffers ( getCurrentBuffers() );
+    // The maximum sizes may be renegotiated with the target whilst a buffer is being filled, so guard against them dropping below what is already used
+    uint32_t lSendBufferFreeSpace ( std::max ( this->getMaxSendSize() , lCurrentBuffers->sendCounter() ) - lCurrentBuffers->sendCounter() );
+    uint32_t lReplyBufferFreeSpace ( std::max ( this->getMaxReplySize() , lCurrentBuffers->replyCounter() ) - lCurrentBuffers->replyCounter() );
 
     if ( ( aRequestedSendSize <= lSendBufferFreeSpace ) && ( aRequestedReplySize <= lReplyBufferFreeSpace ) )
     {
       aAvailableSendSize = aRequestedSendSize;
       aAvailableReplySize = aRequestedReplySize;
-      return mCurrentBuffers;
+      return lCurrentBuffers;
     }
 
     if ( ( lSendBufferFreeSpace > 16 ) && ( lReplyBufferFreeSpace > 16 ) )
     {
       aAvailableSendSize = lSendBufferFreeSpace;
       aAvailableReplySize = lReplyBufferFreeSpace;
-      return mCurrentBuffers;
-    }
-
-#ifdef NO_PREEMPTIVE_DISPATCH
-    mNoPreemptiveDispatchBuffers.push_back ( mCurrentBuffers );
-    mCurrentBuffers.reset();
-#else
-    log ( Debug() , "Triggering automated dispatch" );
-
-    try
-    {
-      this->predispatch ( mCurrentBuffers );
-      this->implementDispatch ( mCurrentBuffers );
-      mCurrentBuffers.reset();
-    }
-    catch ( ... )
-    {
-      this->dispatchExceptionHandler();
-      throw;
+      return lCurrentBuffers;
     }
 
-#endif
+    releaseCurrentBuffers();
     updateCurrentBuffers();
-    lSendBufferFreeSpace = this->getMaxSendSize() - mCurrentBuffers->sendCounter();
-    lReplyBufferFreeSpace = this->getMaxReplySize() - mCurrentBuffers->replyCounter();
+    lSendBufferFreeSpace = std::max ( this->getMaxSendSize() , lCurrentBuffers->sendCounter() ) - lCurrentBuffers->sendCounter();
+    lReplyBufferFreeSpace = std::max ( this->getMaxReplySize() , lCurrentBuffers->replyCounter() ) - lCurrentBuffers->replyCounter();
 
     if ( ( aRequestedSendSize <= lSendBufferFreeSpace ) && ( aRequestedReplySize <= lReplyBufferFreeSpace ) )
     {
       aAvailableSendSize = aRequestedSendSize;
       aAvailableReplySize = aRequestedReplySize;
-      return mCurrentBuffers;
+      return lCurrentBuffers;
     }
 
     aAvailableSendSize = lSendBufferFreeSpace;
     aAvailableReplySize = lReplyBufferFreeSpace;
-    return mCurrentBuffers;
+    return lCurrentBuffers;
   }
   //-------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
 
-  void ClientInterface::updateCurrentBuffers()
+  void ClientInterface::releaseCurrentBuffers()
   {
-    if ( ! mCurrentBuffers )
+    if ( mThreadLocalQueuing )
     {
-      {
-        boost::lock_guard<boost::mutex> lLock ( mBufferMutex );
+      // Per-thread buffers are always dispatched pre-emptively; the user mutex serialises access to the transport layer
+      log ( Debug() , "Triggering automated dispatch of thread-local buffer" );
+      boost::lock_guard<boost::mutex> lLock ( mUserSideMutex );
 
-        if ( mBuffers.size() == 0 )
-        {
-          for ( uint32_t i=0; i!=10; ++i )
-          {
-            mBuffers.push_back ( boost::shared_ptr< Buffers > ( new Buffers ( this->getMaxSendSize() ) ) );
-          }
-        }
+      try
+      {
+        dispatchCurrentBuffers();
+      }
+      catch ( ... )
+      {
+        this->dispatchExceptionHandler();
+        throw;
+      }
+    }
+    else
+    {
+#ifdef NO_PREEMPTIVE_DISPATCH
+      mNoPreemptiveDispatchBuffers.push_back ( mCurrentBuffers );
+      mCurrentBuffers.reset();
+#else
+      log ( Debug() , "Triggering automated dispatch" );
 
-        mCurrentBuffers = mBuffers.front();
-        mBuffers.pop_front();
-        mCurrentBuffers->clear();
+      try
+      {
+        dispatchCurrentBuffers();
+      }
+      catch ( ... )
+      {
+        this->dispatchExceptionHandler();
+        throw;
       }
-      this->preamble ( mCurrentBuffers );
+
+#endif
     }
   }
 
 
-  void ClientInterface::deleteBuffers()
+  boost::shared_ptr< Buffers > ClientInterface::reserveBufferSpace ( const uint32_t& aSendSize , const uint32_t& aReplySize )
   {
-    boost::lock_guard<boost::mutex> lLock ( mBufferMutex );
-    mBuffers.clear();
-
-#ifdef NO_PREEMPTIVE_DISPATCH
-    mNoPreemptiveDispatchBuffers.clear();
-#endif
+    updateCurrentBuffers();
+    boost::shared_ptr< Buffers >& lCurrentBuffers ( getCurrentBuffers() );
 
-    if ( mCurrentBuffers )
+    if ( ( aSendSize > std::max ( this->getMaxSendSize() , lCurrentBuffers->sendCounter() ) - lCurrentBuffers->sendCounter() ) || ( aReplySize > std::max ( this->getMaxReplySize() , lCurrentBuffers->replyCounter() ) - lCurrentBuffers->replyCounter() ) )
     {
-      mCurrentBuffers.reset();
+      releaseCurrentBuffers();
+      updateCurrentBuffers();
     }
 
+    return lCurrentBuffers;
   }
 
 
-  void ClientInterface::dispatchExceptionHandler()
+  void ClientInterface::updateCurrentBuffers()
   {
-    deleteBuffers();
-  }
+    boost::shared_ptr< Buffers >& lCurrentBuffers ( getCurrentBuffers() );
 
+    if ( ! lCurrentBuffers )
+    {
+      {
+        boost::lock_guard<boost::mutex> lLock ( mBufferMutex );
 
-  std::pair < ValHeader , _ValHeader_* > ClientInterface::CreateValHeader()
+        if ( mBuffers.size() == 0 )
+        {
+          ++mBufferPoolStatistics.misses;
+          fillBufferPool ( std::max ( mBufferPoolPreallocation , uint32_t ( 1 ) ) );
+        }
+        else
+        {
+          ++mBufferPoolStatistics.hits;
+        }
+
+        lCurrentBuffers = mBuffers.front();
+        mBuffers.pop_front();
+
+        // Buffers allocated before the maximum packet size was raised (e.g. following negotiation with the target) are too small to reuse
+        if ( lCurrentBuffers->sendCapacity() < this->getMaxSendSize() )
+        {
+          lCurrentBuffers.reset ( new Buffers ( this->getMaxSendSize() , this->getMaxReplySize() ) );
+          ++mBufferPoolStatistics.allocated;
+        }
+
+        lCurrentBuffers->clear();
+        mBufferPoolStatistics.size = mBuffers.size();
+        mBufferPoolStatistics.peakInUse = std::max ( mBufferPoolStatistics.peakInUse , ++mBufferPoolStatistics.inUse );
+
+        if ( mThreadLocalQueuing )
+        {
+          mThreadLocalBuffers->mGeneration = mBufferGeneration;
+        }
+      }
+      this->preamble ( lCurrentBuffers );
+    }
+  }
+
+
+  void ClientInterface::fillBufferPool ( const uint32_t& aCount )
+  {
+    while ( mBuffers.size() < aCount )
+    {
+      mBuffers.push_back ( boost::shared_ptr< Buffers > ( new Buffers ( this->getMaxSendSize() , this->getMaxReplySize() ) ) );
+      ++mBufferPoolStatistics.allocated;
+    }
+
+    mBufferPoolStatistics.size = mBuffers.size();
+    mBufferPoolStatistics.peakSize = std::max ( mBufferPoolStatistics.peakSize , mBufferPoolStatistics.size );
+  }
+
+
+  void ClientInterface::releaseToBufferPool ( boost::shared_ptr< Buffers >& aBuffers )
+  {
+    if ( mBufferPoolStatistics.inUse )
+    {
+      --mBufferPoolStatistics.inUse;
+    }
+
+    if ( mBuffers.size() < bufferPoolHighWaterMark() )
+    {
+      mBuffers.push_back ( aBuffers );
+      mBufferPoolStatistics.size = mBuffers.size();
+      mBufferPoolStatistics.peakSize = std::max ( mBufferPoolStatistics.peakSize , mBufferPoolStatistics.size );
+    }
+    else
+    {
+      ++mBufferPoolStatistics.trimmed;
+    }
+
+    aBuffers.reset();
+  }
+
+
+  uint32_t ClientInterface::bufferPoolHighWaterMark() const
+  {
+    if ( mBufferPoolHighWaterMark )
+    {
+      return mBufferPoolHighWaterMark;
+    }
+
+    return std::max ( mBufferPoolPreallocation , mBufferPoolStatistics.peakInUse );
+  }
+
+
+  void ClientInterface::discardQueuedBuffers()
+  {
+    boost::lock_guard<boost::mutex> lLock ( mBufferMutex );
+    ++mBufferGeneration;
+
+#ifdef NO_PREEMPTIVE_DISPATCH
+
+    for ( std::deque < boost::shared_ptr< Buffers > >::iterator lIt = mNoPreemptiveDispatchBuffers.begin(); lIt != mNoPreemptiveDispatchBuffers.end(); ++lIt )
+    {
+      releaseToBufferPool ( *lIt );
+    }
+
+    mNoPreemptiveDispatchBuffers.clear();
+#endif
+
+    // The buffers being filled have not been passed to the transport layer, so can be reused once cleared; those of other threads are discarded when they next dispatch
+    if ( mCurrentBuffers )
+    {
+      releaseToBufferPool ( mCurrentBuffers );
+    }
+
+    if ( mThreadLocalBuffers.get() && mThreadLocalBuffers->mBuffers )
+    {
+      releaseToBufferPool ( mThreadLocalBuffers->mBuffers );
+    }
+  }
+
+
+  void ClientInterface::deleteBuffers()
+  {
+    boost::lock_guard<boost::mutex> lLock ( mBufferMutex );
+    mBuffers.clear();
+    mBufferPoolStatistics.size = 0;
+    ++mBufferGeneration;
+
+#ifdef NO_PREEMPTIVE_DISPATCH
+    mNoPreemptiveDispatchBuffers.clear();
+#endif
+
+    if ( mCurrentBuffers )
+    {
+      mCurrentBuffers.reset();
+    }
+
+    if ( mThreadLocalBuffers.get() )
+    {
+      mThreadLocalBuffers->mBuffers.reset();
+    }
+  }
+
+
+  void ClientInterface::dispatchExceptionHandler()
+  {
+    // The idle buffers in the pool hold no protocol state, so are kept to avoid reallocating them during recovery
+    discardQueuedBuffers();
+
+    // Writes which were queued may have been lost, so the values of the cacheable registers can no longer be trusted
+    if ( mShadowCacheInUse )
+    {
+      invalidateShadowCache();
+    }
+  }
+
+
+  std::pair < ValHeader , _ValHeader_* > ClientInterface::CreateValHeader()
   {
     ValHeader lReply;
     return std::make_pair ( lReply , & ( * ( lReply.mMembers ) ) );
@@ -445,14 +985,22 @@ namespace uhal
   //-------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
   ValHeader ClientInterface::write ( const uint32_t& aAddr, const uint32_t& aSource )
   {
-    boost::lock_guard<boost::mutex> lLock ( mUserSideMutex );
-    return implementWrite ( aAddr , aSource );
+    UserSideLock lLock ( *this );
+    ValHeader lReply ( implementWrite ( aAddr , aSource ) );
+    countTransaction ( ClientMetrics::WRITE , 1 );
+
+    if ( mShadowCacheInUse )
+    {
+      updateShadowRegister ( aAddr , aSource , lReply );
+    }
+
+    return lReply;
   }
 
 
   ValHeader ClientInterface::write ( const uint32_t& aAddr, const uint32_t& aSource, const uint32_t& aMask )
   {
-    boost::lock_guard<boost::mutex> lLock ( mUserSideMutex );
+    UserSideLock lLock ( *this );
     uint32_t lShiftSize ( utilities::TrailingRightBits ( aMask ) );
     uint32_t lBitShiftedSource ( aSource << lShiftSize );
 
@@ -475,14 +1023,99 @@ namespace uhal
       throw lExc;
     }
 
-    return ( ValHeader ) ( implementRMWbits ( aAddr , ~aMask , lBitShiftedSource & aMask ) );
+    if ( mShadowCacheInUse )
+    {
+      bool lCacheable ( false );
+      bool lKnown ( false );
+      uint32_t lValue ( 0 );
+      ValHeader lLastWrite;
+      {
+        boost::lock_guard<boost::mutex> lCacheLock ( mShadowCacheMutex );
+        boost::unordered_map< uint32_t , ShadowRegister >::iterator lIt ( mShadowCache.find ( aAddr ) );
+
+        if ( lIt != mShadowCache.end() )
+        {
+          lCacheable = true;
+          lKnown = getShadowValue ( lIt->second , lValue );
+          lLastWrite = lIt->second.mLastWrite;
+        }
+      }
+
+      if ( lKnown )
+      {
+        lValue = ( lValue & ~aMask ) | ( lBitShiftedSource & aMask );
+        // If the last transaction in the filling buffer is a write to this register, overwrite its value rather than queue another transaction
+        boost::shared_ptr< Buffers >& lBuffers ( getCurrentBuffers() );
+        uint32_t* lPatchable ( lBuffers ? lBuffers->getPatchableWord ( aAddr ) : NULL );
+        ValHeader lReply;
+
+        if ( lPatchable )
+        {
+          *lPatchable = lValue;
+          lReply = lLastWrite;
+        }
+        else
+        {
+          lReply = implementWrite ( aAddr , lValue );
+          countTransaction ( ClientMetrics::WRITE , 1 );
+        }
+
+        updateShadowRegister ( aAddr , lValue , lReply );
+        boost::lock_guard<boost::mutex> lCacheLock ( mShadowCacheMutex );
+        ++ ( lPatchable ? mShadowCacheStatistics.mergedWrites : mShadowCacheStatistics.convertedWrites );
+        return lReply;
+      }
+
+      if ( lCacheable )
+      {
+        // The read-modify-write returns the value of the whole register, but which value (before or after the modification) depends on the protocol version, so the value is left unknown
+        ValHeader lReply ( implementRMWbits ( aAddr , ~aMask , lBitShiftedSource & aMask ) );
+        countTransaction ( ClientMetrics::RMW_BITS , 1 );
+        invalidateShadowCache ( aAddr );
+        return lReply;
+      }
+    }
+
+    ValHeader lReply ( implementRMWbits ( aAddr , ~aMask , lBitShiftedSource & aMask ) );
+    countTransaction ( ClientMetrics::RMW_BITS , 1 );
+    return lReply;
   }
 
 
   ValHeader ClientInterface::writeBlock ( const uint32_t& aAddr, const std::vector< uint32_t >& aSource, const defs::BlockReadWriteMode& aMode )
   {
-    boost::lock_guard<boost::mutex> lLock ( mUserSideMutex );
-    return implementWriteBlock ( aAddr, aSource, aMode );
+    UserSideLock lLock ( *this );
+    ValHeader lReply ( implementWriteBlock ( aAddr, aSource, aMode ) );
+    countTransaction ( aMode == defs::NON_INCREMENTAL ? ClientMetrics::NON_INCREMENTAL_WRITE : ClientMetrics::WRITE , aSource.size() );
+    invalidateShadowRange ( aAddr , aSource.size() , aMode );
+    return lReply;
+  }
+
+
+  ValHeader ClientInterface::writeBlock ( const uint32_t& aAddr, const uint32_t* aSource, const uint32_t& aSize, const defs::BlockReadWriteMode& aMode )
+  {
+    UserSideLock lLock ( *this );
+    ValHeader lReply ( implementWriteBlock ( aAddr, aSource, aSize, aMode, boost::shared_ptr< const void >() ) );
+    countTransaction ( aMode == defs::NON_INCREMENTAL ? ClientMetrics::NON_INCREMENTAL_WRITE : ClientMetrics::WRITE , aSize );
+    invalidateShadowRange ( aAddr , aSize , aMode );
+    return lReply;
+  }
+
+
+  ValHeader ClientInterface::writeBlock ( const uint32_t& aAddr, const boost::shared_ptr< const std::vector< uint32_t > >& aSource, const defs::BlockReadWriteMode& aMode )
+  {
+    if ( ! aSource )
+    {
+      exception::NullBufferException lExc;
+      log ( lExc , "Null shared buffer passed to writeBlock for address " , Integer ( aAddr , IntFmt<hex,fixed>() ) );
+      throw lExc;
+    }
+
+    UserSideLock lLock ( *this );
+    ValHeader lReply ( implementWriteBlock ( aAddr, aSource->empty() ? NULL : & ( aSource->at ( 0 ) ), aSource->size(), aMode, aSource ) );
+    countTransaction ( aMode == defs::NON_INCREMENTAL ? ClientMetrics::NON_INCREMENTAL_WRITE : ClientMetrics::WRITE , aSource->size() );
+    invalidateShadowRange ( aAddr , aSource->size() , aMode );
+    return lReply;
   }
   //-------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
@@ -490,22 +1123,79 @@ namespace uhal
   //-------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
   ValWord< uint32_t > ClientInterface::read ( const uint32_t& aAddr )
   {
-    boost::lock_guard<boost::mutex> lLock ( mUserSideMutex );
-    return implementRead ( aAddr );
+    return read ( aAddr , defs::NOMASK );
   }
 
 
   ValWord< uint32_t > ClientInterface::read ( const uint32_t& aAddr, const uint32_t& aMask )
   {
-    boost::lock_guard<boost::mutex> lLock ( mUserSideMutex );
-    return implementRead ( aAddr, aMask );
+    UserSideLock lLock ( *this );
+
+    if ( ! mShadowCacheInUse )
+    {
+      ValWord< uint32_t > lReply ( implementRead ( aAddr, aMask ) );
+      countTransaction ( ClientMetrics::READ , 1 );
+      return lReply;
+    }
+
+    bool lCacheable ( false );
+    uint32_t lValue ( 0 );
+    {
+      boost::lock_guard<boost::mutex> lCacheLock ( mShadowCacheMutex );
+      boost::unordered_map< uint32_t , ShadowRegister >::iterator lIt ( mShadowCache.find ( aAddr ) );
+
+      if ( lIt != mShadowCache.end() )
+      {
+        if ( getShadowValue ( lIt->second , lValue ) )
+        {
+          ++mShadowCacheStatistics.hits;
+          std::pair < ValWord<uint32_t> , _ValWord_<uint32_t>* > lReply ( CreateValWord ( lValue , aMask ) );
+          lReply.second->valid = true;
+          return lReply.first;
+        }
+
+        lCacheable = true;
+        ++mShadowCacheStatistics.misses;
+      }
+    }
+
+    ValWord< uint32_t > lReply ( implementRead ( aAddr, aMask ) );
+    countTransaction ( ClientMetrics::READ , 1 );
+
+    if ( lCacheable )
+    {
+      // The reply holds the whole register, whatever the mask, so fills the cache once it has been validated
+      boost::lock_guard<boost::mutex> lCacheLock ( mShadowCacheMutex );
+      boost::unordered_map< uint32_t , ShadowRegister >::iterator lIt ( mShadowCache.find ( aAddr ) );
+
+      if ( lIt != mShadowCache.end() )
+      {
+        lIt->second.mGeneration = mShadowCacheGeneration;
+        lIt->second.mKnown = false;
+        lIt->second.mPending = true;
+        lIt->second.mPendingRead = lReply;
+      }
+    }
+
+    return lReply;
   }
 
 
   ValVector< uint32_t > ClientInterface::readBlock ( const uint32_t& aAddr, const uint32_t& aSize, const defs::BlockReadWriteMode& aMode )
   {
-    boost::lock_guard<boost::mutex> lLock ( mUserSideMutex );
-    return implementReadBlock ( aAddr, aSize, aMode );
+    UserSideLock lLock ( *this );
+    ValVector< uint32_t > lReply ( implementReadBlock ( aAddr, aSize, aMode ) );
+    countTransaction ( aMode == defs::NON_INCREMENTAL ? ClientMetrics::NON_INCREMENTAL_READ : ClientMetrics::READ , aSize );
+    return lReply;
+  }
+
+
+  ValHeader ClientInterface::readBlock ( const uint32_t& aAddr, const uint32_t& aSize, uint32_t* aDestination, const defs::BlockReadWriteMode& aMode )
+  {
+    UserSideLock lLock ( *this );
+    ValHeader lReply ( implementReadBlock ( aAddr, aSize, aDestination, aMode ) );
+    countTransaction ( aMode == defs::NON_INCREMENTAL ? ClientMetrics::NON_INCREMENTAL_READ : ClientMetrics::READ , aSize );
+    return lReply;
   }
   //-------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
@@ -513,8 +1203,11 @@ namespace uhal
   //-------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
   ValWord< uint32_t > ClientInterface::rmw_bits ( const uint32_t& aAddr , const uint32_t& aANDterm , const uint32_t& aORterm )
   {
-    boost::lock_guard<boost::mutex> lLock ( mUserSideMutex );
-    return implementRMWbits ( aAddr , aANDterm , aORterm );
+    UserSideLock lLock ( *this );
+    ValWord< uint32_t > lReply ( implementRMWbits ( aAddr , aANDterm , aORterm ) );
+    countTransaction ( ClientMetrics::RMW_BITS , 1 );
+    invalidateShadowRange ( aAddr , 1 , defs::NON_INCREMENTAL );
+    return lReply;
   }
   //-------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
@@ -522,12 +1215,298 @@ namespace uhal
   //-------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
   ValWord< uint32_t > ClientInterface::rmw_sum ( const uint32_t& aAddr , const int32_t& aAddend )
   {
-    boost::lock_guard<boost::mutex> lLock ( mUserSideMutex );
-    return implementRMWsum ( aAddr , aAddend );
+    UserSideLock lLock ( *this );
+    ValWord< uint32_t > lReply ( implementRMWsum ( aAddr , aAddend ) );
+    countTransaction ( ClientMetrics::RMW_SUM , 1 );
+    invalidateShadowRange ( aAddr , 1 , defs::NON_INCREMENTAL );
+    return lReply;
+  }
+  //-------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+
+  //-------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+  ValHeader ClientInterface::replay ( TransactionProgram& aProgram )
+  {
+    UserSideLock lLock ( *this );
+
+    if ( aProgram.mEncodedFor != this )
+    {
+      aProgram.clearEncoding();
+      implementEncode ( aProgram );
+      aProgram.mEncodedFor = this;
+    }
+
+    std::pair < ValHeader , _ValHeader_* > lReply ( CreateValHeader() );
+    aProgram.mReply = lReply.first;
+    boost::shared_ptr< Buffers > lBuffers;
+
+    for ( std::vector< TransactionProgram::Packet >::const_iterator lIt = aProgram.mPackets.begin() ; lIt != aProgram.mPackets.end() ; ++lIt )
+    {
+      lBuffers = reserveBufferSpace ( lIt->mSend.size() , lIt->mReplyByteCount );
+      lBuffers->send ( & ( lIt->mSend.at ( 0 ) ) , lIt->mSend.size() );
+
+      for ( std::vector< std::pair< uint8_t* , uint32_t > >::const_iterator lReplyIt = lIt->mReplies.begin() ; lReplyIt != lIt->mReplies.end() ; ++lReplyIt )
+      {
+        lBuffers->receive ( lReplyIt->first , lReplyIt->second );
+      }
+    }
+
+    if ( mMetricsEnabled.load ( boost::memory_order_relaxed ) )
+    {
+      for ( std::vector< TransactionProgram::Operation >::const_iterator lIt = aProgram.mOperations.begin() ; lIt != aProgram.mOperations.end() ; ++lIt )
+      {
+        switch ( lIt->mType )
+        {
+          case TransactionProgram::WRITE :
+            countTransaction ( ClientMetrics::WRITE , 1 );
+            break;
+          case TransactionProgram::MASKED_WRITE :
+          case TransactionProgram::RMW_BITS :
+            countTransaction ( ClientMetrics::RMW_BITS , 1 );
+            break;
+          case TransactionProgram::WRITE_BLOCK :
+            countTransaction ( lIt->mMode == defs::NON_INCREMENTAL ? ClientMetrics::NON_INCREMENTAL_WRITE : ClientMetrics::WRITE , lIt->mSize );
+            break;
+          case TransactionProgram::READ :
+            countTransaction ( ClientMetrics::READ , 1 );
+            break;
+          case TransactionProgram::READ_BLOCK :
+            countTransaction ( lIt->mMode == defs::NON_INCREMENTAL ? ClientMetrics::NON_INCREMENTAL_READ : ClientMetrics::READ , lIt->mSize );
+            break;
+          case TransactionProgram::RMW_SUM :
+            countTransaction ( ClientMetrics::RMW_SUM , 1 );
+            break;
+        }
+      }
+    }
+
+    // The writes recorded in the program are not decoded again, so any of the cacheable registers may have been modified
+    if ( mShadowCacheInUse )
+    {
+      invalidateShadowCache();
+    }
+
+    if ( lBuffers )
+    {
+      lBuffers->add ( lReply.first ); //we store the valmem in the last packet so that, if the program is split over many packets, the valmem is guaranteed to still exist when the other packets come back...
+    }
+    else
+    {
+      // An empty program has nothing to wait for
+      lReply.second->valid = true;
+    }
+
+    return lReply.first;
+  }
+  //-------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+
+  BatchResult ClientInterface::batch ( const std::vector< BatchOperation >& aOperations )
+  {
+    boost::shared_ptr< std::vector< uint32_t > > lMasks;
+
+    for ( std::size_t i = 0 ; i != aOperations.size() ; ++i )
+    {
+      if ( aOperations[i].mMask != defs::NOMASK )
+      {
+        if ( ! lMasks )
+        {
+          lMasks.reset ( new std::vector< uint32_t > ( aOperations.size() , defs::NOMASK ) );
+        }
+
+        ( *lMasks ) [i] = aOperations[i].mMask;
+      }
+    }
+
+    UserSideLock lLock ( *this );
+    BatchResult lResult ( implementBatch ( aOperations ) , lMasks );
+
+    if ( mMetricsEnabled.load ( boost::memory_order_relaxed ) )
+    {
+      for ( std::vector< BatchOperation >::const_iterator lIt = aOperations.begin() ; lIt != aOperations.end() ; ++lIt )
+      {
+        switch ( lIt->mType )
+        {
+          case BatchOperation::READ :
+            countTransaction ( ClientMetrics::READ , 1 );
+            break;
+          case BatchOperation::WRITE :
+            countTransaction ( ClientMetrics::WRITE , 1 );
+            break;
+          case BatchOperation::RMW_BITS :
+            countTransaction ( ClientMetrics::RMW_BITS , 1 );
+            break;
+          case BatchOperation::RMW_SUM :
+            countTransaction ( ClientMetrics::RMW_SUM , 1 );
+            break;
+        }
+      }
+    }
+
+    if ( mShadowCacheInUse )
+    {
+      for ( std::vector< BatchOperation >::const_iterator lIt = aOperations.begin() ; lIt != aOperations.end() ; ++lIt )
+      {
+        if ( lIt->mType != BatchOperation::READ )
+        {
+          invalidateShadowCache ( lIt->mAddr );
+        }
+      }
+    }
+
+    return lResult;
+  }
+
+
+  void ClientInterface::setCacheable ( const uint32_t& aAddr , const bool& aCacheable )
+  {
+    boost::lock_guard<boost::mutex> lLock ( mShadowCacheMutex );
+
+    if ( aCacheable )
+    {
+      mShadowCache.insert ( std::make_pair ( aAddr , ShadowRegister() ) );
+      mShadowCacheInUse = true;
+    }
+    else
+    {
+      mShadowCache.erase ( aAddr );
+    }
+  }
+
+
+  bool ClientInterface::isCacheable ( const uint32_t& aAddr )
+  {
+    boost::lock_guard<boost::mutex> lLock ( mShadowCacheMutex );
+    return mShadowCache.find ( aAddr ) != mShadowCache.end();
+  }
+
+
+  void ClientInterface::invalidateShadowCache ()
+  {
+    boost::lock_guard<boost::mutex> lLock ( mShadowCacheMutex );
+    ++mShadowCacheGeneration;
+  }
+
+
+  void ClientInterface::invalidateShadowCache ( const uint32_t& aAddr )
+  {
+    boost::lock_guard<boost::mutex> lLock ( mShadowCacheMutex );
+    boost::unordered_map< uint32_t , ShadowRegister >::iterator lIt ( mShadowCache.find ( aAddr ) );
+
+    if ( lIt != mShadowCache.end() )
+    {
+      lIt->second.mKnown = false;
+      lIt->second.mPending = false;
+    }
+  }
+
+
+  ClientInterface::ShadowCacheStatistics ClientInterface::getShadowCacheStatistics()
+  {
+    boost::lock_guard<boost::mutex> lLock ( mShadowCacheMutex );
+    return mShadowCacheStatistics;
+  }
+
+
+  bool ClientInterface::getShadowValue ( ShadowRegister& aRegister , uint32_t& aValue )
+  {
+    if ( aRegister.mGeneration != mShadowCacheGeneration )
+    {
+      return false;
+    }
+
+    if ( aRegister.mPending && aRegister.mPendingRead.valid() )
+    {
+      aRegister.mKnown = true;
+      aRegister.mValue = aRegister.mPendingRead.mMembers->value;
+      aRegister.mPending = false;
+    }
+
+    aValue = aRegister.mValue;
+    return aRegister.mKnown;
+  }
+
+
+  void ClientInterface::updateShadowRegister ( const uint32_t& aAddr , const uint32_t& aValue , const ValHeader& aReply )
+  {
+    {
+      boost::lock_guard<boost::mutex> lLock ( mShadowCacheMutex );
+      boost::unordered_map< uint32_t , ShadowRegister >::iterator lIt ( mShadowCache.find ( aAddr ) );
+
+      if ( lIt == mShadowCache.end() )
+      {
+        return;
+      }
+
+      lIt->second.mGeneration = mShadowCacheGeneration;
+      lIt->second.mKnown = true;
+      lIt->second.mValue = aValue;
+      lIt->second.mPending = false;
+      lIt->second.mLastWrite = aReply;
+    }
+
+    boost::shared_ptr< Buffers >& lBuffers ( getCurrentBuffers() );
+
+    if ( lBuffers )
+    {
+      lBuffers->setPatchableWord ( aAddr );
+    }
+  }
+
+
+  void ClientInterface::invalidateShadowRange ( const uint32_t& aAddr , const uint32_t& aSize , const defs::BlockReadWriteMode& aMode )
+  {
+    if ( ( ! mShadowCacheInUse ) || ( aSize == 0 ) )
+    {
+      return;
+    }
+
+    if ( aMode == defs::NON_INCREMENTAL )
+    {
+      invalidateShadowCache ( aAddr );
+      return;
+    }
+
+    boost::lock_guard<boost::mutex> lLock ( mShadowCacheMutex );
+
+    for ( boost::unordered_map< uint32_t , ShadowRegister >::iterator lIt = mShadowCache.begin() ; lIt != mShadowCache.end() ; ++lIt )
+    {
+      if ( ( lIt->first - aAddr ) < aSize )
+      {
+        lIt->second.mKnown = false;
+        lIt->second.mPending = false;
+      }
+    }
   }
   //-------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
 
+  void ClientInterface::setMetricsEnabled ( const bool& aEnabled )
+  {
+    mMetricsEnabled.store ( aEnabled , boost::memory_order_relaxed );
+  }
+
+
+  bool ClientInterface::getMetricsEnabled() const
+  {
+    return mMetricsEnabled.load ( boost::memory_order_relaxed );
+  }
+
+
+  ClientMetrics ClientInterface::getMetrics() const
+  {
+    ClientMetrics lMetrics;
+    mMetrics.get ( lMetrics );
+    return lMetrics;
+  }
+
+
+  void ClientInterface::resetMetrics()
+  {
+    mMetrics.reset();
+  }
+
+
   void ClientInterface::setTimeoutPeriod ( const uint32_t& aTimeoutPeriod )
   {
     boost::lock_guard<boost::mutex> lLock ( mUserSideMutex );
@@ -550,6 +1529,74 @@ namespace uhal
   }
 
 
+  void ClientInterface::setThreadLocalQueuing ( const bool& aThreadLocalQueuing )
+  {
+    boost::lock_guard<boost::mutex> lLock ( mUserSideMutex );
+    mThreadLocalQueuing = aThreadLocalQueuing;
+  }
+
+
+  bool ClientInterface::getThreadLocalQueuing() const
+  {
+    return mThreadLocalQueuing;
+  }
+
+
+  void ClientInterface::setBufferPoolPreallocation ( const uint32_t& aCount )
+  {
+    boost::lock_guard<boost::mutex> lLock ( mBufferMutex );
+    mBufferPoolPreallocation = aCount;
+    fillBufferPool ( aCount );
+  }
+
+
+  uint32_t ClientInterface::getBufferPoolPreallocation()
+  {
+    boost::lock_guard<boost::mutex> lLock ( mBufferMutex );
+    return mBufferPoolPreallocation;
+  }
+
+
+  void ClientInterface::setBufferPoolHighWaterMark ( const uint32_t& aCount )
+  {
+    boost::lock_guard<boost::mutex> lLock ( mBufferMutex );
+    mBufferPoolHighWaterMark = aCount;
+    const uint32_t lHighWaterMark ( bufferPoolHighWaterMark() );
+
+    while ( mBuffers.size() > lHighWaterMark )
+    {
+      mBuffers.pop_back();
+      ++mBufferPoolStatistics.trimmed;
+    }
+
+    mBufferPoolStatistics.size = mBuffers.size();
+  }
+
+
+  uint32_t ClientInterface::getBufferPoolHighWaterMark()
+  {
+    boost::lock_guard<boost::mutex> lLock ( mBufferMutex );
+    return bufferPoolHighWaterMark();
+  }
+
+
+  ClientInterface::BufferPoolStatistics ClientInterface::getBufferPoolStatistics()
+  {
+    boost::lock_guard<boost::mutex> lLock ( mBufferMutex );
+    return mBufferPoolStatistics;
+  }
+
+
+  void ClientInterface::resetBufferPoolStatistics()
+  {
+    boost::lock_guard<boost::mutex> lLock ( mBufferMutex );
+    const uint32_t lInUse ( mBufferPoolStatistics.inUse );
+    mBufferPoolStatistics = BufferPoolStatistics();
+    mBufferPoolStatistics.size = mBufferPoolStatistics.peakSize = mBuffers.size();
+    mBufferPoolStatistics.inUse = mBufferPoolStatistics.peakInUse = lInUse;
+  }
+
+
   const boost::posix_time::time_duration& ClientInterface::getBoostTimeoutPeriod()
   {
     return mTimeoutPeriod;
@@ -0,0 +1,228 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+
+#include "uhal/ClientMetrics.hpp"
+
+
+namespace uhal
+{
+
+  LatencyHistogram::LatencyHistogram() :
+    entries ( 0 ),
+    total ( 0 ),
+    max ( 0 ),
+    buckets ( NUMBER_OF_BUCKETS , 0 )
+  {
+  }
+
+
+  uint64_t LatencyHistogram::upperEdge ( const uint32_t& aBucket )
+  {
+    return uint64_t ( 1 ) << aBucket;
+  }
+
+
+  double LatencyHistogram::mean() const
+  {
+    return entries ? double ( total ) / double ( entries ) : 0.0;
+  }
+
+
+  TransactionMetrics::TransactionMetrics() :
+    transactions ( 0 ),
+    words ( 0 ),
+    latency()
+  {
+  }
+
+
+  ClientMetrics::ClientMetrics() :
+    transactions ( NUMBER_OF_TRANSACTION_TYPES ),
+    packets ( 0 ),
+    sentBytes ( 0 ),
+    receivedBytes ( 0 ),
+    dispatches ( 0 ),
+    failedDispatches ( 0 ),
+    packetLatency(),
+    dispatchLatency()
+  {
+  }
+
+
+  const TransactionMetrics& ClientMetrics::transaction ( const TransactionType& aType ) const
+  {
+    return transactions.at ( aType );
+  }
+
+
+  AtomicLatencyHistogram::AtomicLatencyHistogram()
+  {
+    reset();
+  }
+
+
+  void AtomicLatencyHistogram::add ( const uint64_t& aLatency , const uint64_t& aWeight )
+  {
+    uint32_t lBucket ( 0 );
+
+    while ( ( lBucket != LatencyHistogram::NUMBER_OF_BUCKETS - 1 ) && ( aLatency >> lBucket ) )
+    {
+      ++lBucket;
+    }
+
+    mBuckets[ lBucket ].fetch_add ( aWeight , boost::memory_order_relaxed );
+    mEntries.fetch_add ( aWeight , boost::memory_order_relaxed );
+    mTotal.fetch_add ( aLatency * aWeight , boost::memory_order_relaxed );
+    uint64_t lMax ( mMax.load ( boost::memory_order_relaxed ) );
+
+    while ( ( aLatency > lMax ) && ! mMax.compare_exchange_weak ( lMax , aLatency , boost::memory_order_relaxed ) )
+    {
+    }
+  }
+
+
+  void AtomicLatencyHistogram::get ( LatencyHistogram& aSnapshot ) const
+  {
+    aSnapshot.entries = mEntries.load ( boost::memory_order_relaxed );
+    aSnapshot.total = mTotal.load ( boost::memory_order_relaxed );
+    aSnapshot.max = mMax.load ( boost::memory_order_relaxed );
+    aSnapshot.buckets.resize ( LatencyHistogram::NUMBER_OF_BUCKETS );
+
+    for ( uint32_t i = 0 ; i != LatencyHistogram::NUMBER_OF_BUCKETS ; ++i )
+    {
+      aSnapshot.buckets[i] = mBuckets[i].load ( boost::memory_order_relaxed );
+    }
+  }
+
+
+  void AtomicLatencyHistogram::reset()
+  {
+    mEntries.store ( 0 , boost::memory_order_relaxed );
+    mTotal.store ( 0 , boost::memory_order_relaxed );
+    mMax.store ( 0 , boost::memory_order_relaxed );
+
+    for ( uint32_t i = 0 ; i != LatencyHistogram::NUMBER_OF_BUCKETS ; ++i )
+    {
+      mBuckets[i].store ( 0 , boost::memory_order_relaxed );
+    }
+  }
+
+
+  ClientMetricsCounters::ClientMetricsCounters()
+  {
+    reset();
+  }
+
+
+  void ClientMetricsCounters::countTransaction ( const ClientMetrics::TransactionType& aType , const uint32_t& aWords )
+  {
+    mTransactions[ aType ].fetch_add ( 1 , boost::memory_order_relaxed );
+    mWords[ aType ].fetch_add ( aWords , boost::memory_order_relaxed );
+  }
+
+
+  void ClientMetricsCounters::countPacket ( const uint32_t& aBytes )
+  {
+    mPackets.fetch_add ( 1 , boost::memory_order_relaxed );
+    mSentBytes.fetch_add ( aBytes , boost::memory_order_relaxed );
+  }
+
+
+  void ClientMetricsCounters::countReply ( const uint32_t& aBytes , const uint64_t& aLatency , const uint32_t* aTransactionCounts )
+  {
+    mReceivedBytes.fetch_add ( aBytes , boost::memory_order_relaxed );
+    mPacketLatency.add ( aLatency );
+
+    for ( uint32_t i = 0 ; i != ClientMetrics::NUMBER_OF_TRANSACTION_TYPES ; ++i )
+    {
+      if ( aTransactionCounts[i] )
+      {
+        mTransactionLatency[i].add ( aLatency , aTransactionCounts[i] );
+      }
+    }
+  }
+
+
+  void ClientMetricsCounters::countDispatch ( const bool& aSucceeded , const uint64_t& aLatency )
+  {
+    if ( ! aSucceeded )
+    {
+      mFailedDispatches.fetch_add ( 1 , boost::memory_order_relaxed );
+      return;
+    }
+
+    mDispatches.fetch_add ( 1 , boost::memory_order_relaxed );
+    mDispatchLatency.add ( aLatency );
+  }
+
+
+  void ClientMetricsCounters::get ( ClientMetrics& aSnapshot ) const
+  {
+    aSnapshot.transactions.resize ( ClientMetrics::NUMBER_OF_TRANSACTION_TYPES );
+
+    for ( uint32_t i = 0 ; i != ClientMetrics::NUMBER_OF_TRANSACTION_TYPES ; ++i )
+    {
+      aSnapshot.transactions[i].transactions = mTransactions[i].load ( boost::memory_order_relaxed );
+      aSnapshot.transactions[i].words = mWords[i].load ( boost::memory_order_relaxed );
+      mTransactionLatency[i].get ( aSnapshot.transactions[i].latency );
+    }
+
+    aSnapshot.packets = mPackets.load ( boost::memory_order_relaxed );
+    aSnapshot.sentBytes = mSentBytes.load ( boost::memory_order_relaxed );
+    aSnapshot.receivedBytes = mReceivedBytes.load ( boost::memory_order_relaxed );
+    aSnapshot.dispatches = mDispatches.load ( boost::memory_order_relaxed );
+    aSnapshot.failedDispatches = mFailedDispatches.load ( boost::memory_order_relaxed );
+    mPacketLatency.get ( aSnapshot.packetLatency );
+    mDispatchLatency.get ( aSnapshot.dispatchLatency );
+  }
+
+
+  void ClientMetricsCounters::reset()
+  {
+    for ( uint32_t i = 0 ; i != ClientMetrics::NUMBER_OF_TRANSACTION_TYPES ; ++i )
+    {
+      mTransactions[i].store ( 0 , boost::memory_order_relaxed );
+      mWords[i].store ( 0 , boost::memory_order_relaxed );
+      mTransactionLatency[i].reset();
+    }
+
+    mPackets.store ( 0 , boost::memory_order_relaxed );
+    mSentBytes.store ( 0 , boost::memory_order_relaxed );
+    mReceivedBytes.store ( 0 , boost::memory_order_relaxed );
+    mDispatches.store ( 0 , boost::memory_order_relaxed );
+    mFailedDispatches.store ( 0 , boost::memory_order_relaxed );
+    mPacketLatency.reset();
+    mDispatchLatency.reset();
+  }
+
+}
@@ -0,0 +1,250 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+
+
+
+#include "uhal/FifoReader.hpp"
+
+
+#include <algorithm>
+#include <exception>
+
+#include <boost/bind/bind.hpp>
+
+#include "uhal/ClientInterface.hpp"
+#include "uhal/Node.hpp"
+#include "uhal/ValMem.hpp"
+#include "uhal/log/LogLevels.hpp"
+#include "uhal/log/log_inserters.integer.hpp"
+#include "uhal/log/log_inserters.quote.hpp"
+#include "uhal/log/log.hpp"
+
+
+namespace uhal
+{
+
+  FifoReader::FifoReader ( const Node& aPort , const uint32_t& aChunkSize , const uint32_t& aMaxChunksInFlight ) :
+    mPort ( aPort ),
+    mChunkSize ( std::max ( aChunkSize , uint32_t ( 1 ) ) ),
+    mChunks(),
+    mFreeChunks(),
+    mCallback(),
+    mException ( NULL ),
+    mWordsDelivered ( 0 )
+  {
+    if ( ( aPort.getMode() != defs::NON_INCREMENTAL ) || ! ( aPort.getPermission() & defs::READ ) )
+    {
+      exception::FifoReadoutRequiresPort lExc;
+      log ( lExc , "Node " , Quote ( aPort.getPath() ) , " cannot be read out as a FIFO, since it is not a readable, non-incrementing port" );
+      throw lExc;
+    }
+
+    if ( ( aPort.getSize() != 1 ) && ( mChunkSize > aPort.getSize() ) )
+    {
+      mChunkSize = aPort.getSize();
+    }
+
+    mChunks.resize ( std::max ( aMaxChunksInFlight , uint32_t ( 1 ) ) , std::vector< uint32_t > ( mChunkSize ) );
+
+    for ( std::size_t i = 0 ; i != mChunks.size() ; ++i )
+    {
+      mFreeChunks.push_back ( i );
+    }
+  }
+
+
+  FifoReader::~FifoReader()
+  {
+  }
+
+
+  uint64_t FifoReader::read ( const uint64_t& aWordCount , const ChunkCallback& aCallback )
+  {
+    ClientInterface& lClient ( mPort.getClient() );
+
+    {
+      boost::lock_guard<boost::mutex> lLock ( mMutex );
+      mCallback = aCallback;
+      mWordsDelivered = 0;
+    }
+
+    uint64_t lRemaining ( aWordCount );
+
+    while ( lRemaining )
+    {
+      std::size_t lChunk;
+      {
+        boost::unique_lock<boost::mutex> lLock ( mMutex );
+
+        while ( mFreeChunks.empty() && ! mException )
+        {
+          mConditionalVariable.wait ( lLock );
+        }
+
+        if ( mException )
+        {
+          break;
+        }
+
+        lChunk = mFreeChunks.front();
+        mFreeChunks.pop_front();
+      }
+
+      const uint32_t lWordCount ( std::min ( lRemaining , uint64_t ( mChunkSize ) ) );
+
+      try
+      {
+        mPort.readBlockInto ( lWordCount , & mChunks.at ( lChunk ).front() );
+      }
+      catch ( exception::exception& aExc )
+      {
+        boost::lock_guard<boost::mutex> lLock ( mMutex );
+        mFreeChunks.push_back ( lChunk );
+        mException = aExc.clone();
+        break;
+      }
+
+      // Once dispatched, the chunk is returned by chunkDone, whether or not the dispatch succeeds
+      lClient.dispatchAsync ( boost::bind ( &FifoReader::chunkDone , this , lChunk , lWordCount , boost::placeholders::_1 ) );
+      lRemaining -= lWordCount;
+    }
+
+    exception::exception* lExc ( NULL );
+    uint64_t lWordsDelivered ( 0 );
+    {
+      boost::unique_lock<boost::mutex> lLock ( mMutex );
+
+      while ( mFreeChunks.size() != mChunks.size() )
+      {
+        mConditionalVariable.wait ( lLock );
+      }
+
+      mCallback.clear();
+      std::swap ( lExc , mException );
+      lWordsDelivered = mWordsDelivered;
+    }
+
+    if ( lExc )
+    {
+      log ( Error() , "FIFO readout of node " , Quote ( mPort.getPath() ) , " failed after " , Integer ( lWordsDelivered ) , " of " , Integer ( aWordCount ) , " words were delivered" );
+
+      try
+      {
+        lExc->ThrowAsDerivedType();
+      }
+      catch ( ... )
+      {
+        delete lExc;
+        throw;
+      }
+    }
+
+    return lWordsDelivered;
+  }
+
+
+  uint64_t FifoReader::readAvailable ( const Node& aOccupancy , const ChunkCallback& aCallback , const uint64_t& aMaxWordCount )
+  {
+    ValWord< uint32_t > lOccupancy ( aOccupancy.read() );
+    aOccupancy.getClient().dispatch();
+    log ( Debug() , "FIFO readout of node " , Quote ( mPort.getPath() ) , ": occupancy register " , Quote ( aOccupancy.getPath() ) , " holds " , Integer ( lOccupancy.value() ) , " words" );
+    return read ( std::min ( uint64_t ( lOccupancy.value() ) , aMaxWordCount ) , aCallback );
+  }
+
+
+  uint32_t FifoReader::getChunkSize() const
+  {
+    return mChunkSize;
+  }
+
+
+  uint32_t FifoReader::getMaxChunksInFlight() const
+  {
+    return mChunks.size();
+  }
+
+
+  void FifoReader::chunkDone ( const std::size_t& aChunk , const uint32_t& aWordCount , exception::exception* aException )
+  {
+    bool lDeliver ( false );
+    {
+      boost::lock_guard<boost::mutex> lLock ( mMutex );
+
+      if ( aException && ! mException )
+      {
+        mException = aException->clone();
+      }
+
+      lDeliver = ! mException;
+    }
+
+    // The chunks are delivered outside the lock, in the order in which their dispatches complete, which is the order in which they were read
+    if ( lDeliver )
+    {
+      try
+      {
+        mCallback ( & mChunks.at ( aChunk ).front() , aWordCount );
+      }
+      catch ( const std::exception& aExc )
+      {
+        exception::FifoReadoutCallbackFailed* lExc = new exception::FifoReadoutCallbackFailed();
+        log ( *lExc , "Exception " , Quote ( aExc.what() ) , " thrown by the function to which FIFO readout of node " , Quote ( mPort.getPath() ) , " delivers its data" );
+        boost::lock_guard<boost::mutex> lLock ( mMutex );
+
+        if ( mException )
+        {
+          delete lExc;
+        }
+        else
+        {
+          mException = lExc;
+        }
+
+        lDeliver = false;
+      }
+    }
+
+    {
+      boost::lock_guard<boost::mutex> lLock ( mMutex );
+
+      if ( lDeliver )
+      {
+        mWordsDelivered += aWordCount;
+      }
+
+      mFreeChunks.push_back ( aChunk );
+    }
+    mConditionalVariable.notify_all();
+  }
+
+}
@@ -71,6 +71,11 @@ namespace uhal
   {
     aNode.mHw = this;
 
+    if ( aNode.hasTag ( "cacheable" ) )
+    {
+      mClientInterface->setCacheable ( aNode.mAddr );
+    }
+
     for ( std::vector< Node* >::iterator lIt = aNode.mChildren.begin(); lIt != aNode.mChildren.end(); ++lIt )
     {
       claimNode ( **lIt );
@@ -107,6 +112,18 @@ namespace uhal
   }
 
 
+  boost::shared_future< void > HwInterface::dispatchAsync ()
+  {
+    return mClientInterface->dispatchAsync ();
+  }
+
+
+  void HwInterface::dispatchAsync ( const ClientInterface::DispatchCallback& aCallback )
+  {
+    mClientInterface->dispatchAsync ( aCallback );
+  }
+
+
   const std::string& HwInterface::id() const
   {
     return mClientInterface->id();
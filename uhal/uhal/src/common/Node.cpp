@@ -32,11 +32,14 @@
 
 #include "uhal/Node.hpp"
 
+#include <algorithm>
 #include <iomanip>
 #ifdef __GNUG__
 #include <cxxabi.h>
 #endif
 
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
 #include <boost/regex.hpp>
 
 #include "uhal/log/log.hpp"
@@ -295,6 +298,19 @@ namespace uhal
   }
 
 
+  bool Node::hasTag ( const std::string& aTag ) const
+  {
+    if ( mTags.find ( aTag ) == std::string::npos )
+    {
+      return false;
+    }
+
+    std::vector< std::string > lTags;
+    boost::split ( lTags , mTags , boost::is_any_of ( ",; \t" ) , boost::token_compress_on );
+    return std::find ( lTags.begin() , lTags.end() , aTag ) != lTags.end();
+  }
+
+
   const std::string& Node::getDescription() const
   {
     return mDescription;
@@ -674,6 +690,36 @@ namespace uhal
   }
 
 
+  ValHeader Node::readBlockInto ( const uint32_t& aSize , uint32_t* aDestination ) const
+  {
+    if ( ( mMode == defs::SINGLE ) && ( aSize != 1 ) ) //We allow the user to call a bulk access of size=1 to a single register
+    {
+      exception::BulkTransferOnSingleRegister lExc;
+      log ( lExc , "Bulk Transfer requested on single register node ", Quote ( this->getPath() ) );
+      log ( lExc , "If you were expecting an incremental read, please modify your address file to add the 'mode=",  Quote ( "incremental" ) , "' flags there" );
+      throw lExc;
+    }
+
+    if ( ( mSize != 1 ) && ( aSize>mSize ) )
+    {
+      exception::BulkTransferRequestedTooLarge lExc;
+      log ( lExc , "Requested bulk read of greater size than the specified endpoint size of node " , Quote ( this->getPath() ) );
+      throw lExc;
+    }
+
+    if ( mPermission & defs::READ )
+    {
+      return mHw->getClient().readBlock ( mAddr , aSize , aDestination , mMode );
+    }
+    else
+    {
+      exception::ReadAccessDenied lExc;
+      log ( lExc , "Node " , Quote ( this->getPath() ) , ": permissions denied read access" );
+      throw lExc;
+    }
+  }
+
+
   ClientInterface& Node::getClient() const
   {
     return mHw->getClient();
@@ -201,23 +201,59 @@ namespace uhal
   }
 
 
+
+  template < typename InnerProtocol >
+  uint32_t ControlHub< InnerProtocol >::getPreambleReplySize()
+  {
+    return InnerProtocol::getPreambleReplySize() + 3;
+  }
+
+
   template < typename InnerProtocol >
   void ControlHub< InnerProtocol >::predispatch ( boost::shared_ptr< Buffers > aBuffers )
   {
     InnerProtocol::predispatch ( aBuffers );
     boost::lock_guard<boost::mutex> lPreamblesLock ( mPreamblesMutex );
-    tpreamble& lPreambles = mPreambles.back();
-    uint32_t lByteCount ( aBuffers->sendCounter() );
-    * ( lPreambles.mSendWordCountPtr ) = htons ( ( lByteCount-8 ) >>2 );
+    uint8_t* lSendBufferStart ( aBuffers->getSendBuffer() );
+    uint8_t* lSendBufferEnd ( lSendBufferStart + aBuffers->sendCounter() );
+
+    for ( typename std::list< tpreamble >::reverse_iterator lIt = mPreambles.rbegin(); lIt != mPreambles.rend(); ++lIt )
+    {
+      uint8_t* lSendWordCount ( reinterpret_cast< uint8_t* > ( lIt->mSendWordCountPtr ) );
+
+      if ( ( lSendWordCount >= lSendBufferStart ) && ( lSendWordCount < lSendBufferEnd ) )
+      {
+        uint32_t lByteCount ( aBuffers->sendCounter() );
+        * ( lIt->mSendWordCountPtr ) = htons ( ( lByteCount-8 ) >>2 );
+        return;
+      }
+    }
+  }
+
+
+  template < typename InnerProtocol >
+  void ControlHub< InnerProtocol >::removePreamble ( const uint8_t* aReplyChunkByteCounter )
+  {
+    boost::lock_guard<boost::mutex> lPreamblesLock ( mPreamblesMutex );
+
+    for ( typename std::list< tpreamble >::iterator lIt = mPreambles.begin(); lIt != mPreambles.end(); ++lIt )
+    {
+      if ( reinterpret_cast< const uint8_t* > ( & ( lIt->mReplyChunkByteCounter ) ) == aReplyChunkByteCounter )
+      {
+        mPreambles.erase ( lIt );
+        return;
+      }
+    }
   }
 
 
   template < typename InnerProtocol >
   exception::exception* ControlHub< InnerProtocol >::validate ( uint8_t* aSendBufferStart ,
       uint8_t* aSendBufferEnd ,
-      std::deque< std::pair< uint8_t* , uint32_t > >::iterator aReplyStartIt ,
-      std::deque< std::pair< uint8_t* , uint32_t > >::iterator aReplyEndIt )
+      std::pair< uint8_t* , uint32_t >* aReplyStartIt ,
+      std::pair< uint8_t* , uint32_t >* aReplyEndIt )
   {
+    const uint8_t* lReplyChunkByteCounter ( aReplyStartIt->first );
     aReplyStartIt++;
     uint32_t lReplyIPaddress ( * ( ( uint32_t* ) ( aReplyStartIt->first ) ) );
 
@@ -227,8 +263,7 @@ namespace uhal
       log ( *lExc , "Returned IP address " , Integer ( lReplyIPaddress , IntFmt< hex , fixed >() ) ,
             " does not match that sent " , Integer ( mDeviceIPaddress, IntFmt< hex , fixed >() ) ,
             " for device with URI: " , this->uri() );
-      boost::lock_guard<boost::mutex> lPreamblesLock ( mPreamblesMutex );
-      mPreambles.pop_front();
+      removePreamble ( lReplyChunkByteCounter );
       return lExc;
     }
 
@@ -241,8 +276,7 @@ namespace uhal
       log ( *lExc , "Returned Port number " , Integer ( lReplyPort ) ,
             " does not match that sent " , Integer ( mDevicePort ) ,
             " for device with URI: " , this->uri() );
-      boost::lock_guard<boost::mutex> lPreamblesLock ( mPreamblesMutex );
-      mPreambles.pop_front();
+      removePreamble ( lReplyChunkByteCounter );
       return lExc;
     }
 
@@ -251,8 +285,7 @@ namespace uhal
 
     if ( lErrorCode != 0 )
     {
-      boost::lock_guard<boost::mutex> lPreamblesLock ( mPreamblesMutex );
-      mPreambles.pop_front();
+      removePreamble ( lReplyChunkByteCounter );
 
       if ( lErrorCode == 1 || lErrorCode == 3 || lErrorCode == 4 )
       {
@@ -269,10 +302,7 @@ namespace uhal
       return lExc;
     }
 
-    {
-      boost::lock_guard<boost::mutex> lPreamblesLock ( mPreamblesMutex );
-      mPreambles.pop_front();
-    }
+    removePreamble ( lReplyChunkByteCounter );
     return InnerProtocol::validate ( ( aSendBufferStart+=8 ) , aSendBufferEnd , ( ++aReplyStartIt ) , aReplyEndIt );
   }
 
@@ -79,6 +79,13 @@ namespace uhal
   }
 
 
+  template< uint8_t IPbus_minor >
+  uint32_t IPbus< 1 , IPbus_minor >::getPreambleReplySize()
+  {
+    return 1;
+  }
+
+
   template< uint8_t IPbus_minor >
   void IPbus< 1 , IPbus_minor >::predispatch ( boost::shared_ptr< Buffers > aBuffers )
   {
@@ -277,6 +284,13 @@ namespace uhal
   }
 
 
+  template< uint8_t IPbus_minor >
+  uint32_t IPbus< 2 , IPbus_minor >::getPreambleReplySize()
+  {
+    return 1;
+  }
+
+
   template< uint8_t IPbus_minor >
   void IPbus< 2 , IPbus_minor >::predispatch ( boost::shared_ptr< Buffers > aBuffers )
   {
@@ -287,8 +301,8 @@ namespace uhal
   template< uint8_t IPbus_minor >
   exception::exception* IPbus< 2 , IPbus_minor >::validate ( uint8_t* aSendBufferStart ,
       uint8_t* aSendBufferEnd ,
-      std::deque< std::pair< uint8_t* , uint32_t > >::iterator aReplyStartIt ,
-      std::deque< std::pair< uint8_t* , uint32_t > >::iterator aReplyEndIt )
+      std::pair< uint8_t* , uint32_t >* aReplyStartIt ,
+      std::pair< uint8_t* , uint32_t >* aReplyEndIt )
   {
     if ( * ( uint32_t* ) ( aSendBufferStart ) != * ( uint32_t* ) ( aReplyStartIt ->first ) )
     {
@@ -300,7 +314,15 @@ namespace uhal
 
     {
       boost::lock_guard<boost::mutex> lLock ( mReceivePacketMutex );
-      mReceivePacketHeader.pop_front();
+
+      for ( std::list< uint32_t >::iterator lIt = mReceivePacketHeader.begin(); lIt != mReceivePacketHeader.end(); ++lIt )
+      {
+        if ( reinterpret_cast< uint8_t* > ( & ( *lIt ) ) == aReplyStartIt->first )
+        {
+          mReceivePacketHeader.erase ( lIt );
+          break;
+        }
+      }
     }
 
     return IPbusCore::validate ( ( aSendBufferStart+=4 ) , aSendBufferEnd , ( ++aReplyStartIt ) , aReplyEndIt );
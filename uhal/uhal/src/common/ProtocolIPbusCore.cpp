@@ -46,6 +46,7 @@
 #include "uhal/log/log_inserters.integer.hpp"   // for Integer, _Integer
 #include "uhal/log/log_inserters.quote.hpp"     // for Quote, _Quote
 #include "uhal/Buffers.hpp"
+#include "uhal/TransactionProgram.hpp"
 
 
 namespace uhal
@@ -91,7 +92,9 @@ namespace uhal
 
   IPbusCore::IPbusCore ( const std::string& aId, const URI& aUri , const boost::posix_time::time_duration& aTimeoutPeriod ) :
     ClientInterface ( aId , aUri , aTimeoutPeriod ),
-    mTransactionCounter ( 0x00000000 )
+    mTransactionCounter ( 0x00000000 ),
+    mTransactionCoalescing ( false ),
+    mConfigurationSpaceCaching ( false )
   {}
 
 
@@ -102,22 +105,137 @@ namespace uhal
 
   ValWord< uint32_t > IPbusCore::readConfigurationSpace ( const uint32_t& aAddr )
   {
-    boost::lock_guard<boost::mutex> lLock ( mUserSideMutex );
-    return implementReadConfigurationSpace ( aAddr );
+    return readConfigurationSpace ( aAddr , defs::NOMASK );
   }
 
   ValWord< uint32_t > IPbusCore::readConfigurationSpace ( const uint32_t& aAddr, const uint32_t& aMask )
   {
-    boost::lock_guard<boost::mutex> lLock ( mUserSideMutex );
-    return implementReadConfigurationSpace ( aAddr, aMask );
+    UserSideLock lLock ( *this );
+
+    uint32_t lOffset ( 0 );
+
+    if ( ValVector< uint32_t >* lSnapshot = findConfigurationSpaceSnapshot ( aAddr , 1 , lOffset ) )
+    {
+      std::pair < ValWord<uint32_t> , _ValWord_<uint32_t>* > lReply ( CreateValWord ( lSnapshot->at ( lOffset ) , aMask ) );
+      lReply.second->valid = true;
+      return lReply.first;
+    }
+
+    ValWord< uint32_t > lReply ( implementReadConfigurationSpace ( aAddr, aMask ) );
+    countTransaction ( ClientMetrics::CONFIG_SPACE_READ , 1 );
+    return lReply;
+  }
+
+
+  ValVector< uint32_t > IPbusCore::snapshotConfigurationSpace ( const uint32_t& aAddr, const uint32_t& aSize )
+  {
+    UserSideLock lLock ( *this );
+
+    uint32_t lOffset ( 0 );
+
+    if ( ValVector< uint32_t >* lSnapshot = findConfigurationSpaceSnapshot ( aAddr , aSize , lOffset ) )
+    {
+      if ( lOffset == 0 && lSnapshot->size() == aSize )
+      {
+        return *lSnapshot;
+      }
+
+      std::pair < ValVector<uint32_t> , _ValVector_<uint32_t>* > lReply ( CreateValVector ( aSize ) );
+      ValVector< uint32_t >::const_iterator lBegin ( lSnapshot->begin() + lOffset );
+      std::copy ( lBegin , lBegin + aSize , lReply.second->value.begin() );
+      lReply.second->valid = true;
+      return lReply.first;
+    }
+
+    ValVector< uint32_t > lReply ( implementSnapshotConfigurationSpace ( aAddr, aSize ) );
+    countTransaction ( ClientMetrics::CONFIG_SPACE_READ , aSize );
+
+    if ( mConfigurationSpaceCaching )
+    {
+      mConfigurationSpaceCache[ aAddr ] = lReply;
+    }
+
+    return lReply;
+  }
+
+
+  void IPbusCore::setConfigurationSpaceCaching ( const bool& aCaching )
+  {
+    UserSideLock lLock ( *this );
+    mConfigurationSpaceCaching = aCaching;
+
+    if ( ! aCaching )
+    {
+      mConfigurationSpaceCache.clear();
+    }
+  }
+
+
+  bool IPbusCore::getConfigurationSpaceCaching() const
+  {
+    return mConfigurationSpaceCaching;
+  }
+
+
+  void IPbusCore::clearConfigurationSpaceCache()
+  {
+    UserSideLock lLock ( *this );
+    mConfigurationSpaceCache.clear();
+  }
+
+
+  ValVector< uint32_t >* IPbusCore::findConfigurationSpaceSnapshot ( const uint32_t& aAddr, const uint32_t& aSize, uint32_t& aOffset )
+  {
+    if ( mConfigurationSpaceCache.empty() )
+    {
+      return NULL;
+    }
+
+    // Only the snapshot starting at, or closest below, the requested address can cover the whole range
+    std::map< uint32_t , ValVector< uint32_t > >::iterator lIt ( mConfigurationSpaceCache.upper_bound ( aAddr ) );
+
+    if ( lIt == mConfigurationSpaceCache.begin() )
+    {
+      return NULL;
+    }
+
+    --lIt;
+
+    // A snapshot whose dispatch failed, or has not yet happened, is never used; it is replaced by the next snapshot of its range
+    if ( ! lIt->second.valid() || ( uint64_t ( lIt->first ) + lIt->second.size() < uint64_t ( aAddr ) + aSize ) )
+    {
+      return NULL;
+    }
+
+    aOffset = aAddr - lIt->first;
+    return & lIt->second;
+  }
+
+
+  void IPbusCore::setTransactionCoalescing ( const bool& aCoalescing )
+  {
+    mTransactionCoalescing = aCoalescing;
+  }
+
+
+  bool IPbusCore::getTransactionCoalescing() const
+  {
+    return mTransactionCoalescing;
   }
 
 
   exception::exception* IPbusCore::validate ( uint8_t* aSendBufferStart ,
       uint8_t* aSendBufferEnd ,
-      std::deque< std::pair< uint8_t* , uint32_t > >::iterator aReplyStartIt ,
-      std::deque< std::pair< uint8_t* , uint32_t > >::iterator aReplyEndIt )
+      std::pair< uint8_t* , uint32_t >* aReplyStartIt ,
+      std::pair< uint8_t* , uint32_t >* aReplyEndIt )
   {
+    // Almost all replies are good, so they are first checked with a cheap masked comparison against the request headers; the headers are only decoded field by field, to describe what went wrong, if this fails
+    if ( validateReplyHeaders ( aSendBufferStart , aSendBufferEnd , aReplyStartIt , aReplyEndIt ) )
+    {
+      log ( Debug() , "Validation Complete!" );
+      return NULL;
+    }
+
     const uint8_t* lSendBufferFirstByte = aSendBufferStart;
     uint32_t lNrSendBytesProcessed = 0;
     uint32_t lNrReplyBytesValidated = 0;
@@ -224,9 +342,25 @@ namespace uhal
           lNrReplyBytesValidated += aReplyStartIt->second;
           aReplyStartIt++;
           break;
+        case READ:
+        {
+          // If single-word reads were coalesced, the payload is spread over one destination per word
+          lNrReplyBytesValidated += aReplyStartIt->second;
+          aReplyStartIt++;
+          uint32_t lPayloadBytesValidated ( 0 );
+
+          do
+          {
+            lPayloadBytesValidated += aReplyStartIt->second;
+            aReplyStartIt++;
+          }
+          while ( ( lPayloadBytesValidated < ( lSendWordCount<<2 ) ) && ( aReplyEndIt - aReplyStartIt != 0 ) );
+
+          lNrReplyBytesValidated += lPayloadBytesValidated;
+          break;
+        }
         case R_A_I:
         case NI_READ:
-        case READ:
         case CONFIG_SPACE_READ:
         case RMW_SUM:
         case RMW_BITS:
@@ -240,6 +374,98 @@ namespace uhal
     log ( Debug() , "Validation Complete!" );
     return NULL;
   }
+
+
+  bool IPbusCore::validateReplyHeaders ( const uint8_t* aSendBufferStart ,
+      const uint8_t* aSendBufferEnd ,
+      const std::pair< uint8_t* , uint32_t >* aReplyStartIt ,
+      const std::pair< uint8_t* , uint32_t >* aReplyEndIt )
+  {
+    const uint32_t lMask ( replyHeaderCheckMask() );
+    const uint32_t lValue ( replyHeaderCheckValue() );
+    eIPbusTransactionType lType;
+    uint32_t lWordCount , lTransactionId;
+    uint8_t lInfoCode;
+
+    do
+    {
+      const uint32_t lSendHeader ( * reinterpret_cast< const uint32_t* > ( aSendBufferStart ) );
+
+      if ( ( aReplyStartIt->second != 4 ) || ( ( ( lSendHeader ^ * reinterpret_cast< const uint32_t* > ( aReplyStartIt->first ) ) & lMask ) != lValue ) )
+      {
+        return false;
+      }
+
+      // The request headers were created by this client, so decoding them does not fail; the reply header has the same type, since it matched
+      implementExtractHeader ( lSendHeader , lType , lWordCount , lTransactionId , lInfoCode );
+      ++aReplyStartIt;
+
+      switch ( lType )
+      {
+        case B_O_T:
+        case R_A_I:
+          aSendBufferStart += ( 1<<2 );
+          break;
+        case NI_READ:
+        case READ:
+        case CONFIG_SPACE_READ:
+          aSendBufferStart += ( 2<<2 );
+          break;
+        case NI_WRITE:
+        case WRITE:
+          aSendBufferStart += ( ( 2+lWordCount ) <<2 );
+          break;
+        case RMW_SUM:
+          aSendBufferStart += ( 3<<2 );
+          break;
+        case RMW_BITS:
+          aSendBufferStart += ( 4<<2 );
+          break;
+      }
+
+      switch ( lType )
+      {
+        case B_O_T:
+        case NI_WRITE:
+        case WRITE:
+          break;
+        case READ:
+        {
+          // If single-word reads were coalesced, the payload is spread over one destination per word
+          uint32_t lPayloadBytes ( 0 );
+
+          do
+          {
+            if ( aReplyEndIt == aReplyStartIt )
+            {
+              return false;
+            }
+
+            lPayloadBytes += aReplyStartIt->second;
+            ++aReplyStartIt;
+          }
+          while ( ( lPayloadBytes < ( lWordCount<<2 ) ) && ( aReplyEndIt != aReplyStartIt ) );
+
+          break;
+        }
+        case R_A_I:
+        case NI_READ:
+        case CONFIG_SPACE_READ:
+        case RMW_SUM:
+        case RMW_BITS:
+          if ( aReplyEndIt == aReplyStartIt )
+          {
+            return false;
+          }
+
+          ++aReplyStartIt;
+          break;
+      }
+    }
+    while ( ( aSendBufferEnd != aSendBufferStart ) && ( aReplyEndIt != aReplyStartIt ) );
+
+    return true;
+  }
   // ----------------------------------------------------------------------------------------------------------------------------------------------------------------
 
 
@@ -256,7 +482,7 @@ namespace uhal
     uint32_t lSendBytesAvailable;
     uint32_t  lReplyBytesAvailable;
     boost::shared_ptr< Buffers > lBuffers = checkBufferSpace ( lSendByteCount , lReplyByteCount , lSendBytesAvailable , lReplyBytesAvailable );
-    lBuffers->send ( implementCalculateHeader ( B_O_T , 0 , mTransactionCounter++ , requestTransactionInfoCode() ) );
+    lBuffers->send ( implementCalculateHeader ( B_O_T , 0 , nextTransactionId() , requestTransactionInfoCode() ) );
     std::pair < ValHeader , _ValHeader_* > lReply ( CreateValHeader() );
     lReply.second->IPbusHeaders.push_back ( 0 );
     lBuffers->add ( lReply.first );
@@ -270,6 +496,14 @@ namespace uhal
   ValHeader IPbusCore::implementWrite ( const uint32_t& aAddr, const uint32_t& aSource )
   {
     log ( Debug() , "Write " , Integer ( aSource , IntFmt<hex,fixed>() ) , " to address " , Integer ( aAddr , IntFmt<hex,fixed>() ) );
+    std::pair < ValHeader , _ValHeader_* > lReply ( CreateValHeader() );
+    queueWrite ( aAddr , aSource , *lReply.second )->add ( lReply.first );
+    return lReply.first;
+  }
+
+
+  boost::shared_ptr< Buffers > IPbusCore::queueWrite ( const uint32_t& aAddr, const uint32_t& aSource, _ValHeader_& aReply )
+  {
     // IPbus packet format is:
     // HEADER
     // BASE ADDRESS
@@ -281,21 +515,49 @@ namespace uhal
     uint32_t lSendBytesAvailable;
     uint32_t  lReplyBytesAvailable;
     boost::shared_ptr< Buffers > lBuffers = checkBufferSpace ( lSendByteCount , lReplyByteCount , lSendBytesAvailable , lReplyBytesAvailable );
-    lBuffers->send ( implementCalculateHeader ( WRITE , 1 , mTransactionCounter++ , requestTransactionInfoCode()
-                                              ) );
-    lBuffers->send ( aAddr );
-    lBuffers->send ( aSource );
-    std::pair < ValHeader , _ValHeader_* > lReply ( CreateValHeader() );
-    lReply.second->IPbusHeaders.push_back ( 0 );
-    lBuffers->add ( lReply.first );
-    lBuffers->receive ( lReply.second->IPbusHeaders.back() );
-    return lReply.first;
+    uint8_t* lHeader ( mTransactionCoalescing ? extendTransaction ( *lBuffers , WRITE , aAddr ) : NULL );
+
+    if ( lHeader )
+    {
+      // The reply to the extended transaction has a single header, so there is nothing more to receive
+      lBuffers->send ( aSource );
+    }
+    else
+    {
+      lHeader = lBuffers->send ( implementCalculateHeader ( WRITE , 1 , nextTransactionId() , requestTransactionInfoCode()
+                                                          ) );
+      lBuffers->send ( aAddr );
+      lBuffers->send ( aSource );
+      aReply.IPbusHeaders.push_back ( 0 );
+      lBuffers->receive ( aReply.IPbusHeaders.back() );
+    }
+
+    if ( mTransactionCoalescing )
+    {
+      lBuffers->setExtendableTransaction ( lHeader , aAddr + 1 );
+    }
+
+    return lBuffers;
   }
 
 
   ValHeader IPbusCore::implementWriteBlock ( const uint32_t& aAddr, const std::vector< uint32_t >& aSource, const defs::BlockReadWriteMode& aMode )
   {
     log ( Debug() , "Write block of size " , Integer ( aSource.size() ) , " to address " , Integer ( aAddr , IntFmt<hex,fixed>() ) );
+    const uint8_t* lSourcePtr ( ( uint8_t* ) ( aSource.empty() ? NULL : & ( aSource.at ( 0 ) ) ) );
+    return queueWriteBlock ( aAddr , lSourcePtr , aSource.size() << 2 , aMode , false , boost::shared_ptr< const void >() );
+  }
+
+
+  ValHeader IPbusCore::implementWriteBlock ( const uint32_t& aAddr, const uint32_t* aSource, const uint32_t& aSize, const defs::BlockReadWriteMode& aMode, const boost::shared_ptr< const void >& aOwner )
+  {
+    log ( Debug() , "Write block of size " , Integer ( aSize ) , " by reference to address " , Integer ( aAddr , IntFmt<hex,fixed>() ) );
+    return queueWriteBlock ( aAddr , ( const uint8_t* ) ( aSource ) , aSize << 2 , aMode , true , aOwner );
+  }
+
+
+  ValHeader IPbusCore::queueWriteBlock ( const uint32_t& aAddr, const uint8_t* aSource, const uint32_t& aPayloadByteCount, const defs::BlockReadWriteMode& aMode, const bool& aByReference, const boost::shared_ptr< const void >& aOwner )
+  {
     // IPbus packet format is:
     // HEADER
     // BASE ADDRESS
@@ -309,8 +571,8 @@ namespace uhal
     uint32_t lSendBytesAvailable;
     uint32_t  lReplyBytesAvailable;
     eIPbusTransactionType lType ( ( aMode == defs::INCREMENTAL ) ? WRITE : NI_WRITE );
-    int32_t lPayloadByteCount ( aSource.size() << 2 );
-    uint8_t* lSourcePtr ( ( uint8_t* ) ( aSource.empty() ? NULL : & ( aSource.at ( 0 ) ) ) );
+    int32_t lPayloadByteCount ( aPayloadByteCount );
+    const uint8_t* lSourcePtr ( aSource );
     uint32_t lAddr ( aAddr );
     std::pair < ValHeader , _ValHeader_* > lReply ( CreateValHeader() );
     boost::shared_ptr< Buffers > lBuffers;
@@ -320,11 +582,25 @@ namespace uhal
       lBuffers = checkBufferSpace ( lSendHeaderByteCount+lPayloadByteCount , lReplyByteCount , lSendBytesAvailable , lReplyBytesAvailable );
       uint32_t lSendBytesAvailableForPayload ( std::min ( 4*getMaxTransactionWordCount(), lSendBytesAvailable - lSendHeaderByteCount ) & 0xFFFFFFFC );
 
-      lBuffers->send ( implementCalculateHeader ( lType , lSendBytesAvailableForPayload>>2 , mTransactionCounter++ , requestTransactionInfoCode() ) );
+      lBuffers->send ( implementCalculateHeader ( lType , lSendBytesAvailableForPayload>>2 , nextTransactionId() , requestTransactionInfoCode() ) );
       lBuffers->send ( lAddr );
-      if ( aSource.size() > 0 )
+      if ( aPayloadByteCount > 0 )
       {
-        lBuffers->send ( lSourcePtr , lSendBytesAvailableForPayload );
+        if ( aByReference )
+        {
+          // Every chunk holds the owner, since earlier buffers may still be waiting to be sent when the last one is dispatched
+          if ( aOwner )
+          {
+            lBuffers->add ( aOwner );
+          }
+
+          lBuffers->sendByReference ( lSourcePtr , lSendBytesAvailableForPayload );
+        }
+        else
+        {
+          lBuffers->send ( lSourcePtr , lSendBytesAvailableForPayload );
+        }
+
         lSourcePtr += lSendBytesAvailableForPayload;
         lPayloadByteCount -= lSendBytesAvailableForPayload;
       }
@@ -349,6 +625,14 @@ namespace uhal
   ValWord< uint32_t > IPbusCore::implementRead ( const uint32_t& aAddr, const uint32_t& aMask )
   {
     log ( Debug() , "Read one unsigned word from address " , Integer ( aAddr , IntFmt<hex,fixed>() ) );
+    std::pair < ValWord<uint32_t> , _ValWord_<uint32_t>* > lReply ( CreateValWord ( 0 , aMask ) );
+    queueRead ( aAddr , lReply.second->value , *lReply.second )->add ( lReply.first );
+    return lReply.first;
+  }
+
+
+  boost::shared_ptr< Buffers > IPbusCore::queueRead ( const uint32_t& aAddr, uint32_t& aDestination, _ValHeader_& aReply )
+  {
     // IPbus packet format is:
     // HEADER
     // BASE ADDRESS
@@ -360,21 +644,52 @@ namespace uhal
     uint32_t lSendBytesAvailable;
     uint32_t  lReplyBytesAvailable;
     boost::shared_ptr< Buffers > lBuffers = checkBufferSpace ( lSendByteCount , lReplyByteCount , lSendBytesAvailable , lReplyBytesAvailable );
-    lBuffers->send ( implementCalculateHeader ( READ , 1 , mTransactionCounter++ , requestTransactionInfoCode()
-                                              ) );
-    lBuffers->send ( aAddr );
-    std::pair < ValWord<uint32_t> , _ValWord_<uint32_t>* > lReply ( CreateValWord ( 0 , aMask ) );
-    lBuffers->add ( lReply.first );
-    lReply.second->IPbusHeaders.push_back ( 0 );
-    lBuffers->receive ( lReply.second->IPbusHeaders.back() );
-    lBuffers->receive ( lReply.second->value );
-    return lReply.first;
+    uint8_t* lHeader ( mTransactionCoalescing ? extendTransaction ( *lBuffers , READ , aAddr ) : NULL );
+
+    if ( ! lHeader )
+    {
+      lHeader = lBuffers->send ( implementCalculateHeader ( READ , 1 , nextTransactionId() , requestTransactionInfoCode()
+                                                          ) );
+      lBuffers->send ( aAddr );
+      aReply.IPbusHeaders.push_back ( 0 );
+      lBuffers->receive ( aReply.IPbusHeaders.back() );
+    }
+
+    // The reply to an extended transaction has a single header, followed by the words in the order in which they were queued; the mask is applied when the value is retrieved
+    lBuffers->receive ( aDestination );
+
+    if ( mTransactionCoalescing )
+    {
+      lBuffers->setExtendableTransaction ( lHeader , aAddr + 1 );
+    }
+
+    return lBuffers;
   }
 
 
   ValVector< uint32_t > IPbusCore::implementReadBlock ( const uint32_t& aAddr, const uint32_t& aSize, const defs::BlockReadWriteMode& aMode )
   {
     log ( Debug() , "Read unsigned block of size " , Integer ( aSize ) , " from address " , Integer ( aAddr , IntFmt<hex,fixed>() ) );
+    std::pair < ValVector<uint32_t> , _ValVector_<uint32_t>* > lReply ( CreateValVector ( aSize ) );
+    uint8_t* lReplyPtr = ( uint8_t* ) ( aSize == 0 ? NULL : & ( lReply.second->value.at(0) ) );
+    boost::shared_ptr< Buffers > lBuffers = queueReadBlock ( aAddr , lReplyPtr , aSize << 2 , ( aMode == defs::INCREMENTAL ) ? READ : NI_READ , *lReply.second );
+    lBuffers->add ( lReply.first ); //we store the valmem in the last chunk so that, if the reply is split over many chunks, the valmem is guaranteed to still exist when the other chunks come back...
+    return lReply.first;
+  }
+
+
+  ValHeader IPbusCore::implementReadBlock ( const uint32_t& aAddr, const uint32_t& aSize, uint32_t* aDestination, const defs::BlockReadWriteMode& aMode )
+  {
+    log ( Debug() , "Read unsigned block of size " , Integer ( aSize ) , " from address " , Integer ( aAddr , IntFmt<hex,fixed>() ) , " into caller-owned memory" );
+    std::pair < ValHeader , _ValHeader_* > lReply ( CreateValHeader() );
+    boost::shared_ptr< Buffers > lBuffers = queueReadBlock ( aAddr , ( uint8_t* ) ( aDestination ) , aSize << 2 , ( aMode == defs::INCREMENTAL ) ? READ : NI_READ , *lReply.second );
+    lBuffers->add ( lReply.first );
+    return lReply.first;
+  }
+
+
+  boost::shared_ptr< Buffers > IPbusCore::queueReadBlock ( const uint32_t& aAddr, uint8_t* aDestination, const uint32_t& aPayloadByteCount, const eIPbusTransactionType& aType, _ValHeader_& aReply )
+  {
     // IPbus packet format is:
     // HEADER
     // BASE ADDRESS
@@ -387,10 +702,8 @@ namespace uhal
     uint32_t lReplyHeaderByteCount ( 1 << 2 );
     uint32_t lSendBytesAvailable;
     uint32_t  lReplyBytesAvailable;
-    std::pair < ValVector<uint32_t> , _ValVector_<uint32_t>* > lReply ( CreateValVector ( aSize ) );
-    uint8_t* lReplyPtr = ( uint8_t* ) ( aSize == 0 ? NULL : & ( lReply.second->value.at(0) ) );
-    eIPbusTransactionType lType ( ( aMode == defs::INCREMENTAL ) ? READ : NI_READ );
-    int32_t lPayloadByteCount ( aSize << 2 );
+    uint8_t* lReplyPtr = aDestination;
+    int32_t lPayloadByteCount ( aPayloadByteCount );
     uint32_t lAddr ( aAddr );
     boost::shared_ptr< Buffers > lBuffers;
 
@@ -398,24 +711,23 @@ namespace uhal
     {
       lBuffers = checkBufferSpace ( lSendByteCount , lReplyHeaderByteCount+lPayloadByteCount , lSendBytesAvailable , lReplyBytesAvailable );
       uint32_t lReplyBytesAvailableForPayload ( std::min ( 4*getMaxTransactionWordCount(), lReplyBytesAvailable - lReplyHeaderByteCount ) & 0xFFFFFFFC );
-      lBuffers->send ( implementCalculateHeader ( lType , lReplyBytesAvailableForPayload>>2 , mTransactionCounter++ , requestTransactionInfoCode()
+      lBuffers->send ( implementCalculateHeader ( aType , lReplyBytesAvailableForPayload>>2 , nextTransactionId() , requestTransactionInfoCode()
                                                 ) );
       lBuffers->send ( lAddr );
-      lReply.second->IPbusHeaders.push_back ( 0 );
-      lBuffers->receive ( lReply.second->IPbusHeaders.back() );
+      aReply.IPbusHeaders.push_back ( 0 );
+      lBuffers->receive ( aReply.IPbusHeaders.back() );
       lBuffers->receive ( lReplyPtr , lReplyBytesAvailableForPayload );
       lReplyPtr += lReplyBytesAvailableForPayload;
       lPayloadByteCount -= lReplyBytesAvailableForPayload;
 
-      if ( aMode == defs::INCREMENTAL )
+      if ( aType != NI_READ )
       {
         lAddr += ( lReplyBytesAvailableForPayload>>2 );
       }
     }
     while ( lPayloadByteCount > 0 );
 
-    lBuffers->add ( lReply.first ); //we store the valmem in the last chunk so that, if the reply is split over many chunks, the valmem is guaranteed to still exist when the other chunks come back...
-    return lReply.first;
+    return lBuffers;
   }
   //-------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
@@ -434,7 +746,7 @@ namespace uhal
     uint32_t lSendBytesAvailable;
     uint32_t  lReplyBytesAvailable;
     boost::shared_ptr< Buffers > lBuffers = checkBufferSpace ( lSendByteCount , lReplyByteCount , lSendBytesAvailable , lReplyBytesAvailable );
-    lBuffers->send ( implementCalculateHeader ( CONFIG_SPACE_READ , 1 , mTransactionCounter++ , requestTransactionInfoCode()
+    lBuffers->send ( implementCalculateHeader ( CONFIG_SPACE_READ , 1 , nextTransactionId() , requestTransactionInfoCode()
                                               ) );
     lBuffers->send ( aAddr );
     std::pair < ValWord<uint32_t> , _ValWord_<uint32_t>* > lReply ( CreateValWord ( 0 , aMask ) );
@@ -444,6 +756,17 @@ namespace uhal
     lBuffers->receive ( lReply.second->value );
     return lReply.first;
   }
+
+
+  ValVector< uint32_t > IPbusCore::implementSnapshotConfigurationSpace ( const uint32_t& aAddr, const uint32_t& aSize )
+  {
+    log ( Debug() , "Read unsigned block of size " , Integer ( aSize ) , " from configuration space address " , Integer ( aAddr , IntFmt<hex,fixed>() ) );
+    std::pair < ValVector<uint32_t> , _ValVector_<uint32_t>* > lReply ( CreateValVector ( aSize ) );
+    uint8_t* lReplyPtr = ( uint8_t* ) ( aSize == 0 ? NULL : & ( lReply.second->value.at(0) ) );
+    boost::shared_ptr< Buffers > lBuffers = queueReadBlock ( aAddr , lReplyPtr , aSize << 2 , CONFIG_SPACE_READ , *lReply.second );
+    lBuffers->add ( lReply.first );
+    return lReply.first;
+  }
   //-------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
 
@@ -451,6 +774,14 @@ namespace uhal
   ValWord< uint32_t > IPbusCore::implementRMWbits ( const uint32_t& aAddr , const uint32_t& aANDterm , const uint32_t& aORterm )
   {
     log ( Debug() , "Read/Modify/Write bits (and=" , Integer ( aANDterm , IntFmt<hex,fixed>() ) , ", or=" , Integer ( aORterm , IntFmt<hex,fixed>() ) , ") from address " , Integer ( aAddr , IntFmt<hex,fixed>() ) );
+    std::pair < ValWord<uint32_t> , _ValWord_<uint32_t>* > lReply ( CreateValWord ( 0 ) );
+    queueRMWbits ( aAddr , aANDterm , aORterm , lReply.second->value , *lReply.second )->add ( lReply.first );
+    return lReply.first;
+  }
+
+
+  boost::shared_ptr< Buffers > IPbusCore::queueRMWbits ( const uint32_t& aAddr , const uint32_t& aANDterm , const uint32_t& aORterm , uint32_t& aDestination, _ValHeader_& aReply )
+  {
     // IPbus packet format is:
     // HEADER
     // BASE ADDRESS
@@ -464,17 +795,15 @@ namespace uhal
     uint32_t lSendBytesAvailable;
     uint32_t  lReplyBytesAvailable;
     boost::shared_ptr< Buffers > lBuffers = checkBufferSpace ( lSendByteCount , lReplyByteCount , lSendBytesAvailable , lReplyBytesAvailable );
-    lBuffers->send ( implementCalculateHeader ( RMW_BITS , 1 , mTransactionCounter++ , requestTransactionInfoCode()
+    lBuffers->send ( implementCalculateHeader ( RMW_BITS , 1 , nextTransactionId() , requestTransactionInfoCode()
                                               ) );
     lBuffers->send ( aAddr );
     lBuffers->send ( aANDterm );
     lBuffers->send ( aORterm );
-    std::pair < ValWord<uint32_t> , _ValWord_<uint32_t>* > lReply ( CreateValWord ( 0 ) );
-    lBuffers->add ( lReply.first );
-    lReply.second->IPbusHeaders.push_back ( 0 );
-    lBuffers->receive ( lReply.second->IPbusHeaders.back() );
-    lBuffers->receive ( lReply.second->value );
-    return lReply.first;
+    aReply.IPbusHeaders.push_back ( 0 );
+    lBuffers->receive ( aReply.IPbusHeaders.back() );
+    lBuffers->receive ( aDestination );
+    return lBuffers;
   }
   //-------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
@@ -482,7 +811,16 @@ namespace uhal
   //-------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
   ValWord< uint32_t > IPbusCore::implementRMWsum ( const uint32_t& aAddr , const int32_t& aAddend )
   {
-    log ( Debug() , "Read/Modify/Write sum (addend=" , Integer ( aAddend , IntFmt<hex,fixed>() ) , ") from address " , Integer ( aAddr , IntFmt<hex,fixed>() ) );			// IPbus packet format is:
+    log ( Debug() , "Read/Modify/Write sum (addend=" , Integer ( aAddend , IntFmt<hex,fixed>() ) , ") from address " , Integer ( aAddr , IntFmt<hex,fixed>() ) );
+    std::pair < ValWord<uint32_t> , _ValWord_<uint32_t>* > lReply ( CreateValWord ( 0 ) );
+    queueRMWsum ( aAddr , aAddend , lReply.second->value , *lReply.second )->add ( lReply.first );
+    return lReply.first;
+  }
+
+
+  boost::shared_ptr< Buffers > IPbusCore::queueRMWsum ( const uint32_t& aAddr , const int32_t& aAddend , uint32_t& aDestination, _ValHeader_& aReply )
+  {
+    // IPbus packet format is:
     // HEADER
     // BASE ADDRESS
     // ADDEND
@@ -494,23 +832,240 @@ namespace uhal
     uint32_t lSendBytesAvailable;
     uint32_t  lReplyBytesAvailable;
     boost::shared_ptr< Buffers > lBuffers = checkBufferSpace ( lSendByteCount , lReplyByteCount , lSendBytesAvailable , lReplyBytesAvailable );
-    lBuffers->send ( implementCalculateHeader ( RMW_SUM , 1 , mTransactionCounter++ , requestTransactionInfoCode()
+    lBuffers->send ( implementCalculateHeader ( RMW_SUM , 1 , nextTransactionId() , requestTransactionInfoCode()
                                               ) );
     lBuffers->send ( aAddr );
     lBuffers->send ( static_cast< uint32_t > ( aAddend ) );
-    std::pair < ValWord<uint32_t> , _ValWord_<uint32_t>* > lReply ( CreateValWord ( 0 ) );
-    lBuffers->add ( lReply.first );
-    lReply.second->IPbusHeaders.push_back ( 0 );
-    lBuffers->receive ( lReply.second->IPbusHeaders.back() );
-    lBuffers->receive ( lReply.second->value );
-    return lReply.first;
+    aReply.IPbusHeaders.push_back ( 0 );
+    lBuffers->receive ( aReply.IPbusHeaders.back() );
+    lBuffers->receive ( aDestination );
+    return lBuffers;
   }
   //-------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
 
+  void IPbusCore::implementEncode ( TransactionProgram& aProgram )
+  {
+    log ( Debug() , "Encoding transaction program of " , Integer ( aProgram.mOperations.size() ) , " operations" );
+    aProgram.mWriteLocations.resize ( aProgram.mWriteValues.size() );
+    uint32_t lSendBytesAvailable;
+    uint32_t  lReplyBytesAvailable;
+
+    for ( std::vector< TransactionProgram::Operation >::const_iterator lIt = aProgram.mOperations.begin() ; lIt != aProgram.mOperations.end() ; ++lIt )
+    {
+      uint32_t lAddr ( lIt->mAddr );
+      uint32_t lSlot ( lIt->mSlot );
+      uint32_t lRemaining ( lIt->mSize );
+
+      switch ( lIt->mType )
+      {
+        case TransactionProgram::WRITE:
+        case TransactionProgram::WRITE_BLOCK:
+        {
+          const eIPbusTransactionType lType ( ( lIt->mMode == defs::INCREMENTAL ) ? WRITE : NI_WRITE );
+
+          do
+          {
+            // Header, base address and at least one word of payload, unless the block is empty
+            const uint32_t lIndex ( programPacket ( aProgram , ( lRemaining ? 3 : 2 ) << 2 , 1 << 2 , lSendBytesAvailable , lReplyBytesAvailable ) );
+            TransactionProgram::Packet& lPacket ( aProgram.mPackets.at ( lIndex ) );
+            const uint32_t lWords ( std::min ( std::min ( lRemaining , getMaxTransactionWordCount() ) , ( lSendBytesAvailable - ( 2 << 2 ) ) >> 2 ) );
+            lPacket.send ( implementCalculateHeader ( lType , lWords , nextTransactionId() , requestTransactionInfoCode() ) );
+            lPacket.send ( lAddr );
+
+            for ( uint32_t i = 0 ; i != lWords ; ++i , ++lSlot )
+            {
+              aProgram.mWriteLocations.at ( lSlot ) = std::make_pair ( lIndex , lPacket.mSend.size() );
+              lPacket.send ( aProgram.encodeWriteValue ( lSlot ) );
+            }
+
+            aProgram.mScratch.push_back ( 0 );
+            lPacket.receive ( ( uint8_t* ) ( & aProgram.mScratch.back() ) , 1 << 2 );
+            lRemaining -= lWords;
+
+            if ( lIt->mMode == defs::INCREMENTAL )
+            {
+              lAddr += lWords;
+            }
+          }
+          while ( lRemaining );
+
+          break;
+        }
+        case TransactionProgram::READ:
+        case TransactionProgram::READ_BLOCK:
+        {
+          const eIPbusTransactionType lType ( ( lIt->mMode == defs::INCREMENTAL ) ? READ : NI_READ );
+
+          do
+          {
+            // Header and at least one word of payload in the reply, unless the block is empty
+            const uint32_t lIndex ( programPacket ( aProgram , 2 << 2 , ( lRemaining ? 2 : 1 ) << 2 , lSendBytesAvailable , lReplyBytesAvailable ) );
+            TransactionProgram::Packet& lPacket ( aProgram.mPackets.at ( lIndex ) );
+            const uint32_t lWords ( std::min ( std::min ( lRemaining , getMaxTransactionWordCount() ) , ( lReplyBytesAvailable - ( 1 << 2 ) ) >> 2 ) );
+            lPacket.send ( implementCalculateHeader ( lType , lWords , nextTransactionId() , requestTransactionInfoCode() ) );
+            lPacket.send ( lAddr );
+            aProgram.mScratch.push_back ( 0 );
+            lPacket.receive ( ( uint8_t* ) ( & aProgram.mScratch.back() ) , 1 << 2 );
+            lPacket.receive ( ( uint8_t* ) ( lWords ? & aProgram.mResults.at ( lSlot ) : NULL ) , lWords << 2 );
+            lSlot += lWords;
+            lRemaining -= lWords;
+
+            if ( lIt->mMode == defs::INCREMENTAL )
+            {
+              lAddr += lWords;
+            }
+          }
+          while ( lRemaining );
+
+          break;
+        }
+        case TransactionProgram::MASKED_WRITE:
+        case TransactionProgram::RMW_BITS:
+        {
+          const uint32_t lIndex ( programPacket ( aProgram , 4 << 2 , 2 << 2 , lSendBytesAvailable , lReplyBytesAvailable ) );
+          TransactionProgram::Packet& lPacket ( aProgram.mPackets.at ( lIndex ) );
+          lPacket.send ( implementCalculateHeader ( RMW_BITS , 1 , nextTransactionId() , requestTransactionInfoCode() ) );
+          lPacket.send ( lAddr );
+          lPacket.send ( lIt->mTerm1 );
+          aProgram.mScratch.push_back ( 0 );
+          lPacket.receive ( ( uint8_t* ) ( & aProgram.mScratch.back() ) , 1 << 2 );
+
+          if ( lIt->mType == TransactionProgram::MASKED_WRITE )
+          {
+            // The OR-term is the write payload; the value returned is not kept
+            aProgram.mWriteLocations.at ( lSlot ) = std::make_pair ( lIndex , lPacket.mSend.size() );
+            lPacket.send ( aProgram.encodeWriteValue ( lSlot ) );
+            aProgram.mScratch.push_back ( 0 );
+            lPacket.receive ( ( uint8_t* ) ( & aProgram.mScratch.back() ) , 1 << 2 );
+          }
+          else
+          {
+            lPacket.send ( lIt->mTerm2 );
+            lPacket.receive ( ( uint8_t* ) ( & aProgram.mResults.at ( lSlot ) ) , 1 << 2 );
+          }
+
+          break;
+        }
+        case TransactionProgram::RMW_SUM:
+        {
+          const uint32_t lIndex ( programPacket ( aProgram , 3 << 2 , 2 << 2 , lSendBytesAvailable , lReplyBytesAvailable ) );
+          TransactionProgram::Packet& lPacket ( aProgram.mPackets.at ( lIndex ) );
+          lPacket.send ( implementCalculateHeader ( RMW_SUM , 1 , nextTransactionId() , requestTransactionInfoCode() ) );
+          lPacket.send ( lAddr );
+          lPacket.send ( lIt->mTerm1 );
+          aProgram.mScratch.push_back ( 0 );
+          lPacket.receive ( ( uint8_t* ) ( & aProgram.mScratch.back() ) , 1 << 2 );
+          lPacket.receive ( ( uint8_t* ) ( & aProgram.mResults.at ( lSlot ) ) , 1 << 2 );
+          break;
+        }
+      }
+    }
+
+    log ( Debug() , "Transaction program encoded into " , Integer ( aProgram.mPackets.size() ) , " packets" );
+  }
+
+
+  ValVector< uint32_t > IPbusCore::implementBatch ( const std::vector< BatchOperation >& aOperations )
+  {
+    log ( Debug() , "Batch of " , Integer ( aOperations.size() ) , " operations" );
+    std::pair < ValVector<uint32_t> , _ValVector_<uint32_t>* > lReply ( CreateValVector ( aOperations.size() ) );
+    std::vector< uint32_t >::iterator lValueIt ( lReply.second->value.begin() );
+    boost::shared_ptr< Buffers > lBuffers;
+
+    for ( std::vector< BatchOperation >::const_iterator lIt = aOperations.begin() ; lIt != aOperations.end() ; ++lIt , ++lValueIt )
+    {
+      switch ( lIt->mType )
+      {
+        case BatchOperation::READ :
+          lBuffers = queueRead ( lIt->mAddr , *lValueIt , *lReply.second );
+          break;
+        case BatchOperation::WRITE :
+          lBuffers = queueWrite ( lIt->mAddr , lIt->mTerm1 , *lReply.second );
+          break;
+        case BatchOperation::RMW_BITS :
+          lBuffers = queueRMWbits ( lIt->mAddr , lIt->mTerm1 , lIt->mTerm2 , *lValueIt , *lReply.second );
+          break;
+        case BatchOperation::RMW_SUM :
+          lBuffers = queueRMWsum ( lIt->mAddr , static_cast< int32_t > ( lIt->mTerm1 ) , *lValueIt , *lReply.second );
+          break;
+      }
+    }
+
+    if ( lBuffers )
+    {
+      lBuffers->add ( lReply.first ); //we store the valmem in the last chunk so that, if the batch is split over many chunks, the valmem is guaranteed to still exist when the other chunks come back...
+    }
+    else
+    {
+      // An empty batch has nothing to wait for
+      lReply.second->valid = true;
+    }
+
+    return lReply.first;
+  }
+
+
+  uint32_t IPbusCore::programPacket ( TransactionProgram& aProgram , const uint32_t& aSendSize , const uint32_t& aReplySize , uint32_t& aAvailableSendSize , uint32_t& aAvailableReplySize )
+  {
+    // The client adds the preamble to each buffer, so it is not part of the encoded packet
+    const uint32_t lMaxSendSize ( this->getMaxSendSize() - ( this->getPreambleSize() << 2 ) );
+    const uint32_t lMaxReplySize ( this->getMaxReplySize() - ( this->getPreambleReplySize() << 2 ) );
+
+    if ( aProgram.mPackets.empty() || ( aSendSize > lMaxSendSize - aProgram.mPackets.back().mSend.size() ) || ( aReplySize > lMaxReplySize - aProgram.mPackets.back().mReplyByteCount ) )
+    {
+      aProgram.mPackets.push_back ( TransactionProgram::Packet() );
+    }
+
+    aAvailableSendSize = lMaxSendSize - aProgram.mPackets.back().mSend.size();
+    aAvailableReplySize = lMaxReplySize - aProgram.mPackets.back().mReplyByteCount;
+    return aProgram.mPackets.size() - 1;
+  }
+
+
+  uint8_t* IPbusCore::extendTransaction ( Buffers& aBuffers , const eIPbusTransactionType& aType , const uint32_t& aAddr )
+  {
+    uint32_t* lHeader ( aBuffers.getExtendableTransaction ( aAddr ) );
+
+    if ( ! lHeader )
+    {
+      return NULL;
+    }
+
+    eIPbusTransactionType lType;
+    uint32_t lWordCount;
+    uint32_t lTransactionId;
+    uint8_t lInfoCode;
+
+    if ( ( ! implementExtractHeader ( *lHeader , lType , lWordCount , lTransactionId , lInfoCode ) ) || ( lType != aType ) || ( lWordCount >= getMaxTransactionWordCount() ) )
+    {
+      return NULL;
+    }
+
+    log ( Debug() , "Extending " , lType , " transaction to " , Integer ( lWordCount + 1 ) , " words for address " , Integer ( aAddr , IntFmt<hex,fixed>() ) );
+    *lHeader = implementCalculateHeader ( lType , lWordCount + 1 , lTransactionId , lInfoCode );
+    return reinterpret_cast< uint8_t* > ( lHeader );
+  }
+
+
+  uint32_t IPbusCore::nextTransactionId()
+  {
+    if ( ! getThreadLocalQueuing() )
+    {
+      return mTransactionCounter++;
+    }
+
+    boost::lock_guard<boost::mutex> lLock ( mTransactionCounterMutex );
+    return mTransactionCounter++;
+  }
+
+
   void IPbusCore::dispatchExceptionHandler()
   {
-    mTransactionCounter = 0;
+    {
+      boost::lock_guard<boost::mutex> lLock ( mTransactionCounterMutex );
+      mTransactionCounter = 0;
+    }
     ClientInterface::dispatchExceptionHandler();
   }
 
@@ -37,6 +37,8 @@
 
 #include <boost/bind/bind.hpp>
 #include <boost/lambda/lambda.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
 #include <boost/asio/connect.hpp>
 #include <boost/asio/write.hpp>
 #include <boost/asio/read.hpp>
@@ -62,20 +64,31 @@ namespace uhal
   template < typename InnerProtocol , std::size_t nr_buffers_per_send >
   TCP< InnerProtocol, nr_buffers_per_send >::TCP ( const std::string& aId, const URI& aUri ) :
     InnerProtocol ( aId , aUri ),
-    mIOservice ( ),
-    mSocket ( mIOservice ),
-    mEndpoint ( boost::asio::ip::tcp::resolver ( mIOservice ).resolve ( boost::asio::ip::tcp::resolver::query ( aUri.mHostname , aUri.mPort ) ) ),
-    mDeadlineTimer ( mIOservice ),
-    mIOserviceWork ( mIOservice ),
-    mDispatchThread ( boost::bind ( &boost::asio::io_service::run , & ( mIOservice ) ) ),
+    mReactor ( TransportReactor::getInstance() ),
+    mStrand ( mReactor->getIOservice() ),
+    mHandlerToken ( boost::make_shared< bool > ( true ) ),
+    mClosing ( false ),
+    mSocket ( mReactor->getIOservice() ),
+    mEndpoint ( boost::asio::ip::tcp::resolver ( mReactor->getIOservice() ).resolve ( boost::asio::ip::tcp::resolver::query ( aUri.mHostname , aUri.mPort ) ) ),
+    mDeadlineTimer ( mReactor->getIOservice() ),
     mDispatchQueue(),
     mReplyQueue(),
     mPacketsInFlight ( 0 ),
     mFlushStarted ( false ),
     mFlushDone ( true ),
-    mAsynchronousException ( NULL )
+    mAsynchronousException ( NULL ),
+    mBusyPollBudget ( 0 )
   {
-    mDeadlineTimer.async_wait ( boost::bind ( &TCP::CheckDeadline, this ) );
+    for ( NameValuePairVectorType::const_iterator lIt = aUri.mArguments.begin() ; lIt != aUri.mArguments.end() ; ++lIt )
+    {
+      if ( lIt->first == "busy_poll" )
+      {
+        mBusyPollBudget = boost::lexical_cast< uint32_t > ( lIt->second );
+        log ( Notice() , "TCP client with URI " , Quote ( this->uri() ) , " : waiting threads will busy-poll for up to " , Integer ( mBusyPollBudget.load() ) , " microseconds before sleeping, by URI " , Quote ( lIt->first ) , " attribute" );
+      }
+    }
+
+    mDeadlineTimer.async_wait ( mStrand.wrap ( TransportReactor::track ( boost::bind ( &TCP::CheckDeadline, this ) , mHandlerToken ) ) );
   }
 
 
@@ -84,13 +97,20 @@ namespace uhal
   {
     try
     {
+      ClientInterface::stopCompletionThread();
       mSocket.close();
 
       while ( mSocket.is_open() )
         {}
 
-      mIOservice.stop();
-      mDispatchThread.join();
+      {
+        boost::lock_guard<boost::mutex> lLock ( mTransportLayerMutex );
+        mClosing = true;
+        mDeadlineTimer.cancel();
+      }
+
+      // Handlers already queued on the shared reactor still refer to this client, so wait until they have all run
+      TransportReactor::waitForHandlers ( mHandlerToken );
       ClientInterface::returnBufferToPool ( mDispatchQueue );
       for (size_t i = 0; i < mReplyQueue.size(); i++)
         ClientInterface::returnBufferToPool ( mReplyQueue.at(i).first );
@@ -104,6 +124,20 @@ namespace uhal
   }
 
 
+  template < typename InnerProtocol , std::size_t nr_buffers_per_send >
+  void TCP< InnerProtocol , nr_buffers_per_send >::setBusyPollBudget ( const uint32_t& aMicroseconds )
+  {
+    mBusyPollBudget = aMicroseconds;
+  }
+
+
+  template < typename InnerProtocol , std::size_t nr_buffers_per_send >
+  uint32_t TCP< InnerProtocol , nr_buffers_per_send >::getBusyPollBudget() const
+  {
+    return mBusyPollBudget;
+  }
+
+
   template < typename InnerProtocol , std::size_t nr_buffers_per_send >
   void TCP< InnerProtocol , nr_buffers_per_send >::implementDispatch ( boost::shared_ptr< Buffers > aBuffers )
   {
@@ -205,6 +239,7 @@ namespace uhal
     lAsioSendBuffer.push_back ( boost::asio::const_buffer ( &mSendByteCounter , 4 ) );
     mSendByteCounter = 0;
     std::size_t lNrBuffersToSend = std::min ( mDispatchQueue.size(), nr_buffers_per_send );
+    std::vector< std::pair< const uint8_t* , size_t > > lSendSegments;
     mDispatchBuffers.reserve ( lNrBuffersToSend );
 
     for ( std::size_t i = 0; i < lNrBuffersToSend; i++ )
@@ -213,7 +248,13 @@ namespace uhal
       mDispatchQueue.pop_front();
       const boost::shared_ptr<Buffers>& lBuffer = mDispatchBuffers.back();
       mSendByteCounter += lBuffer->sendCounter();
-      lAsioSendBuffer.push_back ( boost::asio::const_buffer ( lBuffer->getSendBuffer() , lBuffer->sendCounter() ) );
+      lSendSegments.clear();
+      lBuffer->getSendSegments ( lSendSegments );
+
+      for ( std::vector< std::pair< const uint8_t* , size_t > >::const_iterator lIt = lSendSegments.begin(); lIt != lSendSegments.end(); ++lIt )
+      {
+        lAsioSendBuffer.push_back ( boost::asio::const_buffer ( lIt->first , lIt->second ) );
+      }
     }
 
     log ( Debug() , "Sending " , Integer ( mSendByteCounter ) , " bytes from ", Integer ( mDispatchBuffers.size() ), " buffers" );
@@ -228,7 +269,7 @@ namespace uhal
       mDeadlineTimer.expires_from_now ( this->getBoostTimeoutPeriod() );
     }
 
-    boost::asio::async_write ( mSocket , lAsioSendBuffer , boost::bind ( &TCP< InnerProtocol , nr_buffers_per_send >::write_callback, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred ) );
+    boost::asio::async_write ( mSocket , lAsioSendBuffer , mStrand.wrap ( TransportReactor::track ( boost::bind ( &TCP< InnerProtocol , nr_buffers_per_send >::write_callback, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred ) , mHandlerToken ) ) );
     mPacketsInFlight += mDispatchBuffers.size();
 
     SteadyClock_t::time_point lNow = SteadyClock_t::now();
@@ -331,7 +372,7 @@ namespace uhal
       mDeadlineTimer.expires_from_now ( this->getBoostTimeoutPeriod() );
     }
 
-    boost::asio::async_read ( mSocket , lAsioReplyBuffer ,  boost::asio::transfer_exactly ( 4 ), boost::bind ( &TCP< InnerProtocol , nr_buffers_per_send >::read_callback, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred ) );
+    boost::asio::async_read ( mSocket , lAsioReplyBuffer ,  boost::asio::transfer_exactly ( 4 ), mStrand.wrap ( TransportReactor::track ( boost::bind ( &TCP< InnerProtocol , nr_buffers_per_send >::read_callback, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred ) , mHandlerToken ) ) );
 
     SteadyClock_t::time_point lNow = SteadyClock_t::now();
     if (mLastRecvQueued > SteadyClock_t::time_point())
@@ -439,9 +480,9 @@ namespace uhal
 
     for ( std::vector< boost::shared_ptr<Buffers> >::const_iterator lBufIt = mReplyBuffers.first.begin(); lBufIt != mReplyBuffers.first.end(); lBufIt++ )
     {
-      std::deque< std::pair< uint8_t* , uint32_t > >& lReplyBuffers ( ( *lBufIt )->getReplyBuffer() );
+      std::vector< std::pair< uint8_t* , uint32_t > >& lReplyBuffers ( ( *lBufIt )->getReplyBuffer() );
 
-      for ( std::deque< std::pair< uint8_t* , uint32_t > >::iterator lIt = lReplyBuffers.begin() ; lIt != lReplyBuffers.end() ; ++lIt )
+      for ( std::vector< std::pair< uint8_t* , uint32_t > >::iterator lIt = lReplyBuffers.begin() ; lIt != lReplyBuffers.end() ; ++lIt )
       {
         lAsioReplyBuffer.push_back ( boost::asio::mutable_buffer ( lIt->first , lIt->second ) );
       }
@@ -537,6 +578,11 @@ namespace uhal
   {
     boost::lock_guard<boost::mutex> lLock ( this->mTransportLayerMutex );
 
+    if ( mClosing )
+    {
+      return;
+    }
+
     // Check whether the deadline has passed. We compare the deadline against the current time since a new asynchronous operation may have moved the deadline before this actor had a chance to run.
     if ( mDeadlineTimer.expires_at() <= boost::asio::deadline_timer::traits_type::now() )
     {
@@ -557,7 +603,7 @@ namespace uhal
     }
 
     // Put the actor back to sleep.
-    mDeadlineTimer.async_wait ( boost::bind ( &TCP::CheckDeadline, this ) );
+    mDeadlineTimer.async_wait ( mStrand.wrap ( TransportReactor::track ( boost::bind ( &TCP::CheckDeadline, this ) , mHandlerToken ) ) );
   }
 
 
@@ -585,6 +631,13 @@ namespace uhal
   }
 
 
+  template < typename InnerProtocol , std::size_t nr_buffers_per_send >
+  bool TCP< InnerProtocol , nr_buffers_per_send >::supportsAsynchronousFlush()
+  {
+    return true;
+  }
+
+
   template < typename InnerProtocol , std::size_t nr_buffers_per_send >
   void TCP< InnerProtocol , nr_buffers_per_send >::dispatchExceptionHandler()
   {
@@ -632,12 +685,20 @@ namespace uhal
       boost::lock_guard<boost::mutex> lLock ( mConditionalVariableMutex );
       mFlushDone = aValue;
     }
-    mConditionalVariable.notify_one();
+    mConditionalVariable.notify_all();
   }
 
   template < typename InnerProtocol , std::size_t nr_buffers_per_send >
   void TCP< InnerProtocol , nr_buffers_per_send >::WaitOnConditionalVariable()
   {
+    const uint32_t lBusyPollBudget ( mBusyPollBudget );
+
+    // In the low-latency mode, this thread completes the dispatch itself if it can, sparing the hand-off from the reactor's threads
+    if ( lBusyPollBudget && mReactor->busyPoll ( boost::bind ( &TCP< InnerProtocol , nr_buffers_per_send >::isFlushDone, this ) , boost::posix_time::microseconds ( lBusyPollBudget ) ) )
+    {
+      return;
+    }
+
     boost::unique_lock<boost::mutex> lLock ( mConditionalVariableMutex );
 
     while ( !mFlushDone )
@@ -647,6 +708,14 @@ namespace uhal
   }
 
 
+  template < typename InnerProtocol , std::size_t nr_buffers_per_send >
+  bool TCP< InnerProtocol , nr_buffers_per_send >::isFlushDone()
+  {
+    boost::lock_guard<boost::mutex> lLock ( mConditionalVariableMutex );
+    return mFlushDone;
+  }
+
+
   template class TCP< IPbus< 1 , 3 > , 1 >;
   template class TCP< IPbus< 2 , 0 > , 1 >;
 
@@ -33,11 +33,21 @@
 #include "uhal/ProtocolUDP.hpp"
 
 
+#include <algorithm>
+#include <cmath>
 #include <exception>
 #include <utility>
 
+#include <cstring>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#endif
+
 #include <boost/bind/bind.hpp>
 #include <boost/lambda/lambda.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
 #include <boost/asio/connect.hpp>
 #include <boost/asio/write.hpp>
 #include <boost/asio/read.hpp>
@@ -56,23 +66,240 @@
 
 namespace uhal
 {
+  namespace
+  {
+    //! Whether the inner protocol defines status packets, and the status/resend packet-loss recovery mechanism
+    template < typename InnerProtocol >
+    struct SupportsStatusPackets
+    {
+      static const bool value = false;
+    };
+
+    template < uint8_t IPbus_minor >
+    struct SupportsStatusPackets< IPbus< 2 , IPbus_minor > >
+    {
+      static const bool value = true;
+    };
+
+    //! The default maximum size of the IPbus packets sent to, and received from, UDP targets (in bytes)
+    const uint32_t kDefaultMaxPacketSize ( 350 * 4 );
+    //! The smallest maximum packet size that may be negotiated or requested (in bytes)
+    const uint32_t kMinPacketSize ( 64 );
+    //! The largest IPbus packet which fits in a standard 1500-byte Ethernet frame, after the IPv4 and UDP headers (in bytes)
+    const uint32_t kMaxStandardPacketSize ( 1500 - 28 );
+    //! The largest IPbus packet which fits in a 9000-byte jumbo Ethernet frame, after the IPv4 and UDP headers (in bytes)
+    const uint32_t kMaxJumboPacketSize ( 9000 - 28 );
+    //! The largest number of packets sent, or replies received, by a single system call
+    const std::size_t kMaxDatagramsPerCall ( 64 );
+    //! The largest number of segments into which a reply is scattered; ASIO ignores the segments of a buffer sequence beyond this
+    const std::size_t kMaxScatterSegments ( 64 );
+
+
+    /**
+      Build the segments into which the reply to a packet is scattered: its reply destinations, followed by the part of a staging memory beyond the expected reply, which takes any excess bytes
+      @param aBuffers the packet whose reply is expected
+      @param aStaging the staging memory
+      @param aStagingSize the size of the staging memory, which must be able to hold the whole of the expected reply
+      @param aSegments return the segments
+      @return whether the reply can be scattered; otherwise it must be staged
+    */
+    bool getScatterSegments ( Buffers& aBuffers , uint8_t* aStaging , const std::size_t& aStagingSize , std::vector< std::pair< uint8_t* , std::size_t > >& aSegments )
+    {
+      const std::vector< std::pair< uint8_t* , uint32_t > >& lReplyBuffers ( aBuffers.getReplyBuffer() );
+      const std::size_t lReplySize ( aBuffers.replyCounter() );
+
+      if ( ( lReplySize > aStagingSize ) || ( lReplyBuffers.size() >= kMaxScatterSegments ) )
+      {
+        return false;
+      }
+
+      aSegments.clear();
+
+      for ( std::vector< std::pair< uint8_t* , uint32_t > >::const_iterator lIt = lReplyBuffers.begin() ; lIt != lReplyBuffers.end() ; ++lIt )
+      {
+        if ( lIt->second )
+        {
+          aSegments.push_back ( std::make_pair ( lIt->first , std::size_t ( lIt->second ) ) );
+        }
+      }
+
+      if ( aStagingSize > lReplySize )
+      {
+        aSegments.push_back ( std::make_pair ( aStaging + lReplySize , aStagingSize - lReplySize ) );
+      }
+
+      return true;
+    }
+
+
+    /**
+      Gather the start of a reply which was scattered into the reply destinations of a packet
+      @param aBuffers the packet into whose reply destinations the reply was scattered
+      @param aDestination the memory into which to gather the reply
+      @param aSize the number of bytes to gather
+    */
+    void gatherReply ( Buffers& aBuffers , uint8_t* aDestination , std::size_t aSize )
+    {
+      const std::vector< std::pair< uint8_t* , uint32_t > >& lReplyBuffers ( aBuffers.getReplyBuffer() );
+
+      for ( std::vector< std::pair< uint8_t* , uint32_t > >::const_iterator lIt = lReplyBuffers.begin() ; ( lIt != lReplyBuffers.end() ) && aSize ; ++lIt )
+      {
+        const std::size_t lNrBytesToCopy ( std::min ( std::size_t ( lIt->second ) , aSize ) );
+        memcpy ( aDestination , lIt->first , lNrBytesToCopy );
+        aDestination += lNrBytesToCopy;
+        aSize -= lNrBytesToCopy;
+      }
+    }
+
+
+    /**
+      Check whether an IPbus 2.0 reply carries the packet header of a request, and the protocol version and transaction ID of its first transaction
+      @param aReply the start of the reply
+      @param aBytesTransferred the size of the reply
+      @param aRequest the request
+      @return whether the reply belongs to the request
+    */
+    bool isReplyTo ( const uint32_t* aReply , const std::size_t& aBytesTransferred , Buffers& aRequest )
+    {
+      const uint32_t* lRequest ( reinterpret_cast< uint32_t* > ( aRequest.getSendBuffer() ) );
+
+      // The packet header identifies the packet when recovery is enabled, since packets are then numbered; otherwise the transaction ID (and protocol version) in the first transaction header does
+      if ( ( aBytesTransferred < 4 ) || ( aReply[0] != lRequest[0] ) )
+      {
+        return false;
+      }
+
+      return ! ( ( aBytesTransferred >= 8 ) && ( aRequest.sendCounter() >= 8 ) && ( ( aReply[1] ^ lRequest[1] ) & 0xFFFF0000 ) );
+    }
+  }
+
+
   template < typename InnerProtocol >
   UDP< InnerProtocol >::UDP ( const std::string& aId, const URI& aUri ) :
     InnerProtocol ( aId , aUri ),
-    mIOservice ( ),
-    mSocket ( mIOservice , boost::asio::ip::udp::endpoint ( boost::asio::ip::udp::v4(), 0 ) ),
-    mEndpoint ( *boost::asio::ip::udp::resolver ( mIOservice ).resolve ( boost::asio::ip::udp::resolver::query ( boost::asio::ip::udp::v4() , aUri.mHostname , aUri.mPort ) ) ),
-    mDeadlineTimer ( mIOservice ),
+    mReactor ( TransportReactor::getInstance() ),
+    mStrand ( mReactor->getIOservice() ),
+    mHandlerToken ( boost::make_shared< bool > ( true ) ),
+    mClosing ( false ),
+    mSocket ( mReactor->getIOservice() ),
+    mEndpoint ( *boost::asio::ip::udp::resolver ( mReactor->getIOservice() ).resolve ( boost::asio::ip::udp::resolver::query ( boost::asio::ip::udp::v4() , aUri.mHostname , aUri.mPort ) ) ),
+    mChannel(),
+    mDeadlineTimer ( mReactor->getIOservice() ),
     mReplyMemory ( 1500 , 0x00000000 ),
-    mIOserviceWork ( mIOservice ),
-    mDispatchThread ( boost::bind ( &boost::asio::io_service::run , & ( mIOservice ) ) ),
+    mScatteredReply(),
     mDispatchQueue(),
     mReplyQueue(),
     mPacketsInFlight ( 0 ),
+    mEarlyReplies(),
     mFlushDone ( true ),
-    mAsynchronousException ( NULL )
+    mAsynchronousException ( NULL ),
+    mMaxRecoveryAttempts ( 0 ),
+    mRecoveryAttempts ( 0 ),
+    mNextPacketId ( 0 ),
+    mStatusPending ( false ),
+    mStatusRequest ( 16 , 0x00000000 ),
+    mMaxPacketSize ( kDefaultMaxPacketSize ),
+    mFixedPacketSize ( false ),
+    mMaxNumberOfBuffers ( 0 ),
+    mFixedNumberOfBuffers ( false ),
+    mJumboFrames ( false ),
+    mCongestionWindow ( 0.0 ),
+    mWindowDecreases ( 0 ),
+    mSendTimes(),
+    mSmoothedRoundTripTime ( 0.0 ),
+    mRoundTripTimeVariation ( 0.0 ),
+    mRoundTripTimeSamples ( 0 ),
+    mReorderedReplies ( 0 ),
+    mReceiveBatch(),
+    mReceiveBatchSizes(),
+    mReceiveBatchTargets(),
+    mReceiveBatchIndex ( 0 ),
+    mBatchedPackets ( 0 ),
+    mBatchedReplies ( 0 ),
+    mBusyPollBudget ( 0 )
   {
-    mDeadlineTimer.async_wait ( boost::bind ( &UDP::CheckDeadline, this ) );
+    mStatusRequest.at ( 0 ) = htonl ( 0x200000F1 );
+
+    for ( NameValuePairVectorType::const_iterator lIt = aUri.mArguments.begin() ; lIt != aUri.mArguments.end() ; ++lIt )
+    {
+      if ( lIt->first == "max_retries" )
+      {
+        if ( ! SupportsStatusPackets< InnerProtocol >::value )
+        {
+          log ( Warning() , "Ignoring URI attribute " , Quote ( lIt->first ) , " for UDP client with URI " , Quote ( this->uri() ) , ", since packet-loss recovery is only defined for IPbus 2.0" );
+          continue;
+        }
+
+        mMaxRecoveryAttempts = boost::lexical_cast< uint32_t > ( lIt->second );
+        log ( Notice() , "UDP client with URI " , Quote ( this->uri() ) , " : up to " , Integer ( mMaxRecoveryAttempts ) , " status/resend attempts will be made to recover from each timeout" );
+      }
+      else if ( lIt->first == "max_packet_size" )
+      {
+        uint32_t lSize ( boost::lexical_cast< uint32_t > ( lIt->second ) & ~0x3 );
+
+        if ( ( lSize < kMinPacketSize ) || ( lSize > kMaxJumboPacketSize ) )
+        {
+          lSize = std::min ( std::max ( lSize , kMinPacketSize ) , kMaxJumboPacketSize );
+          log ( Warning() , "URI attribute " , Quote ( lIt->first ) , " of UDP client with URI " , Quote ( this->uri() ) , " is out of range; using " , Integer ( lSize ) , " bytes instead" );
+        }
+
+        mMaxPacketSize = lSize;
+        mFixedPacketSize = true;
+        log ( Notice() , "UDP client with URI " , Quote ( this->uri() ) , " : maximum packet size set to " , Integer ( mMaxPacketSize ) , " bytes by URI " , Quote ( lIt->first ) , " attribute" );
+
+        if ( mMaxPacketSize > kMaxStandardPacketSize )
+        {
+          log ( Notice() , "UDP client with URI " , Quote ( this->uri() ) , " : packets of more than " , Integer ( kMaxStandardPacketSize ) , " bytes require jumbo frames on the path to the target" );
+        }
+      }
+      else if ( lIt->first == "jumbo" )
+      {
+        mJumboFrames = true;
+        log ( Notice() , "UDP client with URI " , Quote ( this->uri() ) , " : packets of up to " , Integer ( kMaxJumboPacketSize ) , " bytes will be used if the target's MTU allows, by URI " , Quote ( lIt->first ) , " attribute" );
+      }
+      else if ( lIt->first == "busy_poll" )
+      {
+        mBusyPollBudget = boost::lexical_cast< uint32_t > ( lIt->second );
+        log ( Notice() , "UDP client with URI " , Quote ( this->uri() ) , " : waiting threads will busy-poll for up to " , Integer ( mBusyPollBudget.load() ) , " microseconds before sleeping, by URI " , Quote ( lIt->first ) , " attribute" );
+      }
+      else if ( lIt->first == "shared_socket" )
+      {
+        mChannel = UDPMultiplexer::openChannel ( mEndpoint );
+
+        if ( mChannel )
+        {
+          log ( Notice() , "UDP client with URI " , Quote ( this->uri() ) , " : sending and receiving through a socket shared with the clients of other targets, by URI " , Quote ( lIt->first ) , " attribute" );
+        }
+        else
+        {
+          log ( Warning() , "Every shared UDP socket already serves the target of the client with URI " , Quote ( this->uri() ) , "; using a socket of its own instead" );
+        }
+      }
+      else if ( lIt->first == "max_in_flight" )
+      {
+        if ( ! SupportsStatusPackets< InnerProtocol >::value )
+        {
+          log ( Warning() , "Ignoring URI attribute " , Quote ( lIt->first ) , " for UDP client with URI " , Quote ( this->uri() ) , ", since IPbus 1.3 targets only have one buffer" );
+          continue;
+        }
+
+        mMaxNumberOfBuffers = std::max ( boost::lexical_cast< uint32_t > ( lIt->second ) , uint32_t ( 1 ) );
+        mFixedNumberOfBuffers = true;
+        log ( Notice() , "UDP client with URI " , Quote ( this->uri() ) , " : maximum number of packets in flight set to " , Integer ( mMaxNumberOfBuffers ) , " by URI " , Quote ( lIt->first ) , " attribute" );
+      }
+    }
+
+    if ( mReplyMemory.size() < mMaxPacketSize )
+    {
+      mReplyMemory.resize ( mMaxPacketSize );
+    }
+
+    if ( ! mChannel )
+    {
+      mSocket.open ( boost::asio::ip::udp::v4() );
+    }
+
+    mDeadlineTimer.async_wait ( mStrand.wrap ( TransportReactor::track ( boost::bind ( &UDP::CheckDeadline, this ) , mHandlerToken ) ) );
   }
 
 
@@ -81,13 +308,21 @@ namespace uhal
   {
     try
     {
-      mSocket.close();
+      ClientInterface::stopCompletionThread();
+      closeSocket();
 
-      while ( mSocket.is_open() )
+      while ( isSocketOpen() )
         {}
 
-      mIOservice.stop();
-      mDispatchThread.join();
+      {
+        boost::lock_guard<boost::mutex> lLock ( mTransportLayerMutex );
+        mClosing = true;
+        mDeadlineTimer.cancel();
+      }
+
+      // Handlers already queued on the shared reactor still refer to this client, so wait until they have all run
+      TransportReactor::waitForHandlers ( mHandlerToken );
+      mChannel.reset();
       boost::lock_guard<boost::mutex> lLock ( mTransportLayerMutex );
       ClientInterface::returnBufferToPool ( mDispatchQueue );
       ClientInterface::returnBufferToPool ( mReplyQueue );
@@ -103,7 +338,7 @@ namespace uhal
   template < typename InnerProtocol >
   void UDP< InnerProtocol >::implementDispatch ( boost::shared_ptr< Buffers > aBuffers )
   {
-    boost::lock_guard<boost::mutex> lLock ( mTransportLayerMutex );
+    boost::unique_lock<boost::mutex> lLock ( mTransportLayerMutex );
 
     if ( mAsynchronousException )
     {
@@ -111,13 +346,36 @@ namespace uhal
       mAsynchronousException->ThrowAsDerivedType();
     }
 
-    if ( ! mSocket.is_open() )
+    if ( ! isSocketOpen() )
     {
       connect();
     }
 
+    if ( SupportsStatusPackets< InnerProtocol >::value && ! mNextPacketId && ( mMaxRecoveryAttempts || ! mFixedPacketSize || ! mFixedNumberOfBuffers ) )
+    {
+      // Ask the target for its packet size, number of buffers and the next packet ID it expects, before anything is sent.
+      // The caller blocks until the reply is handled, so that the limits do not change under the feet of the thread filling the buffers
+      NotifyConditionalVariable ( false );
+      mStatusPending = true;
+      sendStatusRequest();
+      read();
+      lLock.unlock();
+      WaitOnConditionalVariable();
+      lLock.lock();
+
+      if ( mAsynchronousException )
+      {
+        log ( *mAsynchronousException , "Rethrowing Asynchronous Exception from 'implementDispatch' method of " , Type<UDP< InnerProtocol > >() );
+        mAsynchronousException->ThrowAsDerivedType();
+      }
 
-    if ( mDispatchBuffers || mPacketsInFlight == this->getMaxNumberOfBuffers() )
+      if ( aBuffers->sendCounter() > mMaxPacketSize )
+      {
+        log ( Warning() , "Sending " , Integer ( aBuffers->sendCounter() ) , "-byte packet, which was filled before the " , Integer ( mMaxPacketSize ) , "-byte limit was negotiated with UDP target with URI " , Quote ( this->uri() ) );
+      }
+    }
+
+    if ( mDispatchBuffers || mPacketsInFlight >= getWindowSize() )
     {
       mDispatchQueue.push_back ( aBuffers );
     }
@@ -129,17 +387,92 @@ namespace uhal
   }
 
 
+  template < typename InnerProtocol >
+  uint32_t UDP< InnerProtocol >::getMaxNumberOfBuffers()
+  {
+    return ( mMaxNumberOfBuffers ? mMaxNumberOfBuffers : InnerProtocol::getMaxNumberOfBuffers() );
+  }
+
+
+  template < typename InnerProtocol >
+  uint32_t UDP< InnerProtocol >::getWindowSize()
+  {
+    const uint32_t lLimit ( this->getMaxNumberOfBuffers() );
+
+    if ( mCongestionWindow <= 0.0 )
+    {
+      return lLimit;
+    }
+
+    return std::min ( std::max ( static_cast< uint32_t > ( mCongestionWindow ) , uint32_t ( 1 ) ) , lLimit );
+  }
+
+
+  template < typename InnerProtocol >
+  UDP< InnerProtocol >::CongestionStatistics::CongestionStatistics() :
+    window ( 0 ),
+    windowLimit ( 0 ),
+    windowDecreases ( 0 ),
+    smoothedRoundTripTime ( 0 ),
+    roundTripTimeVariation ( 0 ),
+    roundTripTimeSamples ( 0 ),
+    reorderedReplies ( 0 ),
+    batchedPackets ( 0 ),
+    batchedReplies ( 0 )
+  {
+  }
+
+
+  template < typename InnerProtocol >
+  typename UDP< InnerProtocol >::CongestionStatistics UDP< InnerProtocol >::getCongestionStatistics()
+  {
+    boost::lock_guard<boost::mutex> lLock ( mTransportLayerMutex );
+    CongestionStatistics lStatistics;
+    lStatistics.window = getWindowSize();
+    lStatistics.windowLimit = this->getMaxNumberOfBuffers();
+    lStatistics.windowDecreases = mWindowDecreases;
+    lStatistics.smoothedRoundTripTime = static_cast< uint64_t > ( mSmoothedRoundTripTime );
+    lStatistics.roundTripTimeVariation = static_cast< uint64_t > ( mRoundTripTimeVariation );
+    lStatistics.roundTripTimeSamples = mRoundTripTimeSamples;
+    lStatistics.reorderedReplies = mReorderedReplies;
+    lStatistics.batchedPackets = mBatchedPackets;
+    lStatistics.batchedReplies = mBatchedReplies;
+    return lStatistics;
+  }
+
+
+  template < typename InnerProtocol >
+  void UDP< InnerProtocol >::setBusyPollBudget ( const uint32_t& aMicroseconds )
+  {
+    mBusyPollBudget = aMicroseconds;
+  }
+
+
+  template < typename InnerProtocol >
+  uint32_t UDP< InnerProtocol >::getBusyPollBudget() const
+  {
+    return mBusyPollBudget;
+  }
+
+
+  template < typename InnerProtocol >
+  bool UDP< InnerProtocol >::usesSharedSocket() const
+  {
+    return bool ( mChannel );
+  }
+
+
   template < typename InnerProtocol >
   uint32_t UDP< InnerProtocol >::getMaxSendSize()
   {
-    return (350 * 4);
+    return mMaxPacketSize;
   }
 
 
   template < typename InnerProtocol >
   uint32_t UDP< InnerProtocol >::getMaxReplySize()
   {
-    return (350 * 4);
+    return mMaxPacketSize;
   }
 
 
@@ -148,13 +481,68 @@ namespace uhal
   {
     log ( Info() , "Creating new UDP socket for device " , Quote ( this->uri() ) , ", as it appears to have been closed..." );
     //mSocket = boost::asio::ip::udp::socket ( mIOservice , boost::asio::ip::udp::endpoint ( boost::asio::ip::udp::v4(), 0 ) );
-    mSocket.open ( boost::asio::ip::udp::v4() );
+    if ( mChannel )
+    {
+      mChannel->open();
+    }
+    else
+    {
+      mSocket.open ( boost::asio::ip::udp::v4() );
+    }
+
+    mReceiveBatchSizes.clear();
+    mReceiveBatchTargets.clear();
+    mReceiveBatchIndex = 0;
+    mScatteredReply.reset();
     //    boost::asio::socket_base::non_blocking_io lNonBlocking ( true );
     //    mSocket.io_control ( lNonBlocking );
     log ( Info() , "UDP socket created successfully." );
   }
 
 
+  template < typename InnerProtocol >
+  bool UDP< InnerProtocol >::isSocketOpen()
+  {
+    return mChannel ? mChannel->is_open() : mSocket.is_open();
+  }
+
+
+  template < typename InnerProtocol >
+  void UDP< InnerProtocol >::closeSocket()
+  {
+    if ( mChannel )
+    {
+      mChannel->close();
+    }
+    else
+    {
+      mSocket.close();
+    }
+  }
+
+
+  template < typename InnerProtocol >
+  template < typename ConstBufferSequence >
+  void UDP< InnerProtocol >::sendTo ( const ConstBufferSequence& aBuffers , boost::system::error_code& aErrorCode )
+  {
+    if ( mChannel )
+    {
+      mChannel->send ( aBuffers , aErrorCode );
+    }
+    else
+    {
+      mSocket.send_to ( aBuffers , mEndpoint , 0 , aErrorCode );
+    }
+  }
+
+
+  template < typename InnerProtocol >
+  boost::asio::ip::udp::socket::native_handle_type UDP< InnerProtocol >::nativeHandle()
+  {
+    return mChannel ? mChannel->native_handle() : mSocket.native_handle();
+  }
+
+
   template < typename InnerProtocol >
   void UDP< InnerProtocol >::write ( )
   {
@@ -166,8 +554,40 @@ namespace uhal
       return;
     }
 
+#ifdef __linux__
+    // When several packets are waiting and the window allows, they are sent together, saving a system call and a completion per packet
+    while ( mDispatchBuffers && mDispatchQueue.size() && ( mPacketsInFlight + 1 < getWindowSize() ) )
+    {
+      if ( ! sendBatch() )
+      {
+        break;
+      }
+    }
+
+    if ( !mDispatchBuffers )
+    {
+      return;
+    }
+#endif
+
+    std::vector< std::pair< const uint8_t* , size_t > > lSendSegments;
+    mDispatchBuffers->getSendSegments ( lSendSegments );
     std::vector< boost::asio::const_buffer > lAsioSendBuffer;
-    lAsioSendBuffer.push_back ( boost::asio::const_buffer ( mDispatchBuffers->getSendBuffer() , mDispatchBuffers->sendCounter() ) );
+    lAsioSendBuffer.reserve ( lSendSegments.size() );
+
+    for ( std::vector< std::pair< const uint8_t* , size_t > >::const_iterator lIt = lSendSegments.begin(); lIt != lSendSegments.end(); ++lIt )
+    {
+      lAsioSendBuffer.push_back ( boost::asio::const_buffer ( lIt->first , lIt->second ) );
+    }
+
+    if ( mMaxRecoveryAttempts )
+    {
+      // Number the packet, so that the target can tell us which packets have been lost
+      uint32_t* lPacketHeader ( reinterpret_cast< uint32_t* > ( mDispatchBuffers->getSendBuffer() ) );
+      *lPacketHeader = ( *lPacketHeader & 0xFF0000FF ) | ( uint32_t ( mNextPacketId ) << 8 );
+      mNextPacketId = ( mNextPacketId == 0xFFFF ? 1 : mNextPacketId + 1 );
+    }
+
     log ( Debug() , "Sending " , Integer ( mDispatchBuffers->sendCounter() ) , " bytes" );
     mDeadlineTimer.expires_from_now ( this->getBoostTimeoutPeriod() );
 
@@ -178,11 +598,146 @@ namespace uhal
       mDeadlineTimer.expires_from_now ( this->getBoostTimeoutPeriod() );
     }
 
-    mSocket.async_send_to ( lAsioSendBuffer , mEndpoint , boost::bind ( &UDP< InnerProtocol >::write_callback, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred ) );
+    mSendTimes.push_back ( boost::posix_time::microsec_clock::universal_time() );
+    if ( mChannel )
+    {
+      mChannel->async_send ( lAsioSendBuffer , mStrand.wrap ( TransportReactor::track ( boost::bind ( &UDP< InnerProtocol >::write_callback, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred ) , mHandlerToken ) ) );
+    }
+    else
+    {
+      mSocket.async_send_to ( lAsioSendBuffer , mEndpoint , mStrand.wrap ( TransportReactor::track ( boost::bind ( &UDP< InnerProtocol >::write_callback, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred ) , mHandlerToken ) ) );
+    }
+
     mPacketsInFlight++;
   }
 
 
+  template < typename InnerProtocol >
+  bool UDP< InnerProtocol >::sendBatch()
+  {
+#ifdef __linux__
+    std::vector< boost::shared_ptr< Buffers > > lBatch ( 1 , mDispatchBuffers );
+
+    while ( mDispatchQueue.size() && ( lBatch.size() < kMaxDatagramsPerCall ) && ( mPacketsInFlight + lBatch.size() < getWindowSize() ) )
+    {
+      lBatch.push_back ( mDispatchQueue.front() );
+      mDispatchQueue.pop_front();
+    }
+
+    std::vector< uint16_t > lPacketIds;
+    std::vector< iovec > lSegments;
+    std::vector< std::size_t > lFirstSegments;
+
+    for ( std::vector< boost::shared_ptr< Buffers > >::const_iterator lIt = lBatch.begin() ; lIt != lBatch.end() ; ++lIt )
+    {
+      if ( mMaxRecoveryAttempts )
+      {
+        // Number the packet, so that the target can tell us which packets have been lost
+        uint32_t* lPacketHeader ( reinterpret_cast< uint32_t* > ( ( *lIt )->getSendBuffer() ) );
+        *lPacketHeader = ( *lPacketHeader & 0xFF0000FF ) | ( uint32_t ( mNextPacketId ) << 8 );
+        lPacketIds.push_back ( mNextPacketId );
+        mNextPacketId = ( mNextPacketId == 0xFFFF ? 1 : mNextPacketId + 1 );
+      }
+
+      std::vector< std::pair< const uint8_t* , size_t > > lSendSegments;
+      ( *lIt )->getSendSegments ( lSendSegments );
+      lFirstSegments.push_back ( lSegments.size() );
+
+      for ( std::vector< std::pair< const uint8_t* , size_t > >::const_iterator lSegmentIt = lSendSegments.begin(); lSegmentIt != lSendSegments.end(); ++lSegmentIt )
+      {
+        iovec lSegment;
+        lSegment.iov_base = const_cast< uint8_t* > ( lSegmentIt->first );
+        lSegment.iov_len = lSegmentIt->second;
+        lSegments.push_back ( lSegment );
+      }
+    }
+
+    lFirstSegments.push_back ( lSegments.size() );
+    mmsghdr lMessages [ kMaxDatagramsPerCall ];
+    memset ( lMessages , 0 , sizeof ( lMessages ) );
+
+    for ( std::size_t i = 0 ; i != lBatch.size() ; ++i )
+    {
+      lMessages[i].msg_hdr.msg_name = mEndpoint.data();
+      lMessages[i].msg_hdr.msg_namelen = mEndpoint.size();
+      lMessages[i].msg_hdr.msg_iov = & lSegments.at ( lFirstSegments.at ( i ) );
+      lMessages[i].msg_hdr.msg_iovlen = lFirstSegments.at ( i + 1 ) - lFirstSegments.at ( i );
+    }
+
+    // A failed call sends nothing; the asynchronous send of the first packet then reports the error
+    const int lResult ( ::sendmmsg ( nativeHandle() , lMessages , lBatch.size() , MSG_DONTWAIT ) );
+    const std::size_t lSent ( lResult > 0 ? lResult : 0 );
+    log ( Debug() , "Sent " , Integer ( lSent ) , " of " , Integer ( lBatch.size() ) , " packets with a single system call" );
+
+    if ( lSent )
+    {
+      mDeadlineTimer.expires_from_now ( this->getBoostTimeoutPeriod() );
+
+      // Patch for suspected bug in using boost asio with boost python; see https://svnweb.cern.ch/trac/cactus/ticket/323#comment:7
+      while ( mDeadlineTimer.expires_from_now() < boost::posix_time::microseconds ( 600 ) )
+      {
+        log ( Debug() , "Resetting deadline timer since it just got set to strange value, likely due to a bug within boost (expires_from_now was: ", mDeadlineTimer.expires_from_now() , ")." );
+        mDeadlineTimer.expires_from_now ( this->getBoostTimeoutPeriod() );
+      }
+    }
+
+    if ( lSent > 1 )
+    {
+      mBatchedPackets += lSent;
+    }
+
+    const boost::posix_time::ptime lSendTime ( boost::posix_time::microsec_clock::universal_time() );
+
+    for ( std::size_t i = 0 ; i != lSent ; ++i )
+    {
+      mSendTimes.push_back ( lSendTime );
+      mPacketsInFlight++;
+
+      if ( mReplyBuffers )
+      {
+        mReplyQueue.push_back ( lBatch.at ( i ) );
+      }
+      else
+      {
+        mReplyBuffers = lBatch.at ( i );
+        read ( );
+      }
+    }
+
+    if ( lSent != lBatch.size() )
+    {
+      for ( std::size_t i = lBatch.size() - 1 ; i != lSent ; --i )
+      {
+        mDispatchQueue.push_front ( lBatch.at ( i ) );
+      }
+
+      mDispatchBuffers = lBatch.at ( lSent );
+
+      if ( mMaxRecoveryAttempts )
+      {
+        mNextPacketId = lPacketIds.at ( lSent );
+      }
+
+      return false;
+    }
+
+    if ( mDispatchQueue.size() && mPacketsInFlight < getWindowSize() )
+    {
+      mDispatchBuffers = mDispatchQueue.front();
+      mDispatchQueue.pop_front();
+    }
+    else
+    {
+      mDispatchBuffers.reset();
+    }
+
+    return true;
+#else
+    return false;
+#endif
+  }
+
+
   template < typename InnerProtocol >
   void UDP< InnerProtocol >::write_callback ( const boost::system::error_code& aErrorCode , std::size_t aBytesTransferred )
   {
@@ -211,7 +766,7 @@ namespace uhal
 
     if ( ( aErrorCode && ( aErrorCode != boost::asio::error::eof ) ) || ( aBytesTransferred != mDispatchBuffers->sendCounter() ) )
     {
-      mSocket.close();
+      closeSocket();
       exception::ASIOUdpError* lExc = new exception::ASIOUdpError();
       if ( aErrorCode )
       {
@@ -236,7 +791,7 @@ namespace uhal
       read ( );
     }
 
-    if ( mDispatchQueue.size() && mPacketsInFlight != this->getMaxNumberOfBuffers() )
+    if ( mDispatchQueue.size() && mPacketsInFlight < getWindowSize() )
     {
       mDispatchBuffers = mDispatchQueue.front();
       mDispatchQueue.pop_front();
@@ -244,39 +799,194 @@ namespace uhal
     }
     else
     {
-      mDispatchBuffers.reset();
+      mDispatchBuffers.reset();
+    }
+  }
+
+
+  template < typename InnerProtocol >
+  void UDP< InnerProtocol >::read ( )
+  {
+    if ( !mReplyBuffers && !mStatusPending )
+    {
+      log ( Error() , __PRETTY_FUNCTION__ , " called when 'mReplyBuffers' was NULL" );
+      NotifyConditionalVariable ( true );
+      return;
+    }
+
+    // With IPbus 2.0, status replies, replies to younger packets and stale replies may arrive in place of the expected reply, so the whole of the reply memory is made available
+    std::size_t lReplySize ( SupportsStatusPackets< InnerProtocol >::value ? mReplyMemory.size() : mReplyBuffers->replyCounter() );
+    std::vector<boost::asio::mutable_buffer> lAsioReplyBuffer;
+    std::vector< std::pair< uint8_t* , std::size_t > > lSegments;
+    mScatteredReply.reset();
+
+    // The reply expected is received straight into its destinations, with any excess bytes going to the reply memory
+    if ( mReplyBuffers && getScatterSegments ( *mReplyBuffers , & mReplyMemory.at ( 0 ) , lReplySize , lSegments ) )
+    {
+      mScatteredReply = mReplyBuffers;
+      lAsioReplyBuffer.reserve ( lSegments.size() );
+
+      for ( std::vector< std::pair< uint8_t* , std::size_t > >::const_iterator lIt = lSegments.begin() ; lIt != lSegments.end() ; ++lIt )
+      {
+        lAsioReplyBuffer.push_back ( boost::asio::mutable_buffer ( lIt->first , lIt->second ) );
+      }
+    }
+    else
+    {
+      lAsioReplyBuffer.push_back ( boost::asio::mutable_buffer ( & ( mReplyMemory.at ( 0 ) ) , lReplySize ) );
+    }
+
+    if ( mReplyBuffers )
+    {
+      log ( Debug() , "Expecting " , Integer ( mReplyBuffers->replyCounter() ) , " bytes in reply." );
+    }
+    else
+    {
+      log ( Debug() , "Expecting status reply." );
+    }
+
+    mDeadlineTimer.expires_from_now ( this->getBoostTimeoutPeriod() );
+
+    // Patch for suspected bug in using boost asio with boost python; see https://svnweb.cern.ch/trac/cactus/ticket/323#comment:7
+    while ( mDeadlineTimer.expires_from_now() < boost::posix_time::microseconds ( 600 ) )
+    {
+      log ( Debug() , "Resetting deadline timer since it just got set to strange value, likely due to a bug within boost (expires_from_now was: ", mDeadlineTimer.expires_from_now() , ")." );
+      mDeadlineTimer.expires_from_now ( this->getBoostTimeoutPeriod() );
+    }
+
+#ifdef __linux__
+    if ( ( mReceiveBatchIndex < mReceiveBatchSizes.size() ) || receiveBatch() )
+    {
+      // A reply already drained from the socket is handled as if an asynchronous receive had just completed
+      const std::size_t lBytesTransferred ( mReceiveBatchSizes.at ( mReceiveBatchIndex ) );
+      mScatteredReply = mReceiveBatchTargets.at ( mReceiveBatchIndex );
+      mReceiveBatchTargets.at ( mReceiveBatchIndex ).reset();
+      mReplyMemory.swap ( mReceiveBatch.at ( mReceiveBatchIndex++ ) );
+      mStrand.post ( TransportReactor::track ( boost::bind ( &UDP<InnerProtocol>::read_callback, this, boost::system::error_code(), lBytesTransferred ) , mHandlerToken ) );
+      return;
+    }
+#endif
+
+    if ( mChannel )
+    {
+      mChannel->async_receive ( lAsioReplyBuffer , mStrand.wrap ( TransportReactor::track ( boost::bind ( &UDP<InnerProtocol>::read_callback, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred ) , mHandlerToken ) ) );
+    }
+    else
+    {
+      mSocket.async_receive ( lAsioReplyBuffer , 0 , mStrand.wrap ( TransportReactor::track ( boost::bind ( &UDP<InnerProtocol>::read_callback, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred ) , mHandlerToken ) ) );
+    }
+  }
+
+
+  template < typename InnerProtocol >
+  bool UDP< InnerProtocol >::receiveBatch()
+  {
+#ifdef __linux__
+    mReceiveBatchSizes.clear();
+    mReceiveBatchTargets.clear();
+    mReceiveBatchIndex = 0;
+
+    // Replies are only likely to be waiting when several packets are in flight; otherwise the asynchronous receive is as cheap.
+    // A shared socket is drained by the multiplexer, which hands each client its own replies
+    if ( ! SupportsStatusPackets< InnerProtocol >::value || ( mPacketsInFlight < 2 ) || mChannel )
+    {
+      return false;
+    }
+
+    const std::size_t lCount ( std::min ( std::size_t ( mPacketsInFlight ) , kMaxDatagramsPerCall ) );
+
+    if ( mReceiveBatch.size() < lCount )
+    {
+      mReceiveBatch.resize ( lCount );
+    }
+
+    // The replies are expected in the order in which the packets were sent, so each is scattered into the reply destinations of the next packet whose reply has not yet arrived
+    std::vector< boost::shared_ptr< Buffers > > lCandidates;
+
+    if ( mReplyBuffers )
+    {
+      lCandidates.push_back ( mReplyBuffers );
+    }
+
+    for ( std::deque< boost::shared_ptr< Buffers > >::const_iterator lIt = mReplyQueue.begin() ; lIt != mReplyQueue.end() ; ++lIt )
+    {
+      if ( mEarlyReplies.find ( lIt->get() ) == mEarlyReplies.end() )
+      {
+        lCandidates.push_back ( *lIt );
+      }
+    }
+
+    mReceiveBatchTargets.resize ( lCount );
+    std::vector< iovec > lSegments;
+    std::vector< std::size_t > lFirstSegments;
+    std::vector< std::pair< uint8_t* , std::size_t > > lScatterSegments;
+
+    for ( std::size_t i = 0 ; i != lCount ; ++i )
+    {
+      std::vector< uint8_t >& lMemory ( mReceiveBatch.at ( i ) );
+      lMemory.resize ( mReplyMemory.size() );
+      lFirstSegments.push_back ( lSegments.size() );
+
+      if ( ( i < lCandidates.size() ) && getScatterSegments ( *lCandidates.at ( i ) , & lMemory.at ( 0 ) , lMemory.size() , lScatterSegments ) )
+      {
+        mReceiveBatchTargets.at ( i ) = lCandidates.at ( i );
+      }
+      else
+      {
+        lScatterSegments.assign ( 1 , std::make_pair ( & lMemory.at ( 0 ) , lMemory.size() ) );
+      }
+
+      for ( std::vector< std::pair< uint8_t* , std::size_t > >::const_iterator lIt = lScatterSegments.begin() ; lIt != lScatterSegments.end() ; ++lIt )
+      {
+        iovec lSegment;
+        lSegment.iov_base = lIt->first;
+        lSegment.iov_len = lIt->second;
+        lSegments.push_back ( lSegment );
+      }
+    }
+
+    lFirstSegments.push_back ( lSegments.size() );
+    mmsghdr lMessages [ kMaxDatagramsPerCall ];
+    memset ( lMessages , 0 , sizeof ( lMessages ) );
+
+    for ( std::size_t i = 0 ; i != lCount ; ++i )
+    {
+      lMessages[i].msg_hdr.msg_iov = & lSegments.at ( lFirstSegments.at ( i ) );
+      lMessages[i].msg_hdr.msg_iovlen = lFirstSegments.at ( i + 1 ) - lFirstSegments.at ( i );
     }
-  }
 
+    // Nothing waiting, or an error, which the asynchronous receive then reports
+    const int lReceived ( ::recvmmsg ( mSocket.native_handle() , lMessages , lCount , MSG_DONTWAIT , NULL ) );
 
-  template < typename InnerProtocol >
-  void UDP< InnerProtocol >::read ( )
-  {
-    if ( !mReplyBuffers )
+    if ( lReceived <= 0 )
     {
-      log ( Error() , __PRETTY_FUNCTION__ , " called when 'mReplyBuffers' was NULL" );
-      NotifyConditionalVariable ( true );
-      return;
+      mReceiveBatchTargets.clear();
+      return false;
     }
 
-    std::vector<boost::asio::mutable_buffer> lAsioReplyBuffer ( 1 , boost::asio::mutable_buffer ( & ( mReplyMemory.at ( 0 ) ) , mReplyBuffers->replyCounter() ) );
-    log ( Debug() , "Expecting " , Integer ( mReplyBuffers->replyCounter() ) , " bytes in reply." );
-    mDeadlineTimer.expires_from_now ( this->getBoostTimeoutPeriod() );
+    for ( int i = 0 ; i != lReceived ; ++i )
+    {
+      mReceiveBatchSizes.push_back ( lMessages[i].msg_len );
+    }
 
-    // Patch for suspected bug in using boost asio with boost python; see https://svnweb.cern.ch/trac/cactus/ticket/323#comment:7
-    while ( mDeadlineTimer.expires_from_now() < boost::posix_time::microseconds ( 600 ) )
+    if ( lReceived > 1 )
     {
-      log ( Debug() , "Resetting deadline timer since it just got set to strange value, likely due to a bug within boost (expires_from_now was: ", mDeadlineTimer.expires_from_now() , ")." );
-      mDeadlineTimer.expires_from_now ( this->getBoostTimeoutPeriod() );
+      log ( Debug() , "Received " , Integer ( lReceived ) , " replies with a single system call" );
+      mBatchedReplies += lReceived;
     }
 
-    mSocket.async_receive ( lAsioReplyBuffer , 0 , boost::bind ( &UDP<InnerProtocol>::read_callback, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred ) );
+    return true;
+#else
+    return false;
+#endif
   }
 
 
   template < typename InnerProtocol >
   void UDP< InnerProtocol >::read_callback ( const boost::system::error_code& aErrorCode , std::size_t aBytesTransferred )
   {
+    const boost::posix_time::ptime lReceiveTime ( boost::posix_time::microsec_clock::universal_time() );
+
     {
       boost::lock_guard<boost::mutex> lLock ( mTransportLayerMutex );
       if ( mAsynchronousException )
@@ -290,6 +1000,11 @@ namespace uhal
         mAsynchronousException = new exception::UdpTimeout();
         log ( *mAsynchronousException , "Timeout (" , Integer ( this->getBoostTimeoutPeriod().total_milliseconds() ) , " milliseconds) occurred for UDP receive from target with URI: ", this->uri() );
 
+        if ( mRecoveryAttempts )
+        {
+          log ( *mAsynchronousException , "Gave up after " , Integer ( mRecoveryAttempts ) , " status/resend recovery attempts" );
+        }
+
         if ( aErrorCode && aErrorCode != boost::asio::error::operation_aborted )
         {
           log ( *mAsynchronousException , "ASIO reported an error: " , Quote ( aErrorCode.message() ) );
@@ -300,34 +1015,88 @@ namespace uhal
       }
     }
 
-    if ( !mReplyBuffers )
+    if ( aErrorCode && ( aErrorCode != boost::asio::error::eof ) )
     {
-      log ( Error() , __PRETTY_FUNCTION__ , " called when 'mReplyBuffers' was NULL" );
+      closeSocket();
+
+      boost::lock_guard<boost::mutex> lLock ( mTransportLayerMutex );
+      mAsynchronousException = new exception::ASIOUdpError();
+      log ( *mAsynchronousException , "Error ", Quote ( aErrorCode.message() ) , " encountered during receive from UDP target with URI: " , this->uri() );
+
+      NotifyConditionalVariable ( true );
       return;
     }
 
-    if ( aBytesTransferred != mReplyBuffers->replyCounter() )
+    boost::shared_ptr< Buffers > lBuffers ( mReplyBuffers );
+    std::size_t lIndex ( 0 );
+    bool lInPlace ( false );
+
     {
-      log ( Error() , "Expected " , Integer ( mReplyBuffers->replyCounter() ) , "-byte UDP payload from target " , Quote ( this->uri() ) , ", but only received " , Integer ( aBytesTransferred ) , " bytes. Validating returned data to work out where error occurred." );
+      boost::lock_guard<boost::mutex> lLock ( mTransportLayerMutex );
+      lInPlace = takeScatteredReply ( aBytesTransferred );
     }
 
-    if ( aErrorCode && ( aErrorCode != boost::asio::error::eof ) )
+    if ( SupportsStatusPackets< InnerProtocol >::value && !lInPlace )
     {
-      mSocket.close();
+      boost::lock_guard<boost::mutex> lLock ( mTransportLayerMutex );
+      const uint32_t lPacketHeader ( aBytesTransferred >= 4 ? * reinterpret_cast< uint32_t* > ( & mReplyMemory.at ( 0 ) ) : 0 );
 
+      if ( ( mMaxRecoveryAttempts || mStatusPending ) && ( lPacketHeader == mStatusRequest.at ( 0 ) ) )
+      {
+        handleStatusReply ( aBytesTransferred );
+        return;
+      }
+
+      // Each reply is matched to its packet, so that a reply which overtakes the reply to an older packet is accepted
+      lBuffers = matchReply ( aBytesTransferred , lIndex );
+
+      if ( !lBuffers && !mMaxRecoveryAttempts && !mStatusPending )
+      {
+        // A reply which matches no packet is validated against the oldest packet, in order to work out where the error occurred
+        lBuffers = mReplyBuffers;
+        lIndex = 0;
+      }
+      else if ( !lBuffers )
+      {
+        // Replies which arrive late, or twice following a resend, carry the header of a packet that has already been dealt with
+        log ( Notice() , "Discarding stale " , Integer ( aBytesTransferred ) , "-byte packet with header " , Integer ( lPacketHeader , IntFmt<hex,fixed>() ) , " from UDP target with URI " , Quote ( this->uri() ) );
+
+        if ( mReplyBuffers || mStatusPending )
+        {
+          read();
+        }
+
+        return;
+      }
+    }
+
+    if ( SupportsStatusPackets< InnerProtocol >::value )
+    {
       boost::lock_guard<boost::mutex> lLock ( mTransportLayerMutex );
-      mAsynchronousException = new exception::ASIOUdpError();
-      log ( *mAsynchronousException , "Error ", Quote ( aErrorCode.message() ) , " encountered during receive from UDP target with URI: " , this->uri() );
 
-      NotifyConditionalVariable ( true );
+      if ( mRecoveryAttempts )
+      {
+        log ( Notice() , "Recovered from timeout of UDP target with URI " , Quote ( this->uri() ) , " after " , Integer ( mRecoveryAttempts ) , " status/resend attempts" );
+        mRecoveryAttempts = 0;
+      }
+    }
+
+    if ( !lBuffers )
+    {
+      log ( Error() , __PRETTY_FUNCTION__ , " called when 'mReplyBuffers' was NULL" );
       return;
     }
 
+    if ( aBytesTransferred != lBuffers->replyCounter() )
+    {
+      log ( Error() , "Expected " , Integer ( lBuffers->replyCounter() ) , "-byte UDP payload from target " , Quote ( this->uri() ) , ", but only received " , Integer ( aBytesTransferred ) , " bytes. Validating returned data to work out where error occurred." );
+    }
+
 
-    std::deque< std::pair< uint8_t* , uint32_t > >& lReplyBuffers ( mReplyBuffers->getReplyBuffer() );
+    std::vector< std::pair< uint8_t* , uint32_t > >& lReplyBuffers ( lBuffers->getReplyBuffer() );
     uint8_t* lReplyBuf ( & ( mReplyMemory.at ( 0 ) ) );
 
-    for ( std::deque< std::pair< uint8_t* , uint32_t > >::iterator lIt = lReplyBuffers.begin() ; lIt != lReplyBuffers.end() ; ++lIt )
+    for ( std::vector< std::pair< uint8_t* , uint32_t > >::iterator lIt = lReplyBuffers.begin() ; ( lIt != lReplyBuffers.end() ) && !lInPlace ; ++lIt )
     {
       // Don't copy more of mReplyMemory than was written to, for cases when less data received than expected
       if ( static_cast<uint32_t> ( lReplyBuf - ( & mReplyMemory.at ( 0 ) ) ) >= aBytesTransferred )
@@ -340,53 +1109,200 @@ namespace uhal
       lReplyBuf += lNrBytesToCopy;
     }
 
-    try
     {
-      if ( uhal::exception::exception* lExc = ClientInterface::validate ( mReplyBuffers ) ) //Control of the pointer has been passed back to the client interface
+      boost::lock_guard<boost::mutex> lLock ( mTransportLayerMutex );
+      replyReceived ( lIndex , lReceiveTime );
+
+      if ( lIndex )
       {
-        boost::lock_guard<boost::mutex> lLock ( mTransportLayerMutex );
-        mAsynchronousException = lExc;
+        // A block read split over several packets is marked valid with its last packet, so the younger packet is only validated once all older packets have been
+        mEarlyReplies.insert ( lBuffers.get() );
+        ++mReorderedReplies;
+
+        if ( !mDispatchBuffers && mDispatchQueue.size() && mPacketsInFlight < getWindowSize() )
+        {
+          mDispatchBuffers = mDispatchQueue.front();
+          mDispatchQueue.pop_front();
+          write();
+        }
+
+        read();
+        return;
       }
     }
-    catch ( exception::exception& aExc )
+
+    // Validate the reply, followed by the replies to any younger packets which overtook it, in the order in which the packets were sent
+    while ( true )
     {
+      try
+      {
+        if ( uhal::exception::exception* lExc = ClientInterface::validate ( mReplyBuffers ) ) //Control of the pointer has been passed back to the client interface
+        {
+          boost::lock_guard<boost::mutex> lLock ( mTransportLayerMutex );
+          mAsynchronousException = lExc;
+        }
+      }
+      catch ( exception::exception& aExc )
+      {
+        boost::lock_guard<boost::mutex> lLock ( mTransportLayerMutex );
+        mAsynchronousException = new exception::ValidationError ();
+        log ( *mAsynchronousException , "Exception caught during reply validation for UDP device with URI " , Quote ( this->uri() ) , "; what returned: " , Quote ( aExc.what() ) );
+      }
+
       boost::lock_guard<boost::mutex> lLock ( mTransportLayerMutex );
-      mAsynchronousException = new exception::ValidationError ();
-      log ( *mAsynchronousException , "Exception caught during reply validation for UDP device with URI " , Quote ( this->uri() ) , "; what returned: " , Quote ( aExc.what() ) );
+
+      if ( mAsynchronousException )
+      {
+        NotifyConditionalVariable ( true );
+        return;
+      }
+
+      if ( mSendTimes.size() )
+      {
+        mSendTimes.pop_front();
+      }
+
+      if ( mReplyQueue.empty() )
+      {
+        mReplyBuffers.reset();
+        break;
+      }
+
+      mReplyBuffers = mReplyQueue.front();
+      mReplyQueue.pop_front();
+
+      if ( ! mEarlyReplies.erase ( mReplyBuffers.get() ) )
+      {
+        read();
+        break;
+      }
     }
 
     boost::lock_guard<boost::mutex> lLock ( mTransportLayerMutex );
 
-    if ( mAsynchronousException )
+    if ( !mDispatchBuffers && mDispatchQueue.size() && mPacketsInFlight < getWindowSize() )
+    {
+      mDispatchBuffers = mDispatchQueue.front();
+      mDispatchQueue.pop_front();
+      write();
+    }
+
+    if ( !mDispatchBuffers && !mReplyBuffers )
     {
+      mDeadlineTimer.expires_from_now( boost::posix_time::seconds(60) );
       NotifyConditionalVariable ( true );
-      return;
     }
+  }
+
 
-    if ( mReplyQueue.size() )
+  template < typename InnerProtocol >
+  boost::shared_ptr< Buffers > UDP< InnerProtocol >::matchReply ( const std::size_t& aBytesTransferred , std::size_t& aIndex )
+  {
+    const uint32_t* lReply ( reinterpret_cast< uint32_t* > ( & mReplyMemory.at ( 0 ) ) );
+
+    for ( aIndex = 0 ; mReplyBuffers && ( aIndex <= mReplyQueue.size() ) ; ++aIndex )
     {
-      mReplyBuffers = mReplyQueue.front();
-      mReplyQueue.pop_front();
-      read();
+      const boost::shared_ptr< Buffers >& lCandidate ( aIndex ? mReplyQueue.at ( aIndex - 1 ) : mReplyBuffers );
+
+      if ( ! isReplyTo ( lReply , aBytesTransferred , *lCandidate ) )
+      {
+        continue;
+      }
+
+      // A reply is only taken to have overtaken that of an older packet if it is complete
+      if ( aIndex && ( aBytesTransferred != lCandidate->replyCounter() ) )
+      {
+        continue;
+      }
+
+      if ( mEarlyReplies.find ( lCandidate.get() ) == mEarlyReplies.end() )
+      {
+        return lCandidate;
+      }
     }
-    else
+
+    return boost::shared_ptr< Buffers >();
+  }
+
+
+  template < typename InnerProtocol >
+  bool UDP< InnerProtocol >::takeScatteredReply ( const std::size_t& aBytesTransferred )
+  {
+    boost::shared_ptr< Buffers > lBuffers;
+    lBuffers.swap ( mScatteredReply );
+
+    if ( !lBuffers )
+    {
+      return false;
+    }
+
+    if ( ( lBuffers == mReplyBuffers ) && ( aBytesTransferred == lBuffers->replyCounter() ) )
+    {
+      if ( ! SupportsStatusPackets< InnerProtocol >::value )
+      {
+        return true;
+      }
+
+      uint32_t lHeaders[2] = { 0 , 0 };
+      gatherReply ( *lBuffers , reinterpret_cast< uint8_t* > ( lHeaders ) , std::min ( aBytesTransferred , sizeof ( lHeaders ) ) );
+
+      if ( isReplyTo ( lHeaders , aBytesTransferred , *lBuffers ) )
+      {
+        return true;
+      }
+    }
+
+    log ( Debug() , "Gathering " , Integer ( aBytesTransferred ) , "-byte reply from UDP target with URI " , Quote ( this->uri() ) , " into the reply memory" );
+    gatherReply ( *lBuffers , & mReplyMemory.at ( 0 ) , std::min ( aBytesTransferred , std::size_t ( lBuffers->replyCounter() ) ) );
+
+    // The rest of the current batch is gathered too, before this reply is copied to the packet to which it really belongs, since that may be where a later reply of the batch was scattered
+    for ( std::size_t i = mReceiveBatchIndex ; i < mReceiveBatchSizes.size() ; ++i )
     {
-      mReplyBuffers.reset();
+      if ( mReceiveBatchTargets.at ( i ) )
+      {
+        gatherReply ( *mReceiveBatchTargets.at ( i ) , & mReceiveBatch.at ( i ).at ( 0 ) , std::min ( mReceiveBatchSizes.at ( i ) , std::size_t ( mReceiveBatchTargets.at ( i )->replyCounter() ) ) );
+        mReceiveBatchTargets.at ( i ).reset();
+      }
     }
 
+    return false;
+  }
+
+
+  template < typename InnerProtocol >
+  void UDP< InnerProtocol >::replyReceived ( const std::size_t& aIndex , const boost::posix_time::ptime& aReceiveTime )
+  {
     mPacketsInFlight--;
 
-    if ( !mDispatchBuffers && mDispatchQueue.size() && mPacketsInFlight != this->getMaxNumberOfBuffers() )
+    if ( aIndex < mSendTimes.size() )
     {
-      mDispatchBuffers = mDispatchQueue.front();
-      mDispatchQueue.pop_front();
-      write();
+      boost::posix_time::ptime& lSendTime ( mSendTimes.at ( aIndex ) );
+
+      if ( ! lSendTime.is_special() )
+      {
+        // Smoothed round-trip time and mean deviation, as used for TCP's retransmission timer (RFC 6298)
+        const double lSample ( ( aReceiveTime - lSendTime ).total_microseconds() );
+
+        if ( mRoundTripTimeSamples++ )
+        {
+          mRoundTripTimeVariation += 0.25 * ( std::abs ( mSmoothedRoundTripTime - lSample ) - mRoundTripTimeVariation );
+          mSmoothedRoundTripTime += 0.125 * ( lSample - mSmoothedRoundTripTime );
+        }
+        else
+        {
+          mSmoothedRoundTripTime = lSample;
+          mRoundTripTimeVariation = 0.5 * lSample;
+        }
+      }
+
+      // The send time is kept until the packet is validated, so that the send times stay in step with the packets in flight
+      lSendTime = boost::posix_time::ptime ( boost::posix_time::not_a_date_time );
     }
 
-    if ( !mDispatchBuffers && !mReplyBuffers )
+    if ( mCongestionWindow > 0.0 )
     {
-      mDeadlineTimer.expires_from_now( boost::posix_time::seconds(60) );
-      NotifyConditionalVariable ( true );
+      // Additive increase: the window grows by about one packet each time a full window of replies arrives
+      mCongestionWindow = std::min ( mCongestionWindow + ( 1.0 / mCongestionWindow ) , double ( this->getMaxNumberOfBuffers() ) );
     }
   }
 
@@ -400,8 +1316,34 @@ namespace uhal
     // deadline before this actor had a chance to run.
     boost::lock_guard<boost::mutex> lLock ( this->mTransportLayerMutex );
 
+    if ( mClosing )
+    {
+      return;
+    }
+
     if ( mDeadlineTimer.expires_at() <= boost::asio::deadline_timer::traits_type::now() )
     {
+      if ( mDispatchBuffers || mReplyBuffers )
+      {
+        // Multiplicative decrease: a timeout is taken as a sign that packets are being dropped on the way to, or from, the target
+        mCongestionWindow = std::max ( 0.5 * getWindowSize() , 1.0 );
+        ++mWindowDecreases;
+        log ( Notice() , "Reducing window of UDP client with URI " , Quote ( this->uri() ) , " to " , Integer ( getWindowSize() ) , " packets in flight following timeout" );
+
+        // Replies to the packets already sent would include the time spent waiting for the timeout, so are not timed
+        std::fill ( mSendTimes.begin() , mSendTimes.end() , boost::posix_time::ptime ( boost::posix_time::not_a_date_time ) );
+      }
+
+      if ( mMaxRecoveryAttempts && ( mReplyBuffers || mStatusPending ) && !mDispatchBuffers && ( mRecoveryAttempts < mMaxRecoveryAttempts ) && isSocketOpen() )
+      {
+        // Leave the receive outstanding, and ask the target which packets it has seen; the status reply is handled by read_callback
+        ++mRecoveryAttempts;
+        log ( Notice() , "Timeout (" , Integer ( this->getBoostTimeoutPeriod().total_milliseconds() ) , " milliseconds) for UDP target with URI " , Quote ( this->uri() ) , "; sending status request (recovery attempt " , Integer ( mRecoveryAttempts ) , " of " , Integer ( mMaxRecoveryAttempts ) , ")" );
+        sendStatusRequest();
+        mDeadlineTimer.async_wait ( mStrand.wrap ( TransportReactor::track ( boost::bind ( &UDP::CheckDeadline, this ) , mHandlerToken ) ) );
+        return;
+      }
+
       // SETTING THE EXCEPTION HERE CAN APPEAR AS A TIMEOUT WHEN NONE ACTUALLY EXISTS
       if (  mDispatchBuffers || mReplyBuffers )
       {
@@ -414,14 +1356,145 @@ namespace uhal
 
       // The deadline has passed. The socket is closed so that any outstanding
       // asynchronous operations are cancelled.
-      mSocket.close();
+      closeSocket();
       // There is no longer an active deadline. The expiry is set to positive
       // infinity so that the actor takes no action until a new deadline is set.
       mDeadlineTimer.expires_at ( boost::posix_time::pos_infin );
     }
 
     // Put the actor back to sleep.
-    mDeadlineTimer.async_wait ( boost::bind ( &UDP::CheckDeadline, this ) );
+    mDeadlineTimer.async_wait ( mStrand.wrap ( TransportReactor::track ( boost::bind ( &UDP::CheckDeadline, this ) , mHandlerToken ) ) );
+  }
+
+
+  template < typename InnerProtocol >
+  void UDP< InnerProtocol >::sendStatusRequest()
+  {
+    boost::system::error_code lErrorCode;
+    sendTo ( boost::asio::buffer ( mStatusRequest ) , lErrorCode );
+
+    if ( lErrorCode )
+    {
+      log ( Warning() , "Error " , Quote ( lErrorCode.message() ) , " encountered sending status request to UDP target with URI: " , this->uri() );
+    }
+
+    mDeadlineTimer.expires_from_now ( this->getBoostTimeoutPeriod() );
+  }
+
+
+  template < typename InnerProtocol >
+  void UDP< InnerProtocol >::handleStatusReply ( std::size_t aBytesTransferred )
+  {
+    if ( aBytesTransferred < 16 )
+    {
+      log ( Warning() , "Ignoring truncated " , Integer ( aBytesTransferred ) , "-byte status reply from UDP target with URI " , Quote ( this->uri() ) );
+    }
+    else
+    {
+      // Words 1 to 3 of the status reply are the target's MTU, its number of reply buffers, and the header of the next control packet it expects
+      const uint32_t* lStatus ( reinterpret_cast< uint32_t* > ( & mReplyMemory.at ( 0 ) ) );
+      uint16_t lNextId ( ( ntohl ( lStatus[3] ) >> 8 ) & 0xFFFF );
+
+      if ( mStatusPending )
+      {
+        const uint32_t lTargetMtu ( ntohl ( lStatus[1] ) );
+        const uint32_t lTargetNrBuffers ( ntohl ( lStatus[2] ) );
+
+        if ( ! mFixedPacketSize )
+        {
+          if ( lTargetMtu >= kMinPacketSize + 28 )
+          {
+            mMaxPacketSize = std::min ( ( lTargetMtu - 28 ) & ~0x3 , ( mJumboFrames ? kMaxJumboPacketSize : kDefaultMaxPacketSize ) );
+          }
+          else
+          {
+            log ( Warning() , "Ignoring MTU of " , Integer ( lTargetMtu ) , " bytes reported by UDP target with URI " , Quote ( this->uri() ) );
+          }
+        }
+
+        if ( ! mFixedNumberOfBuffers && lTargetNrBuffers )
+        {
+          mMaxNumberOfBuffers = std::min ( lTargetNrBuffers , InnerProtocol::getMaxNumberOfBuffers() );
+        }
+
+        if ( mReplyMemory.size() < mMaxPacketSize )
+        {
+          mReplyMemory.resize ( mMaxPacketSize );
+        }
+
+        mStatusPending = false;
+        mRecoveryAttempts = 0;
+        mNextPacketId = ( lNextId ? lNextId : 1 );
+        log ( Info() , "UDP target with URI " , Quote ( this->uri() ) , " reports MTU of " , Integer ( lTargetMtu ) , " bytes and " , Integer ( lTargetNrBuffers ) , " buffers, and expects next control packet to have ID " , Integer ( mNextPacketId ) ,
+              "; using packets of up to " , Integer ( mMaxPacketSize ) , " bytes, with up to " , Integer ( this->getMaxNumberOfBuffers() ) , " in flight" );
+        NotifyConditionalVariable ( true );
+        return;
+      }
+
+      if ( mReplyBuffers && mRecoveryAttempts )
+      {
+        // Packets whose replies have already arrived, ahead of the reply to an older packet, were not lost
+        std::deque < boost::shared_ptr< Buffers > > lInFlight ( 1 , mReplyBuffers );
+
+        for ( std::deque < boost::shared_ptr< Buffers > >::const_iterator lIt = mReplyQueue.begin() ; lIt != mReplyQueue.end() ; ++lIt )
+        {
+          if ( mEarlyReplies.find ( lIt->get() ) == mEarlyReplies.end() )
+          {
+            lInFlight.push_back ( *lIt );
+          }
+        }
+
+        uint16_t lOldestId ( ( * reinterpret_cast< uint32_t* > ( mReplyBuffers->getSendBuffer() ) >> 8 ) & 0xFFFF );
+        boost::system::error_code lErrorCode;
+
+        if ( lNextId == lOldestId )
+        {
+          // The target never saw the oldest request, and so will have rejected any sent after it
+          log ( Notice() , "Re-sending " , Integer ( lInFlight.size() ) , " lost request packets to UDP target with URI " , Quote ( this->uri() ) , " (next ID expected by target: " , Integer ( lNextId ) , ")" );
+
+          for ( std::deque < boost::shared_ptr< Buffers > >::const_iterator lIt = lInFlight.begin() ; lIt != lInFlight.end() ; ++lIt )
+          {
+            std::vector< std::pair< const uint8_t* , size_t > > lSendSegments;
+            ( *lIt )->getSendSegments ( lSendSegments );
+            std::vector< boost::asio::const_buffer > lAsioSendBuffer;
+            lAsioSendBuffer.reserve ( lSendSegments.size() );
+
+            for ( std::vector< std::pair< const uint8_t* , size_t > >::const_iterator lSegIt = lSendSegments.begin(); lSegIt != lSendSegments.end(); ++lSegIt )
+            {
+              lAsioSendBuffer.push_back ( boost::asio::const_buffer ( lSegIt->first , lSegIt->second ) );
+            }
+
+            sendTo ( lAsioSendBuffer , lErrorCode );
+          }
+        }
+        else
+        {
+          // The target has processed the oldest request, so its reply was lost; the target keeps a history of its replies which can be resent
+          log ( Notice() , "Requesting re-send of " , Integer ( lInFlight.size() ) , " lost reply packets from UDP target with URI " , Quote ( this->uri() ) , " (next ID expected by target: " , Integer ( lNextId ) , ")" );
+
+          for ( std::deque < boost::shared_ptr< Buffers > >::const_iterator lIt = lInFlight.begin() ; lIt != lInFlight.end() ; ++lIt )
+          {
+            uint32_t lResendRequest ( htonl ( 0x200000F2 | ( * reinterpret_cast< uint32_t* > ( ( *lIt )->getSendBuffer() ) & 0x00FFFF00 ) ) );
+            sendTo ( boost::asio::buffer ( &lResendRequest , 4 ) , lErrorCode );
+          }
+        }
+
+        if ( lErrorCode )
+        {
+          log ( Warning() , "Error " , Quote ( lErrorCode.message() ) , " encountered re-sending packets to UDP target with URI: " , this->uri() );
+        }
+
+        read();
+        return;
+      }
+    }
+
+    log ( Debug() , "Ignoring unsolicited status reply from UDP target with URI " , Quote ( this->uri() ) );
+
+    if ( mReplyBuffers || mStatusPending )
+    {
+      read();
+    }
   }
 
 
@@ -439,18 +1512,25 @@ namespace uhal
 
 
 
+  template < typename InnerProtocol >
+  bool UDP< InnerProtocol >::supportsAsynchronousFlush()
+  {
+    return true;
+  }
+
+
   template < typename InnerProtocol >
   void UDP< InnerProtocol >::dispatchExceptionHandler()
   {
     log ( Warning() , "Closing Socket since exception detected." );
 
-    if ( mSocket.is_open() )
+    if ( isSocketOpen() )
     {
       try
       {
-        mSocket.close();
+        closeSocket();
 
-        while ( mSocket.is_open() )
+        while ( isSocketOpen() )
           {}
       }
       catch ( ... )
@@ -468,12 +1548,23 @@ namespace uhal
     ClientInterface::returnBufferToPool ( mDispatchQueue );
     ClientInterface::returnBufferToPool ( mReplyQueue );
     mPacketsInFlight = 0;
+    mEarlyReplies.clear();
+    mSendTimes.clear();
+    mReceiveBatchSizes.clear();
+    mReceiveBatchTargets.clear();
+    mReceiveBatchIndex = 0;
+    mScatteredReply.reset();
 
     ClientInterface::returnBufferToPool ( mDispatchBuffers );
     mDispatchBuffers.reset();
     ClientInterface::returnBufferToPool ( mReplyBuffers );
     mReplyBuffers.reset();
 
+    // The socket has been closed, so the ID expected by the target must be found afresh
+    mRecoveryAttempts = 0;
+    mNextPacketId = 0;
+    mStatusPending = false;
+
     InnerProtocol::dispatchExceptionHandler();
   }
 
@@ -485,13 +1576,21 @@ namespace uhal
       boost::lock_guard<boost::mutex> lLock ( mConditionalVariableMutex );
       mFlushDone = aValue;
     }
-    mConditionalVariable.notify_one();
+    mConditionalVariable.notify_all();
   }
 
 
   template < typename InnerProtocol  >
   void UDP< InnerProtocol >::WaitOnConditionalVariable()
   {
+    const uint32_t lBusyPollBudget ( mBusyPollBudget );
+
+    // In the low-latency mode, this thread completes the dispatch itself if it can, sparing the hand-off from the reactor's threads
+    if ( lBusyPollBudget && mReactor->busyPoll ( boost::bind ( &UDP< InnerProtocol >::isFlushDone, this ) , boost::posix_time::microseconds ( lBusyPollBudget ) ) )
+    {
+      return;
+    }
+
     boost::unique_lock<boost::mutex> lLock ( mConditionalVariableMutex );
 
     while ( !mFlushDone )
@@ -501,6 +1600,14 @@ namespace uhal
   }
 
 
+  template < typename InnerProtocol  >
+  bool UDP< InnerProtocol >::isFlushDone()
+  {
+    boost::lock_guard<boost::mutex> lLock ( mConditionalVariableMutex );
+    return mFlushDone;
+  }
+
+
   template class UDP< IPbus< 1 , 3 > >;
   template class UDP< IPbus< 2 , 0 > >;
 }
@@ -0,0 +1,300 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+
+#include "uhal/TransactionProgram.hpp"
+
+
+#include <stddef.h>                                            // for NULL
+
+#include "uhal/ClientInterface.hpp"                            // for BitsSetWhichAreForbiddenByBitMask
+#include "uhal/log/LogLevels.hpp"
+#include "uhal/log/log_inserters.integer.hpp"                  // for Integer
+#include "uhal/log/log.hpp"
+#include "uhal/utilities/bits.hpp"
+
+
+namespace uhal
+{
+
+  TransactionProgram::TransactionProgram() :
+    mEncodedFor ( NULL )
+  {
+  }
+
+
+  TransactionProgram::~TransactionProgram()
+  {
+  }
+
+
+  uint32_t TransactionProgram::write ( const uint32_t& aAddr, const uint32_t& aValue )
+  {
+    const uint32_t lSlot ( mWriteValues.size() );
+    mWriteValues.push_back ( aValue );
+    mWriteMasks.push_back ( defs::NOMASK );
+    record ( WRITE , aAddr , 1 , defs::INCREMENTAL , lSlot );
+    return lSlot;
+  }
+
+
+  uint32_t TransactionProgram::write ( const uint32_t& aAddr, const uint32_t& aValue, const uint32_t& aMask )
+  {
+    const uint32_t lSlot ( mWriteValues.size() );
+    mWriteValues.push_back ( aValue );
+    mWriteMasks.push_back ( aMask );
+
+    try
+    {
+      encodeWriteValue ( lSlot );
+    }
+    catch ( ... )
+    {
+      mWriteValues.pop_back();
+      mWriteMasks.pop_back();
+      throw;
+    }
+
+    record ( MASKED_WRITE , aAddr , 1 , defs::INCREMENTAL , lSlot , ~aMask );
+    return lSlot;
+  }
+
+
+  uint32_t TransactionProgram::writeBlock ( const uint32_t& aAddr, const std::vector< uint32_t >& aValues, const defs::BlockReadWriteMode& aMode )
+  {
+    const uint32_t lSlot ( mWriteValues.size() );
+    mWriteValues.insert ( mWriteValues.end() , aValues.begin() , aValues.end() );
+    mWriteMasks.resize ( mWriteValues.size() , defs::NOMASK );
+    record ( WRITE_BLOCK , aAddr , aValues.size() , aMode , lSlot );
+    return lSlot;
+  }
+
+
+  uint32_t TransactionProgram::read ( const uint32_t& aAddr, const uint32_t& aMask )
+  {
+    const uint32_t lSlot ( mResults.size() );
+    mResults.push_back ( 0 );
+    mResultMasks.push_back ( aMask );
+    record ( READ , aAddr , 1 , defs::INCREMENTAL , lSlot );
+    return lSlot;
+  }
+
+
+  uint32_t TransactionProgram::readBlock ( const uint32_t& aAddr, const uint32_t& aSize, const defs::BlockReadWriteMode& aMode )
+  {
+    const uint32_t lSlot ( mResults.size() );
+    mResults.resize ( mResults.size() + aSize , 0 );
+    mResultMasks.resize ( mResults.size() , defs::NOMASK );
+    record ( READ_BLOCK , aAddr , aSize , aMode , lSlot );
+    return lSlot;
+  }
+
+
+  uint32_t TransactionProgram::rmw_bits ( const uint32_t& aAddr , const uint32_t& aANDterm , const uint32_t& aORterm )
+  {
+    const uint32_t lSlot ( mResults.size() );
+    mResults.push_back ( 0 );
+    mResultMasks.push_back ( defs::NOMASK );
+    record ( RMW_BITS , aAddr , 1 , defs::INCREMENTAL , lSlot , aANDterm , aORterm );
+    return lSlot;
+  }
+
+
+  uint32_t TransactionProgram::rmw_sum ( const uint32_t& aAddr , const int32_t& aAddend )
+  {
+    const uint32_t lSlot ( mResults.size() );
+    mResults.push_back ( 0 );
+    mResultMasks.push_back ( defs::NOMASK );
+    record ( RMW_SUM , aAddr , 1 , defs::INCREMENTAL , lSlot , static_cast< uint32_t > ( aAddend ) );
+    return lSlot;
+  }
+
+
+  void TransactionProgram::setWriteValue ( const uint32_t& aSlot , const uint32_t& aValue )
+  {
+    if ( aSlot >= mWriteValues.size() )
+    {
+      exception::TransactionProgramSlotOutOfRange lExc;
+      log ( lExc , "Write slot " , Integer ( aSlot ) , " requested, but the transaction program only has " , Integer ( mWriteValues.size() ) , " write slots" );
+      throw lExc;
+    }
+
+    const uint32_t lPreviousValue ( mWriteValues.at ( aSlot ) );
+    mWriteValues.at ( aSlot ) = aValue;
+    uint32_t lWord;
+
+    try
+    {
+      lWord = encodeWriteValue ( aSlot );
+    }
+    catch ( ... )
+    {
+      mWriteValues.at ( aSlot ) = lPreviousValue;
+      throw;
+    }
+
+    if ( mEncodedFor )
+    {
+      const std::pair< uint32_t , uint32_t >& lLocation ( mWriteLocations.at ( aSlot ) );
+      * ( ( uint32_t* ) ( & ( mPackets.at ( lLocation.first ).mSend.at ( lLocation.second ) ) ) ) = lWord;
+    }
+  }
+
+
+  const uint32_t& TransactionProgram::getWriteValue ( const uint32_t& aSlot ) const
+  {
+    if ( aSlot >= mWriteValues.size() )
+    {
+      exception::TransactionProgramSlotOutOfRange lExc;
+      log ( lExc , "Write slot " , Integer ( aSlot ) , " requested, but the transaction program only has " , Integer ( mWriteValues.size() ) , " write slots" );
+      throw lExc;
+    }
+
+    return mWriteValues.at ( aSlot );
+  }
+
+
+  std::size_t TransactionProgram::writeSlots() const
+  {
+    return mWriteValues.size();
+  }
+
+
+  std::size_t TransactionProgram::resultSlots() const
+  {
+    return mResults.size();
+  }
+
+
+  bool TransactionProgram::valid() const
+  {
+    return mReply.valid();
+  }
+
+
+  uint32_t TransactionProgram::value ( const uint32_t& aSlot ) const
+  {
+    if ( aSlot >= mResults.size() )
+    {
+      exception::TransactionProgramSlotOutOfRange lExc;
+      log ( lExc , "Result slot " , Integer ( aSlot ) , " requested, but the transaction program only has " , Integer ( mResults.size() ) , " result slots" );
+      throw lExc;
+    }
+
+    const uint32_t& lMask ( mResultMasks.at ( aSlot ) );
+    return ( values().at ( aSlot ) & lMask ) >> utilities::TrailingRightBits ( lMask );
+  }
+
+
+  const std::vector< uint32_t >& TransactionProgram::values() const
+  {
+    if ( ! mReply.valid() )
+    {
+      exception::NonValidatedMemory lExc;
+      log ( lExc , "Access attempted on non-validated memory" );
+      throw lExc;
+    }
+
+    return mResults;
+  }
+
+
+  TransactionProgram::Packet::Packet() :
+    mReplyByteCount ( 0 )
+  {
+  }
+
+
+  void TransactionProgram::Packet::send ( const uint32_t& aWord )
+  {
+    const uint8_t* lPtr ( reinterpret_cast< const uint8_t* > ( &aWord ) );
+    mSend.insert ( mSend.end() , lPtr , lPtr + 4 );
+  }
+
+
+  void TransactionProgram::Packet::receive ( uint8_t* aPtr , const uint32_t& aSize )
+  {
+    mReplies.push_back ( std::make_pair ( aPtr , aSize ) );
+    mReplyByteCount += aSize;
+  }
+
+
+  void TransactionProgram::record ( const OperationType& aType , const uint32_t& aAddr , const uint32_t& aSize , const defs::BlockReadWriteMode& aMode , const uint32_t& aSlot , const uint32_t& aTerm1 , const uint32_t& aTerm2 )
+  {
+    // Recording may move the result slots to which the encoded replies point
+    clearEncoding();
+    Operation lOperation;
+    lOperation.mType = aType;
+    lOperation.mAddr = aAddr;
+    lOperation.mSize = aSize;
+    lOperation.mMode = aMode;
+    lOperation.mSlot = aSlot;
+    lOperation.mTerm1 = aTerm1;
+    lOperation.mTerm2 = aTerm2;
+    mOperations.push_back ( lOperation );
+  }
+
+
+  uint32_t TransactionProgram::encodeWriteValue ( const uint32_t& aSlot ) const
+  {
+    const uint32_t& lValue ( mWriteValues.at ( aSlot ) );
+    const uint32_t& lMask ( mWriteMasks.at ( aSlot ) );
+
+    if ( lMask == defs::NOMASK )
+    {
+      return lValue;
+    }
+
+    uint32_t lShiftSize ( utilities::TrailingRightBits ( lMask ) );
+    uint32_t lBitShiftedSource ( lValue << lShiftSize );
+
+    if ( ( ( lBitShiftedSource >> lShiftSize ) != lValue ) || ( lBitShiftedSource & ~lMask ) )
+    {
+      exception::BitsSetWhichAreForbiddenByBitMask lExc;
+      log ( lExc , "Source data (" , Integer ( lValue , IntFmt<hex,fixed>() ) , ") has bits set outside the bounds allowed by the bit-mask (" ,
+            Integer ( lMask , IntFmt<hex,fixed>() ) , ")" );
+      throw lExc;
+    }
+
+    return lBitShiftedSource;
+  }
+
+
+  void TransactionProgram::clearEncoding()
+  {
+    mEncodedFor = NULL;
+    mPackets.clear();
+    mWriteLocations.clear();
+    mScratch.clear();
+  }
+
+}
@@ -0,0 +1,138 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+
+
+
+
+#include "uhal/TransportReactor.hpp"
+
+#include <boost/bind/bind.hpp>
+
+#include "uhal/log/log.hpp"
+#include "uhal/log/log_inserters.integer.hpp"
+
+
+namespace uhal
+{
+
+  boost::mutex TransportReactor::mInstanceMutex;
+
+  boost::weak_ptr< TransportReactor > TransportReactor::mInstance;
+
+  uint32_t TransportReactor::mDefaultNumberOfThreads = 0;
+
+
+  TransportReactor::TransportReactor ( const uint32_t& aNumberOfThreads ) :
+    mIOservice ( ),
+    mIOserviceWork ( new boost::asio::io_service::work ( mIOservice ) ),
+    mThreads ( ),
+    mNumberOfThreads ( aNumberOfThreads )
+  {
+    for ( uint32_t i = 0 ; i != mNumberOfThreads ; ++i )
+    {
+      mThreads.create_thread ( boost::bind ( &boost::asio::io_service::run , & ( mIOservice ) ) );
+    }
+
+    log ( Debug() , "Started transport reactor with " , Integer ( mNumberOfThreads ) , " threads" );
+  }
+
+
+  TransportReactor::~TransportReactor()
+  {
+    mIOserviceWork.reset();
+    mIOservice.stop();
+
+    if ( mThreads.is_this_thread_in() )
+    {
+      log ( Error() , "Transport reactor destroyed from one of its own threads; the threads of the pool cannot be joined" );
+      return;
+    }
+
+    mThreads.join_all();
+  }
+
+
+  boost::shared_ptr< TransportReactor > TransportReactor::getInstance()
+  {
+    boost::lock_guard< boost::mutex > lLock ( mInstanceMutex );
+    boost::shared_ptr< TransportReactor > lInstance ( mInstance.lock() );
+
+    if ( ! lInstance )
+    {
+      uint32_t lNumberOfThreads ( mDefaultNumberOfThreads ? mDefaultNumberOfThreads : boost::thread::hardware_concurrency() );
+      lInstance.reset ( new TransportReactor ( lNumberOfThreads ? lNumberOfThreads : 1 ) );
+      mInstance = lInstance;
+    }
+
+    return lInstance;
+  }
+
+
+  void TransportReactor::setDefaultNumberOfThreads ( const uint32_t& aNumberOfThreads )
+  {
+    boost::lock_guard< boost::mutex > lLock ( mInstanceMutex );
+    mDefaultNumberOfThreads = aNumberOfThreads;
+  }
+
+
+  uint32_t TransportReactor::getDefaultNumberOfThreads()
+  {
+    boost::lock_guard< boost::mutex > lLock ( mInstanceMutex );
+    return mDefaultNumberOfThreads;
+  }
+
+
+  uint32_t TransportReactor::getNumberOfThreads() const
+  {
+    return mNumberOfThreads;
+  }
+
+
+  boost::asio::io_service& TransportReactor::getIOservice()
+  {
+    return mIOservice;
+  }
+
+
+  void TransportReactor::waitForHandlers ( boost::shared_ptr< void >& aToken )
+  {
+    boost::weak_ptr< void > lToken ( aToken );
+    aToken.reset();
+
+    while ( ! lToken.expired() )
+    {
+      boost::this_thread::yield();
+    }
+  }
+
+}
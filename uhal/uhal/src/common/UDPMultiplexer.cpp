@@ -0,0 +1,309 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+
+
+
+
+#include "uhal/UDPMultiplexer.hpp"
+
+#include <algorithm>
+
+#include <boost/asio/placeholders.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/make_shared.hpp>
+
+#include "uhal/log/log.hpp"
+#include "uhal/log/log_inserters.integer.hpp"
+#include "uhal/log/log_inserters.quote.hpp"
+
+
+namespace uhal
+{
+
+  //! The size of the memory into which each shared socket receives, large enough for any UDP datagram
+  static const std::size_t kMaxDatagramSize ( 65536 );
+
+  //! The number of datagrams queued for a channel with no receive outstanding, beyond which further datagrams are dropped, as a full socket buffer would
+  static const std::size_t kMaxQueuedDatagrams ( 256 );
+
+
+  boost::mutex UDPMultiplexer::mInstanceMutex;
+
+  boost::weak_ptr< UDPMultiplexer > UDPMultiplexer::mInstance;
+
+
+  UDPMultiplexer::Channel::Channel ( const boost::shared_ptr< UDPMultiplexer >& aMultiplexer , const std::size_t& aSocket , const boost::asio::ip::udp::endpoint& aEndpoint ) :
+    mMultiplexer ( aMultiplexer ),
+    mSocket ( aSocket ),
+    mEndpoint ( aEndpoint ),
+    mMutex ( ),
+    mOpen ( true ),
+    mQueue ( ),
+    mReceiveBuffers ( ),
+    mReceiveHandler ( )
+  {
+  }
+
+
+  UDPMultiplexer::Channel::~Channel()
+  {
+    boost::lock_guard< boost::mutex > lLock ( mMultiplexer->mMutex );
+    mMultiplexer->mSockets.at ( mSocket )->channels.erase ( mEndpoint );
+  }
+
+
+  void UDPMultiplexer::Channel::open()
+  {
+    boost::lock_guard< boost::mutex > lLock ( mMutex );
+    mOpen = true;
+  }
+
+
+  void UDPMultiplexer::Channel::close()
+  {
+    boost::lock_guard< boost::mutex > lLock ( mMutex );
+    mOpen = false;
+    mQueue.clear();
+
+    if ( mReceiveHandler )
+    {
+      post ( mReceiveHandler , boost::asio::error::operation_aborted , 0 );
+      mReceiveHandler.clear();
+      mReceiveBuffers.clear();
+    }
+  }
+
+
+  bool UDPMultiplexer::Channel::is_open()
+  {
+    boost::lock_guard< boost::mutex > lLock ( mMutex );
+    return mOpen;
+  }
+
+
+  void UDPMultiplexer::Channel::async_receive ( const std::vector< boost::asio::mutable_buffer >& aBuffers , const Handler& aHandler )
+  {
+    boost::lock_guard< boost::mutex > lLock ( mMutex );
+
+    if ( ! mOpen )
+    {
+      post ( aHandler , boost::asio::error::bad_descriptor , 0 );
+      return;
+    }
+
+    if ( mQueue.size() )
+    {
+      const std::size_t lBytesTransferred ( boost::asio::buffer_copy ( aBuffers , boost::asio::buffer ( mQueue.front() ) ) );
+      mQueue.pop_front();
+      post ( aHandler , boost::system::error_code() , lBytesTransferred );
+      return;
+    }
+
+    mReceiveBuffers = aBuffers;
+    mReceiveHandler = aHandler;
+  }
+
+
+  boost::asio::ip::udp::socket::native_handle_type UDPMultiplexer::Channel::native_handle()
+  {
+    return socket().native_handle();
+  }
+
+
+  boost::asio::ip::udp::socket& UDPMultiplexer::Channel::socket()
+  {
+    return mMultiplexer->mSockets.at ( mSocket )->socket;
+  }
+
+
+  void UDPMultiplexer::Channel::post ( const Handler& aHandler , const boost::system::error_code& aErrorCode , const std::size_t& aBytesTransferred )
+  {
+    mMultiplexer->mReactor->getIOservice().post ( boost::bind ( aHandler , aErrorCode , aBytesTransferred ) );
+  }
+
+
+  void UDPMultiplexer::Channel::deliver ( const uint8_t* aData , const std::size_t& aSize )
+  {
+    boost::lock_guard< boost::mutex > lLock ( mMutex );
+
+    if ( ! mOpen )
+    {
+      return;
+    }
+
+    if ( mReceiveHandler )
+    {
+      // As with a socket, a datagram larger than the buffers of the receive is truncated
+      const std::size_t lBytesTransferred ( boost::asio::buffer_copy ( mReceiveBuffers , boost::asio::buffer ( aData , aSize ) ) );
+      post ( mReceiveHandler , boost::system::error_code() , lBytesTransferred );
+      mReceiveHandler.clear();
+      mReceiveBuffers.clear();
+      return;
+    }
+
+    if ( mQueue.size() < kMaxQueuedDatagrams )
+    {
+      mQueue.push_back ( std::vector< uint8_t > ( aData , aData + aSize ) );
+    }
+  }
+
+
+  UDPMultiplexer::SharedSocket::SharedSocket ( boost::asio::io_service& aIOservice ) :
+    socket ( aIOservice , boost::asio::ip::udp::endpoint ( boost::asio::ip::udp::v4(), 0 ) ),
+    memory ( kMaxDatagramSize , 0x00 ),
+    sender ( ),
+    channels ( )
+  {
+  }
+
+
+  UDPMultiplexer::UDPMultiplexer ( const boost::shared_ptr< TransportReactor >& aReactor ) :
+    mReactor ( aReactor ),
+    mHandlerToken ( boost::make_shared< bool > ( true ) ),
+    mSockets ( ),
+    mMutex ( )
+  {
+    for ( uint32_t i = 0 ; i != mReactor->getNumberOfThreads() ; ++i )
+    {
+      mSockets.push_back ( boost::shared_ptr< SharedSocket > ( new SharedSocket ( mReactor->getIOservice() ) ) );
+      receive ( i );
+    }
+
+    log ( Debug() , "Started UDP multiplexer with " , Integer ( mSockets.size() ) , " shared sockets" );
+  }
+
+
+  UDPMultiplexer::~UDPMultiplexer()
+  {
+    for ( std::vector< boost::shared_ptr< SharedSocket > >::iterator lIt = mSockets.begin() ; lIt != mSockets.end() ; ++lIt )
+    {
+      boost::system::error_code lErrorCode;
+      ( *lIt )->socket.close ( lErrorCode );
+    }
+
+    TransportReactor::waitForHandlers ( mHandlerToken );
+  }
+
+
+  boost::shared_ptr< UDPMultiplexer::Channel > UDPMultiplexer::openChannel ( const boost::asio::ip::udp::endpoint& aEndpoint )
+  {
+    boost::shared_ptr< UDPMultiplexer > lMultiplexer;
+    {
+      boost::lock_guard< boost::mutex > lLock ( mInstanceMutex );
+      lMultiplexer = mInstance.lock();
+
+      if ( ! lMultiplexer )
+      {
+        lMultiplexer.reset ( new UDPMultiplexer ( TransportReactor::getInstance() ) );
+        mInstance = lMultiplexer;
+      }
+    }
+
+    boost::lock_guard< boost::mutex > lLock ( lMultiplexer->mMutex );
+    // The target is given the socket with the fewest channels which does not already serve it
+    std::size_t lSocket ( lMultiplexer->mSockets.size() );
+
+    for ( std::size_t i = 0 ; i != lMultiplexer->mSockets.size() ; ++i )
+    {
+      const SharedSocket& lCandidate ( *lMultiplexer->mSockets.at ( i ) );
+
+      if ( lCandidate.channels.count ( aEndpoint ) )
+      {
+        continue;
+      }
+
+      if ( ( lSocket == lMultiplexer->mSockets.size() ) || ( lCandidate.channels.size() < lMultiplexer->mSockets.at ( lSocket )->channels.size() ) )
+      {
+        lSocket = i;
+      }
+    }
+
+    if ( lSocket == lMultiplexer->mSockets.size() )
+    {
+      return boost::shared_ptr< Channel >();
+    }
+
+    boost::shared_ptr< Channel > lChannel ( new Channel ( lMultiplexer , lSocket , aEndpoint ) );
+    lMultiplexer->mSockets.at ( lSocket )->channels [ aEndpoint ] = lChannel.get();
+    return lChannel;
+  }
+
+
+  std::size_t UDPMultiplexer::getNumberOfSockets() const
+  {
+    return mSockets.size();
+  }
+
+
+  void UDPMultiplexer::receive ( const std::size_t& aSocket )
+  {
+    SharedSocket& lSocket ( *mSockets.at ( aSocket ) );
+    lSocket.socket.async_receive_from ( boost::asio::buffer ( lSocket.memory ) , lSocket.sender , TransportReactor::track ( boost::bind ( &UDPMultiplexer::receive_callback , this , aSocket , boost::asio::placeholders::error , boost::asio::placeholders::bytes_transferred ) , mHandlerToken ) );
+  }
+
+
+  void UDPMultiplexer::receive_callback ( const std::size_t& aSocket , const boost::system::error_code& aErrorCode , std::size_t aBytesTransferred )
+  {
+    if ( aErrorCode == boost::asio::error::operation_aborted )
+    {
+      return;
+    }
+
+    SharedSocket& lSocket ( *mSockets.at ( aSocket ) );
+
+    if ( aErrorCode )
+    {
+      log ( Warning() , "Error " , Quote ( aErrorCode.message() ) , " encountered during receive on shared UDP socket" );
+    }
+    else
+    {
+      boost::lock_guard< boost::mutex > lLock ( mMutex );
+      std::map< boost::asio::ip::udp::endpoint , Channel* >::iterator lIt ( lSocket.channels.find ( lSocket.sender ) );
+
+      if ( lIt != lSocket.channels.end() )
+      {
+        lIt->second->deliver ( & lSocket.memory.at ( 0 ) , aBytesTransferred );
+      }
+      else
+      {
+        log ( Debug() , "Dropping datagram of " , Integer ( aBytesTransferred ) , " bytes from " , lSocket.sender.address().to_string() , ":" , Integer ( lSocket.sender.port() ) , ", for which no client is registered" );
+      }
+    }
+
+    if ( lSocket.socket.is_open() )
+    {
+      receive ( aSocket );
+    }
+  }
+
+}
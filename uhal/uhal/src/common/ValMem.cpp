@@ -33,6 +33,10 @@
 #include "uhal/ValMem.hpp"
 
 
+#include <new>
+
+#include <boost/pool/singleton_pool.hpp>
+
 #include "uhal/log/log.hpp"
 #include "uhal/utilities/bits.hpp"
 
@@ -40,12 +44,124 @@
 namespace uhal
 {
 
+  //! Tag type for the pools from which the validated memory helper structs are allocated
+  struct ValMemPoolTag {};
+
+  //! Pool for helper structs of up to 64 bytes (i.e. _ValHeader_ and _ValWord_)
+  typedef boost::singleton_pool< ValMemPoolTag , 64 > ValMemSmallPool;
+  //! Pool for helper structs of up to 128 bytes (i.e. _ValVector_)
+  typedef boost::singleton_pool< ValMemPoolTag , 128 > ValMemLargePool;
+
+
+  IPbusHeaderList::IPbusHeaderList() :
+    mFirst ( 0 ),
+    mSize ( 0 )
+  {
+  }
+
+
+  IPbusHeaderList::~IPbusHeaderList()
+  {
+  }
+
+
+  void IPbusHeaderList::push_back ( const uint32_t& aHeader )
+  {
+    if ( mSize == 0 )
+    {
+      mFirst = aHeader;
+    }
+    else
+    {
+      if ( ! mOthers )
+      {
+        mOthers.reset ( new std::deque<uint32_t>() );
+      }
+
+      mOthers->push_back ( aHeader );
+    }
+
+    mSize++;
+  }
+
+
+  uint32_t& IPbusHeaderList::back()
+  {
+    return ( mSize > 1 ) ? mOthers->back() : mFirst;
+  }
+
+
+  uint32_t& IPbusHeaderList::operator[] ( std::size_t aIndex )
+  {
+    return ( aIndex == 0 ) ? mFirst : ( *mOthers ) [aIndex-1];
+  }
+
+
+  std::size_t IPbusHeaderList::size() const
+  {
+    return mSize;
+  }
+
+
   _ValHeader_::_ValHeader_ ( const bool& aValid ) :
     valid ( aValid )
   {
   }
 
 
+  _ValHeader_::~_ValHeader_()
+  {
+  }
+
+
+  void* _ValHeader_::operator new ( std::size_t aSize )
+  {
+    void* lPtr ( NULL );
+
+    if ( aSize <= ValMemSmallPool::requested_size )
+    {
+      lPtr = ValMemSmallPool::malloc();
+    }
+    else if ( aSize <= ValMemLargePool::requested_size )
+    {
+      lPtr = ValMemLargePool::malloc();
+    }
+    else
+    {
+      return ::operator new ( aSize );
+    }
+
+    if ( ! lPtr )
+    {
+      throw std::bad_alloc();
+    }
+
+    return lPtr;
+  }
+
+
+  void _ValHeader_::operator delete ( void* aPtr , std::size_t aSize )
+  {
+    if ( ! aPtr )
+    {
+      return;
+    }
+
+    if ( aSize <= ValMemSmallPool::requested_size )
+    {
+      ValMemSmallPool::free ( aPtr );
+    }
+    else if ( aSize <= ValMemLargePool::requested_size )
+    {
+      ValMemLargePool::free ( aPtr );
+    }
+    else
+    {
+      ::operator delete ( aPtr );
+    }
+  }
+
+
   template< typename T >
 
   _ValWord_<T>::_ValWord_ ( const T& aValue , const bool& aValid , const uint32_t aMask ) :
@@ -66,6 +182,15 @@ namespace uhal
   }
 
 
+  template< typename T >
+
+  _ValVector_<T>::_ValVector_ ( const uint32_t& aSize , const bool& aValid ) :
+    _ValHeader_ ( aValid ),
+    value ( aSize , T() )
+  {
+  }
+
+
 
 
   ValHeader::ValHeader() :
@@ -201,7 +326,7 @@ namespace uhal
 
   template< typename T >
   ValVector< T >::ValVector ( const uint32_t& aSize )  :
-    mMembers ( new _ValVector_<T> ( std::vector<T> ( aSize , T() ) , false ) )
+    mMembers ( new _ValVector_<T> ( aSize , false ) )
   {
   }
 
@@ -35,6 +35,10 @@
 
 #include "uhal/utilities/bits.hpp"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 
 
 namespace uhal
@@ -79,5 +83,27 @@ namespace uhal
 
       return lReturn;
     }
+
+
+    void SwapByteOrder ( uint32_t* aBegin , uint32_t* aEnd )
+    {
+#ifdef __SSE2__
+      // Four words at a time: swap the bytes within each 16-bit half, then swap the halves
+      for ( ; aEnd - aBegin >= 4 ; aBegin += 4 )
+      {
+        __m128i lWords ( _mm_loadu_si128 ( reinterpret_cast< const __m128i* > ( aBegin ) ) );
+        lWords = _mm_or_si128 ( _mm_slli_epi16 ( lWords , 8 ) , _mm_srli_epi16 ( lWords , 8 ) );
+        lWords = _mm_shufflelo_epi16 ( lWords , _MM_SHUFFLE ( 2 , 3 , 0 , 1 ) );
+        lWords = _mm_shufflehi_epi16 ( lWords , _MM_SHUFFLE ( 2 , 3 , 0 , 1 ) );
+        _mm_storeu_si128 ( reinterpret_cast< __m128i* > ( aBegin ) , lWords );
+      }
+#endif
+
+      for ( ; aBegin != aEnd ; ++aBegin )
+      {
+        const uint32_t lWord ( *aBegin );
+        *aBegin = ( lWord >> 24 ) | ( ( lWord >> 8 ) & 0x0000FF00 ) | ( ( lWord << 8 ) & 0x00FF0000 ) | ( lWord << 24 );
+      }
+    }
   }
 }